@@ -0,0 +1,146 @@
+# -*- coding:utf-8 -*-
+# A stand-in for Anki with AnkiConnect, for testing and benchmarking without a real collection.
+# Serves a made-up collection of "A Frequency Dictionary of Japanese Words" style notes on the same
+# port as AnkiConnect, so close Anki before running it.
+import argparse
+import http.server
+import json
+import random
+import time
+
+argParser = argparse.ArgumentParser(
+    description="""Pretend to be Anki with AnkiConnect installed""")
+argParser.add_argument('--port', type=int, default=8765,
+                       help='Port to listen on (default 8765, the same as AnkiConnect)')
+argParser.add_argument('--num-notes', type=int, default=1000, dest='numNotes',
+                       help='How many notes the made-up collection has')
+argParser.add_argument('--due-fraction', type=float, default=0.1, dest='dueFraction',
+                       help='Fraction of cards which are due')
+argParser.add_argument('--latency', type=float, default=0, dest='latencyMilliseconds',
+                       help='Wait this long before answering each request, to act like a slow '
+                       'Anki or network')
+argParser.add_argument('--churn', type=int, default=0, dest='churn',
+                       help='Each time due cards are found, pretend this many were studied and '
+                       'this many new ones became due, to act like a collection being studied')
+argParser.add_argument('--edits', type=int, default=0, dest='edits',
+                       help='Each sync, pretend this many due cards had their notes edited')
+argParser.add_argument('--verbose', action='store_const', const=True, default=False,
+                       dest='debugVerbose', help='Print every request')
+
+words = [('食べる', 'to eat'), ('飲む', 'to drink'), ('読む', 'to read'), ('書く', 'to write'),
+         ('見る', 'to see'), ('行く', 'to go'), ('来る', 'to come'), ('日本', 'Japan'),
+         ('猫', 'cat'), ('犬', 'dog'), ('本', 'book'), ('水', 'water'), ('学校', 'school'),
+         ('先生', 'teacher'), ('友達', 'friend'), ('時間', 'time'), ('電車', 'train')]
+
+# noteId -> note. Cards have the same ID as their note, plus one
+notes = {}
+dueCardIds = []
+
+def makeCollection(numNotes, dueFraction):
+    randomGenerator = random.Random(1)
+    for i in range(numNotes):
+        noteId = 1500000000000 + i * 2
+        lemma, gloss = words[i % len(words)]
+        if i >= len(words):
+            lemma += str(i)
+        mod = 1600000000 + randomGenerator.randrange(10000000)
+        # Like Anki, editing a note changes the note's modification time but not its card's
+        notes[noteId] = {'noteId': noteId, 'modelName': 'Japanese Frequency', 'tags': [],
+                         'mod': mod, 'cardMod': mod,
+                         'fields': {'Lemma': {'value': lemma, 'order': 0},
+                                    'English Gloss': {'value': gloss, 'order': 1}}}
+        if randomGenerator.random() < dueFraction:
+            dueCardIds.append(noteId + 1)
+
+def cardInfo(cardId):
+    note = notes.get(cardId - 1)
+    if not note:
+        return {}
+    lemma = note['fields']['Lemma']['value']
+    return {'answer': lemma, 'question': lemma, 'deckName': 'Japanese',
+            'modelName': note['modelName'], 'fieldOrder': 0, 'fields': note['fields'],
+            'css': '.card { font-size: 20px; }', 'cardId': cardId, 'interval': 3,
+            'note': note['noteId'], 'ord': 0, 'type': 2, 'queue': 2, 'due': 100, 'reps': 5,
+            'lapses': 0, 'left': 0, 'mod': note['cardMod']}
+
+def findCards(query):
+    if 'is:due' in query:
+        if args.churn:
+            notDue = [noteId + 1 for noteId in notes if noteId + 1 not in dueCardIds]
+            del dueCardIds[:args.churn]
+            dueCardIds.extend(notDue[:args.churn])
+        return dueCardIds
+    return [noteId + 1 for noteId in notes]
+
+def invokeAction(action, params):
+    if action == 'version':
+        return 6
+    if action == 'deckNames':
+        return ['Default', 'Japanese']
+    if action == 'sync':
+        for cardId in dueCardIds[:args.edits]:
+            notes[cardId - 1]['mod'] = int(time.time())
+        return None
+    if action == 'findCards':
+        return findCards(params.get('query', ''))
+    if action == 'cardsInfo':
+        return [cardInfo(cardId) for cardId in params['cards']]
+    if action == 'cardsModTime':
+        return [{'cardId': cardId, 'mod': notes[cardId - 1]['cardMod']}
+                for cardId in params['cards'] if cardId - 1 in notes]
+    if action == 'findNotes':
+        return sorted(notes)
+    if action == 'notesModTime':
+        return [{'noteId': noteId, 'mod': notes[noteId]['mod']}
+                for noteId in params['notes'] if noteId in notes]
+    if action == 'notesInfo':
+        return [notes.get(noteId, {}) for noteId in params['notes']]
+    if action == 'multi':
+        return [handleRequest(request) for request in params['actions']]
+    raise Exception('unsupported action')
+
+# Like AnkiConnect, requests for version 4 or older get the bare result, newer ones get the result
+# wrapped along with its error
+def handleRequest(request):
+    try:
+        response = {'result': invokeAction(request['action'], request.get('params', {})),
+                    'error': None}
+    except Exception as exception:
+        response = {'result': None, 'error': str(exception)}
+    if request.get('version', 4) <= 4:
+        return response['result']
+    return response
+
+class AnkiConnectHandler(http.server.BaseHTTPRequestHandler):
+    # Lets clients keep their connection alive between requests, like AnkiConnect
+    protocol_version = 'HTTP/1.1'
+    # Headers and body are written separately; don't let Nagle's algorithm delay the body
+    disable_nagle_algorithm = True
+
+    def do_POST(self):
+        request = json.loads(self.rfile.read(int(self.headers['Content-Length'])))
+        if args.debugVerbose:
+            print(request)
+        if args.latencyMilliseconds:
+            time.sleep(args.latencyMilliseconds / 1000)
+        response = handleRequest(request)
+        responseJson = json.dumps(response).encode('utf-8')
+        self.send_response(200)
+        self.send_header('Content-Type', 'text/json')
+        self.send_header('Content-Length', str(len(responseJson)))
+        self.end_headers()
+        self.wfile.write(responseJson)
+
+    def log_message(self, format, *args):
+        pass
+
+if __name__ == '__main__':
+    args = argParser.parse_args()
+    makeCollection(args.numNotes, args.dueFraction)
+    print('Serving {} notes ({} cards due) on port {}'.format(len(notes), len(dueCardIds),
+                                                               args.port))
+    server = http.server.ThreadingHTTPServer(('localhost', args.port), AnkiConnectHandler)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
@@ -1,3 +1,3 @@
 #!/bin/sh
 
-jam -j4
+jam -j4 -sRELEASE_BUILD=true
@@ -0,0 +1,283 @@
+#include "AnalysisCacheFile.hpp"
+
+#include <sys/stat.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "Tracing.hpp"
+
+static_assert(sizeof(AnalysisCacheFileDocument) % 8 == 0, "Documents must stay 8-byte aligned");
+static_assert(sizeof(AnalyzedToken) % 8 == 0 && sizeof(AnalyzedDeinflection) % 4 == 0,
+              "Tokens are read in place, so must stay 8-byte aligned");
+
+static const uint64_t hashPrime1 = 11400714785074694791ull;
+static const uint64_t hashPrime2 = 14029467366897019727ull;
+
+static uint64_t readHashWord(const char* bytes)
+{
+	uint64_t word;
+	std::memcpy(&word, bytes, sizeof(word));
+	return word;
+}
+
+static uint64_t hashRound(uint64_t hash, uint64_t word)
+{
+	hash += word * hashPrime2;
+	hash = (hash << 31) | (hash >> 33);
+	return hash * hashPrime1;
+}
+
+// So every input bit affects every output bit
+static uint64_t finishHash(uint64_t hash)
+{
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+uint64_t hashDocumentText(const char* text, size_t textLength)
+{
+	TRACE_ZONE("hashDocumentText");
+	// Four independent lanes, so their multiplies overlap rather than each waiting on the last.
+	// This is most of the work of a re-run over documents which haven't changed
+	uint64_t lanes[4] = {hashPrime1, hashPrime2, 0, textLength};
+	size_t i = 0;
+	for (; i + 32 <= textLength; i += 32)
+	{
+		lanes[0] = hashRound(lanes[0], readHashWord(text + i));
+		lanes[1] = hashRound(lanes[1], readHashWord(text + i + 8));
+		lanes[2] = hashRound(lanes[2], readHashWord(text + i + 16));
+		lanes[3] = hashRound(lanes[3], readHashWord(text + i + 24));
+	}
+	uint64_t hash = hashRound(hashRound(hashRound(lanes[0], lanes[1]), lanes[2]), lanes[3]);
+	for (; i + 8 <= textLength; i += 8)
+		hash = hashRound(hash, readHashWord(text + i));
+	// Empty text may be null, which memcpy() doesn't allow even for zero bytes
+	uint64_t lastWord = 0;
+	if (i < textLength)
+		std::memcpy(&lastWord, text + i, textLength - i);
+	hash = hashRound(hash, lastWord);
+	return finishHash(hash ^ textLength);
+}
+
+static uint64_t combineVersion(uint64_t version, uint64_t value)
+{
+	return finishHash(hashRound(version, value));
+}
+
+uint64_t getMeCabModelVersion(const MeCab::Model& model)
+{
+	const char* mecabVersion = MeCab::Model::version();
+	uint64_t version = hashDocumentText(mecabVersion, std::strlen(mecabVersion));
+	for (const MeCab::DictionaryInfo* info = model.dictionary_info(); info; info = info->next)
+	{
+		version = combineVersion(version, info->size);
+		version = combineVersion(version, info->version);
+		if (!info->filename)
+			continue;
+		version = combineVersion(version, hashDocumentText(info->filename,
+		                                                   std::strlen(info->filename)));
+		// Rebuilding a dictionary (e.g. after adding user words) needn't change its word count
+		struct stat dictionaryStat;
+		if (stat(info->filename, &dictionaryStat) == 0)
+		{
+			version = combineVersion(version, static_cast<uint64_t>(dictionaryStat.st_size));
+			version = combineVersion(version, static_cast<uint64_t>(dictionaryStat.st_mtime));
+		}
+	}
+	return version;
+}
+
+// The size of the document's record, including padding
+static uint64_t getCachedDocumentSize(const AnalysisCacheFileDocument& document)
+{
+	uint64_t size = sizeof(AnalysisCacheFileDocument) +
+	                uint64_t(document.numTokens) * sizeof(AnalyzedToken) +
+	                uint64_t(document.numDeinflections) * sizeof(AnalyzedDeinflection) +
+	                document.stringsSize;
+	return (size + 7) & ~uint64_t(7);
+}
+
+bool openAnalysisCache(const char* filename, uint64_t dictionaryVersion, uint64_t modelVersion,
+                       AnalysisCache& cacheOut)
+{
+	TRACE_ZONE("openAnalysisCache");
+	if (!mapFile(filename, cacheOut.file))
+		return false;
+
+	const AnalysisCacheFileHeader* header =
+	    reinterpret_cast<const AnalysisCacheFileHeader*>(cacheOut.file.data);
+	bool isValid =
+	    cacheOut.file.size >= sizeof(AnalysisCacheFileHeader) &&
+	    std::memcmp(header->magic, analysisCacheFileMagic, sizeof(header->magic)) == 0 &&
+	    header->version == analysisCacheFileVersion;
+	if (!isValid)
+	{
+		std::cerr << "Warning: analysis cache '" << filename
+		          << "' is invalid or from an old version. It will be rebuilt\n";
+		closeAnalysisCache(cacheOut);
+		return false;
+	}
+	if (header->dictionaryVersion != dictionaryVersion || header->modelVersion != modelVersion)
+	{
+		std::cerr << "The "
+		          << (header->dictionaryVersion != dictionaryVersion ? "dictionary" : "MeCab model")
+		          << " has changed since '" << filename
+		          << "' was saved. Every document will be analyzed again\n";
+		closeAnalysisCache(cacheOut);
+		return false;
+	}
+
+	// Only the document headers are read here. Their tokens are checked when they're used
+	cacheOut.documents.reserve(header->numDocuments);
+	uint64_t offset = sizeof(AnalysisCacheFileHeader);
+	for (uint64_t i = 0; i < header->numDocuments; ++i)
+	{
+		const AnalysisCacheFileDocument* document =
+		    reinterpret_cast<const AnalysisCacheFileDocument*>(cacheOut.file.data + offset);
+		if (offset + sizeof(AnalysisCacheFileDocument) > cacheOut.file.size ||
+		    offset + getCachedDocumentSize(*document) > cacheOut.file.size)
+		{
+			std::cerr << "Warning: analysis cache '" << filename
+			          << "' is corrupt. It will be rebuilt\n";
+			closeAnalysisCache(cacheOut);
+			return false;
+		}
+		cacheOut.documents.emplace(document->textHash, document);
+		offset += getCachedDocumentSize(*document);
+	}
+	return true;
+}
+
+void closeAnalysisCache(AnalysisCache& cache)
+{
+	unmapFile(cache.file);
+	cache.documents.clear();
+}
+
+// A corrupt cache must not make the output point outside the document or the strings
+static bool isCachedDocumentValid(const AnalysisCacheFileDocument& document,
+                                  const AnalyzedToken* tokens,
+                                  const AnalyzedDeinflection* deinflections, const char* strings)
+{
+	if (document.stringsSize && strings[document.stringsSize - 1] != '\0')
+		return false;
+	for (uint32_t i = 0; i < document.numTokens; ++i)
+	{
+		const AnalyzedToken& token = tokens[i];
+		if (token.start > document.textLength ||
+		    token.length > document.textLength - token.start ||
+		    token.featureOffset >= document.stringsSize ||
+		    (token.deinflectionIndex != noAnalyzedDeinflection &&
+		     token.deinflectionIndex >= document.numDeinflections))
+			return false;
+	}
+	for (uint32_t i = 0; i < document.numDeinflections; ++i)
+	{
+		const AnalyzedDeinflection& deinflection = deinflections[i];
+		if (uint64_t(deinflection.formOffset) + deinflection.formLength >= document.stringsSize ||
+		    deinflection.numReasons > maxDeinflectionReasons)
+			return false;
+	}
+	return true;
+}
+
+bool findAnalysisCacheDocument(const AnalysisCache& cache, uint64_t textHash, size_t textLength,
+                               DocumentTokens& tokensOut)
+{
+	phmap::flat_hash_map<uint64_t, const AnalysisCacheFileDocument*>::const_iterator documentIt =
+	    cache.documents.find(textHash);
+	if (documentIt == cache.documents.end() || documentIt->second->textLength != textLength)
+		return false;
+
+	TRACE_ZONE("findAnalysisCacheDocument");
+	const AnalysisCacheFileDocument& document = *documentIt->second;
+	const AnalyzedToken* tokens = reinterpret_cast<const AnalyzedToken*>(&document + 1);
+	const AnalyzedDeinflection* deinflections =
+	    reinterpret_cast<const AnalyzedDeinflection*>(tokens + document.numTokens);
+	const char* strings = reinterpret_cast<const char*>(deinflections + document.numDeinflections);
+	if (!isCachedDocumentValid(document, tokens, deinflections, strings))
+		return false;
+
+	clearDocumentTokens(tokensOut);
+	tokensOut.tokens.assign(tokens, tokens + document.numTokens);
+	tokensOut.deinflections.assign(deinflections, deinflections + document.numDeinflections);
+	tokensOut.strings.assign(strings, document.stringsSize);
+	return true;
+}
+
+bool beginAnalysisCacheFile(const char* filename, uint64_t dictionaryVersion,
+                            uint64_t modelVersion, AnalysisCacheFileWriter& writerOut)
+{
+	writerOut.filename = filename;
+	writerOut.temporaryFilename = writerOut.filename + ".tmp";
+	writerOut.file.open(writerOut.temporaryFilename.c_str(),
+	                    std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!writerOut.file.is_open())
+	{
+		std::cerr << "Error: could not open '" << writerOut.temporaryFilename
+		          << "' for writing\n";
+		return false;
+	}
+
+	// numDocuments is filled in once they're all written
+	AnalysisCacheFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, analysisCacheFileMagic, sizeof(header.magic));
+	header.version = analysisCacheFileVersion;
+	header.dictionaryVersion = dictionaryVersion;
+	header.modelVersion = modelVersion;
+	writerOut.file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	writerOut.numDocuments = 0;
+	writerOut.writtenHashes.clear();
+	return true;
+}
+
+void writeAnalysisCacheFileDocument(AnalysisCacheFileWriter& writer, uint64_t textHash,
+                                    size_t textLength, const DocumentTokens& tokens)
+{
+	// The same text twice (e.g. a copied file) only needs saving once
+	if (!writer.writtenHashes.insert(textHash).second)
+		return;
+
+	AnalysisCacheFileDocument document;
+	std::memset(&document, 0, sizeof(document));
+	document.textHash = textHash;
+	document.textLength = textLength;
+	document.numTokens = static_cast<uint32_t>(tokens.tokens.size());
+	document.numDeinflections = static_cast<uint32_t>(tokens.deinflections.size());
+	document.stringsSize = static_cast<uint32_t>(tokens.strings.size());
+	writer.file.write(reinterpret_cast<const char*>(&document), sizeof(document));
+	writer.file.write(reinterpret_cast<const char*>(tokens.tokens.data()),
+	                  tokens.tokens.size() * sizeof(AnalyzedToken));
+	writer.file.write(reinterpret_cast<const char*>(tokens.deinflections.data()),
+	                  tokens.deinflections.size() * sizeof(AnalyzedDeinflection));
+	writer.file.write(tokens.strings.data(), tokens.strings.size());
+	const char padding[8] = {};
+	uint64_t paddedSize = getCachedDocumentSize(document);
+	uint64_t unpaddedSize = sizeof(document) + tokens.tokens.size() * sizeof(AnalyzedToken) +
+	                        tokens.deinflections.size() * sizeof(AnalyzedDeinflection) +
+	                        tokens.strings.size();
+	writer.file.write(padding, paddedSize - unpaddedSize);
+	++writer.numDocuments;
+}
+
+bool endAnalysisCacheFile(AnalysisCacheFileWriter& writer)
+{
+	writer.file.seekp(offsetof(AnalysisCacheFileHeader, numDocuments));
+	writer.file.write(reinterpret_cast<const char*>(&writer.numDocuments),
+	                  sizeof(writer.numDocuments));
+	writer.file.close();
+	if (!writer.file ||
+	    std::rename(writer.temporaryFilename.c_str(), writer.filename.c_str()) != 0)
+	{
+		std::cerr << "Error: failed while writing '" << writer.filename << "'\n";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <fstream>
+#include <string>
+
+#include <mecab.h>
+#include <phmap.h>
+
+#include "DictionaryLookup.hpp"
+#include "DocumentAnalysis.hpp"
+#include "MappedFile.hpp"
+
+// Every document's tokens from the last run of test_mecab, so documents which haven't changed
+// since don't need tokenizing or looking up again: their output is written straight from the
+// saved tokens. Documents are found by a hash of their text, not their name, so renamed or copied
+// documents are found too. The tokens are only valid for the dictionary and MeCab model they came
+// from, so the cache is ignored if either has changed.
+//
+// Layout (native-endian, like the dictionary index). Mapped rather than read:
+//   AnalysisCacheFileHeader
+//   then numDocuments times:
+//     AnalysisCacheFileDocument
+//     AnalyzedToken tokens[numTokens]
+//     AnalyzedDeinflection deinflections[numDeinflections]
+//     char strings[stringsSize]  Null-terminated. Tokens point at these by offset
+//     Padding to the next multiple of 8 bytes
+
+// Bump this whenever the layout, or what tokenizeDocument() finds, changes. Old caches are then
+// ignored and rebuilt
+static const uint32_t analysisCacheFileVersion = 2;
+static const char analysisCacheFileMagic[8] = {'J', 'F', 'M', 'T', 'O', 'K', 'E', 'N'};
+
+struct AnalysisCacheFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	// getDictionaryLookupVersion() and getMeCabModelVersion()
+	uint64_t dictionaryVersion;
+	uint64_t modelVersion;
+	uint64_t numDocuments;
+};
+
+struct AnalysisCacheFileDocument
+{
+	// hashDocumentText()
+	uint64_t textHash;
+	uint64_t textLength;
+	uint32_t numTokens;
+	uint32_t numDeinflections;
+	uint32_t stringsSize;
+	uint32_t reserved;
+};
+
+// Every byte of the text goes in, so any edit changes it
+uint64_t hashDocumentText(const char* text, size_t textLength);
+
+// Changes when MeCab's dictionaries (e.g. IPADIC) are rebuilt or replaced
+uint64_t getMeCabModelVersion(const MeCab::Model& model);
+
+struct AnalysisCache
+{
+	MappedFile file;
+	// textHash -> the document's AnalysisCacheFileDocument
+	phmap::flat_hash_map<uint64_t, const AnalysisCacheFileDocument*> documents;
+};
+
+// Returns false if the file is missing, malformed, from a different analysisCacheFileVersion, or
+// from a different dictionary or model, in which case every document is analyzed again
+bool openAnalysisCache(const char* filename, uint64_t dictionaryVersion, uint64_t modelVersion,
+                       AnalysisCache& cacheOut);
+void closeAnalysisCache(AnalysisCache& cache);
+
+// Replaces tokensOut with the document's saved tokens, if it's in the cache. Safe to call from
+// several threads at once
+bool findAnalysisCacheDocument(const AnalysisCache& cache, uint64_t textHash, size_t textLength,
+                               DocumentTokens& tokensOut);
+
+// The cache for the next run, written a document at a time as they are analyzed, so it never has
+// to be held in memory. Written next to the old cache and swapped in once finished, so a failed
+// run never loses the old one
+struct AnalysisCacheFileWriter
+{
+	std::string filename;
+	std::string temporaryFilename;
+	std::ofstream file;
+	uint64_t numDocuments = 0;
+	phmap::flat_hash_set<uint64_t> writtenHashes;
+};
+
+bool beginAnalysisCacheFile(const char* filename, uint64_t dictionaryVersion,
+                            uint64_t modelVersion, AnalysisCacheFileWriter& writerOut);
+void writeAnalysisCacheFileDocument(AnalysisCacheFileWriter& writer, uint64_t textHash,
+                                    size_t textLength, const DocumentTokens& tokens);
+// Replaces the old cache. Documents not written since beginAnalysisCacheFile() are dropped
+bool endAnalysisCacheFile(AnalysisCacheFileWriter& writer);
@@ -0,0 +1,212 @@
+#include "AnalysisPool.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include "rapidjson/stringbuffer.h"
+
+AnalysisPool::AnalysisPool(const MeCab::Model& model, const DictionaryLookup& dictionary,
+                           std::ostream& output, unsigned int numThreads,
+                           const KnownWords* knownWords, const AnalysisCache* cache,
+                           AnalysisCacheFileWriter* newCache)
+    : model(model),
+      dictionary(dictionary),
+      knownWords(knownWords),
+      cache(cache),
+      newCache(newCache),
+      output(output),
+      numSubmitted(0),
+      numWritten(0),
+      isShuttingDown(false),
+      numFailedDocuments(0)
+{
+	if (!numThreads)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	// Enough to keep every worker busy while a slow document holds up writing
+	maxInFlight = numThreads * 4;
+
+	for (unsigned int i = 0; i < numThreads; ++i)
+		workers.push_back(std::thread(&AnalysisPool::workerThread, this));
+}
+
+AnalysisPool::~AnalysisPool()
+{
+	finish();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isShuttingDown = true;
+	}
+	jobsAvailable.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+bool AnalysisPool::submitFile(const std::string& filename)
+{
+	Job job;
+	job.name = filename;
+	if (!mapFile(filename.c_str(), job.file))
+	{
+		// Empty files can't be mapped, but are still valid (token-less) documents
+		if (isFileEmpty(filename.c_str()))
+		{
+			submitText(filename, std::string());
+			return true;
+		}
+		std::cerr << "Error: could not open '" << filename << "'\n";
+		// Only the submitting thread touches this, so no lock is needed
+		++numFailedDocuments;
+		return false;
+	}
+	submitJob(std::move(job));
+	return true;
+}
+
+void AnalysisPool::submitText(const std::string& name, std::string&& text)
+{
+	Job job;
+	job.name = name;
+	job.text = std::move(text);
+	submitJob(std::move(job));
+}
+
+void AnalysisPool::submitJob(Job&& job)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (numSubmitted - numWritten >= maxInFlight)
+	{
+		// Results may have arrived while the last batch was being written (unlocked)
+		resultsAvailable.wait(lock, [this] { return finishedResults.count(numWritten) != 0; });
+		writeReadyResults(lock);
+	}
+
+	job.index = numSubmitted++;
+	jobs.push_back(std::move(job));
+	jobsAvailable.notify_one();
+}
+
+void AnalysisPool::finish()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	writeReadyResults(lock);
+	while (numWritten < numSubmitted)
+	{
+		// Results may have arrived while the last batch was being written (unlocked)
+		resultsAvailable.wait(lock, [this] { return finishedResults.count(numWritten) != 0; });
+		writeReadyResults(lock);
+	}
+	output.flush();
+}
+
+void AnalysisPool::writeReadyResults(std::unique_lock<std::mutex>& lock)
+{
+	std::vector<Result> readyResults;
+	for (std::map<size_t, Result>::iterator resultIt = finishedResults.find(numWritten);
+	     resultIt != finishedResults.end(); resultIt = finishedResults.find(numWritten))
+	{
+		readyResults.push_back(std::move(resultIt->second));
+		finishedResults.erase(resultIt);
+		++numWritten;
+	}
+	if (readyResults.empty())
+		return;
+
+	// Output, the cache writer and stats are only touched by the submitting thread
+	lock.unlock();
+	for (const Result& result : readyResults)
+	{
+		if (result.succeeded)
+		{
+			output.write(result.output.data(), result.output.size());
+			if (newCache)
+				writeAnalysisCacheFileDocument(*newCache, result.textHash, result.textLength,
+				                               result.tokens);
+			stats.numDocuments += result.stats.numDocuments;
+			stats.numCachedDocuments += result.stats.numCachedDocuments;
+			stats.numBytes += result.stats.numBytes;
+			stats.numTokens += result.stats.numTokens;
+			stats.numDictionaryHits += result.stats.numDictionaryHits;
+			stats.numCompounds += result.stats.numCompounds;
+			stats.numDeinflected += result.stats.numDeinflected;
+			stats.numKnownTokens += result.stats.numKnownTokens;
+		}
+		else
+			++numFailedDocuments;
+	}
+	lock.lock();
+}
+
+void AnalysisPool::workerThread()
+{
+	MeCab::Tagger* tagger = model.createTagger();
+	MeCab::Lattice* lattice = model.createLattice();
+	// Every document this worker takes then fails, and is counted in getNumFailedDocuments()
+	if (!tagger || !lattice)
+		std::cerr << "Error: could not create MeCab tagger: " << MeCab::getLastError() << "\n";
+	rapidjson::StringBuffer documentOutput;
+	DocumentTokens tokens;
+
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (jobs.empty() && !isShuttingDown)
+				jobsAvailable.wait(lock);
+			if (jobs.empty())
+				break;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		const char* text = job.file.data ? job.file.data : job.text.data();
+		size_t textLength = job.file.data ? job.file.size : job.text.size();
+
+		Result result;
+		documentOutput.Clear();
+		clearDocumentTokens(tokens);
+		result.textHash = cache || newCache ? hashDocumentText(text, textLength) : 0;
+		result.textLength = textLength;
+		bool isCached =
+		    cache && findAnalysisCacheDocument(*cache, result.textHash, textLength, tokens);
+		result.succeeded =
+		    isCached || (tagger && lattice &&
+		                 tokenizeDocument(*tagger, *lattice, dictionary, job.name.c_str(), text,
+		                                  textLength, tokens));
+		if (result.succeeded)
+		{
+			writeDocumentTokens(dictionary, knownWords, job.name.c_str(), text, textLength, tokens,
+			                    documentOutput, result.stats);
+			result.output.assign(documentOutput.GetString(), documentOutput.GetSize());
+			if (isCached)
+				++result.stats.numCachedDocuments;
+			if (newCache)
+				result.tokens = std::move(tokens);
+		}
+		unmapFile(job.file);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finishedResults[job.index] = std::move(result);
+		}
+		resultsAvailable.notify_one();
+	}
+
+	delete lattice;
+	delete tagger;
+}
+
+unsigned int AnalysisPool::getNumThreads() const
+{
+	return static_cast<unsigned int>(workers.size());
+}
+
+const DocumentAnalysisStats& AnalysisPool::getStats() const
+{
+	return stats;
+}
+
+size_t AnalysisPool::getNumFailedDocuments() const
+{
+	return numFailedDocuments;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <mecab.h>
+
+#include "AnalysisCacheFile.hpp"
+#include "DictionaryLookup.hpp"
+#include "DocumentAnalysis.hpp"
+#include "KnownWords.hpp"
+#include "MappedFile.hpp"
+
+// Analyzes documents on a pool of worker threads. The MeCab model and dictionary are shared
+// (read-only); each worker owns its tagger, lattice and output buffer. Results are written to the
+// output stream in the order the documents were submitted, no matter which worker finishes first.
+// Only the thread which created the pool may submit documents
+class AnalysisPool
+{
+public:
+	// numThreads = 0 means one per core. knownWords is optional (see analyzeDocument()). Documents
+	// found in cache aren't tokenized again. Every document analyzed is written to newCache, if
+	// given, in the order they were submitted
+	AnalysisPool(const MeCab::Model& model, const DictionaryLookup& dictionary,
+	             std::ostream& output, unsigned int numThreads = 0,
+	             const KnownWords* knownWords = nullptr, const AnalysisCache* cache = nullptr,
+	             AnalysisCacheFileWriter* newCache = nullptr);
+	~AnalysisPool();
+
+	AnalysisPool(const AnalysisPool&) = delete;
+	AnalysisPool& operator=(const AnalysisPool&) = delete;
+
+	// These block while too many documents are waiting to be written, to bound memory use.
+	// submitFile() returns false, and counts the document as failed, if the file can't be opened
+	bool submitFile(const std::string& filename);
+	void submitText(const std::string& name, std::string&& text);
+
+	// Wait for every submitted document to be analyzed and written
+	void finish();
+
+	unsigned int getNumThreads() const;
+	// Only up to date after finish()
+	const DocumentAnalysisStats& getStats() const;
+	size_t getNumFailedDocuments() const;
+
+private:
+	struct Job
+	{
+		size_t index;
+		std::string name;
+		// Files are mapped; text from elsewhere (e.g. stdin) is owned by the job
+		MappedFile file;
+		std::string text;
+	};
+
+	struct Result
+	{
+		bool succeeded;
+		std::string output;
+		DocumentAnalysisStats stats;
+		// Only kept for newCache
+		uint64_t textHash;
+		size_t textLength;
+		DocumentTokens tokens;
+	};
+
+	void submitJob(Job&& job);
+	void workerThread();
+	// Must hold mutex via lock. Takes every result which is next in line, then unlocks while
+	// writing them so workers aren't held up by output I/O. Only the submitting thread writes
+	void writeReadyResults(std::unique_lock<std::mutex>& lock);
+
+	const MeCab::Model& model;
+	const DictionaryLookup& dictionary;
+	const KnownWords* knownWords;
+	const AnalysisCache* cache;
+	AnalysisCacheFileWriter* newCache;
+	std::ostream& output;
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable jobsAvailable;
+	std::condition_variable resultsAvailable;
+	std::deque<Job> jobs;
+	// Keyed by submission index, so they come out in order
+	std::map<size_t, Result> finishedResults;
+	size_t numSubmitted;
+	size_t numWritten;
+	size_t maxInFlight;
+	bool isShuttingDown;
+
+	DocumentAnalysisStats stats;
+	size_t numFailedDocuments;
+};
@@ -0,0 +1,328 @@
+#include "AnkiConnect.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "Tracing.hpp"
+
+//
+// Curl configuration
+//
+static bool curlVerbose = false;
+static bool curlRequestVerbose = false;
+static bool curlResponseStats = false;
+static bool curlResponseVerbose = false;
+
+// Note that this can be called many times for a single request, if the packets are split
+static size_t receiveBody(char* data, size_t size, size_t count, void* userData)
+{
+	std::string* receiveBuffer = static_cast<std::string*>(userData);
+	receiveBuffer->append(data, size * count);
+	return size * count;
+}
+
+// Called once per header line. The data is not null-terminated
+static size_t receiveHeader(char* data, size_t size, size_t count, void* userData)
+{
+	std::string* receiveBuffer = static_cast<std::string*>(userData);
+	static const char contentLength[] = "Content-Length:";
+	const size_t contentLengthLength = sizeof(contentLength) - 1;
+	size_t headerLength = size * count;
+	if (headerLength > contentLengthLength &&
+	    strncasecmp(data, contentLength, contentLengthLength) == 0)
+	{
+		// Grow the buffer once instead of as every packet arrives
+		std::string length(data + contentLengthLength, headerLength - contentLengthLength);
+		unsigned long long bodySize = strtoull(length.c_str(), nullptr, 10);
+		if (bodySize > receiveBuffer->capacity())
+			receiveBuffer->reserve(bodySize);
+	}
+	return headerLength;
+}
+
+curl_slist* createAnkiConnectHeaders()
+{
+	curl_slist* httpHeaders = nullptr;
+	httpHeaders = curl_slist_append(httpHeaders, "Expect:");
+	httpHeaders = curl_slist_append(httpHeaders, "Content-Type: application/json");
+	httpHeaders = curl_slist_append(httpHeaders, "Accept: text/json");
+	httpHeaders = curl_slist_append(httpHeaders, "charset: utf-8");
+	return httpHeaders;
+}
+
+CURL* createAnkiConnectHandle(const char* url, curl_slist* httpHeaders, std::string* receiveBuffer)
+{
+	CURL* curl_handle = curl_easy_init();
+	if (!curl_handle)
+	{
+		std::cerr << "Error: could not create curl handle\n";
+		return nullptr;
+	}
+
+	// Everything but the request body stays the same between requests, so it is only set once
+	curl_easy_setopt(curl_handle, CURLOPT_URL, url);
+	curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, receiveBody);
+	curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, static_cast<void*>(receiveBuffer));
+	curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, receiveHeader);
+	curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, static_cast<void*>(receiveBuffer));
+	curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "Japanese-for-me/1.0");
+	curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, httpHeaders);
+	curl_easy_setopt(curl_handle, CURLOPT_POST, 1L);
+	// Requests are small and answered quickly, so don't let Nagle's algorithm hold them back
+	curl_easy_setopt(curl_handle, CURLOPT_TCP_NODELAY, 1L);
+	curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPALIVE, 1L);
+	if (curlVerbose)
+		curl_easy_setopt(curl_handle, CURLOPT_VERBOSE, 1L);
+	return curl_handle;
+}
+
+void addRequestStats(AnkiConnectStats& stats, const AnkiConnectRequestStats& requestStats,
+                     bool succeeded)
+{
+	++stats.numRequests;
+	if (!succeeded)
+		++stats.numFailedRequests;
+	if (!requestStats.reusedConnection)
+		++stats.numConnectionsOpened;
+	stats.bytesSent += requestStats.bytesSent;
+	stats.bytesReceived += requestStats.bytesReceived;
+	stats.totalLatencyMilliseconds += requestStats.latencyMilliseconds;
+	if (requestStats.latencyMilliseconds > stats.maxLatencyMilliseconds)
+		stats.maxLatencyMilliseconds = requestStats.latencyMilliseconds;
+}
+
+AnkiConnectClient::AnkiConnectClient(const char* url) : httpHeaders(createAnkiConnectHeaders())
+{
+	curl_handle = createAnkiConnectHandle(url, httpHeaders, &receiveBuffer);
+}
+
+AnkiConnectClient::~AnkiConnectClient()
+{
+	if (curl_handle)
+		curl_easy_cleanup(curl_handle);
+	curl_slist_free_all(httpHeaders);
+}
+
+const std::string& AnkiConnectClient::request(const char* jsonRequest, size_t jsonRequestLength)
+{
+	TRACE_ZONE("ankiConnectRequest");
+	// Keeps its capacity, so responses of similar size don't need to allocate
+	receiveBuffer.clear();
+	lastRequestStats = AnkiConnectRequestStats();
+	if (!curl_handle)
+		return receiveBuffer;
+
+	if (curlRequestVerbose)
+		std::cout << "Request: '" << jsonRequest << "'\n";
+
+	curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, static_cast<long>(jsonRequestLength));
+	curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, jsonRequest);
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	CURLcode resultCode = curl_easy_perform(curl_handle);
+	std::chrono::duration<float, std::milli> latency = std::chrono::steady_clock::now() - startTime;
+
+	long numConnects = 0;
+	curl_easy_getinfo(curl_handle, CURLINFO_NUM_CONNECTS, &numConnects);
+	lastRequestStats.latencyMilliseconds = latency.count();
+	lastRequestStats.bytesSent = jsonRequestLength;
+	lastRequestStats.bytesReceived = receiveBuffer.size();
+	lastRequestStats.reusedConnection = numConnects == 0;
+	addRequestStats(stats, lastRequestStats, resultCode == CURLE_OK);
+
+	if (resultCode == CURLE_OK)
+	{
+		char* contentType;
+		resultCode = curl_easy_getinfo(curl_handle, CURLINFO_CONTENT_TYPE, &contentType);
+		if (curlResponseStats && resultCode == CURLE_OK && contentType)
+		{
+			std::cout << "Received type " << contentType << "\n";
+			std::cout << receiveBuffer.size() << " characters received in "
+			          << lastRequestStats.latencyMilliseconds << " ms"
+			          << (lastRequestStats.reusedConnection ? "" : " (new connection)") << "\n";
+		}
+
+		if (curlResponseVerbose)
+			std::cout << receiveBuffer << "\n";
+	}
+	else
+	{
+		std::cerr << "Error: " << curl_easy_strerror(resultCode) << "\n";
+		receiveBuffer.clear();
+	}
+
+	return receiveBuffer;
+}
+
+const std::string& AnkiConnectClient::request(const char* jsonRequest)
+{
+	return request(jsonRequest, strlen(jsonRequest));
+}
+
+bool AnkiConnectClient::request(const char* jsonRequest, rapidjson::Document& responseOut)
+{
+	return parseAnkiConnectResponse(request(jsonRequest), responseOut);
+}
+
+const AnkiConnectRequestStats& AnkiConnectClient::getLastRequestStats() const
+{
+	return lastRequestStats;
+}
+
+const AnkiConnectStats& AnkiConnectClient::getStats() const
+{
+	return stats;
+}
+
+AnkiConnectBatch::AnkiConnectBatch(AnkiConnectClient& client, size_t maxActions)
+    : client(client), maxActions(std::max(maxActions, static_cast<size_t>(1))), numRequestsSent(0)
+{
+}
+
+AnkiConnectBatch::~AnkiConnectBatch()
+{
+	flush();
+}
+
+void AnkiConnectBatch::queue(const char* jsonAction, size_t jsonActionLength,
+                             AnkiConnectCallback callback)
+{
+	if (!queuedActions.empty())
+		queuedActions += ',';
+	queuedActions.append(jsonAction, jsonActionLength);
+	callbacks.push_back(std::move(callback));
+	if (callbacks.size() >= maxActions)
+		flush();
+}
+
+void AnkiConnectBatch::queue(const char* jsonAction, AnkiConnectCallback callback)
+{
+	queue(jsonAction, strlen(jsonAction), std::move(callback));
+}
+
+// multi wraps each result in {"result": ..., "error": ...} for actions which ask for version 5 or
+// later, and gives the bare result for older ones
+static bool getMultiActionResult(const rapidjson::Value& actionResponse,
+                                 const rapidjson::Value*& resultOut)
+{
+	resultOut = &actionResponse;
+	if (!actionResponse.IsObject() || !actionResponse.HasMember("error") ||
+	    !actionResponse.HasMember("result") || actionResponse.MemberCount() != 2)
+		return true;
+	const rapidjson::Value& error = actionResponse["error"];
+	if (!error.IsNull())
+	{
+		std::cerr << "Error: AnkiConnect: "
+		          << (error.IsString() ? error.GetString() : "(unknown error)") << "\n";
+		return false;
+	}
+	resultOut = &actionResponse["result"];
+	return true;
+}
+
+bool AnkiConnectBatch::flush()
+{
+	if (callbacks.empty())
+		return true;
+
+	// Taken out first so callbacks can start the next batch
+	std::vector<AnkiConnectCallback> sentCallbacks;
+	sentCallbacks.swap(callbacks);
+	std::string request;
+	if (sentCallbacks.size() == 1)
+		request.swap(queuedActions);
+	else
+	{
+		static const char multiStart[] =
+		    "{\"action\": \"multi\", \"version\": 6, \"params\": {\"actions\": [";
+		request.reserve(sizeof(multiStart) + queuedActions.size() + 3);
+		request += multiStart;
+		request += queuedActions;
+		request += "]}}";
+		queuedActions.clear();
+	}
+
+	++numRequestsSent;
+	rapidjson::Document response;
+	const rapidjson::Value null;
+	bool succeeded = client.request(request.c_str(), response);
+	if (succeeded && sentCallbacks.size() > 1)
+	{
+		const rapidjson::Value& results = response["result"];
+		if (!results.IsArray() || results.Size() != sentCallbacks.size())
+		{
+			std::cerr << "Error: AnkiConnect multi returned the wrong number of results\n";
+			succeeded = false;
+		}
+		else
+		{
+			for (size_t i = 0; i < sentCallbacks.size(); ++i)
+			{
+				const rapidjson::Value* result = nullptr;
+				bool actionSucceeded =
+				    getMultiActionResult(results[static_cast<rapidjson::SizeType>(i)], result);
+				sentCallbacks[i](actionSucceeded, actionSucceeded ? *result : null);
+			}
+			return true;
+		}
+	}
+
+	if (succeeded)
+		sentCallbacks[0](true, response["result"]);
+	else
+	{
+		for (const AnkiConnectCallback& callback : sentCallbacks)
+			callback(false, null);
+	}
+	return succeeded;
+}
+
+size_t AnkiConnectBatch::getNumQueued() const
+{
+	return callbacks.size();
+}
+
+size_t AnkiConnectBatch::getNumRequestsSent() const
+{
+	return numRequestsSent;
+}
+
+bool parseAnkiConnectResponse(const std::string& response, rapidjson::Document& responseOut)
+{
+	TRACE_ZONE("parseAnkiConnectResponse");
+	if (response.empty())
+		return false;
+	responseOut.Parse(response.c_str());
+	if (responseOut.HasParseError() || !responseOut.IsObject())
+	{
+		std::cerr << "Error: AnkiConnect response is not valid JSON\n";
+		return false;
+	}
+	if (responseOut.HasMember("error") && !responseOut["error"].IsNull())
+	{
+		std::cerr << "Error: AnkiConnect: "
+		          << (responseOut["error"].IsString() ? responseOut["error"].GetString() :
+		                                                "(unknown error)")
+		          << "\n";
+		return false;
+	}
+	if (!responseOut.HasMember("result"))
+	{
+		std::cerr << "Error: AnkiConnect response is missing its result\n";
+		return false;
+	}
+	return true;
+}
+
+void printAnkiConnectStats(const AnkiConnectStats& stats)
+{
+	std::cout << stats.numRequests << " AnkiConnect requests (" << stats.numFailedRequests
+	          << " failed) over " << stats.numConnectionsOpened << " connections: "
+	          << stats.bytesSent << " bytes sent, " << stats.bytesReceived << " bytes received, "
+	          << (stats.numRequests ? stats.totalLatencyMilliseconds / stats.numRequests : 0.f)
+	          << " ms average latency (" << stats.maxLatencyMilliseconds << " ms max)\n";
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "curl/curl.h"
+#include "rapidjson/document.h"
+
+// Assumes Anki is running, with the AnkiConnect plugin installed and enabled. For testing without
+// Anki, run AnkiConnectStub.py instead, which listens on the same port
+static const char* defaultAnkiConnectURL = "http://localhost:8765";
+
+struct AnkiConnectRequestStats
+{
+	float latencyMilliseconds = 0.f;
+	size_t bytesSent = 0;
+	size_t bytesReceived = 0;
+	// False if a new connection had to be opened for this request
+	bool reusedConnection = false;
+};
+
+struct AnkiConnectStats
+{
+	size_t numRequests = 0;
+	size_t numFailedRequests = 0;
+	size_t numConnectionsOpened = 0;
+	uint64_t bytesSent = 0;
+	uint64_t bytesReceived = 0;
+	float totalLatencyMilliseconds = 0.f;
+	float maxLatencyMilliseconds = 0.f;
+};
+
+// The headers every request is sent with. Free with curl_slist_free_all()
+curl_slist* createAnkiConnectHeaders();
+// A handle set up to POST requests to url. Responses are appended to receiveBuffer, which is
+// reserved up front from the response's Content-Length
+CURL* createAnkiConnectHandle(const char* url, curl_slist* httpHeaders, std::string* receiveBuffer);
+void addRequestStats(AnkiConnectStats& stats, const AnkiConnectRequestStats& requestStats,
+                     bool succeeded);
+
+// One connection to AnkiConnect, kept alive between requests. The curl handle, headers and receive
+// buffer are set up once and reused by every request. Not thread safe; use one client per thread.
+// curl_global_init() must have been called first
+class AnkiConnectClient
+{
+public:
+	explicit AnkiConnectClient(const char* url = defaultAnkiConnectURL);
+	~AnkiConnectClient();
+
+	AnkiConnectClient(const AnkiConnectClient&) = delete;
+	AnkiConnectClient& operator=(const AnkiConnectClient&) = delete;
+
+	// Sends the request and returns the raw response, or an empty string if the request failed.
+	// The response is only valid until the next request
+	const std::string& request(const char* jsonRequest, size_t jsonRequestLength);
+	const std::string& request(const char* jsonRequest);
+	// Sends the request and parses the response with parseAnkiConnectResponse()
+	bool request(const char* jsonRequest, rapidjson::Document& responseOut);
+
+	const AnkiConnectRequestStats& getLastRequestStats() const;
+	const AnkiConnectStats& getStats() const;
+
+private:
+	CURL* curl_handle;
+	curl_slist* httpHeaders;
+	std::string receiveBuffer;
+
+	AnkiConnectRequestStats lastRequestStats;
+	AnkiConnectStats stats;
+};
+
+// Called with an action's result once its batch has been sent. If the action failed, result is
+// null. result is only valid during the call
+typedef std::function<void(bool succeeded, const rapidjson::Value& result)> AnkiConnectCallback;
+// Called with the raw response instead, for parsing it some other way (e.g. in place). If the
+// request failed, response is empty
+typedef std::function<void(bool succeeded, std::string& response)> AnkiConnectResponseCallback;
+
+// Queues up actions and sends them together as a single "multi" request, so many small queries
+// only cost one round trip. AnkiConnect runs the actions in order, so later actions see the effects
+// of earlier ones (e.g. sync, then findCards). The queue is sent when it reaches maxActions, when
+// flush() is called, and when the batch is destroyed. Callbacks may queue more actions
+class AnkiConnectBatch
+{
+public:
+	explicit AnkiConnectBatch(AnkiConnectClient& client, size_t maxActions = 16);
+	~AnkiConnectBatch();
+
+	AnkiConnectBatch(const AnkiConnectBatch&) = delete;
+	AnkiConnectBatch& operator=(const AnkiConnectBatch&) = delete;
+
+	// jsonAction is a whole request, just as it would be sent on its own, e.g.
+	// {"action": "findCards", "version": 6, "params": {"query": "is:due"}}
+	void queue(const char* jsonAction, size_t jsonActionLength, AnkiConnectCallback callback);
+	void queue(const char* jsonAction, AnkiConnectCallback callback);
+
+	// Sends everything queued and calls each action's callback. Returns false if the request failed
+	// outright (every callback is told it failed). Otherwise, individual actions may still fail
+	bool flush();
+
+	size_t getNumQueued() const;
+	size_t getNumRequestsSent() const;
+
+private:
+	AnkiConnectClient& client;
+	size_t maxActions;
+	// Comma-separated, ready to go into the multi request
+	std::string queuedActions;
+	std::vector<AnkiConnectCallback> callbacks;
+	size_t numRequestsSent;
+};
+
+// Parses a response and checks it for errors. On success, the response's "result" is the result
+bool parseAnkiConnectResponse(const std::string& response, rapidjson::Document& responseOut);
+
+void printAnkiConnectStats(const AnkiConnectStats& stats);
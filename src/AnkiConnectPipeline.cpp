@@ -0,0 +1,186 @@
+#include "AnkiConnectPipeline.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include "Tracing.hpp"
+
+AnkiConnectPipeline::AnkiConnectPipeline(const char* url, unsigned int maxConnections)
+    : multi_handle(curl_multi_init()),
+      httpHeaders(createAnkiConnectHeaders()),
+      numUsableConnections(0),
+      numInFlight(0)
+{
+	if (!multi_handle)
+	{
+		std::cerr << "Error: could not create curl multi handle\n";
+		return;
+	}
+
+	connections.resize(std::max(1u, maxConnections));
+	for (Connection& connection : connections)
+	{
+		connection.curl_handle = createAnkiConnectHandle(url, httpHeaders, &connection.response);
+		connection.isBusy = false;
+		if (connection.curl_handle)
+			++numUsableConnections;
+	}
+}
+
+AnkiConnectPipeline::~AnkiConnectPipeline()
+{
+	curl_slist_free_all(httpHeaders);
+	if (!multi_handle)
+		return;
+	// Anything still in flight is abandoned
+	for (Connection& connection : connections)
+	{
+		if (!connection.curl_handle)
+			continue;
+		if (connection.isBusy)
+			curl_multi_remove_handle(multi_handle, connection.curl_handle);
+		curl_easy_cleanup(connection.curl_handle);
+	}
+	curl_multi_cleanup(multi_handle);
+}
+
+void AnkiConnectPipeline::queue(std::string&& jsonRequest, AnkiConnectCallback callback)
+{
+	queueForResponse(std::move(jsonRequest),
+	                 [callback](bool succeeded, std::string& responseString) {
+		                 rapidjson::Document response;
+		                 const rapidjson::Value null;
+		                 if (succeeded && parseAnkiConnectResponse(responseString, response))
+			                 callback(true, response["result"]);
+		                 else
+			                 callback(false, null);
+	                 });
+}
+
+void AnkiConnectPipeline::queueForResponse(std::string&& jsonRequest,
+                                           AnkiConnectResponseCallback callback)
+{
+	QueuedRequest queuedRequest;
+	queuedRequest.request = std::move(jsonRequest);
+	queuedRequest.callback = std::move(callback);
+	queuedRequests.push_back(std::move(queuedRequest));
+	startQueuedRequests();
+}
+
+void AnkiConnectPipeline::startQueuedRequests()
+{
+	// Nothing could ever be sent
+	std::string noResponse;
+	while (!numUsableConnections && !queuedRequests.empty())
+	{
+		AnkiConnectResponseCallback callback = std::move(queuedRequests.front().callback);
+		queuedRequests.pop_front();
+		callback(false, noResponse);
+	}
+
+	for (Connection& connection : connections)
+	{
+		if (queuedRequests.empty())
+			return;
+		if (connection.isBusy || !connection.curl_handle)
+			continue;
+
+		QueuedRequest& queuedRequest = queuedRequests.front();
+		connection.request = std::move(queuedRequest.request);
+		connection.callback = std::move(queuedRequest.callback);
+		queuedRequests.pop_front();
+
+		connection.response.clear();
+		curl_easy_setopt(connection.curl_handle, CURLOPT_POSTFIELDSIZE,
+		                 static_cast<long>(connection.request.size()));
+		curl_easy_setopt(connection.curl_handle, CURLOPT_POSTFIELDS, connection.request.c_str());
+		connection.startTime = std::chrono::steady_clock::now();
+		connection.isBusy = true;
+		curl_multi_add_handle(multi_handle, connection.curl_handle);
+		++numInFlight;
+		TRACE_COUNTER("AnkiConnect requests in flight", numInFlight);
+	}
+}
+
+void AnkiConnectPipeline::finishTransfers()
+{
+	int numMessagesLeft = 0;
+	while (CURLMsg* message = curl_multi_info_read(multi_handle, &numMessagesLeft))
+	{
+		if (message->msg != CURLMSG_DONE)
+			continue;
+		std::vector<Connection>::iterator connection = connections.begin();
+		while (connection != connections.end() && connection->curl_handle != message->easy_handle)
+			++connection;
+		if (connection == connections.end())
+			continue;
+
+		CURLcode resultCode = message->data.result;
+		curl_multi_remove_handle(multi_handle, connection->curl_handle);
+		connection->isBusy = false;
+		--numInFlight;
+		TRACE_COUNTER("AnkiConnect requests in flight", numInFlight);
+
+		std::chrono::duration<float, std::milli> latency =
+		    std::chrono::steady_clock::now() - connection->startTime;
+		long numConnects = 0;
+		curl_easy_getinfo(connection->curl_handle, CURLINFO_NUM_CONNECTS, &numConnects);
+		AnkiConnectRequestStats requestStats;
+		requestStats.latencyMilliseconds = latency.count();
+		requestStats.bytesSent = connection->request.size();
+		requestStats.bytesReceived = connection->response.size();
+		requestStats.reusedConnection = numConnects == 0;
+		addRequestStats(stats, requestStats, resultCode == CURLE_OK);
+
+		// Taken out first, so the callback can queue more requests, which may reuse this connection
+		AnkiConnectResponseCallback callback = std::move(connection->callback);
+		std::string response;
+		response.swap(connection->response);
+		if (resultCode != CURLE_OK)
+		{
+			std::cerr << "Error: " << curl_easy_strerror(resultCode) << "\n";
+			response.clear();
+		}
+		{
+			TRACE_ZONE("AnkiConnect response callback");
+			callback(!response.empty(), response);
+		}
+
+		startQueuedRequests();
+	}
+}
+
+bool AnkiConnectPipeline::update(int timeoutMilliseconds)
+{
+	TRACE_ZONE("AnkiConnectPipeline::update");
+	startQueuedRequests();
+	if (!numInFlight)
+		return isBusy();
+
+	int numRunning = 0;
+	curl_multi_perform(multi_handle, &numRunning);
+	finishTransfers();
+	if (numInFlight)
+	{
+		curl_multi_wait(multi_handle, nullptr, 0, timeoutMilliseconds, nullptr);
+		curl_multi_perform(multi_handle, &numRunning);
+		finishTransfers();
+	}
+	return isBusy();
+}
+
+void AnkiConnectPipeline::finish()
+{
+	while (update(100))
+		continue;
+}
+
+bool AnkiConnectPipeline::isBusy() const
+{
+	return numInFlight || !queuedRequests.empty();
+}
+
+const AnkiConnectStats& AnkiConnectPipeline::getStats() const
+{
+	return stats;
+}
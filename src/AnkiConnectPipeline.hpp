@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "curl/curl.h"
+
+#include "AnkiConnect.hpp"
+
+// Keeps several requests in flight at once over a few connections, using curl's multi interface.
+// A big query split into chunks (e.g. cardsInfo for every due card) then arrives as a stream of
+// small responses instead of one huge one, and each response is parsed and handed to its callback
+// as soon as it arrives. Callbacks are called in the order responses arrive, which may not be the
+// order they were queued in.
+// Nothing happens in the background: call update() (e.g. instead of sleeping) or finish() to make
+// progress. Not thread safe
+class AnkiConnectPipeline
+{
+public:
+	explicit AnkiConnectPipeline(const char* url = defaultAnkiConnectURL,
+	                             unsigned int maxConnections = 4);
+	~AnkiConnectPipeline();
+
+	AnkiConnectPipeline(const AnkiConnectPipeline&) = delete;
+	AnkiConnectPipeline& operator=(const AnkiConnectPipeline&) = delete;
+
+	void queue(std::string&& jsonRequest, AnkiConnectCallback callback);
+	// The callback gets the response itself, which it may modify. Unlike queue(), AnkiConnect
+	// errors are left for the callback to find
+	void queueForResponse(std::string&& jsonRequest, AnkiConnectResponseCallback callback);
+
+	// Sends whatever it can, then waits up to timeoutMilliseconds for responses, calling the
+	// callback of each one which arrives. Returns early once anything arrives. Returns whether
+	// any requests are still waiting for a response
+	bool update(int timeoutMilliseconds);
+	// Waits for every queued request to be answered
+	void finish();
+
+	bool isBusy() const;
+	const AnkiConnectStats& getStats() const;
+
+private:
+	struct Connection
+	{
+		CURL* curl_handle;
+		bool isBusy;
+		std::string request;
+		std::string response;
+		AnkiConnectResponseCallback callback;
+		std::chrono::steady_clock::time_point startTime;
+	};
+
+	struct QueuedRequest
+	{
+		std::string request;
+		AnkiConnectResponseCallback callback;
+	};
+
+	void startQueuedRequests();
+	void finishTransfers();
+
+	CURLM* multi_handle;
+	curl_slist* httpHeaders;
+	// Never resized after construction; the curl handles point at each connection's response
+	std::vector<Connection> connections;
+	std::deque<QueuedRequest> queuedRequests;
+	size_t numUsableConnections;
+	size_t numInFlight;
+
+	AnkiConnectStats stats;
+};
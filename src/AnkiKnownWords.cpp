@@ -0,0 +1,294 @@
+#include "AnkiKnownWords.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+
+// Keeps each notesInfo response a reasonable size
+static const size_t notesPerRequest = 1000;
+// Chunks are sent together with AnkiConnect's multi action, to save round trips
+static const size_t requestsPerBatch = 8;
+
+static bool findNotes(AnkiConnectClient& ankiConnect, const char* query,
+                      std::vector<int64_t>& noteIdsOut)
+{
+	rapidjson::StringBuffer jsonString;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(jsonString);
+	writer.StartObject();
+	writer.Key("action");
+	writer.String("findNotes");
+	writer.Key("version");
+	writer.Int(6);
+	writer.Key("params");
+	{
+		writer.StartObject();
+		writer.Key("query");
+		writer.String(query);
+		writer.EndObject();
+	}
+	writer.EndObject();
+
+	rapidjson::Document response;
+	if (!ankiConnect.request(jsonString.GetString(), response) || !response["result"].IsArray())
+		return false;
+
+	const rapidjson::Value& noteIds = response["result"];
+	noteIdsOut.clear();
+	noteIdsOut.reserve(noteIds.Size());
+	for (rapidjson::SizeType i = 0; i < noteIds.Size(); ++i)
+		noteIdsOut.push_back(noteIds[i].GetInt64());
+	std::sort(noteIdsOut.begin(), noteIdsOut.end());
+	return true;
+}
+
+static void writeNotesRequest(rapidjson::StringBuffer& jsonString, const char* action,
+                              const int64_t* noteIds, size_t numNoteIds)
+{
+	rapidjson::Writer<rapidjson::StringBuffer> writer(jsonString);
+	writer.StartObject();
+	writer.Key("action");
+	writer.String(action);
+	writer.Key("version");
+	writer.Int(6);
+	writer.Key("params");
+	{
+		writer.StartObject();
+		writer.Key("notes");
+		writer.StartArray();
+		for (size_t i = 0; i < numNoteIds; ++i)
+			writer.Int64(noteIds[i]);
+		writer.EndArray();
+		writer.EndObject();
+	}
+	writer.EndObject();
+}
+
+static void addModifiedTimes(const rapidjson::Value& modifiedTimes,
+                             const std::vector<int64_t>& noteIds,
+                             std::vector<int64_t>& modifiedTimesOut)
+{
+	for (rapidjson::SizeType i = 0; i < modifiedTimes.Size(); ++i)
+	{
+		const rapidjson::Value& modifiedTime = modifiedTimes[i];
+		if (!modifiedTime.IsObject() || !modifiedTime.HasMember("noteId") ||
+		    !modifiedTime.HasMember("mod"))
+			continue;
+		std::vector<int64_t>::const_iterator noteId =
+		    std::lower_bound(noteIds.begin(), noteIds.end(), modifiedTime["noteId"].GetInt64());
+		if (noteId != noteIds.end() && *noteId == modifiedTime["noteId"].GetInt64())
+			modifiedTimesOut[noteId - noteIds.begin()] = modifiedTime["mod"].GetInt64();
+	}
+}
+
+// Much smaller than notesInfo, so checking every note for changes is cheap. Returns false if this
+// version of AnkiConnect doesn't have notesModTime
+static bool getNotesModifiedTimes(AnkiConnectClient& ankiConnect,
+                                  const std::vector<int64_t>& noteIds,
+                                  std::vector<int64_t>& modifiedTimesOut)
+{
+	modifiedTimesOut.assign(noteIds.size(), 0);
+	bool succeeded = true;
+	AnkiConnectBatch batch(ankiConnect, requestsPerBatch);
+	for (size_t chunkStart = 0; chunkStart < noteIds.size(); chunkStart += notesPerRequest * 10)
+	{
+		size_t chunkSize = std::min(notesPerRequest * 10, noteIds.size() - chunkStart);
+		rapidjson::StringBuffer jsonString;
+		writeNotesRequest(jsonString, "notesModTime", noteIds.data() + chunkStart, chunkSize);
+		batch.queue(jsonString.GetString(), jsonString.GetSize(),
+		            [&](bool chunkSucceeded, const rapidjson::Value& modifiedTimes) {
+			            if (chunkSucceeded && modifiedTimes.IsArray())
+				            addModifiedTimes(modifiedTimes, noteIds, modifiedTimesOut);
+			            else
+				            succeeded = false;
+		            });
+	}
+	batch.flush();
+	return succeeded;
+}
+
+static bool isUtf8Sequence(const char* text, const char* textEnd, const char* sequence)
+{
+	size_t sequenceLength = std::strlen(sequence);
+	return static_cast<size_t>(textEnd - text) >= sequenceLength &&
+	       std::memcmp(text, sequence, sequenceLength) == 0;
+}
+
+static void addFieldWords(const char* text, size_t textLength, std::vector<std::string>& wordsOut)
+{
+	static const char* multiByteSeparators[] = {"、", "，", "；", "／", "　", "&nbsp;"};
+	static const char* htmlEntities[][2] = {
+	    {"&amp;", "&"}, {"&lt;", "<"}, {"&gt;", ">"}, {"&quot;", "\""}};
+
+	const char* textEnd = text + textLength;
+	std::string word;
+	bool wordIsJapanese = false;
+	for (const char* current = text; current <= textEnd;)
+	{
+		size_t separatorLength = 0;
+		if (current == textEnd || *current == ' ' || *current == '\t' || *current == '\n' ||
+		    *current == ',' || *current == ';' || *current == '/')
+			separatorLength = 1;
+		for (const char* separator : multiByteSeparators)
+		{
+			if (isUtf8Sequence(current, textEnd, separator))
+				separatorLength = std::strlen(separator);
+		}
+		if (separatorLength)
+		{
+			// Only the Japanese side of the note is of interest
+			if (wordIsJapanese)
+				wordsOut.push_back(word);
+			word.clear();
+			wordIsJapanese = false;
+			current += separatorLength;
+			continue;
+		}
+
+		// Skip HTML tags and furigana readings, e.g. 日本[にほん]
+		if (*current == '<' || *current == '[')
+		{
+			const char* closing = static_cast<const char*>(
+			    std::memchr(current, *current == '<' ? '>' : ']', textEnd - current));
+			current = closing ? closing + 1 : textEnd;
+			continue;
+		}
+
+		bool wasEntity = false;
+		for (const char** entity : htmlEntities)
+		{
+			if (isUtf8Sequence(current, textEnd, entity[0]))
+			{
+				word += entity[1];
+				current += std::strlen(entity[0]);
+				wasEntity = true;
+				break;
+			}
+		}
+		if (wasEntity)
+			continue;
+
+		if (static_cast<unsigned char>(*current) >= 0x80)
+			wordIsJapanese = true;
+		word += *current;
+		++current;
+	}
+}
+
+void getNoteKnownWords(const rapidjson::Value& fields, std::vector<std::string>& wordsOut)
+{
+	const char* knownWordFields[] = {"Lemma", "Front", "Back"};
+	for (const char* fieldName : knownWordFields)
+	{
+		if (!fields.HasMember(fieldName) || !fields[fieldName].HasMember("value"))
+			continue;
+		const rapidjson::Value& value = fields[fieldName]["value"];
+		addFieldWords(value.GetString(), value.GetStringLength(), wordsOut);
+		// Lemma is the whole Japanese side of frequency dictionary notes
+		if (std::strcmp(fieldName, "Lemma") == 0)
+			break;
+	}
+}
+
+// updatedNotes must be sorted by noteId. Notes which aren't in it are ignored
+static void addNotesInfo(const rapidjson::Value& notesInfo, bool updateModifiedTimes,
+                         std::vector<KnownNote>& updatedNotes)
+{
+	std::vector<std::string> noteWords;
+	for (rapidjson::SizeType i = 0; i < notesInfo.Size(); ++i)
+	{
+		const rapidjson::Value& noteInfo = notesInfo[i];
+		// Notes deleted since findNotes come back empty
+		if (!noteInfo.IsObject() || !noteInfo.HasMember("noteId") || !noteInfo.HasMember("fields"))
+			continue;
+		int64_t noteId = noteInfo["noteId"].GetInt64();
+		std::vector<KnownNote>::iterator note = std::lower_bound(
+		    updatedNotes.begin(), updatedNotes.end(), noteId,
+		    [](const KnownNote& a, int64_t noteId) { return a.noteId < noteId; });
+		if (note == updatedNotes.end() || note->noteId != noteId)
+			continue;
+
+		if (updateModifiedTimes && noteInfo.HasMember("mod"))
+			note->modifiedTime = noteInfo["mod"].GetInt64();
+		noteWords.clear();
+		getNoteKnownWords(noteInfo["fields"], noteWords);
+		note->words.clear();
+		for (const std::string& word : noteWords)
+		{
+			if (!note->words.empty())
+				note->words += '\n';
+			note->words += word;
+		}
+	}
+}
+
+bool syncKnownWordsWithAnki(AnkiConnectClient& ankiConnect, const char* query,
+                            KnownWords& knownWords, KnownWordsSyncStats& statsOut)
+{
+	std::vector<int64_t> noteIds;
+	if (!findNotes(ankiConnect, query, noteIds))
+		return false;
+
+	std::vector<int64_t> modifiedTimes;
+	bool haveModifiedTimes = getNotesModifiedTimes(ankiConnect, noteIds, modifiedTimes);
+	if (!haveModifiedTimes)
+		std::cerr << "Warning: this version of AnkiConnect can't list note modification times. "
+		             "Every note will be fetched\n";
+
+	// Both are sorted by noteId, so unchanged notes can be carried over in a single pass
+	std::vector<KnownNote> updatedNotes;
+	updatedNotes.reserve(noteIds.size());
+	std::vector<int64_t> noteIdsToFetch;
+	std::vector<KnownNote>::const_iterator oldNote = knownWords.notes.begin();
+	size_t numOldNotesKept = 0;
+	for (size_t i = 0; i < noteIds.size(); ++i)
+	{
+		while (oldNote != knownWords.notes.end() && oldNote->noteId < noteIds[i])
+			++oldNote;
+		bool isInCache = oldNote != knownWords.notes.end() && oldNote->noteId == noteIds[i];
+		if (isInCache)
+			++numOldNotesKept;
+		// Copied rather than moved, so knownWords is untouched if a request fails partway
+		if (isInCache && haveModifiedTimes && oldNote->modifiedTime == modifiedTimes[i])
+		{
+			updatedNotes.push_back(*oldNote);
+			continue;
+		}
+
+		KnownNote note;
+		note.noteId = noteIds[i];
+		note.modifiedTime = haveModifiedTimes ? modifiedTimes[i] : 0;
+		updatedNotes.push_back(std::move(note));
+		noteIdsToFetch.push_back(noteIds[i]);
+	}
+
+	bool succeeded = true;
+	AnkiConnectBatch batch(ankiConnect, requestsPerBatch);
+	for (size_t chunkStart = 0; chunkStart < noteIdsToFetch.size(); chunkStart += notesPerRequest)
+	{
+		size_t chunkSize = std::min(notesPerRequest, noteIdsToFetch.size() - chunkStart);
+		rapidjson::StringBuffer jsonString;
+		writeNotesRequest(jsonString, "notesInfo", noteIdsToFetch.data() + chunkStart, chunkSize);
+		batch.queue(jsonString.GetString(), jsonString.GetSize(),
+		            [&](bool chunkSucceeded, const rapidjson::Value& notesInfo) {
+			            if (chunkSucceeded && notesInfo.IsArray())
+				            addNotesInfo(notesInfo, !haveModifiedTimes, updatedNotes);
+			            else
+				            succeeded = false;
+		            });
+	}
+	batch.flush();
+	if (!succeeded)
+		return false;
+
+	statsOut.numNotes = updatedNotes.size();
+	statsOut.numNotesFetched = noteIdsToFetch.size();
+	statsOut.numNotesRemoved = knownWords.notes.size() - numOldNotesKept;
+	knownWords.notes = std::move(updatedNotes);
+	rebuildKnownWordSet(knownWords);
+	statsOut.numWords = knownWords.words.size();
+	return true;
+}
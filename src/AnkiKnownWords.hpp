@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "rapidjson/document.h"
+
+#include "AnkiConnect.hpp"
+#include "KnownWords.hpp"
+
+struct KnownWordsSyncStats
+{
+	size_t numNotes = 0;
+	size_t numNotesFetched = 0;
+	size_t numNotesRemoved = 0;
+	size_t numWords = 0;
+};
+
+// Brings knownWords up to date with the notes matching the Anki search query, e.g.
+// "deck:Japanese". Only notes which are new or were modified since the last sync are fetched
+bool syncKnownWordsWithAnki(AnkiConnectClient& ankiConnect, const char* query,
+                            KnownWords& knownWords, KnownWordsSyncStats& statsOut);
+
+// The Japanese side of a note. Notes from "A Frequency Dictionary of Japanese Words" have a Lemma
+// field; simple notes have Front and Back, either of which may be the Japanese one. HTML and
+// furigana are stripped, and fields listing several words are split
+void getNoteKnownWords(const rapidjson::Value& fields, std::vector<std::string>& wordsOut);
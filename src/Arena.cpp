@@ -0,0 +1,58 @@
+#include "Arena.hpp"
+
+#include <cstring>
+
+Arena::Arena(size_t blockSize)
+    : blockHead(nullptr), blockEnd(nullptr), blockSize(blockSize), totalAllocated(0)
+{
+}
+
+Arena::~Arena()
+{
+	clear();
+}
+
+char* Arena::allocate(size_t size)
+{
+	if (static_cast<size_t>(blockEnd - blockHead) < size)
+	{
+		// Oversized requests get their own block so the rest of the current block isn't wasted
+		size_t newBlockSize = size > blockSize ? size : blockSize;
+		char* newBlock = new char[newBlockSize];
+		blocks.push_back(newBlock);
+		if (size > blockSize)
+		{
+			totalAllocated += size;
+			return newBlock;
+		}
+		blockHead = newBlock;
+		blockEnd = newBlock + newBlockSize;
+	}
+
+	char* allocation = blockHead;
+	blockHead += size;
+	totalAllocated += size;
+	return allocation;
+}
+
+char* Arena::copy(const char* data, size_t size)
+{
+	char* allocation = allocate(size);
+	std::memcpy(allocation, data, size);
+	return allocation;
+}
+
+void Arena::clear()
+{
+	for (char* block : blocks)
+		delete[] block;
+	blocks.clear();
+	blockHead = nullptr;
+	blockEnd = nullptr;
+	totalAllocated = 0;
+}
+
+size_t Arena::bytesAllocated() const
+{
+	return totalAllocated;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Bump allocator for lots of small allocations which all live and die together (e.g. dictionary
+// keys). Individual allocations cannot be freed; everything goes at once on clear() or destruction
+class Arena
+{
+public:
+	explicit Arena(size_t blockSize = 1024 * 1024);
+	~Arena();
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	// Not aligned; only use for character data
+	char* allocate(size_t size);
+	char* copy(const char* data, size_t size);
+
+	void clear();
+	size_t bytesAllocated() const;
+
+private:
+	std::vector<char*> blocks;
+	char* blockHead;
+	char* blockEnd;
+	size_t blockSize;
+	size_t totalAllocated;
+};
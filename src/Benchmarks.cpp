@@ -0,0 +1,1422 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <mecab.h>
+#include "curl/curl.h"
+#include "rapidjson/document.h"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#include "AnalysisCacheFile.hpp"
+#include "AnalysisPool.hpp"
+#include "AnkiConnect.hpp"
+#include "AnkiConnectPipeline.hpp"
+#include "DelimiterScanner.hpp"
+#include "Dictionary.hpp"
+#include "DictionaryIndex.hpp"
+#include "DictionaryLookup.hpp"
+#include "DocumentAnalysis.hpp"
+#include "DocumentList.hpp"
+#include "DueCards.hpp"
+#include "MappedFile.hpp"
+#include "SentenceReader.hpp"
+#include "TokenFeatures.hpp"
+
+// Counts every allocation made through new, and through CountingAllocator below, so benchmarks can
+// compare how many allocations each approach makes. Atomic, since the analysis benchmarks allocate
+// on many threads at once; only the total matters, so relaxed ordering is enough
+static std::atomic<size_t> numAllocations(0);
+
+void* operator new(size_t size)
+{
+	numAllocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* allocation = std::malloc(size ? size : 1))
+		return allocation;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* allocation) noexcept
+{
+	std::free(allocation);
+}
+
+// rapidjson allocates with malloc() rather than new
+struct CountingAllocator
+{
+	static const bool kNeedFree = true;
+
+	void* Malloc(size_t size)
+	{
+		if (!size)
+			return nullptr;
+		numAllocations.fetch_add(1, std::memory_order_relaxed);
+		return std::malloc(size);
+	}
+	void* Realloc(void* originalAllocation, size_t originalSize, size_t newSize)
+	{
+		if (!newSize)
+		{
+			std::free(originalAllocation);
+			return nullptr;
+		}
+		numAllocations.fetch_add(1, std::memory_order_relaxed);
+		return std::realloc(originalAllocation, newSize);
+	}
+	static void Free(void* allocation)
+	{
+		std::free(allocation);
+	}
+};
+
+// Run func numRuns times and return the fastest time in milliseconds. The fastest run is the one
+// least disturbed by everything else happening on the machine
+template <typename Function>
+static float timeBestOfMilliseconds(int numRuns, Function func)
+{
+	float bestTime = 0.f;
+	for (int run = 0; run < numRuns; ++run)
+	{
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		func();
+		std::chrono::duration<float, std::milli> runTime =
+		    std::chrono::steady_clock::now() - startTime;
+		if (run == 0 || runTime.count() < bestTime)
+			bestTime = runTime.count();
+	}
+	return bestTime;
+}
+
+//
+// Results
+//
+
+// Every result is kept as well as printed, so --results can write them all out for comparing
+// between builds and machines
+struct BenchmarkResult
+{
+	std::string name;
+	float milliseconds;
+	// How many units were processed per second, e.g. 50 "MB" is 50 MB/s
+	double perSecond;
+	const char* unit;
+	// Per run. Negative if not counted
+	int64_t numAllocations;
+};
+
+static std::vector<BenchmarkResult> results;
+// Results are named "group/name", e.g. "synthetic/edict2Load/SSE2"
+static std::string resultGroup;
+
+static void recordResult(const std::string& name, float milliseconds, double amount,
+                         const char* unit, int64_t numAllocations = -1)
+{
+	BenchmarkResult result;
+	result.name = resultGroup + "/" + name;
+	result.milliseconds = milliseconds;
+	result.perSecond = milliseconds > 0.f ? amount / (milliseconds / 1000.f) : 0.;
+	result.unit = unit;
+	result.numAllocations = numAllocations;
+	results.push_back(result);
+}
+
+static void printResult(const char* name, float milliseconds, size_t numBytes)
+{
+	float megabytesPerSecond = (numBytes / (1024.f * 1024.f)) / (milliseconds / 1000.f);
+	std::cout << "\t" << name << ": " << milliseconds << " ms (" << megabytesPerSecond
+	          << " MB/s)\n";
+	recordResult(name, milliseconds, numBytes / (1024. * 1024.), "MB");
+}
+
+static bool writeResults(const char* filename)
+{
+	rapidjson::StringBuffer jsonString;
+	rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(jsonString);
+	writer.StartObject();
+	writer.Key("time");
+	writer.Int64(static_cast<int64_t>(std::time(nullptr)));
+	writer.Key("build");
+#ifdef NDEBUG
+	writer.String("release");
+#else
+	writer.String("debug");
+#endif
+	writer.Key("compiler");
+	writer.String(__VERSION__);
+	writer.Key("results");
+	writer.StartArray();
+	for (const BenchmarkResult& result : results)
+	{
+		writer.StartObject();
+		writer.Key("name");
+		writer.String(result.name.c_str());
+		writer.Key("milliseconds");
+		writer.Double(result.milliseconds);
+		writer.Key("perSecond");
+		writer.Double(result.perSecond);
+		writer.Key("unit");
+		writer.String(result.unit);
+		if (result.numAllocations >= 0)
+		{
+			writer.Key("allocations");
+			writer.Int64(result.numAllocations);
+		}
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+
+	std::ofstream outputFile(filename, std::ios::out | std::ios::trunc);
+	if (!outputFile.is_open())
+	{
+		std::cerr << "Error: could not open '" << filename << "' for writing\n";
+		return false;
+	}
+	outputFile.write(jsonString.GetString(), jsonString.GetSize());
+	outputFile.put('\n');
+	return static_cast<bool>(outputFile);
+}
+
+//
+// Fixed inputs
+//
+
+// xorshift32. Unlike std::rand(), gives the same numbers on every platform, so the synthetic
+// inputs (and the results) are the same everywhere
+static uint32_t nextRandom(uint32_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+// Shaped like EDICT2: some entries have several headwords or readings, glosses have part of
+// speech markers, and there are priority markers and entry IDs. Words are made of common kanji
+// and kana, so they're about as long as real ones
+static std::string makeSyntheticEdict2(size_t numEntries)
+{
+	const char* kanji[] = {"日", "本", "語", "学", "生", "先", "食", "飲", "見", "行", "来", "時",
+	                       "間", "電", "車", "水", "猫", "犬", "書", "読", "話", "聞", "手", "目"};
+	const char* kana[] = {"あ", "い", "う", "え", "お", "か", "き", "く", "け", "こ", "さ", "し",
+	                      "す", "せ", "そ", "た", "ち", "つ", "て", "と", "な", "に", "る", "ん"};
+	const size_t numKanji = sizeof(kanji) / sizeof(kanji[0]);
+	const size_t numKana = sizeof(kana) / sizeof(kana[0]);
+	uint32_t randomState = 1;
+
+	std::string edict2 = "　？？？ /EDICT2 synthetic/\n";
+	for (size_t i = 0; i < numEntries; ++i)
+	{
+		size_t numHeadwords = nextRandom(randomState) % 4 == 0 ? 2 : 1;
+		for (size_t headword = 0; headword < numHeadwords; ++headword)
+		{
+			if (headword)
+				edict2 += ';';
+			size_t numCharacters = 1 + nextRandom(randomState) % 3;
+			for (size_t character = 0; character < numCharacters; ++character)
+				edict2 += kanji[nextRandom(randomState) % numKanji];
+			edict2 += kana[nextRandom(randomState) % numKana];
+			if (headword == 0 && nextRandom(randomState) % 8 == 0)
+				edict2 += "(P)";
+		}
+
+		edict2 += " [";
+		size_t numReadingCharacters = 2 + nextRandom(randomState) % 4;
+		for (size_t character = 0; character < numReadingCharacters; ++character)
+			edict2 += kana[nextRandom(randomState) % numKana];
+		edict2 += "] /(n) ";
+
+		size_t numGlosses = 1 + nextRandom(randomState) % 3;
+		for (size_t gloss = 0; gloss < numGlosses; ++gloss)
+		{
+			if (gloss)
+				edict2 += "/(" + std::to_string(gloss + 1) + ") ";
+			edict2 += "synthetic meaning " + std::to_string(nextRandom(randomState) % 10000);
+		}
+		edict2 += "/EntL" + std::to_string(1000000 + i) + "X/\n";
+	}
+	return edict2;
+}
+
+// A few paragraphs of everyday Japanese, repeated until it is long enough to time. Every
+// sentence ends in 。 so it splits like a real document
+static std::string makeSyntheticText(size_t minBytes)
+{
+	const char* paragraph =
+	    "今日は朝から雨が降っていたので、学校まで電車で行きました。"
+	    "先生は新しい本を読んでくれて、みんなは静かに話を聞いていました。"
+	    "昼ご飯の後、友達と一緒に図書館で日本語の勉強をしました。"
+	    "帰り道に猫を見かけたけれど、すぐにどこかへ行ってしまいました。"
+	    "夜は家族と晩ご飯を食べて、少しテレビを見てから寝ました。\n";
+	std::string text;
+	while (text.size() < minBytes)
+		text += paragraph;
+	return text;
+}
+
+// Benchmarks which need a file (e.g. loadDictionary()) are given one of these. Removed afterwards
+static bool writeTemporaryFile(const std::string& contents, std::string& filenameOut)
+{
+	char filename[] = "/tmp/jfmBenchXXXXXX";
+	int fileDescriptor = mkstemp(filename);
+	if (fileDescriptor == -1)
+	{
+		std::cerr << "Error: could not create a temporary file\n";
+		return false;
+	}
+	size_t numWritten = 0;
+	while (numWritten < contents.size())
+	{
+		ssize_t result =
+		    write(fileDescriptor, contents.data() + numWritten, contents.size() - numWritten);
+		if (result <= 0)
+			break;
+		numWritten += static_cast<size_t>(result);
+	}
+	close(fileDescriptor);
+	filenameOut = filename;
+	if (numWritten != contents.size())
+	{
+		std::cerr << "Error: could not write '" << filename << "'\n";
+		std::remove(filename);
+		return false;
+	}
+	return true;
+}
+
+//
+// EDICT2 delimiter scanning
+//
+
+// Both count the words (headwords and readings) in EDICT2 without inserting them anywhere, so only
+// the cost of finding the structure of each line is measured
+
+// How loadDictionary() used to tokenize: switch on every byte, including every byte of the glosses
+static size_t countWordsByteByByte(const char* begin, const char* end)
+{
+	enum class ReadState
+	{
+		VersionNumber = 0,
+		JapaneseWord,
+		Reading,
+		EnglishDefinition,
+		EntryId
+	};
+	ReadState readState = ReadState::VersionNumber;
+	size_t numWords = 0;
+	size_t wordLength = 0;
+	for (const char* current = begin; current < end; ++current)
+	{
+		if (*current == '\n')
+		{
+			readState = ReadState::JapaneseWord;
+			wordLength = 0;
+			continue;
+		}
+		switch (readState)
+		{
+			case ReadState::JapaneseWord:
+			case ReadState::Reading:
+				if (*current == '/' || *current == '[' || *current == ']' || *current == ';')
+				{
+					numWords += wordLength ? 1 : 0;
+					wordLength = 0;
+					if (*current == '/')
+						readState = ReadState::EnglishDefinition;
+					else if (*current == '[')
+						readState = ReadState::Reading;
+					else if (*current == ']')
+						readState = ReadState::JapaneseWord;
+				}
+				else if (*current != ' ')
+					++wordLength;
+				break;
+			case ReadState::EnglishDefinition:
+				if (*current == '/' && end - current > 4 && current[1] == 'E' &&
+				    current[2] == 'n' && current[3] == 't' && current[4] == 'L')
+					readState = ReadState::EntryId;
+				break;
+			default:
+				break;
+		}
+	}
+	return numWords;
+}
+
+// How loadDictionary() tokenizes now: jump between structural characters
+static size_t countWordsScanner(const char* begin, const char* end)
+{
+	static const DelimiterSet wordDelimiters = makeDelimiterSet("/[]; \n");
+	static const DelimiterSet englishDefinitionDelimiters = makeDelimiterSet("/\n");
+	size_t numWords = 0;
+	size_t wordLength = 0;
+	bool inEnglishDefinition = false;
+	// Skip the version line
+	const char* current = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+	while (current && current < end)
+	{
+		if (*current == '\n')
+		{
+			inEnglishDefinition = false;
+			wordLength = 0;
+		}
+		else if (inEnglishDefinition)
+		{
+			if (end - current > 4 && std::memcmp(current + 1, "EntL", 4) == 0)
+				current = static_cast<const char*>(std::memchr(current, '\n', end - current));
+			if (!current)
+				break;
+			if (*current == '\n')
+				continue;
+		}
+		else if (*current != ' ')
+		{
+			numWords += wordLength ? 1 : 0;
+			wordLength = 0;
+			inEnglishDefinition = *current == '/';
+		}
+
+		const char* next = findNextDelimiter(
+		    inEnglishDefinition ? englishDefinitionDelimiters : wordDelimiters, current + 1, end);
+		if (!inEnglishDefinition)
+			wordLength += next - (current + 1);
+		current = next;
+	}
+	return numWords;
+}
+
+static bool benchmarkDictionaryScanning(const char* dictionaryFilename, const char* inputName)
+{
+	MappedFile dictionaryFile;
+	if (!mapFile(dictionaryFilename, dictionaryFile))
+	{
+		std::cerr << "Error: could not open '" << dictionaryFilename << "'\n";
+		return false;
+	}
+	const char* begin = dictionaryFile.data;
+	const char* end = dictionaryFile.data + dictionaryFile.size;
+	const int numRuns = 10;
+	bool succeeded = true;
+
+	std::cout << "EDICT2 tokenize (" << inputName << ", " << dictionaryFile.size << " bytes)\n";
+	resultGroup = std::string(inputName) + "/edict2Tokenize";
+	size_t expectedWords = 0;
+	float byteByByteTime = timeBestOfMilliseconds(
+	    numRuns, [&]() { expectedWords = countWordsByteByByte(begin, end); });
+	printResult("byte by byte", byteByByteTime, dictionaryFile.size);
+
+	const DelimiterScannerImplementation defaultImplementation =
+	    getDelimiterScannerImplementation();
+	const DelimiterScannerImplementation implementations[] = {
+	    DelimiterScannerImplementation::Scalar, DelimiterScannerImplementation::SSE2,
+	    DelimiterScannerImplementation::AVX2};
+	for (DelimiterScannerImplementation implementation : implementations)
+	{
+		setDelimiterScannerImplementation(implementation);
+		if (getDelimiterScannerImplementation() != implementation)
+			continue;
+
+		size_t numWords = 0;
+		float scanTime =
+		    timeBestOfMilliseconds(numRuns, [&]() { numWords = countWordsScanner(begin, end); });
+		printResult(getDelimiterScannerImplementationName(implementation), scanTime,
+		            dictionaryFile.size);
+		if (numWords != expectedWords)
+		{
+			std::cerr << "Error: " << getDelimiterScannerImplementationName(implementation)
+			          << " found " << numWords << " words, expected " << expectedWords << "\n";
+			succeeded = false;
+		}
+	}
+
+	// The whole parse, single threaded so only the tokenizer changes between runs
+	std::cout << "EDICT2 single-threaded load (" << inputName << ")\n";
+	resultGroup = std::string(inputName) + "/edict2Load";
+	for (DelimiterScannerImplementation implementation : implementations)
+	{
+		setDelimiterScannerImplementation(implementation);
+		if (getDelimiterScannerImplementation() != implementation)
+			continue;
+
+		float loadTime = timeBestOfMilliseconds(3, [&]() {
+			Dictionary dictionary;
+			loadDictionary(dictionaryFilename, dictionary, 1);
+			freeDictionary(dictionary);
+		});
+		printResult(getDelimiterScannerImplementationName(implementation), loadTime,
+		            dictionaryFile.size);
+	}
+	setDelimiterScannerImplementation(defaultImplementation);
+
+	unmapFile(dictionaryFile);
+	return succeeded;
+}
+
+//
+// Dictionary lookup
+//
+
+// Every key in the dictionary plus as many misses, in a fixed shuffled order so the table is
+// probed the way analysis probes it rather than in the order it was filled
+static bool benchmarkDictionaryLookup(const char* dictionaryFilename, const char* inputName)
+{
+	// Also compared against the index below
+	DictionaryLookup hashMapLookup;
+	Dictionary& dictionary = hashMapLookup.dictionary;
+	if (!loadDictionary(dictionaryFilename, dictionary))
+	{
+		freeDictionary(dictionary);
+		return false;
+	}
+
+	std::string keyPool;
+	std::vector<size_t> keyEnds;
+	for (const DictionaryHashMap::value_type& entry : dictionary.entries)
+	{
+		keyPool.append(entry.first.data, entry.first.length);
+		keyEnds.push_back(keyPool.size());
+		// Words which are close to real ones, like analysis mostly looks up
+		keyPool.append(entry.first.data, entry.first.length);
+		keyPool += "ー";
+		keyEnds.push_back(keyPool.size());
+	}
+	std::vector<DictionaryKey> keys(keyEnds.size());
+	for (size_t i = 0; i < keyEnds.size(); ++i)
+	{
+		size_t keyStart = i ? keyEnds[i - 1] : 0;
+		keys[i].data = keyPool.data() + keyStart;
+		keys[i].length = static_cast<uint32_t>(keyEnds[i] - keyStart);
+	}
+	uint32_t randomState = 1;
+	for (size_t i = keys.size(); i > 1; --i)
+		std::swap(keys[i - 1], keys[nextRandom(randomState) % i]);
+	const size_t expectedHits = dictionary.entries.size();
+
+	std::cout << "Dictionary lookup (" << inputName << ", " << keys.size() << " words, half of "
+	          << "them misses)\n";
+	resultGroup = std::string(inputName) + "/dictionaryLookup";
+	bool succeeded = true;
+	size_t numHits = 0;
+	float hashMapTime = timeBestOfMilliseconds(5, [&]() {
+		numHits = 0;
+		for (const DictionaryKey& key : keys)
+			numHits += findDictionaryEntry(dictionary, key.data, key.length) ? 1 : 0;
+	});
+	std::cout << "\thash map: " << hashMapTime << " ms, "
+	          << keys.size() / (hashMapTime / 1000.f) << " lookups/second\n";
+	recordResult("hash map", hashMapTime, keys.size(), "lookups");
+	if (numHits != expectedHits)
+	{
+		std::cerr << "Error: hash map found " << numHits << " words, expected " << expectedHits
+		          << "\n";
+		succeeded = false;
+	}
+
+	// About a sentence's worth of words at a time
+	const size_t batchSize = 32;
+	const char* batchEntries[batchSize];
+	float hashMapBatchTime = timeBestOfMilliseconds(5, [&]() {
+		numHits = 0;
+		for (size_t batchStart = 0; batchStart < keys.size(); batchStart += batchSize)
+		{
+			size_t numBatchKeys = std::min(batchSize, keys.size() - batchStart);
+			findDictionaryEntries(dictionary, &keys[batchStart], numBatchKeys, batchEntries);
+			for (size_t i = 0; i < numBatchKeys; ++i)
+				numHits += batchEntries[i] ? 1 : 0;
+		}
+	});
+	std::cout << "\thash map, batched: " << hashMapBatchTime << " ms, "
+	          << keys.size() / (hashMapBatchTime / 1000.f) << " lookups/second\n";
+	recordResult("hash map, batched", hashMapBatchTime, keys.size(), "lookups");
+	if (numHits != expectedHits)
+	{
+		std::cerr << "Error: batched hash map found " << numHits << " words, expected "
+		          << expectedHits << "\n";
+		succeeded = false;
+	}
+
+	// Segmenting text by the dictionary alone: every word starting at every character
+	const std::string text = makeSyntheticText(1024 * 1024);
+	std::vector<DictionaryTextMatch> textMatches;
+	float hashMapSegmentTime = timeBestOfMilliseconds(3, [&]() {
+		textMatches.clear();
+		findDictionaryLookupTextMatches(hashMapLookup, text.data(), text.size(), textMatches);
+	});
+	const size_t expectedTextMatches = textMatches.size();
+	std::cout << "\thash map, all prefixes of " << text.size() / 1024 << " KB of text: "
+	          << hashMapSegmentTime << " ms ("
+	          << (text.size() / (1024.f * 1024.f)) / (hashMapSegmentTime / 1000.f) << " MB/s, "
+	          << textMatches.size() << " matches)\n";
+	recordResult("hash map, all prefixes", hashMapSegmentTime, text.size(), "bytes");
+
+	std::string indexFilename;
+	DictionaryLookup indexLookup;
+	DictionaryIndex& index = indexLookup.index;
+	indexLookup.usingIndex = true;
+	if (writeTemporaryFile(std::string(), indexFilename) &&
+	    writeDictionaryIndex(dictionary, dictionaryFilename, indexFilename.c_str()) &&
+	    openDictionaryIndex(indexFilename.c_str(), index))
+	{
+		float indexTime = timeBestOfMilliseconds(5, [&]() {
+			numHits = 0;
+			for (const DictionaryKey& key : keys)
+				numHits += findDictionaryIndexEntry(index, key.data, key.length) ? 1 : 0;
+		});
+		std::cout << "\tcompiled index: " << indexTime << " ms, "
+		          << keys.size() / (indexTime / 1000.f) << " lookups/second\n";
+		recordResult("compiled index", indexTime, keys.size(), "lookups");
+		if (numHits != expectedHits)
+		{
+			std::cerr << "Error: compiled index found " << numHits << " words, expected "
+			          << expectedHits << "\n";
+			succeeded = false;
+		}
+
+		float indexBatchTime = timeBestOfMilliseconds(5, [&]() {
+			numHits = 0;
+			for (size_t batchStart = 0; batchStart < keys.size(); batchStart += batchSize)
+			{
+				size_t numBatchKeys = std::min(batchSize, keys.size() - batchStart);
+				findDictionaryIndexEntries(index, &keys[batchStart], numBatchKeys, batchEntries);
+				for (size_t i = 0; i < numBatchKeys; ++i)
+					numHits += batchEntries[i] ? 1 : 0;
+			}
+		});
+		std::cout << "\tcompiled index, batched: " << indexBatchTime << " ms, "
+		          << keys.size() / (indexBatchTime / 1000.f) << " lookups/second\n";
+		recordResult("compiled index, batched", indexBatchTime, keys.size(), "lookups");
+		if (numHits != expectedHits)
+		{
+			std::cerr << "Error: batched compiled index found " << numHits
+			          << " words, expected " << expectedHits << "\n";
+			succeeded = false;
+		}
+
+		float trieSegmentTime = timeBestOfMilliseconds(3, [&]() {
+			textMatches.clear();
+			findDictionaryLookupTextMatches(indexLookup, text.data(), text.size(), textMatches);
+		});
+		std::cout << "\tcompiled index trie, all prefixes: " << trieSegmentTime << " ms ("
+		          << (text.size() / (1024.f * 1024.f)) / (trieSegmentTime / 1000.f) << " MB/s, "
+		          << textMatches.size() << " matches)\n";
+		recordResult("compiled index trie, all prefixes", trieSegmentTime, text.size(), "bytes");
+		if (textMatches.size() != expectedTextMatches)
+		{
+			std::cerr << "Error: trie found " << textMatches.size() << " prefixes, expected "
+			          << expectedTextMatches << "\n";
+			succeeded = false;
+		}
+		closeDictionaryIndex(index);
+	}
+	else
+		succeeded = false;
+	if (!indexFilename.empty())
+		std::remove(indexFilename.c_str());
+
+	freeDictionary(dictionary);
+	return succeeded;
+}
+
+// Whether the line has a (P) marker, the way anything needing an entry's tags had to find out
+// before the entry table
+static bool lineHasPriorityMarker(const char* line, size_t lineLength)
+{
+	const char* lineEnd = line + lineLength;
+	const char* marker = line;
+	while ((marker = static_cast<const char*>(std::memchr(marker, '(', lineEnd - marker))))
+	{
+		if (lineEnd - marker >= 3 && marker[1] == 'P' && marker[2] == ')')
+			return true;
+		++marker;
+	}
+	return false;
+}
+
+// Counting common words by scanning every entry line vs reading the entry table's tags, which is
+// what anything filtering entries by part of speech or priority does
+static bool benchmarkDictionaryEntries(const char* dictionaryFilename, const char* inputName)
+{
+	Dictionary dictionary;
+	if (!loadDictionary(dictionaryFilename, dictionary))
+	{
+		freeDictionary(dictionary);
+		return false;
+	}
+	const DictionaryEntryTable& entryTable = dictionary.entryTable;
+
+	std::cout << "Dictionary entries (" << inputName << ", " << entryTable.numEntries
+	          << " entries)\n";
+	resultGroup = std::string(inputName) + "/dictionaryEntries";
+	size_t numLinePriority = 0;
+	float lineScanTime = timeBestOfMilliseconds(5, [&]() {
+		numLinePriority = 0;
+		for (uint32_t i = 0; i < entryTable.numEntries; ++i)
+		{
+			DictionaryEntryView line = getDictionaryEntryLine(entryTable, i);
+			numLinePriority += lineHasPriorityMarker(line.data, line.length) ? 1 : 0;
+		}
+	});
+	std::cout << "\tcommon words, scanning lines: " << lineScanTime << " ms, "
+	          << entryTable.numEntries / (lineScanTime / 1000.f) << " entries/second\n";
+	recordResult("common words, scanning lines", lineScanTime, entryTable.numEntries, "entries");
+
+	size_t numTagPriority = 0;
+	float tagScanTime = timeBestOfMilliseconds(5, [&]() {
+		numTagPriority = 0;
+		for (uint32_t i = 0; i < entryTable.numEntries; ++i)
+			numTagPriority += hasDictionaryEntryTag(entryTable, i, DictionaryTag::Priority) ? 1 : 0;
+	});
+	std::cout << "\tcommon words, entry table tags: " << tagScanTime << " ms, "
+	          << entryTable.numEntries / (tagScanTime / 1000.f) << " entries/second, "
+	          << numTagPriority << " common\n";
+	recordResult("common words, entry table tags", tagScanTime, entryTable.numEntries, "entries");
+
+	bool succeeded = numTagPriority == numLinePriority;
+	if (!succeeded)
+		std::cerr << "Error: entry table has " << numTagPriority << " common words, lines have "
+		          << numLinePriority << "\n";
+	freeDictionary(dictionary);
+	return succeeded;
+}
+
+//
+// Text analysis
+//
+
+// MeCab on its own, looking up its tokens one at a time vs a sentence at a time, then the whole of
+// analyzeDocument() (tokenizing, looking up every token and writing JSON), single threaded on fixed
+// text. Then the same document again from the analysis cache
+static bool benchmarkTextAnalysis(const char* dictionaryFilename, const char* inputName)
+{
+	MeCab::Model* model = MeCab::createModel("");
+	if (!model)
+	{
+		std::cerr << "Warning: could not create MeCab model, so text analysis is skipped: "
+		          << MeCab::getLastError() << "\n";
+		return true;
+	}
+	DictionaryLookup dictionary;
+	std::string indexFilename = std::string(dictionaryFilename) + ".index";
+	if (!openDictionaryLookup(dictionaryFilename, indexFilename.c_str(), dictionary))
+	{
+		delete model;
+		return false;
+	}
+	MeCab::Tagger* tagger = model->createTagger();
+	MeCab::Lattice* lattice = model->createLattice();
+
+	const std::string text = makeSyntheticText(1024 * 1024);
+	const char* textEnd = text.data() + text.size();
+	std::cout << "Text analysis (" << text.size() / 1024 << " KB of fixed text, looked up in "
+	          << inputName << ")\n";
+	resultGroup = std::string(inputName) + "/textAnalysis";
+
+	bool succeeded = true;
+	size_t numTokens = 0;
+	float mecabTime = timeBestOfMilliseconds(3, [&]() {
+		numTokens = 0;
+		const char* sentence = text.data();
+		while (sentence < textEnd)
+		{
+			const char* sentenceEnd = findSentenceEnd(sentence, textEnd);
+			lattice->set_sentence(sentence, sentenceEnd - sentence);
+			succeeded &= tagger->parse(lattice);
+			for (const MeCab::Node* node = lattice->bos_node(); node; node = node->next)
+			{
+				if (node->stat != MECAB_BOS_NODE && node->stat != MECAB_EOS_NODE)
+					++numTokens;
+			}
+			sentence = sentenceEnd;
+		}
+	});
+	std::cout << "\tMeCab: " << mecabTime << " ms, " << numTokens / (mecabTime / 1000.f)
+	          << " tokens/second\n";
+	recordResult("MeCab", mecabTime, numTokens, "tokens");
+
+	// Surfaces point into text, so they stay valid after the lattice moves on. Features might not,
+	// so base forms and readings are copied into wordPool
+	std::vector<DictionaryKey> tokens;
+	std::vector<DictionaryWord> words;
+	std::string wordPool;
+	std::vector<size_t> wordPoolOffsets;
+	std::vector<size_t> sentenceEnds;
+	for (const char* sentence = text.data(); sentence < textEnd;)
+	{
+		const char* sentenceEnd = findSentenceEnd(sentence, textEnd);
+		lattice->set_sentence(sentence, sentenceEnd - sentence);
+		succeeded &= tagger->parse(lattice);
+		for (const MeCab::Node* node = lattice->bos_node(); node; node = node->next)
+		{
+			if (node->stat == MECAB_BOS_NODE || node->stat == MECAB_EOS_NODE)
+				continue;
+			DictionaryKey token;
+			token.data = node->surface;
+			token.length = node->length;
+			tokens.push_back(token);
+
+			DictionaryWord word = getTokenDictionaryWord(*node);
+			wordPoolOffsets.push_back(wordPool.size());
+			wordPool.append(word.baseForm ? word.baseForm : "", word.baseFormLength);
+			wordPool.append(word.reading ? word.reading : "", word.readingLength);
+			words.push_back(word);
+		}
+		sentenceEnds.push_back(tokens.size());
+		sentence = sentenceEnd;
+	}
+	for (size_t i = 0; i < words.size(); ++i)
+	{
+		words[i].baseForm = wordPool.data() + wordPoolOffsets[i];
+		words[i].reading = words[i].baseForm + words[i].baseFormLength;
+	}
+
+	size_t numEntryBytes = 0;
+	float singleLookupTime = timeBestOfMilliseconds(5, [&]() {
+		numEntryBytes = 0;
+		for (const DictionaryKey& token : tokens)
+		{
+			const char* entry = findDictionaryLookupEntry(dictionary, token.data, token.length);
+			if (entry)
+				numEntryBytes += getDictionaryLookupEntryLength(dictionary, entry);
+		}
+	});
+	std::cout << "\ttoken lookup, one at a time: " << singleLookupTime << " ms, "
+	          << tokens.size() / (singleLookupTime / 1000.f) << " tokens/second\n";
+	recordResult("token lookup, one at a time", singleLookupTime, tokens.size(), "tokens");
+
+	const size_t expectedEntryBytes = numEntryBytes;
+	std::vector<DictionaryEntryView> entries(tokens.size());
+	float batchLookupTime = timeBestOfMilliseconds(5, [&]() {
+		numEntryBytes = 0;
+		size_t sentenceStart = 0;
+		for (size_t sentenceEnd : sentenceEnds)
+		{
+			findDictionaryLookupEntries(dictionary, &tokens[sentenceStart],
+			                            sentenceEnd - sentenceStart, &entries[sentenceStart]);
+			for (size_t i = sentenceStart; i < sentenceEnd; ++i)
+				numEntryBytes += entries[i].length;
+			sentenceStart = sentenceEnd;
+		}
+	});
+	std::cout << "\ttoken lookup, by sentence: " << batchLookupTime << " ms, "
+	          << tokens.size() / (batchLookupTime / 1000.f) << " tokens/second\n";
+	recordResult("token lookup, by sentence", batchLookupTime, tokens.size(), "tokens");
+	if (numEntryBytes != expectedEntryBytes)
+	{
+		std::cerr << "Error: looking up by sentence found " << numEntryBytes
+		          << " bytes of entries, expected " << expectedEntryBytes << "\n";
+		succeeded = false;
+	}
+
+	// Lemmas, with readings to pick between entries, which is what analyzeDocument() looks up
+	const size_t maxEntriesPerWord = 8;
+	DictionaryEntryView wordEntries[maxEntriesPerWord];
+	size_t numWordEntries = 0;
+	float wordLookupTime = timeBestOfMilliseconds(5, [&]() {
+		numWordEntries = 0;
+		for (const DictionaryWord& word : words)
+			numWordEntries +=
+			    findDictionaryLookupWordEntries(dictionary, word, wordEntries, maxEntriesPerWord);
+	});
+	std::cout << "\tword lookup, one at a time: " << wordLookupTime << " ms, "
+	          << words.size() / (wordLookupTime / 1000.f) << " tokens/second, " << numWordEntries
+	          << " entries\n";
+	recordResult("word lookup, one at a time", wordLookupTime, words.size(), "tokens");
+
+	size_t numWordHits = 0;
+	float wordBatchLookupTime = timeBestOfMilliseconds(5, [&]() {
+		numWordHits = 0;
+		size_t sentenceStart = 0;
+		for (size_t sentenceEnd : sentenceEnds)
+		{
+			findDictionaryLookupWordEntries(dictionary, &words[sentenceStart],
+			                                sentenceEnd - sentenceStart, &entries[sentenceStart]);
+			for (size_t i = sentenceStart; i < sentenceEnd; ++i)
+				numWordHits += entries[i].data ? 1 : 0;
+			sentenceStart = sentenceEnd;
+		}
+	});
+	std::cout << "\tword lookup, by sentence: " << wordBatchLookupTime << " ms, "
+	          << words.size() / (wordBatchLookupTime / 1000.f) << " tokens/second, "
+	          << numWordHits << " hits\n";
+	recordResult("word lookup, by sentence", wordBatchLookupTime, words.size(), "tokens");
+
+	rapidjson::StringBuffer output;
+	DocumentAnalysisStats stats;
+	float analysisTime = timeBestOfMilliseconds(3, [&]() {
+		output.Clear();
+		stats = DocumentAnalysisStats();
+		succeeded &= analyzeDocument(*tagger, *lattice, dictionary, nullptr, "synthetic",
+		                             text.data(), text.size(), output, stats);
+	});
+	std::cout << "\tanalyzeDocument: " << analysisTime << " ms, "
+	          << stats.numTokens / (analysisTime / 1000.f) << " tokens/second, "
+	          << stats.numDictionaryHits << " dictionary hits\n";
+	recordResult("analyzeDocument", analysisTime, stats.numTokens, "tokens");
+
+	// A re-run over the same document with --cache: hash it, then write it from the tokens the
+	// last run saved, without MeCab. Must write exactly what analyzeDocument() did
+	const std::string expectedOutput(output.GetString(), output.GetSize());
+	DocumentTokens documentTokens;
+	succeeded &= tokenizeDocument(*tagger, *lattice, dictionary, "synthetic", text.data(),
+	                              text.size(), documentTokens);
+	std::string cacheFilename;
+	AnalysisCacheFileWriter cacheWriter;
+	if (writeTemporaryFile("", cacheFilename) &&
+	    beginAnalysisCacheFile(cacheFilename.c_str(), 0, 0, cacheWriter))
+	{
+		uint64_t textHash = hashDocumentText(text.data(), text.size());
+		writeAnalysisCacheFileDocument(cacheWriter, textHash, text.size(), documentTokens);
+		AnalysisCache cache;
+		if (endAnalysisCacheFile(cacheWriter) &&
+		    openAnalysisCache(cacheFilename.c_str(), 0, 0, cache))
+		{
+			float hashTime = timeBestOfMilliseconds(
+			    5, [&]() { textHash = hashDocumentText(text.data(), text.size()); });
+			printResult("hashDocumentText", hashTime, text.size());
+
+			float cachedAnalysisTime = timeBestOfMilliseconds(3, [&]() {
+				output.Clear();
+				stats = DocumentAnalysisStats();
+				succeeded &= findAnalysisCacheDocument(
+				    cache, hashDocumentText(text.data(), text.size()), text.size(), documentTokens);
+				writeDocumentTokens(dictionary, nullptr, "synthetic", text.data(), text.size(),
+				                    documentTokens, output, stats);
+			});
+			std::cout << "\tanalyzeDocument, cached: " << cachedAnalysisTime << " ms, "
+			          << stats.numTokens / (cachedAnalysisTime / 1000.f) << " tokens/second, "
+			          << cacheWriter.numDocuments << " document of " << cache.file.size
+			          << " bytes cached\n";
+			recordResult("analyzeDocument, cached", cachedAnalysisTime, stats.numTokens,
+			             "tokens");
+			if (expectedOutput != std::string(output.GetString(), output.GetSize()))
+			{
+				std::cerr << "Error: the cached document's output differs from "
+				             "analyzeDocument()'s\n";
+				succeeded = false;
+			}
+			closeAnalysisCache(cache);
+		}
+		else
+			succeeded = false;
+	}
+	else
+		succeeded = false;
+	std::remove(cacheFilename.c_str());
+
+	delete lattice;
+	delete tagger;
+	delete model;
+	closeDictionaryLookup(dictionary);
+	return succeeded;
+}
+
+//
+// Parallel tokenization
+//
+
+static bool benchmarkAnalysisScaling(const char* dictionaryFilename, const char* corpusDirectory)
+{
+	std::vector<std::string> documents;
+	if (!addDocumentsFromPath(corpusDirectory, documents))
+		return false;
+
+	DictionaryLookup dictionary;
+	std::string indexFilename = std::string(dictionaryFilename) + ".index";
+	if (!openDictionaryLookup(dictionaryFilename, indexFilename.c_str(), dictionary))
+		return false;
+	MeCab::Model* model = MeCab::createModel("");
+	if (!model)
+	{
+		std::cerr << "Error: could not create MeCab model: " << MeCab::getLastError() << "\n";
+		closeDictionaryLookup(dictionary);
+		return false;
+	}
+
+	// Output is thrown away; only analysis should be measured
+	std::ostream discardOutput(nullptr);
+
+	std::cout << "Analysis scaling (" << documents.size() << " documents from '"
+	          << corpusDirectory << "')\n";
+	resultGroup = "corpus/analysisScaling";
+	float singleThreadTime = 0.f;
+	const unsigned int maxThreads = std::max(16u, std::thread::hardware_concurrency());
+	for (unsigned int numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+	{
+		DocumentAnalysisStats stats;
+		float analysisTime = timeBestOfMilliseconds(3, [&]() {
+			AnalysisPool analysisPool(*model, dictionary, discardOutput, numThreads);
+			for (const std::string& document : documents)
+				analysisPool.submitFile(document);
+			analysisPool.finish();
+			stats = analysisPool.getStats();
+		});
+		if (numThreads == 1)
+			singleThreadTime = analysisTime;
+
+		std::cout << "\t" << numThreads << " threads: " << analysisTime << " ms, "
+		          << stats.numTokens / (analysisTime / 1000.f) << " tokens/second, "
+		          << singleThreadTime / analysisTime << "x speedup\n";
+		recordResult(std::to_string(numThreads) + " threads", analysisTime, stats.numTokens,
+		             "tokens");
+	}
+
+	delete model;
+	closeDictionaryLookup(dictionary);
+	return true;
+}
+
+//
+// AnkiConnect
+//
+
+static std::string makeIdsRequest(const char* action, const char* idsName,
+                                  const std::vector<int64_t>& ids, size_t chunkStart,
+                                  size_t chunkSize)
+{
+	rapidjson::StringBuffer jsonString;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(jsonString);
+	writer.StartObject();
+	writer.Key("action");
+	writer.String(action);
+	writer.Key("version");
+	writer.Int(6);
+	writer.Key("params");
+	writer.StartObject();
+	writer.Key(idsName);
+	writer.StartArray();
+	for (size_t i = chunkStart; i < chunkStart + chunkSize; ++i)
+		writer.Int64(ids[i]);
+	writer.EndArray();
+	writer.EndObject();
+	writer.EndObject();
+	return std::string(jsonString.GetString(), jsonString.GetSize());
+}
+
+static void queueIdsRequest(AnkiConnectBatch& batch, const char* action, const char* idsName,
+                            const std::vector<int64_t>& ids, size_t chunkStart, size_t chunkSize,
+                            AnkiConnectCallback callback)
+{
+	std::string request = makeIdsRequest(action, idsName, ids, chunkStart, chunkSize);
+	batch.queue(request.c_str(), request.size(), std::move(callback));
+}
+
+static void getIds(bool succeeded, const rapidjson::Value& result, std::vector<int64_t>& idsOut)
+{
+	idsOut.clear();
+	if (!succeeded || !result.IsArray())
+		return;
+	for (rapidjson::SizeType i = 0; i < result.Size(); ++i)
+		idsOut.push_back(result[i].GetInt64());
+}
+
+// Everything the pacer and known words sync ask for when starting up. Actions which don't depend
+// on each other go in the same batch. maxActions = 1 sends every action on its own
+static bool refreshFromAnki(AnkiConnectClient& ankiConnect, size_t maxActions,
+                            size_t& numCardsOut)
+{
+	bool succeeded = true;
+	std::vector<int64_t> dueCardIds;
+	std::vector<int64_t> noteIds;
+	AnkiConnectCallback ignoreResult = [&succeeded](bool actionSucceeded,
+	                                                const rapidjson::Value&) {
+		succeeded &= actionSucceeded;
+	};
+	{
+		AnkiConnectBatch batch(ankiConnect, maxActions);
+		batch.queue("{\"action\": \"sync\", \"version\": 6}", ignoreResult);
+		batch.queue("{\"action\": \"deckNames\", \"version\": 6}", ignoreResult);
+		batch.queue(
+		    "{\"action\": \"findCards\", \"version\": 6, \"params\": {\"query\": \"is:due\"}}",
+		    [&](bool actionSucceeded, const rapidjson::Value& result) {
+			    getIds(actionSucceeded, result, dueCardIds);
+		    });
+		batch.queue(
+		    "{\"action\": \"findNotes\", \"version\": 6, \"params\": {\"query\": \"deck:*\"}}",
+		    [&](bool actionSucceeded, const rapidjson::Value& result) {
+			    getIds(actionSucceeded, result, noteIds);
+		    });
+		succeeded &= batch.flush();
+	}
+
+	numCardsOut = 0;
+	AnkiConnectBatch batch(ankiConnect, maxActions);
+	const size_t cardsPerRequest = 50;
+	for (size_t i = 0; i < dueCardIds.size(); i += cardsPerRequest)
+	{
+		queueIdsRequest(batch, "cardsInfo", "cards", dueCardIds, i,
+		                std::min(cardsPerRequest, dueCardIds.size() - i),
+		                [&](bool actionSucceeded, const rapidjson::Value& result) {
+			                succeeded &= actionSucceeded;
+			                if (actionSucceeded && result.IsArray())
+				                numCardsOut += result.Size();
+		                });
+	}
+	const size_t notesPerRequest = 1000;
+	for (size_t i = 0; i < noteIds.size(); i += notesPerRequest)
+	{
+		queueIdsRequest(batch, "notesModTime", "notes", noteIds, i,
+		                std::min(notesPerRequest, noteIds.size() - i), ignoreResult);
+	}
+	succeeded &= batch.flush();
+	return succeeded;
+}
+
+static void printCardsLoadingResult(const char* name, float firstCardTime, float allCardsTime,
+                                    size_t numCards)
+{
+	std::cout << "\t" << name << ": first card after " << firstCardTime << " ms, all " << numCards
+	          << " after " << allCardsTime << " ms\n";
+	recordResult(std::string(name) + "/first card", firstCardTime, 1, "cards");
+	recordResult(std::string(name) + "/all cards", allCardsTime, numCards, "cards");
+}
+
+// How long it takes before the pacer can show the first due card, and before every card is loaded
+static bool benchmarkCardsInfoLoading(AnkiConnectClient& ankiConnect, const char* ankiConnectURL)
+{
+	rapidjson::Document response;
+	std::vector<int64_t> dueCardIds;
+	if (!ankiConnect.request(
+	        "{\"action\": \"findCards\", \"version\": 6, \"params\": {\"query\": \"is:due\"}}",
+	        response))
+		return false;
+	getIds(true, response["result"], dueCardIds);
+	std::cout << "cardsInfo loading (" << dueCardIds.size() << " due cards)\n";
+	resultGroup = "anki/cardsInfoLoading";
+
+	bool succeeded = true;
+	size_t numCards = 0;
+	float allCardsTime = timeBestOfMilliseconds(3, [&]() {
+		std::string request =
+		    makeIdsRequest("cardsInfo", "cards", dueCardIds, 0, dueCardIds.size());
+		rapidjson::Document cardsInfo;
+		succeeded &= ankiConnect.request(request.c_str(), cardsInfo);
+		numCards = succeeded ? cardsInfo["result"].Size() : 0;
+	});
+	printCardsLoadingResult("one request", allCardsTime, allCardsTime, numCards);
+
+	const size_t cardsPerRequest = 50;
+	const unsigned int connectionCounts[] = {1, 2, 4, 8};
+	for (unsigned int numConnections : connectionCounts)
+	{
+		float firstCardTime = 0.f;
+		allCardsTime = timeBestOfMilliseconds(3, [&]() {
+			std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+			AnkiConnectPipeline pipeline(ankiConnectURL, numConnections);
+			numCards = 0;
+			for (size_t i = 0; i < dueCardIds.size(); i += cardsPerRequest)
+			{
+				size_t chunkSize = std::min(cardsPerRequest, dueCardIds.size() - i);
+				pipeline.queue(makeIdsRequest("cardsInfo", "cards", dueCardIds, i, chunkSize),
+				               [&](bool chunkSucceeded, const rapidjson::Value& cardsInfo) {
+					               succeeded &= chunkSucceeded;
+					               if (!chunkSucceeded || !cardsInfo.IsArray())
+						               return;
+					               if (!numCards)
+					               {
+						               std::chrono::duration<float, std::milli> time =
+						                   std::chrono::steady_clock::now() - startTime;
+						               firstCardTime = time.count();
+					               }
+					               numCards += cardsInfo.Size();
+				               });
+			}
+			pipeline.finish();
+		});
+		std::string name = "chunks of " + std::to_string(cardsPerRequest) + " over " +
+		                   std::to_string(numConnections) + " connections";
+		printCardsLoadingResult(name.c_str(), firstCardTime, allCardsTime, numCards);
+	}
+	return succeeded;
+}
+
+// Looks like what cardsInfo returns for "A Frequency Dictionary of Japanese Words" cards, including
+// the rendered question and answer HTML the pacer never reads
+static std::string makeCardsInfoResponse(size_t numCards)
+{
+	const char* lemmas[] = {"食べる", "飲む", "読む", "書く", "見る", "行く", "来る", "日本"};
+	const char* glosses[] = {"to eat", "to drink", "to read", "to write",
+	                         "to see", "to go",    "to come", "Japan"};
+	const size_t numWords = sizeof(lemmas) / sizeof(lemmas[0]);
+	rapidjson::StringBuffer jsonString;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(jsonString);
+	writer.StartObject();
+	writer.Key("result");
+	writer.StartArray();
+	for (size_t i = 0; i < numCards; ++i)
+	{
+		std::string lemma = lemmas[i % numWords] + std::to_string(i);
+		std::string html = "<style>.card { font-family: arial; font-size: 20px; text-align: "
+		                   "center; }</style><div class=\"lemma\">" +
+		                   lemma + "</div><hr id=answer><div class=\"gloss\">" +
+		                   glosses[i % numWords] + "</div>";
+		writer.StartObject();
+		writer.Key("answer");
+		writer.String(html.c_str());
+		writer.Key("question");
+		writer.String(html.c_str());
+		writer.Key("deckName");
+		writer.String("Japanese");
+		writer.Key("modelName");
+		writer.String("Japanese Frequency");
+		writer.Key("fieldOrder");
+		writer.Int(static_cast<int>(i % 2));
+		writer.Key("fields");
+		writer.StartObject();
+		writer.Key("Lemma");
+		writer.StartObject();
+		writer.Key("value");
+		writer.String(lemma.c_str());
+		writer.Key("order");
+		writer.Int(0);
+		writer.EndObject();
+		writer.Key("English Gloss");
+		writer.StartObject();
+		writer.Key("value");
+		writer.String(glosses[i % numWords]);
+		writer.Key("order");
+		writer.Int(1);
+		writer.EndObject();
+		writer.EndObject();
+		writer.Key("css");
+		writer.String(".card { font-family: arial; font-size: 20px; }");
+		writer.Key("cardId");
+		writer.Int64(1500000000001 + static_cast<int64_t>(i) * 2);
+		writer.Key("interval");
+		writer.Int(static_cast<int>(i % 100));
+		writer.Key("note");
+		writer.Int64(1500000000000 + static_cast<int64_t>(i) * 2);
+		writer.Key("ord");
+		writer.Int(0);
+		writer.Key("type");
+		writer.Int(2);
+		writer.Key("queue");
+		writer.Int(2);
+		writer.Key("due");
+		writer.Int(100);
+		writer.Key("reps");
+		writer.Int(5);
+		writer.Key("lapses");
+		writer.Int(0);
+		writer.Key("left");
+		writer.Int(0);
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.Key("error");
+	writer.Null();
+	writer.EndObject();
+	return std::string(jsonString.GetString(), jsonString.GetSize());
+}
+
+typedef rapidjson::GenericDocument<rapidjson::UTF8<>,
+                                   rapidjson::MemoryPoolAllocator<CountingAllocator>,
+                                   CountingAllocator>
+    CountingDocument;
+
+// How the pacer used to read cardsInfo: parse the whole response into a DOM, then copy out each
+// card's quiz word
+static size_t parseCardsInfoDOM(const std::string& response, std::vector<std::string>& quizWords)
+{
+	CountingDocument document;
+	document.Parse(response.c_str());
+	if (document.HasParseError() || !document.IsObject() || !document["result"].IsArray())
+		return 0;
+	const CountingDocument::ValueType& cards = document["result"];
+	quizWords.assign(cards.Size(), std::string());
+	for (rapidjson::SizeType i = 0; i < cards.Size(); ++i)
+	{
+		const CountingDocument::ValueType& fields = cards[i]["fields"];
+		if (cards[i]["fieldOrder"].GetInt() == 1)
+			quizWords[i] = fields["English Gloss"]["value"].GetString();
+		else
+			quizWords[i] = fields["Lemma"]["value"].GetString();
+	}
+	return cards.Size();
+}
+
+static bool benchmarkCardsInfoParsing()
+{
+	const size_t numCards = 10000;
+	std::string response = makeCardsInfoResponse(numCards);
+	std::cout << "cardsInfo parsing (" << numCards << " synthetic cards, "
+	          << response.size() / 1024 << " KB)\n";
+	resultGroup = "synthetic/cardsInfoParsing";
+
+	std::vector<std::string> quizWords;
+	size_t numParsed = 0;
+	size_t allocationsBefore = numAllocations.load(std::memory_order_relaxed);
+	float domTime = timeBestOfMilliseconds(5, [&]() {
+		quizWords.clear();
+		quizWords.shrink_to_fit();
+		numParsed = parseCardsInfoDOM(response, quizWords);
+	});
+	size_t domAllocations = (numAllocations.load(std::memory_order_relaxed) - allocationsBefore) / 5;
+	std::cout << "\tDOM: " << domTime << " ms, " << domAllocations << " allocations, " << numParsed
+	          << " cards\n";
+	recordResult("DOM", domTime, numParsed, "cards", static_cast<int64_t>(domAllocations));
+
+	// In-place parsing overwrites the response, so every run parses a fresh copy. The copy is
+	// timed too, since the pacer parses straight out of the receive buffer instead
+	std::string responseCopy;
+	responseCopy.reserve(response.size());
+	DueCards dueCards;
+	bool succeeded = true;
+	allocationsBefore = numAllocations.load(std::memory_order_relaxed);
+	float saxTime = timeBestOfMilliseconds(5, [&]() {
+		responseCopy.assign(response);
+		dueCards.reset(numCards);
+		succeeded &= parseCardsInfoResponse(&responseCopy[0], 0, numCards, dueCards);
+	});
+	size_t saxAllocations = (numAllocations.load(std::memory_order_relaxed) - allocationsBefore) / 5;
+	numParsed = std::count(dueCards.isLoaded.begin(), dueCards.isLoaded.end(), 1);
+	std::cout << "\tSAX in place: " << saxTime << " ms, " << saxAllocations << " allocations, "
+	          << numParsed << " cards, " << dueCards.strings.getNumStrings()
+	          << " distinct strings (" << dueCards.strings.bytesAllocated() << " bytes)\n";
+	recordResult("SAX in place", saxTime, numParsed, "cards", static_cast<int64_t>(saxAllocations));
+
+	for (size_t i = 0; i < numCards && succeeded; ++i)
+	{
+		if (quizWords[i] != dueCards.getQuizWord(i))
+		{
+			std::cerr << "Error: card " << i << " parsed as " << dueCards.getQuizWord(i)
+			          << " instead of " << quizWords[i] << "\n";
+			succeeded = false;
+		}
+	}
+	return succeeded && numParsed == numCards;
+}
+
+static bool benchmarkAnkiConnect(const char* ankiConnectURL)
+{
+	curl_global_init(CURL_GLOBAL_ALL);
+	bool succeeded = true;
+	{
+		AnkiConnectClient ankiConnect(ankiConnectURL);
+		std::cout << "AnkiConnect refresh from " << ankiConnectURL << "\n";
+		resultGroup = "anki/refresh";
+		const size_t batchSizes[] = {1, 4, 16, 64};
+		for (size_t maxActions : batchSizes)
+		{
+			size_t numCards = 0;
+			size_t numRequestsBefore = ankiConnect.getStats().numRequests;
+			float refreshTime = timeBestOfMilliseconds(3, [&]() {
+				succeeded &= refreshFromAnki(ankiConnect, maxActions, numCards);
+			});
+			size_t numRequests = (ankiConnect.getStats().numRequests - numRequestsBefore) / 3;
+			std::cout << "\t" << (maxActions == 1 ? "unbatched" : "multi") << " (up to "
+			          << maxActions << " actions per request): " << refreshTime << " ms, "
+			          << numRequests << " requests, " << numCards << " due cards\n";
+			recordResult("up to " + std::to_string(maxActions) + " actions per request",
+			             refreshTime, numRequests, "requests");
+		}
+		succeeded &= benchmarkCardsInfoLoading(ankiConnect, ankiConnectURL);
+		printAnkiConnectStats(ankiConnect.getStats());
+	}
+	curl_global_cleanup();
+	return succeeded;
+}
+
+static void printUsage()
+{
+	std::cerr << "Usage: bench [--dictionary file] [--corpus directory] [--anki url] [--results "
+	             "file]\n"
+	             "Always benchmarks fixed synthetic inputs. Real inputs are benchmarked too when "
+	             "available.\n"
+	             "\t--dictionary file    EDICT2 to benchmark loading and lookup (default "
+	             "data/utf8Edict2,\n"
+	             "\t                     skipped if it doesn't exist)\n"
+	             "\t--corpus directory   Documents to benchmark analysis with. Skipped if not "
+	             "given\n"
+	             "\t--anki url           Benchmark batching requests to AnkiConnect at url, e.g. "
+	             "AnkiConnectStub.py\n"
+	             "\t                     --latency 20 listening on http://localhost:8765\n"
+	             "\t--results file       Also write every result to file as JSON, for comparing "
+	             "runs\n";
+}
+
+// Both synthetic and real: the synthetic ones are the same everywhere, so regressions show up
+// between runs and machines; the real ones are what actually matters
+static bool benchmarkDictionary(const char* dictionaryFilename, const char* inputName)
+{
+	bool succeeded = benchmarkDictionaryScanning(dictionaryFilename, inputName);
+	succeeded &= benchmarkDictionaryLookup(dictionaryFilename, inputName);
+	succeeded &= benchmarkDictionaryEntries(dictionaryFilename, inputName);
+	succeeded &= benchmarkTextAnalysis(dictionaryFilename, inputName);
+	return succeeded;
+}
+
+int main(int argc, char** argv)
+{
+	const char* dictionaryFilename = "data/utf8Edict2";
+	bool isDictionaryRequired = false;
+	const char* corpusDirectory = nullptr;
+	const char* ankiConnectURL = nullptr;
+	const char* resultsFilename = nullptr;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--dictionary") == 0 && i + 1 < argc)
+		{
+			dictionaryFilename = argv[++i];
+			isDictionaryRequired = true;
+		}
+		else if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc)
+			corpusDirectory = argv[++i];
+		else if (strcmp(argv[i], "--anki") == 0 && i + 1 < argc)
+			ankiConnectURL = argv[++i];
+		else if (strcmp(argv[i], "--results") == 0 && i + 1 < argc)
+			resultsFilename = argv[++i];
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+#ifndef NDEBUG
+	std::cerr << "Warning: this is not a release build, so timings are much slower than they "
+	             "should be. Build with Build_Release.sh\n";
+#endif
+
+	bool succeeded = true;
+	std::string syntheticDictionaryFilename;
+	if (writeTemporaryFile(makeSyntheticEdict2(200000), syntheticDictionaryFilename))
+	{
+		succeeded &= benchmarkDictionary(syntheticDictionaryFilename.c_str(), "synthetic");
+		std::remove(syntheticDictionaryFilename.c_str());
+	}
+	else
+		succeeded = false;
+
+	if (access(dictionaryFilename, R_OK) == 0)
+		succeeded &= benchmarkDictionary(dictionaryFilename, "edict2");
+	else if (isDictionaryRequired)
+	{
+		std::cerr << "Error: could not open '" << dictionaryFilename << "'\n";
+		succeeded = false;
+	}
+	else
+		std::cout << "Skipping EDICT2 (no " << dictionaryFilename << ")\n";
+
+	succeeded &= benchmarkCardsInfoParsing();
+	if (corpusDirectory)
+		succeeded &= benchmarkAnalysisScaling(dictionaryFilename, corpusDirectory);
+	if (ankiConnectURL)
+		succeeded &= benchmarkAnkiConnect(ankiConnectURL);
+
+	if (resultsFilename)
+		succeeded &= writeResults(resultsFilename);
+	return succeeded ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+#include "CardCacheFile.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "MappedFile.hpp"
+
+bool loadCardCacheFile(const char* filename, CardCache& cardCacheOut,
+                       std::vector<int64_t>& dueCardIdsOut, int64_t& savedTimeOut)
+{
+	MappedFile file;
+	if (!mapFile(filename, file))
+		return false;
+
+	const CardCacheFileHeader* header = reinterpret_cast<const CardCacheFileHeader*>(file.data);
+	bool isValid =
+	    file.size >= sizeof(CardCacheFileHeader) &&
+	    std::memcmp(header->magic, cardCacheFileMagic, sizeof(header->magic)) == 0 &&
+	    header->version == cardCacheFileVersion &&
+	    isSectionInFile(file, header->cardsOffset, header->numCards, sizeof(CardCacheFileCard)) &&
+	    isSectionInFile(file, header->dueCardIdsOffset, header->numDueCards, sizeof(int64_t)) &&
+	    isSectionInFile(file, header->stringsOffset, header->stringsSize, 1) &&
+	    header->stringsSize &&
+	    file.data[header->stringsOffset + header->stringsSize - 1] == '\0';
+	if (!isValid)
+	{
+		std::cerr << "Warning: card cache '" << filename
+		          << "' is invalid or from an old version. It will be rebuilt\n";
+		unmapFile(file);
+		return false;
+	}
+
+	const CardCacheFileCard* cards =
+	    reinterpret_cast<const CardCacheFileCard*>(file.data + header->cardsOffset);
+	const char* strings = file.data + header->stringsOffset;
+	for (uint32_t i = 0; i < header->numCards; ++i)
+	{
+		if (cards[i].quizWordOffset >= header->stringsSize ||
+		    cards[i].modelNameOffset >= header->stringsSize)
+		{
+			std::cerr << "Warning: card cache '" << filename << "' is corrupt\n";
+			unmapFile(file);
+			return false;
+		}
+	}
+
+	std::vector<int64_t> cardIds(header->numCards);
+	for (uint32_t i = 0; i < header->numCards; ++i)
+		cardIds[i] = cards[i].cardId;
+	size_t firstCard = 0;
+	cardCacheOut.add(cardIds.data(), cardIds.size(), firstCard);
+	DueCards& dueCards = cardCacheOut.getCards();
+	for (uint32_t i = 0; i < header->numCards; ++i)
+	{
+		const CardCacheFileCard& cachedCard = cards[i];
+		const char* quizWord = strings + cachedCard.quizWordOffset;
+		const char* modelName = strings + cachedCard.modelNameOffset;
+		size_t card = firstCard + i;
+		dueCards.noteIds[card] = cachedCard.noteId;
+		dueCards.modifiedTimes[card] = cachedCard.modifiedTime;
+		dueCards.loadedTimes[card] = cachedCard.loadedTime;
+		dueCards.intervals[card] = cachedCard.interval;
+		dueCards.fieldOrders[card] = cachedCard.fieldOrder;
+		dueCards.quizWords[card] =
+		    dueCards.strings.intern(quizWord, static_cast<uint32_t>(std::strlen(quizWord)));
+		dueCards.modelNames[card] =
+		    dueCards.strings.intern(modelName, static_cast<uint32_t>(std::strlen(modelName)));
+		dueCards.isLoaded[card] = true;
+	}
+
+	const int64_t* dueCardIds =
+	    reinterpret_cast<const int64_t*>(file.data + header->dueCardIdsOffset);
+	dueCardIdsOut.assign(dueCardIds, dueCardIds + header->numDueCards);
+	savedTimeOut = header->savedTime;
+	unmapFile(file);
+	return true;
+}
+
+bool saveCardCacheFile(const CardCache& cardCache, const std::vector<int64_t>& dueCardIds,
+                       const char* filename)
+{
+	const DueCards& dueCards = cardCache.getCards();
+
+	// The whole string pool goes in as-is, so cards can point at the same offsets
+	std::vector<uint32_t> stringOffsets(dueCards.strings.getNumStrings());
+	uint64_t stringsSize = 0;
+	for (size_t i = 0; i < stringOffsets.size(); ++i)
+	{
+		stringOffsets[i] = static_cast<uint32_t>(stringsSize);
+		stringsSize += std::strlen(dueCards.strings.get(static_cast<uint32_t>(i))) + 1;
+	}
+
+	std::vector<CardCacheFileCard> cards;
+	for (size_t card = 0; card < dueCards.size(); ++card)
+	{
+		// Forgotten cards are left behind in the cache, and have been replaced by a newer copy
+		size_t cachedCard = 0;
+		if (!dueCards.isLoaded[card] || !cardCache.find(dueCards.cardIds[card], cachedCard) ||
+		    cachedCard != card)
+			continue;
+		CardCacheFileCard cachedCardOut;
+		std::memset(&cachedCardOut, 0, sizeof(cachedCardOut));
+		cachedCardOut.cardId = dueCards.cardIds[card];
+		cachedCardOut.noteId = dueCards.noteIds[card];
+		cachedCardOut.modifiedTime = dueCards.modifiedTimes[card];
+		cachedCardOut.loadedTime = dueCards.loadedTimes[card];
+		cachedCardOut.interval = dueCards.intervals[card];
+		cachedCardOut.quizWordOffset = stringOffsets[dueCards.quizWords[card]];
+		cachedCardOut.modelNameOffset = stringOffsets[dueCards.modelNames[card]];
+		cachedCardOut.fieldOrder = dueCards.fieldOrders[card];
+		cards.push_back(cachedCardOut);
+	}
+
+	CardCacheFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, cardCacheFileMagic, sizeof(header.magic));
+	header.version = cardCacheFileVersion;
+	header.numCards = static_cast<uint32_t>(cards.size());
+	header.numDueCards = static_cast<uint32_t>(dueCardIds.size());
+	header.savedTime = static_cast<int64_t>(std::time(nullptr));
+	header.cardsOffset = sizeof(CardCacheFileHeader);
+	header.dueCardIdsOffset = header.cardsOffset + cards.size() * sizeof(CardCacheFileCard);
+	header.stringsOffset = header.dueCardIdsOffset + dueCardIds.size() * sizeof(int64_t);
+	header.stringsSize = stringsSize;
+
+	// Write next to the old cache and swap it in, so a failed write never loses the old one
+	std::string temporaryFilename = std::string(filename) + ".tmp";
+	std::ofstream outputFile;
+	outputFile.open(temporaryFilename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!outputFile.is_open())
+	{
+		std::cerr << "Error: could not open '" << temporaryFilename << "' for writing\n";
+		return false;
+	}
+	outputFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	outputFile.write(reinterpret_cast<const char*>(cards.data()),
+	                 cards.size() * sizeof(CardCacheFileCard));
+	outputFile.write(reinterpret_cast<const char*>(dueCardIds.data()),
+	                 dueCardIds.size() * sizeof(int64_t));
+	for (size_t i = 0; i < stringOffsets.size(); ++i)
+	{
+		const char* string = dueCards.strings.get(static_cast<uint32_t>(i));
+		outputFile.write(string, std::strlen(string) + 1);
+	}
+	outputFile.close();
+
+	if (!outputFile || std::rename(temporaryFilename.c_str(), filename) != 0)
+	{
+		std::cerr << "Error: failed while writing '" << filename << "'\n";
+		return false;
+	}
+	return true;
+}
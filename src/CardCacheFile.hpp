@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "DueCards.hpp"
+
+// The pacer's cards saved between runs, so it can start presenting cards straight away and sync
+// with Anki in the background. Each card is tagged with Anki's modification time and when it was
+// loaded, so cards (or their notes) which changed since they were cached can be found and fetched
+// again.
+//
+// Layout (native-endian, like the dictionary index). Mapped rather than read:
+//   CardCacheFileHeader
+//   CardCacheFileCard cards[numCards]
+//   int64_t dueCardIds[numDueCards]  The due cards when the cache was saved, in order
+//   char strings[stringsSize]        Null-terminated. Cards point at these by offset
+
+// Bump this whenever the layout changes. Old caches are then ignored and rebuilt
+static const uint32_t cardCacheFileVersion = 1;
+static const char cardCacheFileMagic[8] = {'J', 'F', 'M', 'C', 'A', 'R', 'D', 'S'};
+
+struct CardCacheFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t numCards;
+	uint32_t numDueCards;
+	uint32_t reserved;
+	// Seconds since the epoch. Due cards change every day, so the due card list is only worth
+	// using the same day it was saved
+	int64_t savedTime;
+
+	uint64_t cardsOffset;
+	uint64_t dueCardIdsOffset;
+	uint64_t stringsOffset;
+	uint64_t stringsSize;
+};
+
+struct CardCacheFileCard
+{
+	int64_t cardId;
+	int64_t noteId;
+	int64_t modifiedTime;
+	int64_t loadedTime;
+	int32_t interval;
+	uint32_t quizWordOffset;
+	uint32_t modelNameOffset;
+	uint8_t fieldOrder;
+	uint8_t reserved[3];
+};
+
+// Adds every cached card to cardCacheOut as already loaded. Returns false if the file is missing,
+// malformed or from a different cardCacheFileVersion, in which case nothing is added
+bool loadCardCacheFile(const char* filename, CardCache& cardCacheOut,
+                       std::vector<int64_t>& dueCardIdsOut, int64_t& savedTimeOut);
+// Only cards which are loaded are saved
+bool saveCardCacheFile(const CardCache& cardCache, const std::vector<int64_t>& dueCardIds,
+                       const char* filename);
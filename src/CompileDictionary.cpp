@@ -0,0 +1,140 @@
+#include <sys/resource.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "Dictionary.hpp"
+#include "DictionaryIndex.hpp"
+#include "Tracing.hpp"
+
+// Parse the dictionary serially and in parallel, then diff the results. The parallel loader must
+// never produce a different dictionary
+static bool verifyParallelLoad(const char* sourceFilename)
+{
+	// Always split into several chunks, even on machines with few cores, so the chunk seams are
+	// exercised
+	unsigned int numThreads = std::max(8u, std::thread::hardware_concurrency());
+	Dictionary serialDictionary;
+	Dictionary parallelDictionary;
+	if (!loadDictionary(sourceFilename, serialDictionary, 1) ||
+	    !loadDictionary(sourceFilename, parallelDictionary, numThreads))
+		return false;
+
+	bool isEqual = dictionariesAreEqual(serialDictionary, parallelDictionary) &&
+	               dictionariesAreEqual(parallelDictionary, serialDictionary);
+	std::cout << (isEqual ? "Serial and parallel dictionaries match (" :
+	                        "Error: serial and parallel dictionaries differ (")
+	          << serialDictionary.entries.size() << " vs. " << parallelDictionary.entries.size()
+	          << " keys)\n";
+
+	freeDictionary(serialDictionary);
+	freeDictionary(parallelDictionary);
+	return isEqual;
+}
+
+// Every key must be found in the written index, both by hash and by walking the trie, and the
+// entry table must have survived the round trip
+static bool verifyDictionaryIndex(const Dictionary& dictionary, const char* indexFilename)
+{
+	DictionaryIndex index;
+	if (!openDictionaryIndex(indexFilename, index))
+		return false;
+
+	size_t numMismatches = 0;
+	const size_t maxMatches = 64;
+	DictionaryPrefixMatch matches[maxMatches];
+	for (const DictionaryHashMap::value_type& entry : dictionary.entries)
+	{
+		const DictionaryKey& key = entry.first;
+		const char* indexEntry = findDictionaryIndexEntry(index, key.data, key.length);
+		size_t numMatches =
+		    findDictionaryIndexPrefixes(index, key.data, key.length, matches, maxMatches);
+		bool isFound =
+		    indexEntry &&
+		    indexEntry - index.text == entry.second.entry - dictionary.rawDictionary &&
+		    numMatches && matches[numMatches - 1].length == key.length &&
+		    matches[numMatches - 1].postings.numPostings == entry.second.numPostings;
+		if (!isFound && ++numMismatches <= 10)
+		{
+			std::cerr << "Error: '";
+			std::cerr.write(key.data, key.length);
+			std::cerr << "' is missing or wrong in the index\n";
+		}
+	}
+
+	// The entry table is copied as is, so it must match exactly
+	const DictionaryEntryArrays& entries = dictionary.entryArrays;
+	const DictionaryEntryTable& indexEntries = index.entryTable;
+	bool entriesMatch =
+	    indexEntries.numEntries == entries.lineOffsets.size() &&
+	    indexEntries.numSpans == entries.spans.size() &&
+	    std::equal(entries.lineOffsets.begin(), entries.lineOffsets.end(),
+	               indexEntries.lineOffsets) &&
+	    std::equal(entries.lineLengths.begin(), entries.lineLengths.end(),
+	               indexEntries.lineLengths) &&
+	    std::equal(entries.ids.begin(), entries.ids.end(), indexEntries.ids) &&
+	    std::equal(entries.tags.begin(), entries.tags.end(), indexEntries.tags) &&
+	    std::equal(entries.firstSpans.begin(), entries.firstSpans.end(), indexEntries.firstSpans) &&
+	    std::equal(entries.spanCounts.begin(), entries.spanCounts.end(), indexEntries.spanCounts) &&
+	    std::memcmp(entries.spans.data(), indexEntries.spans,
+	                entries.spans.size() * sizeof(DictionaryTextSpan)) == 0;
+	if (!entriesMatch)
+	{
+		std::cerr << "Error: the entry table is wrong in the index\n";
+		++numMismatches;
+	}
+
+	closeDictionaryIndex(index);
+	return numMismatches == 0;
+}
+
+// Converts the text EDICT2 into the memory-mappable index. Only needs to be re-run when EDICT2 is
+// updated
+int main(int argc, char** argv)
+{
+	bool verify = false;
+	const char* sourceFilename = "data/utf8Edict2";
+	const char* indexFilename = "data/utf8Edict2.index";
+	int numPositionalArguments = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--verify") == 0)
+			verify = true;
+		else if (numPositionalArguments++ == 0)
+			sourceFilename = argv[i];
+		else
+			indexFilename = argv[i];
+	}
+
+	if (verify)
+		return verifyParallelLoad(sourceFilename) ? 0 : 1;
+
+	Dictionary dictionary;
+	if (!loadDictionary(sourceFilename, dictionary))
+		return 1;
+
+	size_t copiedKeyBytes = 0;
+	for (const std::unique_ptr<Arena>& keyArena : dictionary.keyArenas)
+		copiedKeyBytes += keyArena->bytesAllocated();
+	// ru_maxrss is in kilobytes on Linux
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	std::cout << "Peak memory while loading: " << usage.ru_maxrss / 1024 << " MB ("
+	          << copiedKeyBytes << " bytes of copied keys)\n";
+
+	std::cout << "Writing " << dictionary.entries.size() << " keys to '" << indexFilename
+	          << "'..." << std::flush;
+	bool succeeded = writeDictionaryIndex(dictionary, sourceFilename, indexFilename);
+	std::cout << (succeeded ? "done.\n" : "failed.\n");
+	if (succeeded)
+	{
+		succeeded = verifyDictionaryIndex(dictionary, indexFilename);
+		if (succeeded)
+			std::cout << "Verified every key can be found in the index\n";
+	}
+
+	freeDictionary(dictionary);
+	TRACE_SAVE("compile_dictionary.trace.json");
+	return succeeded ? 0 : 1;
+}
@@ -0,0 +1,390 @@
+#include "Deinflection.hpp"
+
+#include <cstring>
+
+#include "DictionaryEntryTable.hpp"
+
+struct DeinflectionRule
+{
+	const char* from;
+	uint32_t fromLength;
+	const char* to;
+	uint32_t toLength;
+	// DeinflectionType bits. The candidate must be one of these for the rule to apply
+	uint32_t typesIn;
+	// What the result is
+	uint32_t typeOut;
+	DeinflectionReason reason;
+};
+
+#define DEINFLECTION_RULE(from, to, typesIn, typeOut, reason) \
+	{from, sizeof(from) - 1, to, sizeof(to) - 1, typesIn, typeOut, DeinflectionReason::reason}
+
+// Shorthand for the rule table
+static const uint32_t ichidan = 1 << static_cast<int>(DeinflectionType::IchidanVerb);
+static const uint32_t godan = 1 << static_cast<int>(DeinflectionType::GodanVerb);
+static const uint32_t adjective = 1 << static_cast<int>(DeinflectionType::IAdjective);
+static const uint32_t kuru = 1 << static_cast<int>(DeinflectionType::KuruVerb);
+static const uint32_t suru = 1 << static_cast<int>(DeinflectionType::SuruVerb);
+static const uint32_t teForm = 1 << static_cast<int>(DeinflectionType::TeForm);
+static const uint32_t polite = 1 << static_cast<int>(DeinflectionType::Polite);
+static const uint32_t politeNegative = 1 << static_cast<int>(DeinflectionType::PoliteNegative);
+static const uint32_t unchanged = 1 << static_cast<int>(DeinflectionType::Unchanged);
+
+// Each rule undoes one step. typesIn says what the word must be for the ending to mean that, e.g.
+// ない conjugates as an い adjective, so 渡さなかった -> 渡さない (past) -> 渡す (negative)
+static const DeinflectionRule deinflectionRules[] = {
+    // Godan verbs
+    DEINFLECTION_RULE("わない", "う", adjective, godan, Negative),
+    DEINFLECTION_RULE("わず", "う", unchanged, godan, Negative),
+    DEINFLECTION_RULE("います", "う", polite, godan, Polite),
+    DEINFLECTION_RULE("いたい", "う", adjective, godan, Desire),
+    DEINFLECTION_RULE("って", "う", unchanged | teForm, godan, TeForm),
+    DEINFLECTION_RULE("った", "う", unchanged, godan, Past),
+    DEINFLECTION_RULE("ったら", "う", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("えば", "う", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("える", "う", ichidan, godan, Potential),
+    DEINFLECTION_RULE("え", "う", unchanged, godan, Imperative),
+    DEINFLECTION_RULE("おう", "う", unchanged, godan, Volitional),
+    DEINFLECTION_RULE("われる", "う", ichidan, godan, Passive),
+    DEINFLECTION_RULE("わせる", "う", ichidan, godan, Causative),
+    DEINFLECTION_RULE("かない", "く", adjective, godan, Negative),
+    DEINFLECTION_RULE("かず", "く", unchanged, godan, Negative),
+    DEINFLECTION_RULE("きます", "く", polite, godan, Polite),
+    DEINFLECTION_RULE("きたい", "く", adjective, godan, Desire),
+    DEINFLECTION_RULE("いて", "く", unchanged | teForm, godan, TeForm),
+    DEINFLECTION_RULE("いた", "く", unchanged, godan, Past),
+    DEINFLECTION_RULE("いたら", "く", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("けば", "く", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("ける", "く", ichidan, godan, Potential),
+    DEINFLECTION_RULE("け", "く", unchanged, godan, Imperative),
+    DEINFLECTION_RULE("こう", "く", unchanged, godan, Volitional),
+    DEINFLECTION_RULE("かれる", "く", ichidan, godan, Passive),
+    DEINFLECTION_RULE("かせる", "く", ichidan, godan, Causative),
+    DEINFLECTION_RULE("がない", "ぐ", adjective, godan, Negative),
+    DEINFLECTION_RULE("がず", "ぐ", unchanged, godan, Negative),
+    DEINFLECTION_RULE("ぎます", "ぐ", polite, godan, Polite),
+    DEINFLECTION_RULE("ぎたい", "ぐ", adjective, godan, Desire),
+    DEINFLECTION_RULE("いで", "ぐ", unchanged | teForm, godan, TeForm),
+    DEINFLECTION_RULE("いだ", "ぐ", unchanged, godan, Past),
+    DEINFLECTION_RULE("いだら", "ぐ", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("げば", "ぐ", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("げる", "ぐ", ichidan, godan, Potential),
+    DEINFLECTION_RULE("げ", "ぐ", unchanged, godan, Imperative),
+    DEINFLECTION_RULE("ごう", "ぐ", unchanged, godan, Volitional),
+    DEINFLECTION_RULE("がれる", "ぐ", ichidan, godan, Passive),
+    DEINFLECTION_RULE("がせる", "ぐ", ichidan, godan, Causative),
+    DEINFLECTION_RULE("さない", "す", adjective, godan, Negative),
+    DEINFLECTION_RULE("さず", "す", unchanged, godan, Negative),
+    DEINFLECTION_RULE("します", "す", polite, godan, Polite),
+    DEINFLECTION_RULE("したい", "す", adjective, godan, Desire),
+    DEINFLECTION_RULE("して", "す", unchanged | teForm, godan, TeForm),
+    DEINFLECTION_RULE("した", "す", unchanged, godan, Past),
+    DEINFLECTION_RULE("したら", "す", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("せば", "す", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("せる", "す", ichidan, godan, Potential),
+    DEINFLECTION_RULE("せ", "す", unchanged, godan, Imperative),
+    DEINFLECTION_RULE("そう", "す", unchanged, godan, Volitional),
+    DEINFLECTION_RULE("される", "す", ichidan, godan, Passive),
+    DEINFLECTION_RULE("させる", "す", ichidan, godan, Causative),
+    DEINFLECTION_RULE("たない", "つ", adjective, godan, Negative),
+    DEINFLECTION_RULE("たず", "つ", unchanged, godan, Negative),
+    DEINFLECTION_RULE("ちます", "つ", polite, godan, Polite),
+    DEINFLECTION_RULE("ちたい", "つ", adjective, godan, Desire),
+    DEINFLECTION_RULE("って", "つ", unchanged | teForm, godan, TeForm),
+    DEINFLECTION_RULE("った", "つ", unchanged, godan, Past),
+    DEINFLECTION_RULE("ったら", "つ", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("てば", "つ", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("てる", "つ", ichidan, godan, Potential),
+    DEINFLECTION_RULE("て", "つ", unchanged, godan, Imperative),
+    DEINFLECTION_RULE("とう", "つ", unchanged, godan, Volitional),
+    DEINFLECTION_RULE("たれる", "つ", ichidan, godan, Passive),
+    DEINFLECTION_RULE("たせる", "つ", ichidan, godan, Causative),
+    DEINFLECTION_RULE("なない", "ぬ", adjective, godan, Negative),
+    DEINFLECTION_RULE("なず", "ぬ", unchanged, godan, Negative),
+    DEINFLECTION_RULE("にます", "ぬ", polite, godan, Polite),
+    DEINFLECTION_RULE("にたい", "ぬ", adjective, godan, Desire),
+    DEINFLECTION_RULE("んで", "ぬ", unchanged | teForm, godan, TeForm),
+    DEINFLECTION_RULE("んだ", "ぬ", unchanged, godan, Past),
+    DEINFLECTION_RULE("んだら", "ぬ", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("ねば", "ぬ", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("ねる", "ぬ", ichidan, godan, Potential),
+    DEINFLECTION_RULE("ね", "ぬ", unchanged, godan, Imperative),
+    DEINFLECTION_RULE("のう", "ぬ", unchanged, godan, Volitional),
+    DEINFLECTION_RULE("なれる", "ぬ", ichidan, godan, Passive),
+    DEINFLECTION_RULE("なせる", "ぬ", ichidan, godan, Causative),
+    DEINFLECTION_RULE("ばない", "ぶ", adjective, godan, Negative),
+    DEINFLECTION_RULE("ばず", "ぶ", unchanged, godan, Negative),
+    DEINFLECTION_RULE("びます", "ぶ", polite, godan, Polite),
+    DEINFLECTION_RULE("びたい", "ぶ", adjective, godan, Desire),
+    DEINFLECTION_RULE("んで", "ぶ", unchanged | teForm, godan, TeForm),
+    DEINFLECTION_RULE("んだ", "ぶ", unchanged, godan, Past),
+    DEINFLECTION_RULE("んだら", "ぶ", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("べば", "ぶ", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("べる", "ぶ", ichidan, godan, Potential),
+    DEINFLECTION_RULE("べ", "ぶ", unchanged, godan, Imperative),
+    DEINFLECTION_RULE("ぼう", "ぶ", unchanged, godan, Volitional),
+    DEINFLECTION_RULE("ばれる", "ぶ", ichidan, godan, Passive),
+    DEINFLECTION_RULE("ばせる", "ぶ", ichidan, godan, Causative),
+    DEINFLECTION_RULE("まない", "む", adjective, godan, Negative),
+    DEINFLECTION_RULE("まず", "む", unchanged, godan, Negative),
+    DEINFLECTION_RULE("みます", "む", polite, godan, Polite),
+    DEINFLECTION_RULE("みたい", "む", adjective, godan, Desire),
+    DEINFLECTION_RULE("んで", "む", unchanged | teForm, godan, TeForm),
+    DEINFLECTION_RULE("んだ", "む", unchanged, godan, Past),
+    DEINFLECTION_RULE("んだら", "む", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("めば", "む", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("める", "む", ichidan, godan, Potential),
+    DEINFLECTION_RULE("め", "む", unchanged, godan, Imperative),
+    DEINFLECTION_RULE("もう", "む", unchanged, godan, Volitional),
+    DEINFLECTION_RULE("まれる", "む", ichidan, godan, Passive),
+    DEINFLECTION_RULE("ませる", "む", ichidan, godan, Causative),
+    DEINFLECTION_RULE("らない", "る", adjective, godan, Negative),
+    DEINFLECTION_RULE("らず", "る", unchanged, godan, Negative),
+    DEINFLECTION_RULE("ります", "る", polite, godan, Polite),
+    DEINFLECTION_RULE("りたい", "る", adjective, godan, Desire),
+    DEINFLECTION_RULE("って", "る", unchanged | teForm, godan, TeForm),
+    DEINFLECTION_RULE("った", "る", unchanged, godan, Past),
+    DEINFLECTION_RULE("ったら", "る", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("れば", "る", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("れる", "る", ichidan, godan, Potential),
+    DEINFLECTION_RULE("れ", "る", unchanged, godan, Imperative),
+    DEINFLECTION_RULE("ろう", "る", unchanged, godan, Volitional),
+    DEINFLECTION_RULE("られる", "る", ichidan, godan, Passive),
+    DEINFLECTION_RULE("らせる", "る", ichidan, godan, Causative),
+    // 行く is the one irregular godan verb
+    DEINFLECTION_RULE("行って", "行く", unchanged | teForm, godan, TeForm),
+    DEINFLECTION_RULE("行った", "行く", unchanged, godan, Past),
+    DEINFLECTION_RULE("行ったら", "行く", unchanged, godan, Conditional),
+    DEINFLECTION_RULE("いって", "いく", unchanged | teForm, godan, TeForm),
+    DEINFLECTION_RULE("いった", "いく", unchanged, godan, Past),
+    DEINFLECTION_RULE("いったら", "いく", unchanged, godan, Conditional),
+
+    // Ichidan verbs
+    DEINFLECTION_RULE("ない", "る", adjective, ichidan, Negative),
+    DEINFLECTION_RULE("ず", "る", unchanged, ichidan, Negative),
+    DEINFLECTION_RULE("ます", "る", polite, ichidan, Polite),
+    DEINFLECTION_RULE("たい", "る", adjective, ichidan, Desire),
+    DEINFLECTION_RULE("て", "る", unchanged | teForm, ichidan, TeForm),
+    DEINFLECTION_RULE("た", "る", unchanged, ichidan, Past),
+    DEINFLECTION_RULE("たら", "る", unchanged, ichidan, Conditional),
+    DEINFLECTION_RULE("れば", "る", unchanged, ichidan, Conditional),
+    DEINFLECTION_RULE("られる", "る", ichidan, ichidan, PotentialOrPassive),
+    DEINFLECTION_RULE("れる", "る", ichidan, ichidan, Potential),
+    DEINFLECTION_RULE("させる", "る", ichidan, ichidan, Causative),
+    DEINFLECTION_RULE("よう", "る", unchanged, ichidan, Volitional),
+    DEINFLECTION_RULE("ろ", "る", unchanged, ichidan, Imperative),
+    DEINFLECTION_RULE("よ", "る", unchanged, ichidan, Imperative),
+    // 来る, in kanji or kana
+    DEINFLECTION_RULE("来ない", "来る", adjective, kuru, Negative),
+    DEINFLECTION_RULE("来ます", "来る", polite, kuru, Polite),
+    DEINFLECTION_RULE("来たい", "来る", adjective, kuru, Desire),
+    DEINFLECTION_RULE("来て", "来る", unchanged | teForm, kuru, TeForm),
+    DEINFLECTION_RULE("来た", "来る", unchanged, kuru, Past),
+    DEINFLECTION_RULE("来たら", "来る", unchanged, kuru, Conditional),
+    DEINFLECTION_RULE("来れば", "来る", unchanged, kuru, Conditional),
+    DEINFLECTION_RULE("来られる", "来る", ichidan, kuru, PotentialOrPassive),
+    DEINFLECTION_RULE("来させる", "来る", ichidan, kuru, Causative),
+    DEINFLECTION_RULE("来よう", "来る", unchanged, kuru, Volitional),
+    DEINFLECTION_RULE("来い", "来る", unchanged, kuru, Imperative),
+    DEINFLECTION_RULE("こない", "くる", adjective, kuru, Negative),
+    DEINFLECTION_RULE("きます", "くる", polite, kuru, Polite),
+    DEINFLECTION_RULE("きたい", "くる", adjective, kuru, Desire),
+    DEINFLECTION_RULE("きて", "くる", unchanged | teForm, kuru, TeForm),
+    DEINFLECTION_RULE("きた", "くる", unchanged, kuru, Past),
+    DEINFLECTION_RULE("きたら", "くる", unchanged, kuru, Conditional),
+    DEINFLECTION_RULE("くれば", "くる", unchanged, kuru, Conditional),
+    DEINFLECTION_RULE("こられる", "くる", ichidan, kuru, PotentialOrPassive),
+    DEINFLECTION_RULE("こさせる", "くる", ichidan, kuru, Causative),
+    DEINFLECTION_RULE("こよう", "くる", unchanged, kuru, Volitional),
+    DEINFLECTION_RULE("こい", "くる", unchanged, kuru, Imperative),
+    // する
+    DEINFLECTION_RULE("しない", "する", adjective, suru, Negative),
+    DEINFLECTION_RULE("せず", "する", unchanged, suru, Negative),
+    DEINFLECTION_RULE("します", "する", polite, suru, Polite),
+    DEINFLECTION_RULE("したい", "する", adjective, suru, Desire),
+    DEINFLECTION_RULE("して", "する", unchanged | teForm, suru, TeForm),
+    DEINFLECTION_RULE("した", "する", unchanged, suru, Past),
+    DEINFLECTION_RULE("したら", "する", unchanged, suru, Conditional),
+    DEINFLECTION_RULE("すれば", "する", unchanged, suru, Conditional),
+    DEINFLECTION_RULE("できる", "する", ichidan, suru, Potential),
+    DEINFLECTION_RULE("される", "する", ichidan, suru, Passive),
+    DEINFLECTION_RULE("させる", "する", ichidan, suru, Causative),
+    DEINFLECTION_RULE("しよう", "する", unchanged, suru, Volitional),
+    DEINFLECTION_RULE("しろ", "する", unchanged, suru, Imperative),
+    DEINFLECTION_RULE("せよ", "する", unchanged, suru, Imperative),
+    // い adjectives. ない and たい conjugate like these, so negatives and desires chain through
+    DEINFLECTION_RULE("くない", "い", adjective, adjective, Negative),
+    DEINFLECTION_RULE("かった", "い", unchanged, adjective, Past),
+    DEINFLECTION_RULE("くて", "い", unchanged | teForm, adjective, TeForm),
+    DEINFLECTION_RULE("かったら", "い", unchanged, adjective, Conditional),
+    DEINFLECTION_RULE("ければ", "い", unchanged, adjective, Conditional),
+    DEINFLECTION_RULE("く", "い", unchanged, adjective, Adverb),
+    DEINFLECTION_RULE("さ", "い", unchanged, adjective, Noun),
+    // The ます form conjugates on its own
+    DEINFLECTION_RULE("ました", "ます", unchanged, polite, Past),
+    DEINFLECTION_RULE("まして", "ます", unchanged | teForm, polite, TeForm),
+    DEINFLECTION_RULE("ましょう", "ます", unchanged, polite, Volitional),
+    DEINFLECTION_RULE("ません", "ます", unchanged | politeNegative, polite, Negative),
+    DEINFLECTION_RULE("ませんでした", "ません", unchanged, politeNegative, Past),
+    // Auxiliaries after the te form. They conjugate as ichidan or godan verbs themselves
+    DEINFLECTION_RULE("ている", "て", ichidan, teForm, Progressive),
+    DEINFLECTION_RULE("てる", "て", ichidan, teForm, Progressive),
+    DEINFLECTION_RULE("でいる", "で", ichidan, teForm, Progressive),
+    DEINFLECTION_RULE("でる", "で", ichidan, teForm, Progressive),
+    DEINFLECTION_RULE("てしまう", "て", godan, teForm, Completion),
+    DEINFLECTION_RULE("でしまう", "で", godan, teForm, Completion),
+    DEINFLECTION_RULE("ちゃう", "て", godan, teForm, Completion),
+    DEINFLECTION_RULE("じゃう", "で", godan, teForm, Completion),
+
+};
+
+#undef DEINFLECTION_RULE
+
+const char* getDeinflectionReasonName(DeinflectionReason reason)
+{
+	switch (reason)
+	{
+		case DeinflectionReason::Past:
+			return "past";
+		case DeinflectionReason::Negative:
+			return "negative";
+		case DeinflectionReason::Polite:
+			return "polite";
+		case DeinflectionReason::TeForm:
+			return "te form";
+		case DeinflectionReason::Progressive:
+			return "progressive";
+		case DeinflectionReason::Completion:
+			return "completion";
+		case DeinflectionReason::Desire:
+			return "desire";
+		case DeinflectionReason::Conditional:
+			return "conditional";
+		case DeinflectionReason::Potential:
+			return "potential";
+		case DeinflectionReason::Passive:
+			return "passive";
+		case DeinflectionReason::PotentialOrPassive:
+			return "potential or passive";
+		case DeinflectionReason::Causative:
+			return "causative";
+		case DeinflectionReason::Volitional:
+			return "volitional";
+		case DeinflectionReason::Imperative:
+			return "imperative";
+		case DeinflectionReason::Adverb:
+			return "adverb";
+		case DeinflectionReason::Noun:
+			return "noun";
+	}
+	return "unknown";
+}
+
+// Adds the result of applying the rule to the candidate, unless it's already there, in which case
+// it could now also be the rule's type
+static void applyDeinflectionRule(const DeinflectionCandidate& candidate,
+                                  const DeinflectionRule& rule, Deinflections& deinflections)
+{
+	const uint32_t stemLength = candidate.length - rule.fromLength;
+	const uint32_t length = stemLength + rule.toLength;
+	if (length > maxDeinflectionLength)
+		return;
+	// Every dictionary form is at least two characters (来る, いい), so e.g. た on its own isn't
+	// one. Kana and kanji are at least three bytes each
+	if (length < 6)
+		return;
+
+	for (size_t i = 0; i < deinflections.numCandidates; ++i)
+	{
+		DeinflectionCandidate& existing = deinflections.candidates[i];
+		if (existing.length == length &&
+		    std::memcmp(existing.text, candidate.text, stemLength) == 0 &&
+		    std::memcmp(existing.text + stemLength, rule.to, rule.toLength) == 0)
+		{
+			existing.types |= rule.typeOut;
+			return;
+		}
+	}
+
+	if (deinflections.numCandidates == maxDeinflectionCandidates ||
+	    candidate.numReasons == maxDeinflectionReasons)
+		return;
+	DeinflectionCandidate& result = deinflections.candidates[deinflections.numCandidates++];
+	std::memcpy(result.text, candidate.text, stemLength);
+	std::memcpy(result.text + stemLength, rule.to, rule.toLength);
+	result.length = length;
+	result.types = rule.typeOut;
+	std::memcpy(result.reasons, candidate.reasons,
+	            candidate.numReasons * sizeof(DeinflectionReason));
+	result.reasons[candidate.numReasons] = rule.reason;
+	result.numReasons = candidate.numReasons + 1;
+}
+
+void deinflectWord(const char* word, size_t wordLength, Deinflections& deinflectionsOut)
+{
+	deinflectionsOut.numCandidates = 0;
+	if (wordLength > maxDeinflectionLength)
+		return;
+	DeinflectionCandidate& original = deinflectionsOut.candidates[0];
+	std::memcpy(original.text, word, wordLength);
+	original.length = static_cast<uint32_t>(wordLength);
+	// It could be anything
+	original.types = ~uint32_t(0);
+	original.numReasons = 0;
+	deinflectionsOut.numCandidates = 1;
+
+	// Candidates are added to the end as they're found, so this visits each of them once
+	const size_t numRules = sizeof(deinflectionRules) / sizeof(deinflectionRules[0]);
+	for (size_t candidateIndex = 0; candidateIndex < deinflectionsOut.numCandidates;
+	     ++candidateIndex)
+	{
+		// The candidates are a fixed array, so adding more never moves this
+		const DeinflectionCandidate& candidate = deinflectionsOut.candidates[candidateIndex];
+		for (size_t ruleIndex = 0; ruleIndex < numRules; ++ruleIndex)
+		{
+			const DeinflectionRule& rule = deinflectionRules[ruleIndex];
+			if (!(candidate.types & rule.typesIn) || candidate.length < rule.fromLength ||
+			    std::memcmp(candidate.text + candidate.length - rule.fromLength, rule.from,
+			                rule.fromLength) != 0)
+				continue;
+			applyDeinflectionRule(candidate, rule, deinflectionsOut);
+		}
+	}
+}
+
+bool isDeinflectionTypeOfEntry(const DeinflectionCandidate& candidate, uint64_t entryTags)
+{
+	if (candidate.types & unchanged)
+		return true;
+
+	uint64_t tags = 0;
+	if (candidate.types & ichidan)
+		tags |= getDictionaryTagBit(DictionaryTag::IchidanVerb) |
+		        getDictionaryTagBit(DictionaryTag::IchidanKureruVerb) |
+		        getDictionaryTagBit(DictionaryTag::ZuruVerb);
+	if (candidate.types & godan)
+		tags |= getDictionaryTagBit(DictionaryTag::GodanAruVerb) |
+		        getDictionaryTagBit(DictionaryTag::GodanBuVerb) |
+		        getDictionaryTagBit(DictionaryTag::GodanGuVerb) |
+		        getDictionaryTagBit(DictionaryTag::GodanKuVerb) |
+		        getDictionaryTagBit(DictionaryTag::GodanIkuVerb) |
+		        getDictionaryTagBit(DictionaryTag::GodanMuVerb) |
+		        getDictionaryTagBit(DictionaryTag::GodanNuVerb) |
+		        getDictionaryTagBit(DictionaryTag::GodanRuVerb) |
+		        getDictionaryTagBit(DictionaryTag::GodanRuIrregularVerb) |
+		        getDictionaryTagBit(DictionaryTag::GodanSuVerb) |
+		        getDictionaryTagBit(DictionaryTag::GodanTsuVerb) |
+		        getDictionaryTagBit(DictionaryTag::GodanUVerb) |
+		        getDictionaryTagBit(DictionaryTag::GodanUSpecialVerb);
+	if (candidate.types & adjective)
+		tags |= getDictionaryTagBit(DictionaryTag::IAdjective) |
+		        getDictionaryTagBit(DictionaryTag::IAdjectiveIi) |
+		        getDictionaryTagBit(DictionaryTag::AuxiliaryAdjective);
+	if (candidate.types & kuru)
+		tags |= getDictionaryTagBit(DictionaryTag::KuruVerb);
+	if (candidate.types & suru)
+		tags |= getDictionaryTagBit(DictionaryTag::SuruIrregularVerb) |
+		        getDictionaryTagBit(DictionaryTag::SuruSpecialVerb);
+	return entryTags & tags;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Turns conjugated words back into the dictionary forms they could have come from, e.g. 渡した
+// into 渡す (past) and 持っていた into 持つ (te-form, progressive, past). Works like the
+// deinflect tables of Rikaichan and Yomichan: rules replace one ending with another, and chain,
+// so each rule only has to know one step. Most candidates are wrong (渡した also gives 渡する and
+// 渡しる); the dictionary's part of speech tags prune them (see isDeinflectionTypeOfEntry()).
+//
+// Needs nothing but the word, so it works without MeCab, e.g. for looking up whatever is under
+// the cursor. Does not allocate.
+
+// What kind of word a candidate could be. Each is a bit of DeinflectionCandidate::types
+enum class DeinflectionType
+{
+	// Dictionary forms, checked against entries' part of speech tags
+	IchidanVerb = 0,
+	GodanVerb,
+	IAdjective,
+	KuruVerb,
+	SuruVerb,
+
+	// Only ever an intermediate step, e.g. 持って from 持っている
+	TeForm,
+	// The ます form, e.g. 渡します from 渡しました
+	Polite,
+	// The ません form, e.g. 渡しません from 渡しませんでした
+	PoliteNegative,
+
+	// The word as given. Rules for endings which nothing else can follow (e.g. the past tense)
+	// only apply to this
+	Unchanged,
+
+	Count
+};
+
+inline uint32_t getDeinflectionTypeBit(DeinflectionType type)
+{
+	return uint32_t(1) << static_cast<int>(type);
+}
+
+// Why a rule applies, e.g. Past for 渡した -> 渡す
+enum class DeinflectionReason
+{
+	Past = 0,
+	Negative,
+	Polite,
+	TeForm,
+	Progressive,
+	Completion,
+	Desire,
+	Conditional,
+	Potential,
+	Passive,
+	PotentialOrPassive,
+	Causative,
+	Volitional,
+	Imperative,
+	Adverb,
+	Noun
+};
+
+// e.g. "past". Never nullptr
+const char* getDeinflectionReasonName(DeinflectionReason reason);
+
+// In bytes. Longer candidates are dropped. No conjugated word is anywhere near this long
+static const size_t maxDeinflectionLength = 64;
+// Longer chains are dropped
+static const size_t maxDeinflectionReasons = 8;
+// 持っていなかった has about 20; leave room
+static const size_t maxDeinflectionCandidates = 48;
+
+struct DeinflectionCandidate
+{
+	// Not null-terminated
+	char text[maxDeinflectionLength];
+	uint32_t length;
+	// DeinflectionType bits: what the candidate could be, if it's a word at all
+	uint32_t types;
+	// The rules applied to get here, from the word given, e.g. TeForm, Progressive, Past for
+	// 持つ from 持っていた
+	uint32_t numReasons;
+	DeinflectionReason reasons[maxDeinflectionReasons];
+};
+
+// The first candidate is always the word as given. The rest are in the order they were found, so
+// fewer rules come first
+struct Deinflections
+{
+	DeinflectionCandidate candidates[maxDeinflectionCandidates];
+	size_t numCandidates = 0;
+};
+
+// Every form the word could have been conjugated from, including the word itself. Stops early if
+// deinflectionsOut fills up
+void deinflectWord(const char* word, size_t wordLength, Deinflections& deinflectionsOut);
+
+// Whether an entry with these DictionaryTag bits (see DictionaryEntryTable.hpp) can be the
+// candidate. The word as given is anything
+bool isDeinflectionTypeOfEntry(const DeinflectionCandidate& candidate, uint64_t entryTags);
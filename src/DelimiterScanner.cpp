@@ -0,0 +1,165 @@
+#include "DelimiterScanner.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DELIMITER_SCANNER_X86
+#include <immintrin.h>
+#endif
+
+typedef const char* (*FindNextDelimiterFunction)(const DelimiterSet&, const char*, const char*);
+
+DelimiterSet makeDelimiterSet(const char* delimiters)
+{
+	DelimiterSet delimiterSet;
+	std::memset(&delimiterSet, 0, sizeof(delimiterSet));
+	for (const char* delimiter = delimiters;
+	     *delimiter && delimiterSet.numDelimiters < maxDelimitersInSet; ++delimiter)
+	{
+		delimiterSet.delimiters[delimiterSet.numDelimiters++] = *delimiter;
+		delimiterSet.isDelimiter[static_cast<unsigned char>(*delimiter)] = true;
+	}
+	return delimiterSet;
+}
+
+static const char* findNextDelimiterScalar(const DelimiterSet& delimiterSet, const char* begin,
+                                           const char* end)
+{
+	for (const char* current = begin; current < end; ++current)
+	{
+		if (delimiterSet.isDelimiter[static_cast<unsigned char>(*current)])
+			return current;
+	}
+	return end;
+}
+
+#ifdef DELIMITER_SCANNER_X86
+// SSE2 is always there on x86-64; the attribute is for 32-bit builds
+__attribute__((target("sse2"))) static const char* findNextDelimiterSSE2(
+    const DelimiterSet& delimiterSet, const char* begin, const char* end)
+{
+	__m128i delimiters[maxDelimitersInSet];
+	for (int i = 0; i < delimiterSet.numDelimiters; ++i)
+		delimiters[i] = _mm_set1_epi8(delimiterSet.delimiters[i]);
+
+	const char* current = begin;
+	for (; end - current >= 16; current += 16)
+	{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+		__m128i matches = _mm_setzero_si128();
+		for (int i = 0; i < delimiterSet.numDelimiters; ++i)
+			matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, delimiters[i]));
+		int matchMask = _mm_movemask_epi8(matches);
+		if (matchMask)
+			return current + __builtin_ctz(static_cast<unsigned int>(matchMask));
+	}
+	return findNextDelimiterScalar(delimiterSet, current, end);
+}
+
+__attribute__((target("avx2"))) static const char* findNextDelimiterAVX2(
+    const DelimiterSet& delimiterSet, const char* begin, const char* end)
+{
+	__m256i delimiters[maxDelimitersInSet];
+	for (int i = 0; i < delimiterSet.numDelimiters; ++i)
+		delimiters[i] = _mm256_set1_epi8(delimiterSet.delimiters[i]);
+
+	const char* current = begin;
+	for (; end - current >= 32; current += 32)
+	{
+		__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current));
+		__m256i matches = _mm256_setzero_si256();
+		for (int i = 0; i < delimiterSet.numDelimiters; ++i)
+			matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, delimiters[i]));
+		unsigned int matchMask = static_cast<unsigned int>(_mm256_movemask_epi8(matches));
+		if (matchMask)
+			return current + __builtin_ctz(matchMask);
+	}
+	// Most structural characters in EDICT2 are close together, so the remainder is common enough
+	// to be worth a 16-byte step before going scalar
+	return findNextDelimiterSSE2(delimiterSet, current, end);
+}
+#endif
+
+static bool isImplementationSupported(DelimiterScannerImplementation implementation)
+{
+#ifdef DELIMITER_SCANNER_X86
+	// Required because this is first called during static initialization
+	__builtin_cpu_init();
+#endif
+	switch (implementation)
+	{
+		case DelimiterScannerImplementation::Scalar:
+			return true;
+#ifdef DELIMITER_SCANNER_X86
+		case DelimiterScannerImplementation::SSE2:
+			return __builtin_cpu_supports("sse2");
+		case DelimiterScannerImplementation::AVX2:
+			return __builtin_cpu_supports("avx2");
+#endif
+		default:
+			return false;
+	}
+}
+
+static FindNextDelimiterFunction getImplementationFunction(
+    DelimiterScannerImplementation implementation)
+{
+	switch (implementation)
+	{
+#ifdef DELIMITER_SCANNER_X86
+		case DelimiterScannerImplementation::SSE2:
+			return findNextDelimiterSSE2;
+		case DelimiterScannerImplementation::AVX2:
+			return findNextDelimiterAVX2;
+#endif
+		default:
+			return findNextDelimiterScalar;
+	}
+}
+
+static DelimiterScannerImplementation detectBestImplementation()
+{
+	if (isImplementationSupported(DelimiterScannerImplementation::AVX2))
+		return DelimiterScannerImplementation::AVX2;
+	if (isImplementationSupported(DelimiterScannerImplementation::SSE2))
+		return DelimiterScannerImplementation::SSE2;
+	return DelimiterScannerImplementation::Scalar;
+}
+
+static DelimiterScannerImplementation currentImplementation = detectBestImplementation();
+static FindNextDelimiterFunction currentFindNextDelimiter =
+    getImplementationFunction(currentImplementation);
+
+const char* findNextDelimiter(const DelimiterSet& delimiterSet, const char* begin,
+                              const char* end)
+{
+	return currentFindNextDelimiter(delimiterSet, begin, end);
+}
+
+DelimiterScannerImplementation getDelimiterScannerImplementation()
+{
+	return currentImplementation;
+}
+
+void setDelimiterScannerImplementation(DelimiterScannerImplementation implementation)
+{
+	if (!isImplementationSupported(implementation))
+		return;
+	currentImplementation = implementation;
+	currentFindNextDelimiter = getImplementationFunction(implementation);
+}
+
+const char* getDelimiterScannerImplementationName(DelimiterScannerImplementation implementation)
+{
+	switch (implementation)
+	{
+		case DelimiterScannerImplementation::Scalar:
+			return "scalar";
+		case DelimiterScannerImplementation::SSE2:
+			return "SSE2";
+		case DelimiterScannerImplementation::AVX2:
+			return "AVX2";
+		default:
+			return "unknown";
+	}
+}
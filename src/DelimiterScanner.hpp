@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+
+// Finds the next occurrence of any of a small set of delimiter bytes, 16 (SSE2) or 32 (AVX2)
+// bytes at a time. The implementation is picked at runtime based on what the CPU supports, with a
+// table-driven scalar fallback for everything else.
+
+static const int maxDelimitersInSet = 8;
+
+struct DelimiterSet
+{
+	char delimiters[maxDelimitersInSet];
+	int numDelimiters;
+	// For the scalar fallback and tail bytes
+	bool isDelimiter[256];
+};
+
+// delimiters is a null-terminated list of up to maxDelimitersInSet bytes, e.g. "/[; \n"
+DelimiterSet makeDelimiterSet(const char* delimiters);
+
+// Returns the first byte in [begin, end) which is in the set, or end if there are none
+const char* findNextDelimiter(const DelimiterSet& delimiterSet, const char* begin,
+                              const char* end);
+
+enum class DelimiterScannerImplementation
+{
+	Scalar = 0,
+	SSE2,
+	AVX2
+};
+
+// Which implementation findNextDelimiter() uses. Overriding is only meant for benchmarking and
+// verifying implementations against each other; the override is ignored if the CPU can't run it
+DelimiterScannerImplementation getDelimiterScannerImplementation();
+void setDelimiterScannerImplementation(DelimiterScannerImplementation implementation);
+const char* getDelimiterScannerImplementationName(DelimiterScannerImplementation implementation);
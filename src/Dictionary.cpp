@@ -0,0 +1,497 @@
+#include "Dictionary.hpp"
+
+#include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "DelimiterScanner.hpp"
+#include "Tracing.hpp"
+
+// A key found by a parsing thread, waiting to be merged into the dictionary
+struct ParsedDictionaryKey
+{
+	DictionaryKey key;
+	const char* entry;
+	// Relative to the first entry of the chunk it was parsed from
+	uint32_t entryIndex;
+	bool isReading;
+	// Which submap of DictionaryHashMap the key belongs to, so merging doesn't need to rehash to
+	// find out which thread owns it
+	uint32_t submapIndex;
+};
+
+static void finishAddWordToDictionary(const DictionaryHashMap& entries, Arena& keyArena,
+                                      std::vector<ParsedDictionaryKey>& keysOut, const char* word,
+                                      size_t wordLength, const char* wordInRawDictionary,
+                                      size_t wordLengthInRawDictionary, const char* entry,
+                                      uint32_t entryIndex, bool isReading)
+{
+	// Tags such as (P) in 会う(P) aren't part of the word
+	const char* tagsStart = static_cast<const char*>(std::memchr(word, '(', wordLength));
+	if (tagsStart)
+	{
+		if (wordLength == wordLengthInRawDictionary)
+			wordLengthInRawDictionary = tagsStart - word;
+		wordLength = tagsStart - word;
+		if (!wordLength)
+			return;
+	}
+
+	ParsedDictionaryKey parsedKey;
+	parsedKey.key.length = static_cast<uint32_t>(wordLength);
+	// Nearly every word is contiguous in the raw dictionary, so the key can just point at it. If
+	// spaces were stripped, the key needs its own copy
+	if (wordLength == wordLengthInRawDictionary)
+		parsedKey.key.data = wordInRawDictionary;
+	else
+		parsedKey.key.data = keyArena.copy(word, wordLength);
+	parsedKey.entry = entry;
+	parsedKey.entryIndex = entryIndex;
+	parsedKey.isReading = isReading;
+	parsedKey.submapIndex = static_cast<uint32_t>(entries.subidx(entries.hash(parsedKey.key)));
+	keysOut.push_back(parsedKey);
+}
+
+// Structural characters of each part of an EDICT2 line, e.g.
+// 渡す [わたす] /(v5s,vt) (1) to ferry across/(2) to hand over/(P)/EntL1560100X/
+static const DelimiterSet japaneseWordDelimiters = makeDelimiterSet("/[; \n");
+static const DelimiterSet readingDelimiters = makeDelimiterSet("]; \n");
+// English glosses are by far the longest part of each line, so they are skipped slash to slash
+static const DelimiterSet englishDefinitionDelimiters = makeDelimiterSet("/\n");
+
+// Parse [chunkBegin, chunkEnd), which must start at the beginning of a line and end after a
+// newline (or at the end of the file). Only the chunk starting the file has the version line.
+// Every other line is also parsed into entriesOut, with spans relative to rawDictionary
+static void parseDictionaryChunk(const DictionaryHashMap& entries, const char* rawDictionary,
+                                 const char* chunkBegin, const char* chunkEnd, bool isFirstChunk,
+                                 Arena& keyArena, std::vector<ParsedDictionaryKey>& keysOut,
+                                 DictionaryEntryArrays& entriesOut)
+{
+	TRACE_ZONE("parseDictionaryChunk");
+	enum class EDict2ReadState
+	{
+		VersionNumber = 0,
+		JapaneseWord,
+		Reading,
+		EnglishDefinition,
+		EntryId
+	};
+
+	EDict2ReadState readState =
+	    isFirstChunk ? EDict2ReadState::VersionNumber : EDict2ReadState::JapaneseWord;
+	char buffer[1024];
+	char* bufferWriteHead = buffer;
+	// Where the buffered word starts and ends in rawDictionary, to avoid copying the key
+	const char* wordBegin = nullptr;
+	const char* wordEnd = nullptr;
+	const char* beginningOfLine = chunkBegin;
+
+#define FINISH_ADD_WORD()                                                                     \
+	if (bufferWriteHead != buffer)                                                            \
+	{                                                                                         \
+		finishAddWordToDictionary(                                                            \
+		    entries, keyArena, keysOut, buffer, bufferWriteHead - buffer, wordBegin,          \
+		    wordEnd - wordBegin, beginningOfLine,                                             \
+		    static_cast<uint32_t>(entriesOut.lineOffsets.size()),                             \
+		    readState == EDict2ReadState::Reading);                                           \
+		bufferWriteHead = buffer;                                                             \
+	}
+
+	const char* current = chunkBegin;
+	while (current < chunkEnd)
+	{
+		const char* delimiter = chunkEnd;
+		switch (readState)
+		{
+			case EDict2ReadState::VersionNumber:
+			case EDict2ReadState::EntryId:
+				// Ignore the rest of the line. The first line is a different format to report
+				// version info
+				delimiter =
+				    static_cast<const char*>(std::memchr(current, '\n', chunkEnd - current));
+				if (!delimiter)
+					delimiter = chunkEnd;
+				break;
+			case EDict2ReadState::JapaneseWord:
+			case EDict2ReadState::Reading:
+			{
+				delimiter = findNextDelimiter(readState == EDict2ReadState::JapaneseWord ?
+				                                  japaneseWordDelimiters :
+				                                  readingDelimiters,
+				                              current, chunkEnd);
+				size_t runLength = delimiter - current;
+				// Words are never anywhere near this long; don't overrun the buffer if the file is
+				// malformed
+				if (runLength > static_cast<size_t>(buffer + sizeof(buffer) - bufferWriteHead))
+					runLength = buffer + sizeof(buffer) - bufferWriteHead;
+				if (runLength)
+				{
+					if (bufferWriteHead == buffer)
+						wordBegin = current;
+					wordEnd = current + runLength;
+					std::memcpy(bufferWriteHead, current, runLength);
+					bufferWriteHead += runLength;
+				}
+				break;
+			}
+			case EDict2ReadState::EnglishDefinition:
+				delimiter = findNextDelimiter(englishDefinitionDelimiters, current, chunkEnd);
+				break;
+		}
+
+		if (delimiter == chunkEnd)
+			break;
+
+		const char delimiterCharacter = *delimiter;
+		current = delimiter + 1;
+		if (delimiterCharacter == '\n')
+		{
+			// If this is hit, an entry has a format this state machine doesn't understand
+			assert(readState == EDict2ReadState::VersionNumber ||
+			       readState == EDict2ReadState::EntryId);
+			if (readState != EDict2ReadState::VersionNumber)
+				parseDictionaryEntryLine(beginningOfLine, delimiter - beginningOfLine,
+				                         static_cast<uint32_t>(beginningOfLine - rawDictionary),
+				                         entriesOut);
+			// Reset for the start of next word (words are separated by line). Throw away any
+			// unfinished word so a malformed line can't bleed into the next one
+			beginningOfLine = current;
+			bufferWriteHead = buffer;
+			readState = EDict2ReadState::JapaneseWord;
+			continue;
+		}
+
+		switch (readState)
+		{
+			case EDict2ReadState::JapaneseWord:
+				if (delimiterCharacter == '/')
+				{
+					FINISH_ADD_WORD();
+					readState = EDict2ReadState::EnglishDefinition;
+				}
+				else if (delimiterCharacter == '[')
+				{
+					FINISH_ADD_WORD();
+					readState = EDict2ReadState::Reading;
+				}
+				else if (delimiterCharacter == ';')
+				{
+					// Separate writing of the same word
+					FINISH_ADD_WORD();
+				}
+				// Ignore all spaces
+				break;
+			case EDict2ReadState::Reading:
+				if (delimiterCharacter == ']')
+				{
+					FINISH_ADD_WORD();
+					readState = EDict2ReadState::JapaneseWord;
+				}
+				else if (delimiterCharacter == ';')
+				{
+					// Separate reading
+					FINISH_ADD_WORD();
+				}
+				// Ignore all spaces
+				break;
+			case EDict2ReadState::EnglishDefinition:
+				// Absorb '/' unless it's clearly the entry ID slash. Glosses can contain slashes
+				if (chunkEnd - current >= 4 && std::memcmp(current, "EntL", 4) == 0)
+					readState = EDict2ReadState::EntryId;
+				break;
+			default:
+				break;
+		}
+	}
+
+	// The last line of the file might not have a newline
+	if (beginningOfLine < chunkEnd && readState != EDict2ReadState::VersionNumber)
+		parseDictionaryEntryLine(beginningOfLine, chunkEnd - beginningOfLine,
+		                         static_cast<uint32_t>(beginningOfLine - rawDictionary),
+		                         entriesOut);
+
+#undef FINISH_ADD_WORD
+}
+
+// Each merging thread owns a disjoint set of submaps, so no locking is needed. Chunks are visited
+// in file order so duplicate keys resolve the same way as a serial parse (the last entry wins), and
+// postings end up in file order. chunkFirstEntries is the index of each chunk's first entry
+static void mergeParsedKeys(DictionaryHashMap& entries,
+                            const std::vector<std::vector<ParsedDictionaryKey>>& parsedChunks,
+                            const std::vector<uint32_t>& chunkFirstEntries,
+                            unsigned int threadIndex, unsigned int numThreads,
+                            std::vector<uint32_t>& postingsOut)
+{
+	TRACE_ZONE("mergeParsedKeys");
+	// Counted first, so each key's postings can be given one contiguous range
+	size_t numPostings = 0;
+	for (const std::vector<ParsedDictionaryKey>& parsedKeys : parsedChunks)
+	{
+		for (const ParsedDictionaryKey& parsedKey : parsedKeys)
+		{
+			if (parsedKey.submapIndex % numThreads != threadIndex)
+				continue;
+			DictionaryValue& value = entries[parsedKey.key];
+			value.entry = parsedKey.entry;
+			++value.numPostings;
+			++numPostings;
+		}
+	}
+
+	// No more keys are added, so postingsOut never moves after this
+	postingsOut.resize(numPostings);
+	size_t nextPosting = 0;
+	for (size_t chunkIndex = 0; chunkIndex < parsedChunks.size(); ++chunkIndex)
+	{
+		for (const ParsedDictionaryKey& parsedKey : parsedChunks[chunkIndex])
+		{
+			if (parsedKey.submapIndex % numThreads != threadIndex)
+				continue;
+			DictionaryValue& value = entries.find(parsedKey.key)->second;
+			// First time this key is seen. numPostings then counts back up as they're filled in
+			if (!value.postings)
+			{
+				value.postings = postingsOut.data() + nextPosting;
+				nextPosting += value.numPostings;
+				value.numPostings = 0;
+			}
+			postingsOut[value.postings - postingsOut.data() + value.numPostings++] =
+			    makeDictionaryPosting(chunkFirstEntries[chunkIndex] + parsedKey.entryIndex,
+			                          parsedKey.isReading);
+		}
+	}
+}
+
+bool loadDictionary(const char* filename, Dictionary& dictionaryOut, unsigned int numThreads)
+{
+	TRACE_ZONE("loadDictionary");
+	std::cerr << "Loading dictionary..." << std::flush;
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	if (!mapFile(filename, dictionaryOut.rawFile))
+	{
+		std::cerr << "\nError: could not open dictionary '" << filename << "'\n";
+		return false;
+	}
+	dictionaryOut.rawDictionary = dictionaryOut.rawFile.data;
+	dictionaryOut.rawDictionarySize = dictionaryOut.rawFile.size;
+
+	if (!numThreads)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	// Don't bother splitting tiny files
+	const size_t minimumChunkSize = 64 * 1024;
+	if (dictionaryOut.rawDictionarySize / numThreads < minimumChunkSize)
+		numThreads = std::min(
+		    numThreads,
+		    static_cast<unsigned int>(dictionaryOut.rawDictionarySize / minimumChunkSize) + 1);
+
+	// Split on line boundaries. Chunk i is [chunkStarts[i], chunkStarts[i + 1])
+	const char* rawDictionary = dictionaryOut.rawDictionary;
+	const char* rawDictionaryEnd = rawDictionary + dictionaryOut.rawDictionarySize;
+	std::vector<const char*> chunkStarts;
+	chunkStarts.push_back(rawDictionary);
+	for (unsigned int i = 1; i < numThreads; ++i)
+	{
+		const char* chunkStart =
+		    rawDictionary + (dictionaryOut.rawDictionarySize / numThreads) * i;
+		if (chunkStart < chunkStarts.back())
+			chunkStart = chunkStarts.back();
+		const char* newline = static_cast<const char*>(
+		    std::memchr(chunkStart, '\n', rawDictionaryEnd - chunkStart));
+		if (!newline || newline + 1 == rawDictionaryEnd)
+			break;
+		chunkStarts.push_back(newline + 1);
+	}
+	chunkStarts.push_back(rawDictionaryEnd);
+	const unsigned int numChunks = static_cast<unsigned int>(chunkStarts.size() - 1);
+
+	// About how many keys there are (lower bound!)
+	dictionaryOut.entries.reserve(190000);
+
+	std::vector<std::vector<ParsedDictionaryKey>> parsedChunks(numChunks);
+	std::vector<DictionaryEntryArrays> parsedEntries(numChunks);
+	for (unsigned int i = 0; i < numChunks; ++i)
+		dictionaryOut.keyArenas.push_back(std::unique_ptr<Arena>(new Arena()));
+
+	// The calling thread takes the first chunk/share of the work itself
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < numChunks; ++i)
+		threads.push_back(std::thread(parseDictionaryChunk, std::cref(dictionaryOut.entries),
+		                              rawDictionary, chunkStarts[i], chunkStarts[i + 1], false,
+		                              std::ref(*dictionaryOut.keyArenas[i]),
+		                              std::ref(parsedChunks[i]), std::ref(parsedEntries[i])));
+	parseDictionaryChunk(dictionaryOut.entries, rawDictionary, chunkStarts[0], chunkStarts[1],
+	                     true, *dictionaryOut.keyArenas[0], parsedChunks[0], parsedEntries[0]);
+	for (std::thread& thread : threads)
+		thread.join();
+	threads.clear();
+
+	std::vector<uint32_t> chunkFirstEntries;
+	for (const DictionaryEntryArrays& chunkEntries : parsedEntries)
+	{
+		chunkFirstEntries.push_back(
+		    static_cast<uint32_t>(dictionaryOut.entryArrays.lineOffsets.size()));
+		appendDictionaryEntries(dictionaryOut.entryArrays, chunkEntries);
+	}
+	dictionaryOut.entryTable =
+	    makeDictionaryEntryTable(dictionaryOut.entryArrays, dictionaryOut.rawDictionary);
+
+	dictionaryOut.postingArrays.resize(numChunks);
+	for (unsigned int i = 1; i < numChunks; ++i)
+		threads.push_back(std::thread(mergeParsedKeys, std::ref(dictionaryOut.entries),
+		                              std::cref(parsedChunks), std::cref(chunkFirstEntries), i,
+		                              numChunks, std::ref(dictionaryOut.postingArrays[i])));
+	mergeParsedKeys(dictionaryOut.entries, parsedChunks, chunkFirstEntries, 0, numChunks,
+	                dictionaryOut.postingArrays[0]);
+	for (std::thread& thread : threads)
+		thread.join();
+
+	for (const std::vector<ParsedDictionaryKey>& parsedKeys : parsedChunks)
+	{
+		for (const ParsedDictionaryKey& parsedKey : parsedKeys)
+			dictionaryOut.maxKeyLength = std::max(dictionaryOut.maxKeyLength, parsedKey.key.length);
+	}
+
+	TRACE_COUNTER("dictionary keys", dictionaryOut.entries.size());
+	TRACE_COUNTER("dictionary entries", dictionaryOut.entryTable.numEntries);
+	std::chrono::duration<float, std::milli> loadTime =
+	    std::chrono::steady_clock::now() - startTime;
+	std::cerr << "done in " << loadTime.count() << " ms using " << numChunks
+	          << (numChunks == 1 ? " thread.\n" : " threads.\n") << std::flush;
+	return true;
+}
+
+void freeDictionary(Dictionary& dictionary)
+{
+	dictionary.entries.clear();
+	dictionary.keyArenas.clear();
+	dictionary.postingArrays.clear();
+	dictionary.entryArrays = DictionaryEntryArrays();
+	dictionary.entryTable = DictionaryEntryTable();
+	dictionary.maxKeyLength = 0;
+	unmapFile(dictionary.rawFile);
+	dictionary.rawDictionary = nullptr;
+	dictionary.rawDictionarySize = 0;
+}
+
+const char* findDictionaryEntry(const Dictionary& dictionary, const char* word)
+{
+	DictionaryHashMap::const_iterator findIt = dictionary.entries.find(word);
+	if (findIt == dictionary.entries.end())
+		return nullptr;
+	return findIt->second.entry;
+}
+
+const char* findDictionaryEntry(const Dictionary& dictionary, const char* word, size_t wordLength)
+{
+	DictionaryKey key;
+	key.data = word;
+	key.length = static_cast<uint32_t>(wordLength);
+	DictionaryHashMap::const_iterator findIt = dictionary.entries.find(key);
+	if (findIt == dictionary.entries.end())
+		return nullptr;
+	return findIt->second.entry;
+}
+
+// The shared half of the batch lookups. valuesOut is nullptr for words which aren't present
+static void findDictionaryValues(const Dictionary& dictionary, const DictionaryKey* words,
+                                 size_t numWords, const DictionaryValue** valuesOut)
+{
+	size_t hashes[dictionaryLookupBatchSize];
+	for (size_t blockStart = 0; blockStart < numWords; blockStart += dictionaryLookupBatchSize)
+	{
+		size_t numBlockWords = std::min(dictionaryLookupBatchSize, numWords - blockStart);
+		const DictionaryKey* blockWords = words + blockStart;
+		for (size_t i = 0; i < numBlockWords; ++i)
+		{
+			hashes[i] = dictionary.entries.hash(blockWords[i]);
+			dictionary.entries.prefetch_hash(hashes[i]);
+		}
+		for (size_t i = 0; i < numBlockWords; ++i)
+		{
+			DictionaryHashMap::const_iterator findIt =
+			    dictionary.entries.find(blockWords[i], hashes[i]);
+			valuesOut[blockStart + i] =
+			    findIt != dictionary.entries.end() ? &findIt->second : nullptr;
+		}
+	}
+}
+
+void findDictionaryEntries(const Dictionary& dictionary, const DictionaryKey* words,
+                           size_t numWords, const char** entriesOut)
+{
+	const DictionaryValue* values[dictionaryLookupBatchSize];
+	for (size_t blockStart = 0; blockStart < numWords; blockStart += dictionaryLookupBatchSize)
+	{
+		size_t numBlockWords = std::min(dictionaryLookupBatchSize, numWords - blockStart);
+		findDictionaryValues(dictionary, words + blockStart, numBlockWords, values);
+		for (size_t i = 0; i < numBlockWords; ++i)
+			entriesOut[blockStart + i] = values[i] ? values[i]->entry : nullptr;
+	}
+}
+
+bool findDictionaryPostings(const Dictionary& dictionary, const char* word, size_t wordLength,
+                            DictionaryPostings& postingsOut)
+{
+	DictionaryKey key;
+	key.data = word;
+	key.length = static_cast<uint32_t>(wordLength);
+	findDictionaryPostings(dictionary, &key, 1, &postingsOut);
+	return postingsOut.numPostings != 0;
+}
+
+void findDictionaryPostings(const Dictionary& dictionary, const DictionaryKey* words,
+                            size_t numWords, DictionaryPostings* postingsOut)
+{
+	const DictionaryValue* values[dictionaryLookupBatchSize];
+	for (size_t blockStart = 0; blockStart < numWords; blockStart += dictionaryLookupBatchSize)
+	{
+		size_t numBlockWords = std::min(dictionaryLookupBatchSize, numWords - blockStart);
+		findDictionaryValues(dictionary, words + blockStart, numBlockWords, values);
+		for (size_t i = 0; i < numBlockWords; ++i)
+		{
+			DictionaryPostings& postings = postingsOut[blockStart + i];
+			postings.postings = values[i] ? values[i]->postings : nullptr;
+			postings.numPostings = values[i] ? values[i]->numPostings : 0;
+		}
+	}
+}
+
+bool dictionariesAreEqual(const Dictionary& a, const Dictionary& b)
+{
+	if (a.entries.size() != b.entries.size())
+		return false;
+
+	// Offsets are all relative to rawDictionary
+	const DictionaryEntryArrays& aEntries = a.entryArrays;
+	const DictionaryEntryArrays& bEntries = b.entryArrays;
+	if (aEntries.lineOffsets != bEntries.lineOffsets ||
+	    aEntries.lineLengths != bEntries.lineLengths || aEntries.ids != bEntries.ids ||
+	    aEntries.tags != bEntries.tags || aEntries.firstSpans != bEntries.firstSpans ||
+	    aEntries.spanCounts != bEntries.spanCounts ||
+	    aEntries.spans.size() != bEntries.spans.size())
+		return false;
+	for (size_t i = 0; i < aEntries.spans.size(); ++i)
+	{
+		if (aEntries.spans[i].offset != bEntries.spans[i].offset ||
+		    aEntries.spans[i].length != bEntries.spans[i].length)
+			return false;
+	}
+
+	for (DictionaryHashMap::const_iterator it = a.entries.begin(); it != a.entries.end(); ++it)
+	{
+		DictionaryHashMap::const_iterator findIt = b.entries.find(it->first);
+		if (findIt == b.entries.end())
+			return false;
+		const DictionaryValue& aValue = it->second;
+		const DictionaryValue& bValue = findIt->second;
+		// Postings are entry indices, so they compare directly
+		if (aValue.entry - a.rawDictionary != bValue.entry - b.rawDictionary ||
+		    aValue.numPostings != bValue.numPostings ||
+		    !std::equal(aValue.postings, aValue.postings + aValue.numPostings, bValue.postings))
+			return false;
+	}
+	return true;
+}
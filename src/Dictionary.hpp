@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <phmap.h>
+
+#include "Arena.hpp"
+#include "DictionaryEntryTable.hpp"
+#include "MappedFile.hpp"
+
+// FNV-1a. Stored in the dictionary index, so changing this requires bumping
+// dictionaryIndexVersion
+inline uint32_t hashDictionaryKey(const char* key, size_t keyLength)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < keyLength; ++i)
+	{
+		hash ^= static_cast<unsigned char>(key[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Points either into Dictionary::rawDictionary or Dictionary::keyArena. Not null-terminated
+struct DictionaryKey
+{
+	const char* data;
+	uint32_t length;
+};
+
+// Both transparent so lookups by const char* don't need to build a key (or a std::string)
+struct DictionaryKeyHash
+{
+	typedef void is_transparent;
+
+	size_t operator()(const DictionaryKey& key) const
+	{
+		return hashDictionaryKey(key.data, key.length);
+	}
+	size_t operator()(const char* key) const
+	{
+		return hashDictionaryKey(key, std::strlen(key));
+	}
+};
+
+struct DictionaryKeyEqual
+{
+	typedef void is_transparent;
+
+	bool operator()(const DictionaryKey& a, const DictionaryKey& b) const
+	{
+		return a.length == b.length && std::memcmp(a.data, b.data, a.length) == 0;
+	}
+	bool operator()(const DictionaryKey& a, const char* b) const
+	{
+		return std::strncmp(a.data, b, a.length) == 0 && b[a.length] == '\0';
+	}
+	bool operator()(const char* a, const DictionaryKey& b) const
+	{
+		return operator()(b, a);
+	}
+};
+
+// One key can be the headword (written form) of some entries and the reading of others, and many
+// entries can share it, e.g. かく is the reading of 書く, 描く, 欠く... A posting is one of these,
+// packed as the entry's index in the DictionaryEntryTable shifted up by one, with the bottom bit
+// set if the key is the entry's reading
+inline uint32_t makeDictionaryPosting(uint32_t entryIndex, bool isReading)
+{
+	return (entryIndex << 1) | (isReading ? 1 : 0);
+}
+inline uint32_t getDictionaryPostingEntryIndex(uint32_t posting)
+{
+	return posting >> 1;
+}
+inline bool isDictionaryPostingReading(uint32_t posting)
+{
+	return posting & 1;
+}
+
+// Every entry a key appears in, in file order (so ascending by entry index). Points into the
+// dictionary or its index
+struct DictionaryPostings
+{
+	const uint32_t* postings;
+	uint32_t numPostings;
+};
+
+struct DictionaryValue
+{
+	// The start of the entry line in rawDictionary. If several entries have this key (as headwords
+	// or readings), the last one in the file
+	const char* entry;
+	// Into Dictionary::postingArrays
+	const uint32_t* postings;
+	uint32_t numPostings;
+};
+
+// Sharded so the parsing threads can each fill their own submaps without locking
+typedef phmap::parallel_flat_hash_map<DictionaryKey, DictionaryValue, DictionaryKeyHash,
+                                      DictionaryKeyEqual>
+    DictionaryHashMap;
+
+// EDICT2 parsed in memory
+struct Dictionary
+{
+	DictionaryHashMap entries;
+	MappedFile rawFile;
+	const char* rawDictionary = nullptr;
+	size_t rawDictionarySize = 0;
+	// Only keys which aren't contiguous in rawDictionary (i.e. had spaces stripped) live here. One
+	// per parsing thread
+	std::vector<std::unique_ptr<Arena>> keyArenas;
+	// Every key's postings are contiguous in one of these. One per merging thread
+	std::vector<std::vector<uint32_t>> postingArrays;
+	// Every entry line but the version line, in file order. entryTable views entryArrays
+	DictionaryEntryArrays entryArrays;
+	DictionaryEntryTable entryTable;
+	// In bytes
+	uint32_t maxKeyLength = 0;
+};
+
+// Parse the UTF-8 EDICT2 file. This takes a while; see DictionaryIndex.hpp for the fast path.
+// The file is split at line boundaries and parsed on numThreads threads (0 = one per core). The
+// result is identical regardless of thread count
+bool loadDictionary(const char* filename, Dictionary& dictionaryOut, unsigned int numThreads = 0);
+void freeDictionary(Dictionary& dictionary);
+
+// Returns the start of the entry line, or nullptr if the word isn't in the dictionary
+const char* findDictionaryEntry(const Dictionary& dictionary, const char* word);
+const char* findDictionaryEntry(const Dictionary& dictionary, const char* word,
+                                size_t wordLength);
+
+// How many words the batch lookups (findDictionaryEntries() etc.) hash and prefetch ahead. Enough
+// to cover memory latency without the prefetched lines being evicted before they're used
+static const size_t dictionaryLookupBatchSize = 16;
+
+// findDictionaryEntry() for each of numWords words, written to entriesOut. Faster than calling it
+// in a loop because each bucket is prefetched before any is probed
+void findDictionaryEntries(const Dictionary& dictionary, const DictionaryKey* words,
+                           size_t numWords, const char** entriesOut);
+
+// Every entry the word appears in. Returns false (and empty postings) if there are none
+bool findDictionaryPostings(const Dictionary& dictionary, const char* word, size_t wordLength,
+                            DictionaryPostings& postingsOut);
+// findDictionaryPostings() for each of numWords words, prefetching like findDictionaryEntries()
+void findDictionaryPostings(const Dictionary& dictionary, const DictionaryKey* words,
+                            size_t numWords, DictionaryPostings* postingsOut);
+
+// For verifying the parallel loader. Returns true if both have the same keys mapping to the same
+// entries, postings and entry table (relative to their own rawDictionary)
+bool dictionariesAreEqual(const Dictionary& a, const Dictionary& b);
@@ -0,0 +1,296 @@
+#include "DictionaryEntryTable.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+struct DictionaryTagName
+{
+	const char* name;
+	DictionaryTag tag;
+};
+
+// Sorted by name (strcmp order) so they can be binary searched
+static const DictionaryTagName dictionaryTagNames[] = {
+    {"P", DictionaryTag::Priority},
+    {"abbr", DictionaryTag::Abbreviation},
+    {"adj-f", DictionaryTag::PreNominal},
+    {"adj-i", DictionaryTag::IAdjective},
+    {"adj-ix", DictionaryTag::IAdjectiveIi},
+    {"adj-na", DictionaryTag::NaAdjective},
+    {"adj-no", DictionaryTag::NoAdjective},
+    {"adj-pn", DictionaryTag::PreNounAdjectival},
+    {"adj-t", DictionaryTag::TaruAdjective},
+    {"adv", DictionaryTag::Adverb},
+    {"adv-to", DictionaryTag::ToAdverb},
+    {"arch", DictionaryTag::Archaic},
+    {"aux", DictionaryTag::Auxiliary},
+    {"aux-adj", DictionaryTag::AuxiliaryAdjective},
+    {"aux-v", DictionaryTag::AuxiliaryVerb},
+    {"col", DictionaryTag::Colloquial},
+    {"conj", DictionaryTag::Conjunction},
+    {"cop", DictionaryTag::Copula},
+    {"cop-da", DictionaryTag::Copula},
+    {"ctr", DictionaryTag::Counter},
+    {"exp", DictionaryTag::Expression},
+    {"hon", DictionaryTag::Honorific},
+    {"hum", DictionaryTag::Humble},
+    {"id", DictionaryTag::Idiomatic},
+    {"int", DictionaryTag::Interjection},
+    {"n", DictionaryTag::Noun},
+    {"n-adv", DictionaryTag::AdverbialNoun},
+    {"n-pref", DictionaryTag::NounPrefix},
+    {"n-suf", DictionaryTag::NounSuffix},
+    {"n-t", DictionaryTag::TemporalNoun},
+    {"num", DictionaryTag::Numeric},
+    {"obs", DictionaryTag::Obsolete},
+    {"on-mim", DictionaryTag::Onomatopoeia},
+    {"pn", DictionaryTag::Pronoun},
+    {"pol", DictionaryTag::Polite},
+    {"pref", DictionaryTag::Prefix},
+    {"prt", DictionaryTag::Particle},
+    {"rare", DictionaryTag::Rare},
+    {"sl", DictionaryTag::Slang},
+    {"suf", DictionaryTag::Suffix},
+    {"uK", DictionaryTag::UsuallyKanji},
+    {"uk", DictionaryTag::UsuallyKana},
+    {"v1", DictionaryTag::IchidanVerb},
+    {"v1-s", DictionaryTag::IchidanKureruVerb},
+    {"v5aru", DictionaryTag::GodanAruVerb},
+    {"v5b", DictionaryTag::GodanBuVerb},
+    {"v5g", DictionaryTag::GodanGuVerb},
+    {"v5k", DictionaryTag::GodanKuVerb},
+    {"v5k-s", DictionaryTag::GodanIkuVerb},
+    {"v5m", DictionaryTag::GodanMuVerb},
+    {"v5n", DictionaryTag::GodanNuVerb},
+    {"v5r", DictionaryTag::GodanRuVerb},
+    {"v5r-i", DictionaryTag::GodanRuIrregularVerb},
+    {"v5s", DictionaryTag::GodanSuVerb},
+    {"v5t", DictionaryTag::GodanTsuVerb},
+    {"v5u", DictionaryTag::GodanUVerb},
+    {"v5u-s", DictionaryTag::GodanUSpecialVerb},
+    {"vi", DictionaryTag::IntransitiveVerb},
+    {"vk", DictionaryTag::KuruVerb},
+    {"vs", DictionaryTag::SuruNoun},
+    {"vs-i", DictionaryTag::SuruIrregularVerb},
+    {"vs-s", DictionaryTag::SuruSpecialVerb},
+    {"vt", DictionaryTag::TransitiveVerb},
+    {"vz", DictionaryTag::ZuruVerb},
+};
+
+bool findDictionaryTag(const char* name, size_t nameLength, DictionaryTag& tagOut)
+{
+	const DictionaryTagName* tagNamesEnd =
+	    dictionaryTagNames + sizeof(dictionaryTagNames) / sizeof(dictionaryTagNames[0]);
+	const DictionaryTagName* tagName = std::lower_bound(
+	    dictionaryTagNames, tagNamesEnd, nullptr,
+	    [name, nameLength](const DictionaryTagName& tagName, const void*) {
+		    int order = std::strncmp(tagName.name, name, nameLength);
+		    // Equal up to nameLength, so it's only less if it's exactly as long
+		    return order != 0 ? order < 0 : false;
+	    });
+	if (tagName == tagNamesEnd || std::strncmp(tagName->name, name, nameLength) != 0 ||
+	    tagName->name[nameLength] != '\0')
+		return false;
+	tagOut = tagName->tag;
+	return true;
+}
+
+static bool isDigits(const char* text, const char* textEnd)
+{
+	for (; text < textEnd; ++text)
+	{
+		if (*text < '0' || *text > '9')
+			return false;
+	}
+	return true;
+}
+
+// Parses a run of groups like "(v5s,vt) (1) {comp} " from the start of [text, textEnd), adding
+// their tags. Stops at the first group which isn't tags (e.g. "(as in ...)", which is part of a
+// gloss). Returns where the rest of the text starts
+static const char* parseTagGroups(const char* text, const char* textEnd, uint64_t& tagsOut)
+{
+	while (text < textEnd)
+	{
+		if (*text == ' ')
+		{
+			++text;
+			continue;
+		}
+		if (*text != '(' && *text != '{')
+			break;
+		const char closing = *text == '(' ? ')' : '}';
+		const char* groupEnd =
+		    static_cast<const char*>(std::memchr(text, closing, textEnd - text));
+		if (!groupEnd)
+			break;
+
+		// Fields of use, e.g. {comp}, aren't worth a tag but shouldn't be part of the gloss
+		bool isTagGroup = closing == '}' || isDigits(text + 1, groupEnd);
+		uint64_t groupTags = 0;
+		for (const char* name = text + 1; name < groupEnd && closing == ')';)
+		{
+			const char* nameEnd =
+			    static_cast<const char*>(std::memchr(name, ',', groupEnd - name));
+			if (!nameEnd)
+				nameEnd = groupEnd;
+			DictionaryTag tag;
+			if (findDictionaryTag(name, nameEnd - name, tag))
+			{
+				groupTags |= getDictionaryTagBit(tag);
+				isTagGroup = true;
+			}
+			name = nameEnd + 1;
+		}
+		if (!isTagGroup)
+			break;
+		tagsOut |= groupTags;
+		text = groupEnd + 1;
+	}
+	return text;
+}
+
+// Headwords or readings, separated by ';'. Each can be followed by tags, e.g. 渡す(P) or
+// かく(書く) (readings which only apply to some headwords), which aren't part of the word
+static uint32_t parseWords(const char* text, const char* textEnd, const char* dictionaryText,
+                           uint64_t& tagsOut, std::vector<DictionaryTextSpan>& spansOut)
+{
+	uint32_t numWords = 0;
+	while (text < textEnd)
+	{
+		const char* wordEnd = static_cast<const char*>(std::memchr(text, ';', textEnd - text));
+		if (!wordEnd)
+			wordEnd = textEnd;
+		const char* tagsStart = static_cast<const char*>(std::memchr(text, '(', wordEnd - text));
+		if (tagsStart)
+			parseTagGroups(tagsStart, wordEnd, tagsOut);
+		const char* wordStart = text;
+		const char* wordTextEnd = tagsStart ? tagsStart : wordEnd;
+		while (wordStart < wordTextEnd && *wordStart == ' ')
+			++wordStart;
+		while (wordTextEnd > wordStart && wordTextEnd[-1] == ' ')
+			--wordTextEnd;
+		// The count is packed into 8 bits
+		if (wordTextEnd > wordStart && numWords < 0xFF)
+		{
+			DictionaryTextSpan span;
+			span.offset = static_cast<uint32_t>(wordStart - dictionaryText);
+			span.length = static_cast<uint32_t>(wordTextEnd - wordStart);
+			spansOut.push_back(span);
+			++numWords;
+		}
+		text = wordEnd + 1;
+	}
+	return numWords;
+}
+
+void parseDictionaryEntryLine(const char* line, size_t lineLength, uint32_t lineOffset,
+                              DictionaryEntryArrays& entriesOut)
+{
+	// Spans are relative to the start of the dictionary text
+	const char* dictionaryText = line - lineOffset;
+	const char* lineEnd = line + lineLength;
+	uint64_t tags = 0;
+	uint32_t id = 0;
+	const size_t firstSpan = entriesOut.spans.size();
+
+	const char* glossesStart = static_cast<const char*>(std::memchr(line, '/', lineLength));
+	if (!glossesStart)
+		glossesStart = lineEnd;
+	const char* readingsStart =
+	    static_cast<const char*>(std::memchr(line, '[', glossesStart - line));
+	const char* readingsEnd = nullptr;
+	if (readingsStart)
+		readingsEnd = static_cast<const char*>(
+		    std::memchr(readingsStart, ']', glossesStart - readingsStart));
+	if (!readingsEnd)
+		readingsStart = nullptr;
+
+	uint32_t numHeadwords = parseWords(line, readingsStart ? readingsStart : glossesStart,
+	                                   dictionaryText, tags, entriesOut.spans);
+	uint32_t numReadings = readingsStart ? parseWords(readingsStart + 1, readingsEnd,
+	                                                  dictionaryText, tags, entriesOut.spans) :
+	                                       0;
+
+	uint32_t numGlosses = 0;
+	const char* gloss = glossesStart + 1;
+	while (gloss < lineEnd)
+	{
+		const char* glossEnd = static_cast<const char*>(std::memchr(gloss, '/', lineEnd - gloss));
+		if (!glossEnd)
+			glossEnd = lineEnd;
+
+		if (glossEnd - gloss > 4 && std::memcmp(gloss, "EntL", 4) == 0)
+		{
+			for (const char* digit = gloss + 4; digit < glossEnd && *digit >= '0' && *digit <= '9';
+			     ++digit)
+				id = id * 10 + (*digit - '0');
+		}
+		else
+		{
+			// Tags and sense numbers come first, e.g. (v5s,vt) (1) to ferry across. A gloss of
+			// nothing but tags is (P)
+			const char* glossText = parseTagGroups(gloss, glossEnd, tags);
+			if (glossText < glossEnd && numGlosses < 0xFFFF)
+			{
+				DictionaryTextSpan span;
+				span.offset = static_cast<uint32_t>(glossText - dictionaryText);
+				span.length = static_cast<uint32_t>(glossEnd - glossText);
+				entriesOut.spans.push_back(span);
+				++numGlosses;
+			}
+		}
+		gloss = glossEnd + 1;
+	}
+
+	entriesOut.lineOffsets.push_back(lineOffset);
+	entriesOut.lineLengths.push_back(static_cast<uint32_t>(lineLength));
+	entriesOut.ids.push_back(id);
+	entriesOut.tags.push_back(tags);
+	entriesOut.firstSpans.push_back(static_cast<uint32_t>(firstSpan));
+	entriesOut.spanCounts.push_back(
+	    packDictionarySpanCounts(numHeadwords, numReadings, numGlosses));
+}
+
+void appendDictionaryEntries(DictionaryEntryArrays& to, const DictionaryEntryArrays& from)
+{
+	const uint32_t spanOffset = static_cast<uint32_t>(to.spans.size());
+	to.lineOffsets.insert(to.lineOffsets.end(), from.lineOffsets.begin(), from.lineOffsets.end());
+	to.lineLengths.insert(to.lineLengths.end(), from.lineLengths.begin(), from.lineLengths.end());
+	to.ids.insert(to.ids.end(), from.ids.begin(), from.ids.end());
+	to.tags.insert(to.tags.end(), from.tags.begin(), from.tags.end());
+	for (uint32_t firstSpan : from.firstSpans)
+		to.firstSpans.push_back(firstSpan + spanOffset);
+	to.spanCounts.insert(to.spanCounts.end(), from.spanCounts.begin(), from.spanCounts.end());
+	to.spans.insert(to.spans.end(), from.spans.begin(), from.spans.end());
+}
+
+DictionaryEntryTable makeDictionaryEntryTable(const DictionaryEntryArrays& entries,
+                                              const char* text)
+{
+	DictionaryEntryTable table;
+	table.text = text;
+	table.numEntries = static_cast<uint32_t>(entries.lineOffsets.size());
+	table.numSpans = static_cast<uint32_t>(entries.spans.size());
+	table.lineOffsets = entries.lineOffsets.data();
+	table.lineLengths = entries.lineLengths.data();
+	table.ids = entries.ids.data();
+	table.tags = entries.tags.data();
+	table.firstSpans = entries.firstSpans.data();
+	table.spanCounts = entries.spanCounts.data();
+	table.spans = entries.spans.data();
+	return table;
+}
+
+uint32_t findDictionaryEntryIndex(const DictionaryEntryTable& table, const char* line)
+{
+	// Entries are in file order, so their offsets are sorted
+	if (line < table.text)
+		return table.numEntries;
+	const uint32_t* lineOffsetsEnd = table.lineOffsets + table.numEntries;
+	const uint32_t* lineOffset = std::lower_bound(table.lineOffsets, lineOffsetsEnd,
+	                                              static_cast<uint32_t>(line - table.text));
+	if (lineOffset == lineOffsetsEnd || table.text + *lineOffset != line)
+		return table.numEntries;
+	return static_cast<uint32_t>(lineOffset - table.lineOffsets);
+}
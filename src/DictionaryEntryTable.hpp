@@ -0,0 +1,244 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Every EDICT2 entry line, parsed once on load so nothing needs to re-scan the line for its
+// fields. Stored as parallel arrays indexed by entry (in file order), so a pass over one field
+// (e.g. the tags, while deinflecting) only touches that field's memory. Text fields are spans of
+// the dictionary text itself, so there's no copy of it. The same arrays are written to the
+// dictionary index (see DictionaryIndex.hpp).
+//
+// 渡す(P);渡 [わたす] /(v5s,vt) (1) to ferry across/(2) to hand over/(P)/EntL1560100X/
+// has headwords 渡す and 渡, reading わたす, glosses "to ferry across" and "to hand over", the
+// tags v5s, vt and priority, and ID 1560100.
+
+// Part of speech and usage tags. Each is one bit of DictionaryEntryTable::tags. Only tags which
+// are useful to look at are here; the rest are ignored
+enum class DictionaryTag
+{
+	// Common word: (P) anywhere in the entry
+	Priority = 0,
+
+	// Nouns and pronouns
+	Noun,
+	AdverbialNoun,
+	TemporalNoun,
+	NounPrefix,
+	NounSuffix,
+	Pronoun,
+	Counter,
+	Numeric,
+
+	// Adjectives
+	IAdjective,
+	IAdjectiveIi,
+	NaAdjective,
+	NoAdjective,
+	PreNounAdjectival,
+	TaruAdjective,
+	PreNominal,
+
+	// Verbs
+	IchidanVerb,
+	IchidanKureruVerb,
+	GodanAruVerb,
+	GodanBuVerb,
+	GodanGuVerb,
+	GodanKuVerb,
+	GodanIkuVerb,
+	GodanMuVerb,
+	GodanNuVerb,
+	GodanRuVerb,
+	GodanRuIrregularVerb,
+	GodanSuVerb,
+	GodanTsuVerb,
+	GodanUVerb,
+	GodanUSpecialVerb,
+	KuruVerb,
+	// Nouns which take する, e.g. 勉強
+	SuruNoun,
+	SuruSpecialVerb,
+	SuruIrregularVerb,
+	ZuruVerb,
+	TransitiveVerb,
+	IntransitiveVerb,
+	AuxiliaryVerb,
+	AuxiliaryAdjective,
+
+	// Everything else
+	Adverb,
+	ToAdverb,
+	Auxiliary,
+	Conjunction,
+	Copula,
+	Expression,
+	Interjection,
+	Particle,
+	Prefix,
+	Suffix,
+
+	// Usage
+	UsuallyKana,
+	UsuallyKanji,
+	Colloquial,
+	Honorific,
+	Humble,
+	Polite,
+	Archaic,
+	Obsolete,
+	Rare,
+	Slang,
+	Abbreviation,
+	Onomatopoeia,
+	Idiomatic,
+
+	Count
+};
+static_assert(static_cast<int>(DictionaryTag::Count) <= 64, "Tags must fit in a uint64_t");
+
+inline uint64_t getDictionaryTagBit(DictionaryTag tag)
+{
+	return uint64_t(1) << static_cast<int>(tag);
+}
+
+// Which tag an EDICT2 abbreviation (e.g. "v5s") is. Returns false for unknown ones
+bool findDictionaryTag(const char* name, size_t nameLength, DictionaryTag& tagOut);
+
+// In the dictionary text
+struct DictionaryTextSpan
+{
+	uint32_t offset;
+	uint32_t length;
+};
+
+// The number of each kind of span an entry has, packed into a uint32_t
+inline uint32_t packDictionarySpanCounts(uint32_t numHeadwords, uint32_t numReadings,
+                                         uint32_t numGlosses)
+{
+	return numHeadwords | (numReadings << 8) | (numGlosses << 16);
+}
+
+// What the loader builds. See DictionaryEntryTable for what each array holds
+struct DictionaryEntryArrays
+{
+	std::vector<uint32_t> lineOffsets;
+	std::vector<uint32_t> lineLengths;
+	std::vector<uint32_t> ids;
+	std::vector<uint64_t> tags;
+	std::vector<uint32_t> firstSpans;
+	std::vector<uint32_t> spanCounts;
+	std::vector<DictionaryTextSpan> spans;
+};
+
+// Parse the entry line [line, line + lineLength) (not including the newline), which starts at
+// lineOffset in the dictionary text, and append it to entriesOut. Every line gets an entry, even
+// if it's malformed, so entry indices always match line numbers
+void parseDictionaryEntryLine(const char* line, size_t lineLength, uint32_t lineOffset,
+                              DictionaryEntryArrays& entriesOut);
+
+// Append every entry of from to to. Span offsets are already relative to the whole dictionary text
+void appendDictionaryEntries(DictionaryEntryArrays& to, const DictionaryEntryArrays& from);
+
+// Read-only view of the arrays, either a DictionaryEntryArrays or mapped from the index
+struct DictionaryEntryTable
+{
+	const char* text = nullptr;
+	uint32_t numEntries = 0;
+	uint32_t numSpans = 0;
+	// Where each entry's line starts in text, and how long it is (not including the newline)
+	const uint32_t* lineOffsets = nullptr;
+	const uint32_t* lineLengths = nullptr;
+	// EntL number, or 0 if it doesn't have one
+	const uint32_t* ids = nullptr;
+	// DictionaryTag bits
+	const uint64_t* tags = nullptr;
+	// The entry's headwords, then readings, then glosses, are contiguous in spans starting here
+	const uint32_t* firstSpans = nullptr;
+	// packDictionarySpanCounts()
+	const uint32_t* spanCounts = nullptr;
+	const DictionaryTextSpan* spans = nullptr;
+};
+
+DictionaryEntryTable makeDictionaryEntryTable(const DictionaryEntryArrays& entries,
+                                              const char* text);
+
+// Which entry the line starting at line (in table.text) is, or numEntries if no line starts there
+uint32_t findDictionaryEntryIndex(const DictionaryEntryTable& table, const char* line);
+
+// A field of an entry, or a whole line. Not null-terminated
+struct DictionaryEntryView
+{
+	// nullptr if there is no such entry
+	const char* data;
+	size_t length;
+};
+
+// Field access. None of these check entryIndex (or the headword, reading or gloss index) is in
+// range
+
+inline DictionaryEntryView getDictionaryEntryLine(const DictionaryEntryTable& table,
+                                                  uint32_t entryIndex)
+{
+	DictionaryEntryView line;
+	line.data = table.text + table.lineOffsets[entryIndex];
+	line.length = table.lineLengths[entryIndex];
+	return line;
+}
+
+inline bool hasDictionaryEntryTag(const DictionaryEntryTable& table, uint32_t entryIndex,
+                                  DictionaryTag tag)
+{
+	return table.tags[entryIndex] & getDictionaryTagBit(tag);
+}
+
+inline uint32_t getDictionaryEntryNumHeadwords(const DictionaryEntryTable& table,
+                                               uint32_t entryIndex)
+{
+	return table.spanCounts[entryIndex] & 0xFF;
+}
+
+inline uint32_t getDictionaryEntryNumReadings(const DictionaryEntryTable& table,
+                                              uint32_t entryIndex)
+{
+	return (table.spanCounts[entryIndex] >> 8) & 0xFF;
+}
+
+inline uint32_t getDictionaryEntryNumGlosses(const DictionaryEntryTable& table,
+                                             uint32_t entryIndex)
+{
+	return table.spanCounts[entryIndex] >> 16;
+}
+
+inline DictionaryEntryView getDictionaryEntrySpan(const DictionaryEntryTable& table,
+                                                  uint32_t spanIndex)
+{
+	DictionaryEntryView field;
+	field.data = table.text + table.spans[spanIndex].offset;
+	field.length = table.spans[spanIndex].length;
+	return field;
+}
+
+inline DictionaryEntryView getDictionaryEntryHeadword(const DictionaryEntryTable& table,
+                                                      uint32_t entryIndex, uint32_t headwordIndex)
+{
+	return getDictionaryEntrySpan(table, table.firstSpans[entryIndex] + headwordIndex);
+}
+
+inline DictionaryEntryView getDictionaryEntryReading(const DictionaryEntryTable& table,
+                                                     uint32_t entryIndex, uint32_t readingIndex)
+{
+	return getDictionaryEntrySpan(table, table.firstSpans[entryIndex] +
+	                                         getDictionaryEntryNumHeadwords(table, entryIndex) +
+	                                         readingIndex);
+}
+
+inline DictionaryEntryView getDictionaryEntryGloss(const DictionaryEntryTable& table,
+                                                   uint32_t entryIndex, uint32_t glossIndex)
+{
+	return getDictionaryEntrySpan(table, table.firstSpans[entryIndex] +
+	                                         getDictionaryEntryNumHeadwords(table, entryIndex) +
+	                                         getDictionaryEntryNumReadings(table, entryIndex) +
+	                                         glossIndex);
+}
@@ -0,0 +1,399 @@
+#include "DictionaryIndex.hpp"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Keep the table at most half full so probe sequences stay short
+static uint32_t slotCountForKeys(size_t numKeys)
+{
+	uint32_t numSlots = 16;
+	while (numSlots < numKeys * 2)
+		numSlots *= 2;
+	return numSlots;
+}
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static void writePadding(std::ofstream& outputFile, uint64_t currentOffset, uint64_t targetOffset)
+{
+	static const char zeroes[64] = {0};
+	while (currentOffset < targetOffset)
+	{
+		uint64_t numToWrite = targetOffset - currentOffset;
+		if (numToWrite > sizeof(zeroes))
+			numToWrite = sizeof(zeroes);
+		outputFile.write(zeroes, numToWrite);
+		currentOffset += numToWrite;
+	}
+}
+
+// Pad from currentOffset up to sectionOffset, then write the section. currentOffset is left at
+// the end of it
+static void writeSection(std::ofstream& outputFile, uint64_t& currentOffset,
+                         uint64_t sectionOffset, const void* data, uint64_t size)
+{
+	writePadding(outputFile, currentOffset, sectionOffset);
+	outputFile.write(static_cast<const char*>(data), size);
+	currentOffset = sectionOffset + size;
+}
+
+// Where the section after one ending at previousEnd starts
+static uint64_t nextSectionOffset(uint64_t previousEnd)
+{
+	return alignOffset(previousEnd, 64);
+}
+
+bool writeDictionaryIndex(const Dictionary& dictionary, const char* sourceFilename,
+                          const char* indexFilename)
+{
+	struct stat sourceStat;
+	if (stat(sourceFilename, &sourceStat) != 0)
+	{
+		std::cerr << "Error: could not stat '" << sourceFilename << "'\n";
+		return false;
+	}
+
+	DictionaryIndexHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, dictionaryIndexMagic, sizeof(header.magic));
+	header.version = dictionaryIndexVersion;
+	header.numKeys = static_cast<uint32_t>(dictionary.entries.size());
+	header.numSlots = slotCountForKeys(dictionary.entries.size());
+	header.sourceSize = static_cast<uint64_t>(sourceStat.st_size);
+	header.sourceModifiedTime = static_cast<int64_t>(sourceStat.st_mtime);
+
+	std::vector<DictionaryIndexSlot> slots(header.numSlots);
+	std::memset(slots.data(), 0, slots.size() * sizeof(DictionaryIndexSlot));
+	std::vector<char> keyPool;
+	std::vector<uint32_t> postings;
+	std::vector<DictionaryTrieKey> trieKeys;
+	trieKeys.reserve(dictionary.entries.size());
+	const uint32_t slotMask = header.numSlots - 1;
+	for (DictionaryHashMap::const_iterator it = dictionary.entries.begin();
+	     it != dictionary.entries.end(); ++it)
+	{
+		const DictionaryKey& key = it->first;
+		uint32_t hash = hashDictionaryKey(key.data, key.length);
+		uint32_t slotIndex = hash & slotMask;
+		while (slots[slotIndex].keyLength)
+			slotIndex = (slotIndex + 1) & slotMask;
+
+		DictionaryIndexSlot& slot = slots[slotIndex];
+		slot.hash = hash;
+		slot.keyOffset = static_cast<uint32_t>(keyPool.size());
+		slot.keyLength = key.length;
+		slot.entryOffset = static_cast<uint32_t>(it->second.entry - dictionary.rawDictionary);
+		slot.firstPosting = static_cast<uint32_t>(postings.size());
+		slot.numPostings = it->second.numPostings;
+		keyPool.insert(keyPool.end(), key.data, key.data + key.length);
+		postings.insert(postings.end(), it->second.postings,
+		                it->second.postings + it->second.numPostings);
+
+		DictionaryTrieKey trieKey;
+		trieKey.data = key.data;
+		trieKey.length = key.length;
+		trieKey.value = slotIndex;
+		trieKeys.push_back(trieKey);
+	}
+
+	std::vector<DictionaryTrieUnit> trie;
+	buildDictionaryTrie(trieKeys, trie);
+
+	const DictionaryEntryArrays& entries = dictionary.entryArrays;
+	const uint64_t entriesSize = entries.lineOffsets.size() * sizeof(uint32_t);
+	header.slotsOffset = nextSectionOffset(sizeof(header));
+	header.keyPoolOffset = header.slotsOffset + slots.size() * sizeof(DictionaryIndexSlot);
+	header.keyPoolSize = keyPool.size();
+	header.postingsOffset = nextSectionOffset(header.keyPoolOffset + header.keyPoolSize);
+	header.numPostings = postings.size();
+	header.trieOffset =
+	    nextSectionOffset(header.postingsOffset + header.numPostings * sizeof(uint32_t));
+	header.numTrieUnits = trie.size();
+	header.numEntries = entries.lineOffsets.size();
+	header.numSpans = entries.spans.size();
+	header.entryLineOffsetsOffset =
+	    nextSectionOffset(header.trieOffset + header.numTrieUnits * sizeof(DictionaryTrieUnit));
+	header.entryLineLengthsOffset = nextSectionOffset(header.entryLineOffsetsOffset + entriesSize);
+	header.entryIdsOffset = nextSectionOffset(header.entryLineLengthsOffset + entriesSize);
+	header.entryTagsOffset = nextSectionOffset(header.entryIdsOffset + entriesSize);
+	header.entryFirstSpansOffset =
+	    nextSectionOffset(header.entryTagsOffset + header.numEntries * sizeof(uint64_t));
+	header.entrySpanCountsOffset = nextSectionOffset(header.entryFirstSpansOffset + entriesSize);
+	header.entrySpansOffset = nextSectionOffset(header.entrySpanCountsOffset + entriesSize);
+	header.textOffset =
+	    nextSectionOffset(header.entrySpansOffset + header.numSpans * sizeof(DictionaryTextSpan));
+	header.textSize = dictionary.rawDictionarySize;
+
+	// Other processes may have the old index mapped, so never rewrite it in place. Write next to
+	// it and rename over it; existing mappings keep the old inode until they're unmapped
+	std::string temporaryFilename = std::string(indexFilename) + ".tmp";
+	std::ofstream outputFile;
+	outputFile.open(temporaryFilename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!outputFile.is_open())
+	{
+		std::cerr << "Error: could not open '" << temporaryFilename << "' for writing\n";
+		return false;
+	}
+
+	uint64_t currentOffset = 0;
+	writeSection(outputFile, currentOffset, 0, &header, sizeof(header));
+	writeSection(outputFile, currentOffset, header.slotsOffset, slots.data(),
+	             slots.size() * sizeof(DictionaryIndexSlot));
+	writeSection(outputFile, currentOffset, header.keyPoolOffset, keyPool.data(), keyPool.size());
+	writeSection(outputFile, currentOffset, header.postingsOffset, postings.data(),
+	             postings.size() * sizeof(uint32_t));
+	writeSection(outputFile, currentOffset, header.trieOffset, trie.data(),
+	             trie.size() * sizeof(DictionaryTrieUnit));
+	writeSection(outputFile, currentOffset, header.entryLineOffsetsOffset,
+	             entries.lineOffsets.data(), entriesSize);
+	writeSection(outputFile, currentOffset, header.entryLineLengthsOffset,
+	             entries.lineLengths.data(), entriesSize);
+	writeSection(outputFile, currentOffset, header.entryIdsOffset, entries.ids.data(),
+	             entriesSize);
+	writeSection(outputFile, currentOffset, header.entryTagsOffset, entries.tags.data(),
+	             entries.tags.size() * sizeof(uint64_t));
+	writeSection(outputFile, currentOffset, header.entryFirstSpansOffset,
+	             entries.firstSpans.data(), entriesSize);
+	writeSection(outputFile, currentOffset, header.entrySpanCountsOffset,
+	             entries.spanCounts.data(), entriesSize);
+	writeSection(outputFile, currentOffset, header.entrySpansOffset, entries.spans.data(),
+	             entries.spans.size() * sizeof(DictionaryTextSpan));
+	writeSection(outputFile, currentOffset, header.textOffset, dictionary.rawDictionary,
+	             dictionary.rawDictionarySize);
+	outputFile.close();
+
+	if (!outputFile || std::rename(temporaryFilename.c_str(), indexFilename) != 0)
+	{
+		std::cerr << "Error: failed while writing '" << indexFilename << "'\n";
+		std::remove(temporaryFilename.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool openDictionaryIndex(const char* indexFilename, DictionaryIndex& indexOut)
+{
+	MappedFile file;
+	if (!mapFile(indexFilename, file))
+		return false;
+
+	const DictionaryIndexHeader* header = reinterpret_cast<const DictionaryIndexHeader*>(file.data);
+	bool isValid =
+	    file.size >= sizeof(DictionaryIndexHeader) &&
+	    std::memcmp(header->magic, dictionaryIndexMagic, sizeof(header->magic)) == 0 &&
+	    header->version == dictionaryIndexVersion && header->numSlots &&
+	    (header->numSlots & (header->numSlots - 1)) == 0 &&
+	    isSectionInFile(file, header->slotsOffset, header->numSlots, sizeof(DictionaryIndexSlot)) &&
+	    isSectionInFile(file, header->keyPoolOffset, header->keyPoolSize, 1) &&
+	    isSectionInFile(file, header->postingsOffset, header->numPostings, sizeof(uint32_t)) &&
+	    isSectionInFile(file, header->trieOffset, header->numTrieUnits,
+	                    sizeof(DictionaryTrieUnit)) &&
+	    isSectionInFile(file, header->entryLineOffsetsOffset, header->numEntries,
+	                    sizeof(uint32_t)) &&
+	    isSectionInFile(file, header->entryLineLengthsOffset, header->numEntries,
+	                    sizeof(uint32_t)) &&
+	    isSectionInFile(file, header->entryIdsOffset, header->numEntries, sizeof(uint32_t)) &&
+	    isSectionInFile(file, header->entryTagsOffset, header->numEntries, sizeof(uint64_t)) &&
+	    isSectionInFile(file, header->entryFirstSpansOffset, header->numEntries,
+	                    sizeof(uint32_t)) &&
+	    isSectionInFile(file, header->entrySpanCountsOffset, header->numEntries,
+	                    sizeof(uint32_t)) &&
+	    isSectionInFile(file, header->entrySpansOffset, header->numSpans,
+	                    sizeof(DictionaryTextSpan)) &&
+	    isSectionInFile(file, header->textOffset, header->textSize, 1);
+	if (!isValid)
+	{
+		std::cerr << "Warning: dictionary index '" << indexFilename
+		          << "' is invalid or from an old version. Re-run compile_dictionary\n";
+		unmapFile(file);
+		return false;
+	}
+
+	indexOut.file = file;
+	indexOut.header = header;
+	indexOut.slots =
+	    reinterpret_cast<const DictionaryIndexSlot*>(file.data + header->slotsOffset);
+	indexOut.keyPool = file.data + header->keyPoolOffset;
+	indexOut.postings = reinterpret_cast<const uint32_t*>(file.data + header->postingsOffset);
+	indexOut.trie = reinterpret_cast<const DictionaryTrieUnit*>(file.data + header->trieOffset);
+	indexOut.numTrieUnits = header->numTrieUnits;
+	DictionaryEntryTable& entryTable = indexOut.entryTable;
+	entryTable.text = file.data + header->textOffset;
+	entryTable.numEntries = static_cast<uint32_t>(header->numEntries);
+	entryTable.numSpans = static_cast<uint32_t>(header->numSpans);
+	entryTable.lineOffsets =
+	    reinterpret_cast<const uint32_t*>(file.data + header->entryLineOffsetsOffset);
+	entryTable.lineLengths =
+	    reinterpret_cast<const uint32_t*>(file.data + header->entryLineLengthsOffset);
+	entryTable.ids = reinterpret_cast<const uint32_t*>(file.data + header->entryIdsOffset);
+	entryTable.tags = reinterpret_cast<const uint64_t*>(file.data + header->entryTagsOffset);
+	entryTable.firstSpans =
+	    reinterpret_cast<const uint32_t*>(file.data + header->entryFirstSpansOffset);
+	entryTable.spanCounts =
+	    reinterpret_cast<const uint32_t*>(file.data + header->entrySpanCountsOffset);
+	entryTable.spans =
+	    reinterpret_cast<const DictionaryTextSpan*>(file.data + header->entrySpansOffset);
+	indexOut.text = file.data + header->textOffset;
+	indexOut.textSize = header->textSize;
+	return true;
+}
+
+void closeDictionaryIndex(DictionaryIndex& index)
+{
+	unmapFile(index.file);
+	index = DictionaryIndex();
+}
+
+bool isDictionaryIndexStale(const DictionaryIndex& index, const char* sourceFilename)
+{
+	struct stat sourceStat;
+	// If the source is gone, the index is all we have
+	if (stat(sourceFilename, &sourceStat) != 0)
+		return false;
+	return static_cast<uint64_t>(sourceStat.st_size) != index.header->sourceSize ||
+	       static_cast<int64_t>(sourceStat.st_mtime) != index.header->sourceModifiedTime;
+}
+
+const char* findDictionaryIndexEntry(const DictionaryIndex& index, const char* word,
+                                     size_t wordLength)
+{
+	if (!index.header || !wordLength)
+		return nullptr;
+
+	uint32_t hash = hashDictionaryKey(word, wordLength);
+	const uint32_t slotMask = index.header->numSlots - 1;
+	for (uint32_t slotIndex = hash & slotMask;; slotIndex = (slotIndex + 1) & slotMask)
+	{
+		const DictionaryIndexSlot& slot = index.slots[slotIndex];
+		if (!slot.keyLength)
+			return nullptr;
+		if (slot.hash == hash && slot.keyLength == wordLength &&
+		    std::memcmp(index.keyPool + slot.keyOffset, word, wordLength) == 0)
+			return index.text + slot.entryOffset;
+	}
+}
+
+// The shared half of the batch lookups. slotsOut is nullptr for words which aren't present
+static void findDictionaryIndexSlots(const DictionaryIndex& index, const DictionaryKey* words,
+                                     size_t numWords, const DictionaryIndexSlot** slotsOut)
+{
+	if (!index.header)
+	{
+		std::fill(slotsOut, slotsOut + numWords, nullptr);
+		return;
+	}
+
+	const uint32_t slotMask = index.header->numSlots - 1;
+	uint32_t hashes[dictionaryLookupBatchSize];
+	for (size_t blockStart = 0; blockStart < numWords; blockStart += dictionaryLookupBatchSize)
+	{
+		size_t numBlockWords = std::min(dictionaryLookupBatchSize, numWords - blockStart);
+		const DictionaryKey* blockWords = words + blockStart;
+		for (size_t i = 0; i < numBlockWords; ++i)
+		{
+			hashes[i] = hashDictionaryKey(blockWords[i].data, blockWords[i].length);
+			__builtin_prefetch(&index.slots[hashes[i] & slotMask]);
+		}
+		// The first slot is usually the right one (or empty), so its key is the next miss
+		for (size_t i = 0; i < numBlockWords; ++i)
+		{
+			const DictionaryIndexSlot& slot = index.slots[hashes[i] & slotMask];
+			if (slot.keyLength)
+				__builtin_prefetch(index.keyPool + slot.keyOffset);
+		}
+		for (size_t i = 0; i < numBlockWords; ++i)
+		{
+			const DictionaryKey& word = blockWords[i];
+			const DictionaryIndexSlot* foundSlot = nullptr;
+			for (uint32_t slotIndex = hashes[i] & slotMask; word.length;
+			     slotIndex = (slotIndex + 1) & slotMask)
+			{
+				const DictionaryIndexSlot& slot = index.slots[slotIndex];
+				if (!slot.keyLength)
+					break;
+				if (slot.hash == hashes[i] && slot.keyLength == word.length &&
+				    std::memcmp(index.keyPool + slot.keyOffset, word.data, word.length) == 0)
+				{
+					foundSlot = &slot;
+					break;
+				}
+			}
+			slotsOut[blockStart + i] = foundSlot;
+		}
+	}
+}
+
+void findDictionaryIndexEntries(const DictionaryIndex& index, const DictionaryKey* words,
+                                size_t numWords, const char** entriesOut)
+{
+	const DictionaryIndexSlot* slots[dictionaryLookupBatchSize];
+	for (size_t blockStart = 0; blockStart < numWords; blockStart += dictionaryLookupBatchSize)
+	{
+		size_t numBlockWords = std::min(dictionaryLookupBatchSize, numWords - blockStart);
+		findDictionaryIndexSlots(index, words + blockStart, numBlockWords, slots);
+		for (size_t i = 0; i < numBlockWords; ++i)
+		{
+			const char* entry = slots[i] ? index.text + slots[i]->entryOffset : nullptr;
+			// The caller reads the entry next
+			if (entry)
+				__builtin_prefetch(entry);
+			entriesOut[blockStart + i] = entry;
+		}
+	}
+}
+
+bool findDictionaryIndexPostings(const DictionaryIndex& index, const char* word, size_t wordLength,
+                                 DictionaryPostings& postingsOut)
+{
+	DictionaryKey key;
+	key.data = word;
+	key.length = static_cast<uint32_t>(wordLength);
+	findDictionaryIndexPostings(index, &key, 1, &postingsOut);
+	return postingsOut.numPostings != 0;
+}
+
+void findDictionaryIndexPostings(const DictionaryIndex& index, const DictionaryKey* words,
+                                 size_t numWords, DictionaryPostings* postingsOut)
+{
+	const DictionaryIndexSlot* slots[dictionaryLookupBatchSize];
+	for (size_t blockStart = 0; blockStart < numWords; blockStart += dictionaryLookupBatchSize)
+	{
+		size_t numBlockWords = std::min(dictionaryLookupBatchSize, numWords - blockStart);
+		findDictionaryIndexSlots(index, words + blockStart, numBlockWords, slots);
+		for (size_t i = 0; i < numBlockWords; ++i)
+		{
+			DictionaryPostings& postings = postingsOut[blockStart + i];
+			postings.postings = slots[i] ? index.postings + slots[i]->firstPosting : nullptr;
+			postings.numPostings = slots[i] ? slots[i]->numPostings : 0;
+		}
+	}
+}
+
+size_t findDictionaryIndexPrefixes(const DictionaryIndex& index, const char* text,
+                                   size_t textLength, DictionaryPrefixMatch* matchesOut,
+                                   size_t maxMatches)
+{
+	// Words are never anywhere near this many characters long, let alone this many prefixes
+	const size_t maxTrieMatches = 64;
+	DictionaryTrieMatch trieMatches[maxTrieMatches];
+	size_t numMatches =
+	    findDictionaryTriePrefixes(index.trie, index.numTrieUnits, text, textLength, trieMatches,
+	                               std::min(maxMatches, maxTrieMatches));
+	for (size_t i = 0; i < numMatches; ++i)
+	{
+		const DictionaryIndexSlot& slot = index.slots[trieMatches[i].value];
+		matchesOut[i].length = trieMatches[i].length;
+		matchesOut[i].postings.postings = index.postings + slot.firstPosting;
+		matchesOut[i].postings.numPostings = slot.numPostings;
+	}
+	return numMatches;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Dictionary.hpp"
+#include "DictionaryTrie.hpp"
+#include "MappedFile.hpp"
+
+// A compiled, memory-mappable dictionary. Run compile_dictionary once after downloading EDICT2,
+// then every process can map the result instead of parsing the text dictionary on startup. The
+// pages are shared between processes because the file is mapped read-only.
+//
+// Layout (all integers are native-endian; the index is not meant to be moved between machines):
+//   DictionaryIndexHeader
+//   DictionaryIndexSlot[numSlots]  Open-addressed hash table, linear probing
+//   char keyPool[keyPoolSize]      Keys, not null-terminated
+//   uint32_t postings[numPostings] Each key's postings (see Dictionary.hpp), contiguous
+//   DictionaryTrieUnit trie[numTrieUnits]  Every key again, for prefix matching. Values are
+//                                          indices into the slots
+//   The DictionaryEntryTable arrays, each numEntries long except spans (numSpans):
+//     uint32_t entryLineOffsets[], entryLineLengths[], entryIds[]
+//     uint64_t entryTags[]
+//     uint32_t entryFirstSpans[], entrySpanCounts[]
+//     DictionaryTextSpan entrySpans[]
+//   char text[textSize]            The original EDICT2 file. Entries are offsets into this
+//
+// Every section starts on a 64-byte boundary.
+
+// Bump this whenever the layout changes. Old indices are then rejected and must be recompiled
+static const uint32_t dictionaryIndexVersion = 4;
+static const char dictionaryIndexMagic[8] = {'J', 'F', 'M', 'D', 'I', 'C', 'T', '\0'};
+
+struct DictionaryIndexHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t numKeys;
+	// Always a power of two
+	uint32_t numSlots;
+	uint32_t reserved;
+
+	// Used to detect whether the source dictionary changed since compilation
+	uint64_t sourceSize;
+	int64_t sourceModifiedTime;
+
+	uint64_t slotsOffset;
+	uint64_t keyPoolOffset;
+	uint64_t keyPoolSize;
+	uint64_t postingsOffset;
+	uint64_t numPostings;
+	uint64_t trieOffset;
+	uint64_t numTrieUnits;
+	uint64_t numEntries;
+	uint64_t numSpans;
+	uint64_t entryLineOffsetsOffset;
+	uint64_t entryLineLengthsOffset;
+	uint64_t entryIdsOffset;
+	uint64_t entryTagsOffset;
+	uint64_t entryFirstSpansOffset;
+	uint64_t entrySpanCountsOffset;
+	uint64_t entrySpansOffset;
+	uint64_t textOffset;
+	uint64_t textSize;
+};
+
+struct DictionaryIndexSlot
+{
+	// hashDictionaryKey()
+	uint32_t hash;
+	uint32_t keyOffset;
+	// Zero marks an empty slot (EDICT2 has no empty words)
+	uint32_t keyLength;
+	// The last entry with this key, like Dictionary's
+	uint32_t entryOffset;
+	uint32_t firstPosting;
+	uint32_t numPostings;
+};
+
+struct DictionaryIndex
+{
+	MappedFile file;
+
+	const DictionaryIndexHeader* header = nullptr;
+	const DictionaryIndexSlot* slots = nullptr;
+	const char* keyPool = nullptr;
+	const uint32_t* postings = nullptr;
+	const DictionaryTrieUnit* trie = nullptr;
+	size_t numTrieUnits = 0;
+	// Its text is this text
+	DictionaryEntryTable entryTable;
+	const char* text = nullptr;
+	size_t textSize = 0;
+};
+
+bool writeDictionaryIndex(const Dictionary& dictionary, const char* sourceFilename,
+                          const char* indexFilename);
+
+// Returns false if the file is missing, malformed, or from a different dictionaryIndexVersion
+bool openDictionaryIndex(const char* indexFilename, DictionaryIndex& indexOut);
+void closeDictionaryIndex(DictionaryIndex& index);
+
+// True if sourceFilename no longer matches the size and modification time the index was built from
+bool isDictionaryIndexStale(const DictionaryIndex& index, const char* sourceFilename);
+
+// Returns the start of the entry line within index.text, or nullptr if the word isn't present.
+// Does not allocate
+const char* findDictionaryIndexEntry(const DictionaryIndex& index, const char* word,
+                                     size_t wordLength);
+
+// findDictionaryIndexEntry() for each of numWords words, written to entriesOut. Faster than
+// calling it in a loop: every slot is prefetched before any is probed, then every key they point
+// at, so the misses overlap. Does not allocate
+void findDictionaryIndexEntries(const DictionaryIndex& index, const DictionaryKey* words,
+                                size_t numWords, const char** entriesOut);
+
+// Every entry the word appears in. Returns false (and empty postings) if there are none
+bool findDictionaryIndexPostings(const DictionaryIndex& index, const char* word, size_t wordLength,
+                                 DictionaryPostings& postingsOut);
+// findDictionaryIndexPostings() for each of numWords words, prefetching like
+// findDictionaryIndexEntries()
+void findDictionaryIndexPostings(const DictionaryIndex& index, const DictionaryKey* words,
+                                 size_t numWords, DictionaryPostings* postingsOut);
+
+// A dictionary key found at the start of some text
+struct DictionaryPrefixMatch
+{
+	// In bytes. Always a whole number of UTF-8 characters
+	uint32_t length;
+	DictionaryPostings postings;
+};
+
+// Every key which text starts with, shortest first, e.g. 日, 日本 and 日本語 for 日本語で. Returns
+// how many were written to matchesOut (at most maxMatches). Does not allocate
+size_t findDictionaryIndexPrefixes(const DictionaryIndex& index, const char* text,
+                                   size_t textLength, DictionaryPrefixMatch* matchesOut,
+                                   size_t maxMatches);
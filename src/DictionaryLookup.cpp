@@ -0,0 +1,451 @@
+#include "DictionaryLookup.hpp"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+bool openDictionaryLookup(const char* dictionaryFilename, const char* indexFilename,
+                          DictionaryLookup& lookupOut)
+{
+	if (openDictionaryIndex(indexFilename, lookupOut.index))
+	{
+		if (isDictionaryIndexStale(lookupOut.index, dictionaryFilename))
+			std::cerr << "Warning: '" << dictionaryFilename << "' has changed since '"
+			          << indexFilename << "' was compiled. Re-run compile_dictionary\n";
+		lookupOut.usingIndex = true;
+		lookupOut.sourceSize = lookupOut.index.header->sourceSize;
+		lookupOut.sourceModifiedTime = lookupOut.index.header->sourceModifiedTime;
+		return true;
+	}
+
+	std::cerr << "No compiled dictionary found. Run compile_dictionary for faster startup\n";
+	lookupOut.usingIndex = false;
+	struct stat sourceStat;
+	if (stat(dictionaryFilename, &sourceStat) == 0)
+	{
+		lookupOut.sourceSize = static_cast<uint64_t>(sourceStat.st_size);
+		lookupOut.sourceModifiedTime = static_cast<int64_t>(sourceStat.st_mtime);
+	}
+	return loadDictionary(dictionaryFilename, lookupOut.dictionary);
+}
+
+void closeDictionaryLookup(DictionaryLookup& lookup)
+{
+	closeDictionaryIndex(lookup.index);
+	freeDictionary(lookup.dictionary);
+	lookup.usingIndex = false;
+}
+
+const char* findDictionaryLookupEntry(const DictionaryLookup& lookup, const char* word,
+                                      size_t wordLength)
+{
+	if (lookup.usingIndex)
+		return findDictionaryIndexEntry(lookup.index, word, wordLength);
+	return findDictionaryEntry(lookup.dictionary, word, wordLength);
+}
+
+void findDictionaryLookupEntries(const DictionaryLookup& lookup, const DictionaryKey* words,
+                                 size_t numWords, DictionaryEntryView* entriesOut)
+{
+	// The lookups already prefetch in blocks this size, so there's no point going larger
+	const size_t blockSize = dictionaryLookupBatchSize;
+	const char* entries[blockSize];
+	for (size_t blockStart = 0; blockStart < numWords; blockStart += blockSize)
+	{
+		size_t numBlockWords = std::min(blockSize, numWords - blockStart);
+		if (lookup.usingIndex)
+			findDictionaryIndexEntries(lookup.index, words + blockStart, numBlockWords, entries);
+		else
+			findDictionaryEntries(lookup.dictionary, words + blockStart, numBlockWords, entries);
+		for (size_t i = 0; i < numBlockWords; ++i)
+		{
+			DictionaryEntryView& entryOut = entriesOut[blockStart + i];
+			entryOut.data = entries[i];
+			entryOut.length = entries[i] ? getDictionaryLookupEntryLength(lookup, entries[i]) : 0;
+		}
+	}
+}
+
+size_t getDictionaryLookupEntryLength(const DictionaryLookup& lookup, const char* entry)
+{
+	const char* dictionaryEnd =
+	    lookup.usingIndex ? lookup.index.text + lookup.index.textSize :
+	                        lookup.dictionary.rawDictionary + lookup.dictionary.rawDictionarySize;
+	const char* lineEnd =
+	    static_cast<const char*>(std::memchr(entry, '\n', dictionaryEnd - entry));
+	return (lineEnd ? lineEnd : dictionaryEnd) - entry;
+}
+
+bool findDictionaryLookupPostings(const DictionaryLookup& lookup, const char* word,
+                                  size_t wordLength, DictionaryPostings& postingsOut)
+{
+	if (lookup.usingIndex)
+		return findDictionaryIndexPostings(lookup.index, word, wordLength, postingsOut);
+	return findDictionaryPostings(lookup.dictionary, word, wordLength, postingsOut);
+}
+
+void findDictionaryLookupPostings(const DictionaryLookup& lookup, const DictionaryKey* words,
+                                  size_t numWords, DictionaryPostings* postingsOut)
+{
+	if (lookup.usingIndex)
+		findDictionaryIndexPostings(lookup.index, words, numWords, postingsOut);
+	else
+		findDictionaryPostings(lookup.dictionary, words, numWords, postingsOut);
+}
+
+const DictionaryEntryTable& getDictionaryLookupEntryTable(const DictionaryLookup& lookup)
+{
+	return lookup.usingIndex ? lookup.index.entryTable : lookup.dictionary.entryTable;
+}
+
+uint64_t getDictionaryLookupVersion(const DictionaryLookup& lookup)
+{
+	// Whether the index is used doesn't matter: both parse EDICT2 the same way
+	uint64_t version = dictionaryIndexVersion;
+	version = version * 1000003u ^ lookup.sourceSize;
+	version = version * 1000003u ^ static_cast<uint64_t>(lookup.sourceModifiedTime);
+	version = version * 1000003u ^ getDictionaryLookupEntryTable(lookup).numEntries;
+	return version;
+}
+
+DictionaryEntryView getDictionaryLookupPostingEntry(const DictionaryLookup& lookup,
+                                                    uint32_t posting)
+{
+	return getDictionaryEntryLine(getDictionaryLookupEntryTable(lookup),
+	                              getDictionaryPostingEntryIndex(posting));
+}
+
+void convertKatakanaToHiragana(const char* text, size_t length, char* textOut)
+{
+	std::memcpy(textOut, text, length);
+	// ァ (U+30A1) to ヶ (U+30F6) are E3 82 A1 to E3 83 B6. Hiragana is 0x60 code points lower
+	for (size_t i = 0; i + 2 < length; ++i)
+	{
+		const unsigned char* character = reinterpret_cast<const unsigned char*>(text + i);
+		if (character[0] != 0xE3 || (character[1] != 0x82 && character[1] != 0x83))
+			continue;
+		unsigned int codePoint = 0x3000 | ((character[1] & 0x3F) << 6) | (character[2] & 0x3F);
+		if (codePoint < 0x30A1 || codePoint > 0x30F6)
+			continue;
+		codePoint -= 0x60;
+		textOut[i + 1] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+		textOut[i + 2] = static_cast<char>(0x80 | (codePoint & 0x3F));
+		i += 2;
+	}
+}
+
+// Writes the entry of a posting if its priority is isPriority, at most once per entry. Postings
+// are in file order, so the same entry twice (e.g. a key listed twice in one line) is always
+// adjacent
+static void addWordEntry(const DictionaryLookup& lookup, uint32_t posting, bool isPriority,
+                         DictionaryEntryView* entriesOut, size_t& numEntries)
+{
+	const uint32_t entryIndex = getDictionaryPostingEntryIndex(posting);
+	const DictionaryEntryTable& entryTable = getDictionaryLookupEntryTable(lookup);
+	if (hasDictionaryEntryTag(entryTable, entryIndex, DictionaryTag::Priority) != isPriority)
+		return;
+	DictionaryEntryView entry = getDictionaryEntryLine(entryTable, entryIndex);
+	if (numEntries && entriesOut[numEntries - 1].data == entry.data)
+		return;
+	entriesOut[numEntries++] = entry;
+}
+
+// Step 1 of findDictionaryLookupWordEntries(): entries where the headword postings and the
+// reading postings meet. Both are sorted by entry, so this is a merge
+static void addHeadwordAndReadingEntries(const DictionaryLookup& lookup,
+                                         const DictionaryPostings& postings,
+                                         const DictionaryPostings& readingPostings,
+                                         bool isPriority, DictionaryEntryView* entriesOut,
+                                         size_t& numEntries, size_t maxEntries)
+{
+	const uint32_t* headword = postings.postings;
+	const uint32_t* postingsEnd = postings.postings + postings.numPostings;
+	const uint32_t* readingPosting = readingPostings.postings;
+	const uint32_t* readingPostingsEnd = readingPostings.postings + readingPostings.numPostings;
+	while (headword != postingsEnd && readingPosting != readingPostingsEnd &&
+	       numEntries < maxEntries)
+	{
+		if (isDictionaryPostingReading(*headword))
+			++headword;
+		else if (!isDictionaryPostingReading(*readingPosting))
+			++readingPosting;
+		else if (getDictionaryPostingEntryIndex(*headword) <
+		         getDictionaryPostingEntryIndex(*readingPosting))
+			++headword;
+		else if (getDictionaryPostingEntryIndex(*readingPosting) <
+		         getDictionaryPostingEntryIndex(*headword))
+			++readingPosting;
+		else
+		{
+			addWordEntry(lookup, *headword, isPriority, entriesOut, numEntries);
+			++headword;
+			++readingPosting;
+		}
+	}
+}
+
+// Steps 2 and 3: every entry the key is a headword of, or a reading of
+static void addPostingEntries(const DictionaryLookup& lookup, const DictionaryPostings& postings,
+                              bool isReading, bool isPriority, DictionaryEntryView* entriesOut,
+                              size_t& numEntries, size_t maxEntries)
+{
+	const uint32_t* postingsEnd = postings.postings + postings.numPostings;
+	for (const uint32_t* posting = postings.postings;
+	     posting != postingsEnd && numEntries < maxEntries; ++posting)
+	{
+		if (isDictionaryPostingReading(*posting) == isReading)
+			addWordEntry(lookup, *posting, isPriority, entriesOut, numEntries);
+	}
+}
+
+// Steps 1 to 3 of findDictionaryLookupWordEntries(), given the postings of the base form (or
+// surface form)
+static size_t selectWordEntries(const DictionaryLookup& lookup, const DictionaryPostings& postings,
+                                const DictionaryWord& word, DictionaryEntryView* entriesOut,
+                                size_t maxEntries)
+{
+	const uint32_t* postingsEnd = postings.postings + postings.numPostings;
+	size_t numHeadwords = 0;
+	for (const uint32_t* posting = postings.postings; posting != postingsEnd; ++posting)
+		numHeadwords += isDictionaryPostingReading(*posting) ? 0 : 1;
+
+	size_t numEntries = 0;
+	char reading[maxDictionaryReadingLength];
+	DictionaryPostings readingPostings;
+	if (numHeadwords > 1 && word.readingLength && word.readingLength <= sizeof(reading))
+	{
+		convertKatakanaToHiragana(word.reading, word.readingLength, reading);
+		if (findDictionaryLookupPostings(lookup, reading, word.readingLength, readingPostings))
+		{
+			addHeadwordAndReadingEntries(lookup, postings, readingPostings, true, entriesOut,
+			                             numEntries, maxEntries);
+			addHeadwordAndReadingEntries(lookup, postings, readingPostings, false, entriesOut,
+			                             numEntries, maxEntries);
+			if (numEntries)
+				return numEntries;
+		}
+	}
+
+	const bool isReading = numHeadwords == 0;
+	addPostingEntries(lookup, postings, isReading, true, entriesOut, numEntries, maxEntries);
+	addPostingEntries(lookup, postings, isReading, false, entriesOut, numEntries, maxEntries);
+	return numEntries;
+}
+
+static bool isSameWord(const char* a, size_t aLength, const char* b, size_t bLength)
+{
+	return aLength == bLength && std::memcmp(a, b, aLength) == 0;
+}
+
+// The base form found nothing, so try the surface form (if it's any different)
+static size_t findSurfaceEntries(const DictionaryLookup& lookup, const DictionaryWord& word,
+                                 DictionaryEntryView* entriesOut, size_t maxEntries)
+{
+	DictionaryPostings postings;
+	if (!word.baseFormLength ||
+	    isSameWord(word.baseForm, word.baseFormLength, word.surface, word.surfaceLength) ||
+	    !findDictionaryLookupPostings(lookup, word.surface, word.surfaceLength, postings))
+		return 0;
+	return selectWordEntries(lookup, postings, word, entriesOut, maxEntries);
+}
+
+// Words without a base form are looked up by their surface form instead
+static DictionaryKey getWordKey(const DictionaryWord& word)
+{
+	DictionaryKey key;
+	key.data = word.baseFormLength ? word.baseForm : word.surface;
+	key.length =
+	    static_cast<uint32_t>(word.baseFormLength ? word.baseFormLength : word.surfaceLength);
+	return key;
+}
+
+size_t findDictionaryLookupWordEntries(const DictionaryLookup& lookup, const DictionaryWord& word,
+                                       DictionaryEntryView* entriesOut, size_t maxEntries)
+{
+	if (!maxEntries)
+		return 0;
+	DictionaryKey key = getWordKey(word);
+	DictionaryPostings postings;
+	findDictionaryLookupPostings(lookup, &key, 1, &postings);
+	size_t numEntries = selectWordEntries(lookup, postings, word, entriesOut, maxEntries);
+	if (!numEntries)
+		numEntries = findSurfaceEntries(lookup, word, entriesOut, maxEntries);
+	return numEntries;
+}
+
+void findDictionaryLookupWordEntries(const DictionaryLookup& lookup, const DictionaryWord* words,
+                                     size_t numWords, DictionaryEntryView* entriesOut)
+{
+	DictionaryKey keys[dictionaryLookupBatchSize];
+	DictionaryPostings postings[dictionaryLookupBatchSize];
+	for (size_t blockStart = 0; blockStart < numWords; blockStart += dictionaryLookupBatchSize)
+	{
+		size_t numBlockWords = std::min(dictionaryLookupBatchSize, numWords - blockStart);
+		for (size_t i = 0; i < numBlockWords; ++i)
+			keys[i] = getWordKey(words[blockStart + i]);
+		findDictionaryLookupPostings(lookup, keys, numBlockWords, postings);
+
+		for (size_t i = 0; i < numBlockWords; ++i)
+		{
+			const DictionaryWord& word = words[blockStart + i];
+			DictionaryEntryView& entryOut = entriesOut[blockStart + i];
+			size_t numEntries = selectWordEntries(lookup, postings[i], word, &entryOut, 1);
+			if (!numEntries)
+				numEntries = findSurfaceEntries(lookup, word, &entryOut, 1);
+			if (!numEntries)
+			{
+				entryOut.data = nullptr;
+				entryOut.length = 0;
+			}
+		}
+	}
+}
+
+// Whether the byte starts a UTF-8 character (rather than continuing one)
+static bool isCharacterStart(char byte)
+{
+	return (static_cast<unsigned char>(byte) & 0xC0) != 0x80;
+}
+
+// Every prefix which ends on a character boundary and isn't longer than the longest key
+static size_t findDictionaryPrefixes(const Dictionary& dictionary, const char* text,
+                                     size_t textLength, DictionaryPrefixMatch* matchesOut,
+                                     size_t maxMatches)
+{
+	const size_t maxLength = std::min(textLength, static_cast<size_t>(dictionary.maxKeyLength));
+	DictionaryKey prefixes[dictionaryLookupBatchSize];
+	DictionaryPostings postings[dictionaryLookupBatchSize];
+	size_t numMatches = 0;
+	size_t length = 1;
+	while (length <= maxLength && numMatches < maxMatches)
+	{
+		size_t numPrefixes = 0;
+		for (; length <= maxLength && numPrefixes < dictionaryLookupBatchSize; ++length)
+		{
+			if (length < textLength && !isCharacterStart(text[length]))
+				continue;
+			prefixes[numPrefixes].data = text;
+			prefixes[numPrefixes].length = static_cast<uint32_t>(length);
+			++numPrefixes;
+		}
+		findDictionaryPostings(dictionary, prefixes, numPrefixes, postings);
+		for (size_t i = 0; i < numPrefixes && numMatches < maxMatches; ++i)
+		{
+			if (!postings[i].numPostings)
+				continue;
+			matchesOut[numMatches].length = prefixes[i].length;
+			matchesOut[numMatches].postings = postings[i];
+			++numMatches;
+		}
+	}
+	return numMatches;
+}
+
+size_t findDictionaryLookupPrefixes(const DictionaryLookup& lookup, const char* text,
+                                    size_t textLength, DictionaryPrefixMatch* matchesOut,
+                                    size_t maxMatches)
+{
+	if (lookup.usingIndex)
+		return findDictionaryIndexPrefixes(lookup.index, text, textLength, matchesOut,
+		                                   maxMatches);
+	return findDictionaryPrefixes(lookup.dictionary, text, textLength, matchesOut, maxMatches);
+}
+
+void findDictionaryLookupTextMatches(const DictionaryLookup& lookup, const char* text,
+                                     size_t textLength,
+                                     std::vector<DictionaryTextMatch>& matchesOut)
+{
+	const size_t maxMatchesPerCharacter = 64;
+	DictionaryPrefixMatch prefixMatches[maxMatchesPerCharacter];
+	for (size_t start = 0; start < textLength; ++start)
+	{
+		if (!isCharacterStart(text[start]))
+			continue;
+		size_t numMatches = findDictionaryLookupPrefixes(
+		    lookup, text + start, textLength - start, prefixMatches, maxMatchesPerCharacter);
+		for (size_t i = 0; i < numMatches; ++i)
+		{
+			DictionaryTextMatch match;
+			match.start = start;
+			match.length = prefixMatches[i].length;
+			match.postings = prefixMatches[i].postings;
+			matchesOut.push_back(match);
+		}
+	}
+}
+
+static bool hasDeinflectedEntry(const DictionaryDeinflectedEntry* entries, size_t numEntries,
+                                uint32_t entryIndex)
+{
+	for (size_t i = 0; i < numEntries; ++i)
+	{
+		if (entries[i].entryIndex == entryIndex)
+			return true;
+	}
+	return false;
+}
+
+size_t findDictionaryLookupDeinflectedEntries(const DictionaryLookup& lookup,
+                                              const Deinflections& deinflections,
+                                              DictionaryDeinflectedEntry* entriesOut,
+                                              size_t maxEntries)
+{
+	// Every candidate is looked up at once, so their cache misses overlap
+	DictionaryKey keys[maxDeinflectionCandidates];
+	DictionaryPostings postings[maxDeinflectionCandidates];
+	for (size_t i = 0; i < deinflections.numCandidates; ++i)
+	{
+		keys[i].data = deinflections.candidates[i].text;
+		keys[i].length = deinflections.candidates[i].length;
+	}
+	findDictionaryLookupPostings(lookup, keys, deinflections.numCandidates, postings);
+
+	const DictionaryEntryTable& entryTable = getDictionaryLookupEntryTable(lookup);
+	size_t numEntries = 0;
+	for (size_t candidateIndex = 0; candidateIndex < deinflections.numCandidates; ++candidateIndex)
+	{
+		const DeinflectionCandidate& candidate = deinflections.candidates[candidateIndex];
+		const DictionaryPostings& candidatePostings = postings[candidateIndex];
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			const bool isPriority = pass == 0;
+			for (uint32_t i = 0; i < candidatePostings.numPostings && numEntries < maxEntries; ++i)
+			{
+				const uint32_t entryIndex =
+				    getDictionaryPostingEntryIndex(candidatePostings.postings[i]);
+				const uint64_t tags = entryTable.tags[entryIndex];
+				if (((tags & getDictionaryTagBit(DictionaryTag::Priority)) != 0) != isPriority ||
+				    !isDeinflectionTypeOfEntry(candidate, tags) ||
+				    hasDeinflectedEntry(entriesOut, numEntries, entryIndex))
+					continue;
+				entriesOut[numEntries].candidateIndex = static_cast<uint32_t>(candidateIndex);
+				entriesOut[numEntries].entryIndex = entryIndex;
+				++numEntries;
+			}
+		}
+	}
+	return numEntries;
+}
+
+size_t findDictionaryLookupLongestDeinflection(const DictionaryLookup& lookup, const char* text,
+                                               size_t textLength, Deinflections& deinflectionsOut,
+                                               DictionaryDeinflectedEntry* entriesOut,
+                                               size_t maxEntries, size_t& numEntriesOut)
+{
+	numEntriesOut = 0;
+	deinflectionsOut.numCandidates = 0;
+	// Longest first, a whole character at a time
+	for (size_t length = std::min(textLength, maxDeinflectionLength); length; --length)
+	{
+		if (length < textLength && !isCharacterStart(text[length]))
+			continue;
+		deinflectWord(text, length, deinflectionsOut);
+		numEntriesOut = findDictionaryLookupDeinflectedEntries(lookup, deinflectionsOut,
+		                                                       entriesOut, maxEntries);
+		if (numEntriesOut)
+			return length;
+	}
+	deinflectionsOut.numCandidates = 0;
+	return 0;
+}
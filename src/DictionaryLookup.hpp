@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include "Deinflection.hpp"
+#include "Dictionary.hpp"
+#include "DictionaryIndex.hpp"
+
+// Whichever dictionary is available: the compiled index if it exists, otherwise EDICT2 parsed on
+// startup. Only one of the two is loaded
+struct DictionaryLookup
+{
+	DictionaryIndex index;
+	Dictionary dictionary;
+	bool usingIndex = false;
+	// The EDICT2 the entries came from: with the index, what it was compiled from
+	uint64_t sourceSize = 0;
+	int64_t sourceModifiedTime = 0;
+};
+
+bool openDictionaryLookup(const char* dictionaryFilename, const char* indexFilename,
+                          DictionaryLookup& lookupOut);
+void closeDictionaryLookup(DictionaryLookup& lookup);
+
+// Returns the start of the entry line, or nullptr if the word isn't in the dictionary
+const char* findDictionaryLookupEntry(const DictionaryLookup& lookup, const char* word,
+                                      size_t wordLength);
+
+// Looks up every word at once, e.g. every token in a sentence. All the words are hashed and their
+// buckets prefetched before any is probed, so the cache misses overlap instead of each lookup
+// waiting on its own. entriesOut must hold numWords views of whole entry lines (not including the
+// newline), which point into the dictionary, so they are only valid until the lookup is closed.
+// Does not allocate
+void findDictionaryLookupEntries(const DictionaryLookup& lookup, const DictionaryKey* words,
+                                 size_t numWords, DictionaryEntryView* entriesOut);
+
+// The length of the entry line starting at entry, not including the newline. Never reads past the
+// end of the dictionary
+size_t getDictionaryLookupEntryLength(const DictionaryLookup& lookup, const char* entry);
+
+// Every entry the word appears in, as a headword or as a reading. Returns false (and empty
+// postings) if there are none
+bool findDictionaryLookupPostings(const DictionaryLookup& lookup, const char* word,
+                                  size_t wordLength, DictionaryPostings& postingsOut);
+// findDictionaryLookupPostings() for each of numWords words, prefetching like
+// findDictionaryLookupEntries()
+void findDictionaryLookupPostings(const DictionaryLookup& lookup, const DictionaryKey* words,
+                                  size_t numWords, DictionaryPostings* postingsOut);
+
+// Every entry's fields and tags. Postings' entry indices index into this
+const DictionaryEntryTable& getDictionaryLookupEntryTable(const DictionaryLookup& lookup);
+
+// Changes whenever the entries (or their indices) could have, i.e. when EDICT2 or the index format
+// changes. For telling whether results saved by an earlier run are still valid
+uint64_t getDictionaryLookupVersion(const DictionaryLookup& lookup);
+
+// The entry line a posting refers to
+DictionaryEntryView getDictionaryLookupPostingEntry(const DictionaryLookup& lookup,
+                                                    uint32_t posting);
+
+// A word as it appears in text. See getTokenDictionaryWord() for making one from a MeCab token.
+// None of these are null-terminated
+struct DictionaryWord
+{
+	// The dictionary form, e.g. 食べる for 食べた. Empty if unknown
+	const char* baseForm;
+	size_t baseFormLength;
+	// The reading of the surface form. May be katakana (MeCab's are). Empty if unknown
+	const char* reading;
+	size_t readingLength;
+	const char* surface;
+	size_t surfaceLength;
+};
+
+// Longer readings aren't used to pick between entries. No word is anywhere near this long
+static const size_t maxDictionaryReadingLength = 256;
+
+// EDICT2 readings are hiragana. textOut must hold length bytes; the conversion never changes the
+// length. Anything which isn't katakana is copied as is (including ー)
+void convertKatakanaToHiragana(const char* text, size_t length, char* textOut);
+
+// The entries for a word, best matches first:
+//   1. Entries with baseForm as a headword, and the reading as their reading (only checked if
+//      there's more than one, e.g. 生 or 日本)
+//   2. Otherwise every entry with baseForm as a headword
+//   3. Otherwise every entry with baseForm as a reading (words normally written in kanji)
+// Then the same again for the surface form if the base form found nothing. Within a step, common
+// words (tagged (P)) come first, then the rest, each in file order. Returns how many were written
+// to entriesOut (at most maxEntries). Does not allocate
+size_t findDictionaryLookupWordEntries(const DictionaryLookup& lookup, const DictionaryWord& word,
+                                       DictionaryEntryView* entriesOut, size_t maxEntries);
+// The best entry for each of numWords words (data is nullptr if none). The base forms are looked
+// up together, like findDictionaryLookupEntries()
+void findDictionaryLookupWordEntries(const DictionaryLookup& lookup, const DictionaryWord* words,
+                                     size_t numWords, DictionaryEntryView* entriesOut);
+
+// Every dictionary key which text starts with, shortest first, e.g. 日, 日本 and 日本語 for
+// 日本語で. Returns how many were written to matchesOut (at most maxMatches). Walks the index's
+// trie; without the index, each prefix is looked up in the hash map instead, which is much slower
+size_t findDictionaryLookupPrefixes(const DictionaryLookup& lookup, const char* text,
+                                    size_t textLength, DictionaryPrefixMatch* matchesOut,
+                                    size_t maxMatches);
+
+// A dictionary key found in text
+struct DictionaryTextMatch
+{
+	// Both in bytes
+	size_t start;
+	uint32_t length;
+	DictionaryPostings postings;
+};
+
+// Every dictionary key starting at every character of text, by start then shortest first. This
+// segments text by the dictionary alone, like popup readers do, e.g. to find compound expressions
+// which MeCab splits into several tokens. Appends to matchesOut
+void findDictionaryLookupTextMatches(const DictionaryLookup& lookup, const char* text,
+                                     size_t textLength,
+                                     std::vector<DictionaryTextMatch>& matchesOut);
+
+// An entry found by deinflecting a word
+struct DictionaryDeinflectedEntry
+{
+	// Into Deinflections::candidates: the form the entry was found by, and the rules leading there
+	uint32_t candidateIndex;
+	uint32_t entryIndex;
+};
+
+// The entries of every candidate which is in the dictionary (as a headword or a reading) and whose
+// part of speech fits how it was reached, e.g. 渡す (v5s) for 渡した but not 渡しる. In candidate
+// order, so the word as given comes first, then shorter chains; within a candidate, common words
+// (P) come first. Each entry is written once. Returns how many were written to entriesOut (at most
+// maxEntries). Does not allocate
+size_t findDictionaryLookupDeinflectedEntries(const DictionaryLookup& lookup,
+                                              const Deinflections& deinflections,
+                                              DictionaryDeinflectedEntry* entriesOut,
+                                              size_t maxEntries);
+
+// Popup-style lookup of whatever text starts with, without MeCab: the longest prefix which is a
+// dictionary word once deinflected, e.g. 渡したい (desire of 渡す) for 渡したい物. Returns the
+// length of the prefix in bytes, or 0 if not even the first character is a word. deinflectionsOut
+// holds the prefix's candidates, which the entries refer to
+size_t findDictionaryLookupLongestDeinflection(const DictionaryLookup& lookup, const char* text,
+                                               size_t textLength, Deinflections& deinflectionsOut,
+                                               DictionaryDeinflectedEntry* entriesOut,
+                                               size_t maxEntries, size_t& numEntriesOut);
@@ -0,0 +1,133 @@
+#include "DictionaryTrie.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Codes are bytes + 1, so the end of a key (0) sorts before every byte
+static const uint32_t numTrieCodes = 257;
+
+static uint32_t getTrieCode(const DictionaryTrieKey& key, uint32_t depth)
+{
+	return depth < key.length ? static_cast<unsigned char>(key.data[depth]) + 1 : 0;
+}
+
+// Keys [begin, end) share their first depth bytes, and node is the state reached by them
+struct TrieBuildRange
+{
+	size_t begin;
+	size_t end;
+	uint32_t depth;
+	uint32_t node;
+};
+
+void buildDictionaryTrie(std::vector<DictionaryTrieKey>& keys,
+                         std::vector<DictionaryTrieUnit>& unitsOut)
+{
+	// Sorted, every node's children are contiguous runs of keys in code order
+	std::sort(keys.begin(), keys.end(),
+	          [](const DictionaryTrieKey& a, const DictionaryTrieKey& b) {
+		          int order = std::memcmp(a.data, b.data, std::min(a.length, b.length));
+		          return order != 0 ? order < 0 : a.length < b.length;
+	          });
+
+	std::vector<DictionaryTrieUnit>& units = unitsOut;
+	units.assign(numTrieCodes * 4, DictionaryTrieUnit());
+	// Not a child of anything, but mustn't look free
+	units[0].check = UINT32_MAX;
+	uint32_t numUsedUnits = 1;
+	// Every unit before this is in use. Searches for a free base start here
+	uint32_t firstFreeUnit = 1;
+
+	uint32_t codes[numTrieCodes];
+	size_t childBegins[numTrieCodes + 1];
+	std::vector<TrieBuildRange> ranges;
+	if (!keys.empty())
+		ranges.push_back({0, keys.size(), 0, 0});
+	while (!ranges.empty())
+	{
+		TrieBuildRange range = ranges.back();
+		ranges.pop_back();
+
+		uint32_t numCodes = 0;
+		for (size_t i = range.begin; i < range.end; ++i)
+		{
+			uint32_t code = getTrieCode(keys[i], range.depth);
+			if (!numCodes || codes[numCodes - 1] != code)
+			{
+				codes[numCodes] = code;
+				childBegins[numCodes] = i;
+				++numCodes;
+			}
+		}
+		childBegins[numCodes] = range.end;
+
+		// The first base where every child lands on a free unit. Mostly-full stretches at the
+		// start are skipped for good, otherwise building is quadratic (this is Darts' heuristic)
+		uint32_t numSkippedUsed = 0;
+		uint32_t position = std::max(firstFreeUnit, codes[0] + 1);
+		uint32_t base = 0;
+		while (true)
+		{
+			if (position + numTrieCodes >= units.size())
+				units.resize(units.size() * 2, DictionaryTrieUnit());
+			if (units[position].check)
+			{
+				++position;
+				++numSkippedUsed;
+				continue;
+			}
+			base = position - codes[0];
+			bool isFree = true;
+			for (uint32_t i = 1; i < numCodes && isFree; ++i)
+				isFree = !units[base + codes[i]].check;
+			if (isFree)
+				break;
+			++position;
+		}
+		if (numSkippedUsed * 20 >= (position - firstFreeUnit + 1) * 19)
+			firstFreeUnit = position;
+
+		units[range.node].base = base;
+		for (uint32_t i = 0; i < numCodes; ++i)
+			units[base + codes[i]].check = range.node + 1;
+		numUsedUnits = std::max(numUsedUnits, base + codes[numCodes - 1] + 1);
+
+		for (uint32_t i = 0; i < numCodes; ++i)
+		{
+			if (codes[i] == 0)
+				units[base].base = keys[childBegins[i]].value;
+			else
+				ranges.push_back(
+				    {childBegins[i], childBegins[i + 1], range.depth + 1, base + codes[i]});
+		}
+	}
+
+	units.resize(numUsedUnits);
+}
+
+size_t findDictionaryTriePrefixes(const DictionaryTrieUnit* units, size_t numUnits,
+                                  const char* text, size_t textLength,
+                                  DictionaryTrieMatch* matchesOut, size_t maxMatches)
+{
+	size_t numMatches = 0;
+	uint32_t node = 0;
+	for (size_t length = 0; numUnits && numMatches < maxMatches; ++length)
+	{
+		const uint32_t base = units[node].base;
+		if (base < numUnits && units[base].check == node + 1)
+		{
+			matchesOut[numMatches].length = static_cast<uint32_t>(length);
+			matchesOut[numMatches].value = units[base].base;
+			++numMatches;
+		}
+		if (length == textLength)
+			break;
+
+		const size_t next =
+		    static_cast<size_t>(base) + static_cast<unsigned char>(text[length]) + 1;
+		if (next >= numUnits || units[next].check != node + 1)
+			break;
+		node = static_cast<uint32_t>(next);
+	}
+	return numMatches;
+}
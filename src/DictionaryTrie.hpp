@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// A double-array trie over the bytes of every dictionary key, in the style of Darts (which MeCab
+// uses for its own dictionaries). Hash tables can only answer "is this exactly a key?"; the trie
+// answers "which keys does this text start with?" in one walk, which is what segmenting text by
+// the dictionary needs.
+//
+// Each unit is a state. The transition from state s on byte b goes to t = units[s].base + b + 1,
+// and is only valid if units[t].check == s + 1. Keys end with a transition on code 0, whose unit's
+// base holds the key's value instead. Unit 0 is the root; a check of zero marks an unused unit.
+struct DictionaryTrieUnit
+{
+	uint32_t base;
+	uint32_t check;
+};
+
+struct DictionaryTrieKey
+{
+	const char* data;
+	uint32_t length;
+	uint32_t value;
+};
+
+// keys must not be empty or contain duplicates. Their order doesn't matter
+void buildDictionaryTrie(std::vector<DictionaryTrieKey>& keys,
+                         std::vector<DictionaryTrieUnit>& unitsOut);
+
+struct DictionaryTrieMatch
+{
+	// Bytes from the start of the text. Always a whole number of UTF-8 characters, because keys are
+	uint32_t length;
+	uint32_t value;
+};
+
+// Every key which text starts with, shortest first. Returns how many were written to matchesOut
+// (at most maxMatches). Does not allocate
+size_t findDictionaryTriePrefixes(const DictionaryTrieUnit* units, size_t numUnits,
+                                  const char* text, size_t textLength,
+                                  DictionaryTrieMatch* matchesOut, size_t maxMatches);
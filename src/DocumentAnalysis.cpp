@@ -0,0 +1,385 @@
+#include "DocumentAnalysis.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#include "rapidjson/writer.h"
+
+#include "SentenceReader.hpp"
+#include "TokenFeatures.hpp"
+#include "Tracing.hpp"
+
+typedef rapidjson::Writer<rapidjson::StringBuffer> JsonWriter;
+
+static void beginDocument(JsonWriter& writer, const char* documentName)
+{
+	writer.StartObject();
+	writer.Key("document");
+	writer.String(documentName);
+	writer.Key("tokens");
+	writer.StartArray();
+}
+
+static void endDocument(JsonWriter& writer, rapidjson::StringBuffer& output)
+{
+	writer.EndArray();
+	writer.EndObject();
+	output.Put('\n');
+}
+
+// Sentences are usually far shorter. Longer ones are looked up in several blocks
+static const size_t maxTokensPerLookup = 64;
+
+// Words are never anywhere near this many characters long, let alone this many prefixes
+static const size_t maxPrefixMatches = 64;
+
+// Only the best entry is written
+static const size_t maxDeinflectedEntries = 1;
+
+void clearDocumentTokens(DocumentTokens& tokens)
+{
+	tokens.tokens.clear();
+	tokens.deinflections.clear();
+	tokens.strings.clear();
+	tokens.featureOffsets.clear();
+}
+
+static uint32_t addString(DocumentTokens& tokens, const char* string, size_t length)
+{
+	uint32_t offset = static_cast<uint32_t>(tokens.strings.size());
+	tokens.strings.append(string, length);
+	tokens.strings.push_back('\0');
+	return offset;
+}
+
+// A document only uses a few hundred distinct feature strings, over and over. Keyed by length and
+// hash, so finding one doesn't allocate; on the rare collision, the string is just stored again
+static uint32_t addFeature(DocumentTokens& tokens, const char* feature)
+{
+	if (!feature)
+		feature = "";
+	size_t featureLength = std::strlen(feature);
+	uint64_t featureKey = (static_cast<uint64_t>(featureLength) << 32) |
+	                      hashDictionaryKey(feature, featureLength);
+	phmap::flat_hash_map<uint64_t, uint32_t>::iterator featureIt =
+	    tokens.featureOffsets.find(featureKey);
+	if (featureIt != tokens.featureOffsets.end() &&
+	    tokens.strings.compare(featureIt->second, featureLength, feature) == 0)
+		return featureIt->second;
+	uint32_t offset = addString(tokens, feature, featureLength);
+	tokens.featureOffsets.emplace(featureKey, offset);
+	return offset;
+}
+
+static uint32_t addDeinflection(DocumentTokens& tokens, const DeinflectionCandidate& candidate)
+{
+	AnalyzedDeinflection deinflection;
+	std::memset(&deinflection, 0, sizeof(deinflection));
+	deinflection.formOffset = addString(tokens, candidate.text, candidate.length);
+	deinflection.formLength = candidate.length;
+	deinflection.numReasons = candidate.numReasons;
+	for (uint32_t i = 0; i < candidate.numReasons; ++i)
+		deinflection.reasons[i] = static_cast<uint8_t>(candidate.reasons[i]);
+	tokens.deinflections.push_back(deinflection);
+	return static_cast<uint32_t>(tokens.deinflections.size() - 1);
+}
+
+// The token wasn't found as MeCab gave it, so try the dictionary forms its surface could have been
+// conjugated from. candidateOut is which one the entry was found by, or nullptr if none was
+static uint32_t findDeinflectedEntry(const DictionaryLookup& dictionary, const MeCab::Node& node,
+                                     Deinflections& deinflections,
+                                     const DeinflectionCandidate*& candidateOut)
+{
+	candidateOut = nullptr;
+	deinflectWord(node.surface, node.length, deinflections);
+	DictionaryDeinflectedEntry deinflectedEntries[maxDeinflectedEntries];
+	if (!findDictionaryLookupDeinflectedEntries(dictionary, deinflections, deinflectedEntries,
+	                                            maxDeinflectedEntries))
+		return noAnalyzedEntry;
+	candidateOut = &deinflections.candidates[deinflectedEntries[0].candidateIndex];
+	return deinflectedEntries[0].entryIndex;
+}
+
+// MeCab splits set expressions (e.g. 取り敢えず, 気を付ける) into several tokens. If the dictionary
+// has a longer word starting at this token, note it, so the expression isn't read word by word
+static void findCompound(const DictionaryLookup& dictionary, const MeCab::Node& node,
+                         const char* sentenceEnd, AnalyzedToken& token)
+{
+	token.compoundLength = 0;
+	token.compoundEntryIndex = noAnalyzedEntry;
+	DictionaryPrefixMatch matches[maxPrefixMatches];
+	size_t numMatches = findDictionaryLookupPrefixes(
+	    dictionary, node.surface, sentenceEnd - node.surface, matches, maxPrefixMatches);
+	if (!numMatches || matches[numMatches - 1].length <= node.length)
+		return;
+
+	// Shortest first, so the last is the longest. Prefer an entry it's the headword of, then
+	// common words
+	const DictionaryPrefixMatch& longestMatch = matches[numMatches - 1];
+	const DictionaryEntryTable& entryTable = getDictionaryLookupEntryTable(dictionary);
+	uint32_t posting = longestMatch.postings.postings[0];
+	int bestScore = -1;
+	for (uint32_t i = 0; i < longestMatch.postings.numPostings; ++i)
+	{
+		const uint32_t candidate = longestMatch.postings.postings[i];
+		int score = isDictionaryPostingReading(candidate) ? 0 : 2;
+		if (hasDictionaryEntryTag(entryTable, getDictionaryPostingEntryIndex(candidate),
+		                          DictionaryTag::Priority))
+			++score;
+		if (score > bestScore)
+		{
+			posting = candidate;
+			bestScore = score;
+		}
+	}
+	token.compoundLength = static_cast<uint32_t>(longestMatch.length);
+	token.compoundEntryIndex = getDictionaryPostingEntryIndex(posting);
+}
+
+// MeCab is given one sentence at a time, so the lattice never has to hold the whole document.
+// sentenceStart is the byte offset of the sentence in the document
+static bool analyzeSentence(const MeCab::Tagger& tagger, MeCab::Lattice& lattice,
+                            const DictionaryLookup& dictionary, const char* documentName,
+                            const char* sentence, size_t sentenceLength, size_t sentenceStart,
+                            DocumentTokens& tokensOut)
+{
+	lattice.set_sentence(sentence, sentenceLength);
+	bool isParsed = false;
+	{
+		TRACE_ZONE("MeCab parse");
+		isParsed = tagger.parse(&lattice);
+	}
+	if (!isParsed)
+	{
+		std::cerr << "Error: failed to tokenize '" << documentName << "' at byte "
+		          << sentenceStart << ": " << lattice.what() << "\n";
+		return false;
+	}
+
+	// Tokens are looked up a block at a time, which lets the dictionary overlap their cache misses.
+	// By base form, so conjugated words are found
+	const MeCab::Node* nodes[maxTokensPerLookup];
+	DictionaryWord words[maxTokensPerLookup];
+	DictionaryEntryView entries[maxTokensPerLookup];
+	// Only used for tokens which aren't found as MeCab gave them
+	Deinflections deinflections;
+	const DictionaryEntryTable& entryTable = getDictionaryLookupEntryTable(dictionary);
+	const MeCab::Node* nextNode = lattice.bos_node();
+	while (nextNode)
+	{
+		size_t numNodes = 0;
+		for (; nextNode && numNodes < maxTokensPerLookup; nextNode = nextNode->next)
+		{
+			if (nextNode->stat == MECAB_BOS_NODE || nextNode->stat == MECAB_EOS_NODE)
+				continue;
+			nodes[numNodes] = nextNode;
+			words[numNodes] = getTokenDictionaryWord(*nextNode);
+			++numNodes;
+		}
+		findDictionaryLookupWordEntries(dictionary, words, numNodes, entries);
+
+		for (size_t nodeIndex = 0; nodeIndex < numNodes; ++nodeIndex)
+		{
+			const MeCab::Node* node = nodes[nodeIndex];
+			AnalyzedToken token;
+			token.start = sentenceStart + (node->surface - sentence);
+			token.length = node->length;
+			token.featureOffset = addFeature(tokensOut, node->feature);
+			token.entryIndex = entries[nodeIndex].data ?
+			                       findDictionaryEntryIndex(entryTable, entries[nodeIndex].data) :
+			                       noAnalyzedEntry;
+			token.deinflectionIndex = noAnalyzedDeinflection;
+			if (!entries[nodeIndex].data && !isSymbolToken(*node))
+			{
+				const DeinflectionCandidate* deinflected = nullptr;
+				token.entryIndex =
+				    findDeinflectedEntry(dictionary, *node, deinflections, deinflected);
+				if (deinflected)
+					token.deinflectionIndex = addDeinflection(tokensOut, *deinflected);
+			}
+			findCompound(dictionary, *node, sentence + sentenceLength, token);
+			tokensOut.tokens.push_back(token);
+		}
+	}
+	return true;
+}
+
+static void writeDeinflection(const DocumentTokens& tokens,
+                              const AnalyzedDeinflection& deinflection, JsonWriter& writer)
+{
+	writer.Key("deinflection");
+	writer.StartObject();
+	writer.Key("form");
+	writer.String(tokens.strings.data() + deinflection.formOffset, deinflection.formLength);
+	writer.Key("reasons");
+	writer.StartArray();
+	for (uint32_t i = 0; i < deinflection.numReasons; ++i)
+		writer.String(
+		    getDeinflectionReasonName(static_cast<DeinflectionReason>(deinflection.reasons[i])));
+	writer.EndArray();
+	writer.EndObject();
+}
+
+static void writeEntry(const DictionaryEntryTable& entryTable, uint32_t entryIndex,
+                       JsonWriter& writer)
+{
+	DictionaryEntryView entry = getDictionaryEntryLine(entryTable, entryIndex);
+	writer.String(entry.data, static_cast<rapidjson::SizeType>(entry.length));
+}
+
+// Writes every token in tokens. text is the part of the document they're in, which starts at byte
+// textStart of the document
+static void writeTokens(const DictionaryLookup& dictionary, const KnownWords* knownWords,
+                        const char* text, size_t textStart, const DocumentTokens& tokens,
+                        JsonWriter& writer, DocumentAnalysisStats& stats)
+{
+	const DictionaryEntryTable& entryTable = getDictionaryLookupEntryTable(dictionary);
+	for (const AnalyzedToken& token : tokens.tokens)
+	{
+		const char* surface = text + (token.start - textStart);
+		const char* feature = tokens.strings.data() + token.featureOffset;
+		writer.StartObject();
+		writer.Key("surface");
+		writer.String(surface, token.length);
+		writer.Key("start");
+		writer.Uint64(token.start);
+		writer.Key("length");
+		writer.Uint(token.length);
+		writer.Key("feature");
+		writer.String(feature);
+		writer.Key("entry");
+		if (token.entryIndex < entryTable.numEntries)
+		{
+			writeEntry(entryTable, token.entryIndex, writer);
+			++stats.numDictionaryHits;
+		}
+		else
+			writer.Null();
+		if (token.deinflectionIndex < tokens.deinflections.size())
+		{
+			writeDeinflection(tokens, tokens.deinflections[token.deinflectionIndex], writer);
+			++stats.numDeinflected;
+		}
+		if (token.compoundEntryIndex < entryTable.numEntries)
+		{
+			writer.Key("compound");
+			writer.StartObject();
+			writer.Key("length");
+			writer.Uint(token.compoundLength);
+			writer.Key("entry");
+			writeEntry(entryTable, token.compoundEntryIndex, writer);
+			writer.EndObject();
+			++stats.numCompounds;
+		}
+		if (knownWords)
+		{
+			// Anki notes hold the dictionary form, so conjugated words still count as known
+			const char* lemma = nullptr;
+			size_t lemmaLength = 0;
+			getFeatureLemma(feature, surface, token.length, lemma, lemmaLength);
+			bool isKnown = isKnownWord(*knownWords, lemma, lemmaLength) ||
+			               isKnownWord(*knownWords, surface, token.length);
+			writer.Key("known");
+			writer.Bool(isKnown);
+			if (isKnown)
+				++stats.numKnownTokens;
+		}
+		writer.EndObject();
+
+		++stats.numTokens;
+	}
+}
+
+bool tokenizeDocument(const MeCab::Tagger& tagger, MeCab::Lattice& lattice,
+                      const DictionaryLookup& dictionary, const char* documentName,
+                      const char* text, size_t textLength, DocumentTokens& tokensOut)
+{
+	TRACE_ZONE("tokenizeDocument");
+	const char* textEnd = text + textLength;
+	for (const char* sentence = text; sentence < textEnd;)
+	{
+		const char* sentenceEnd = findSentenceEnd(sentence, textEnd);
+		if (!sentenceEnd)
+			sentenceEnd = textEnd;
+		if (!analyzeSentence(tagger, lattice, dictionary, documentName, sentence,
+		                     sentenceEnd - sentence, sentence - text, tokensOut))
+			return false;
+		sentence = sentenceEnd;
+	}
+	return true;
+}
+
+void writeDocumentTokens(const DictionaryLookup& dictionary, const KnownWords* knownWords,
+                         const char* documentName, const char* text, size_t textLength,
+                         const DocumentTokens& tokens, rapidjson::StringBuffer& output,
+                         DocumentAnalysisStats& stats)
+{
+	TRACE_ZONE("writeDocumentTokens");
+	JsonWriter writer(output);
+	beginDocument(writer, documentName);
+	writeTokens(dictionary, knownWords, text, 0, tokens, writer, stats);
+	endDocument(writer, output);
+
+	stats.numBytes += textLength;
+	++stats.numDocuments;
+}
+
+bool analyzeDocument(const MeCab::Tagger& tagger, MeCab::Lattice& lattice,
+                     const DictionaryLookup& dictionary, const KnownWords* knownWords,
+                     const char* documentName, const char* text, size_t textLength,
+                     rapidjson::StringBuffer& output, DocumentAnalysisStats& stats)
+{
+	TRACE_ZONE("analyzeDocument");
+	DocumentTokens tokens;
+	if (!tokenizeDocument(tagger, lattice, dictionary, documentName, text, textLength, tokens))
+		return false;
+	writeDocumentTokens(dictionary, knownWords, documentName, text, textLength, tokens, output,
+	                    stats);
+	return true;
+}
+
+bool analyzeDocumentStream(const MeCab::Tagger& tagger, MeCab::Lattice& lattice,
+                           const DictionaryLookup& dictionary, const KnownWords* knownWords,
+                           const char* documentName, SentenceReader& reader, std::ostream& output,
+                           DocumentAnalysisStats& stats)
+{
+	TRACE_ZONE("analyzeDocumentStream");
+	rapidjson::StringBuffer sentenceOutput;
+	JsonWriter writer(sentenceOutput);
+	beginDocument(writer, documentName);
+	DocumentTokens tokens;
+	bool succeeded = true;
+	size_t sentenceStart = 0;
+	const char* sentence = nullptr;
+	size_t sentenceLength = 0;
+	while (reader.readSentence(sentence, sentenceLength))
+	{
+		clearDocumentTokens(tokens);
+		if (!analyzeSentence(tagger, lattice, dictionary, documentName, sentence, sentenceLength,
+		                     sentenceStart, tokens))
+		{
+			succeeded = false;
+			break;
+		}
+		writeTokens(dictionary, knownWords, sentence, sentenceStart, tokens, writer, stats);
+		stats.numBytes += sentenceLength;
+		sentenceStart += sentenceLength;
+
+		// Only one sentence's worth of output is held at a time
+		output.write(sentenceOutput.GetString(), sentenceOutput.GetSize());
+		sentenceOutput.Clear();
+	}
+	if (reader.hadReadError())
+	{
+		std::cerr << "Error: failed to read '" << documentName << "'\n";
+		succeeded = false;
+	}
+
+	// Part of the document may have been written already; close it so the output stays valid JSON
+	endDocument(writer, sentenceOutput);
+	output.write(sentenceOutput.GetString(), sentenceOutput.GetSize());
+
+	if (succeeded)
+		++stats.numDocuments;
+	return succeeded;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <mecab.h>
+#include <phmap.h>
+#include "rapidjson/stringbuffer.h"
+
+#include "DictionaryLookup.hpp"
+#include "KnownWords.hpp"
+
+class SentenceReader;
+
+struct DocumentAnalysisStats
+{
+	size_t numDocuments = 0;
+	// Of numDocuments, those whose tokens were saved by an earlier run (see AnalysisCacheFile.hpp)
+	size_t numCachedDocuments = 0;
+	size_t numBytes = 0;
+	size_t numTokens = 0;
+	size_t numDictionaryHits = 0;
+	// Of numDictionaryHits, those only found by deinflecting the surface form
+	size_t numDeinflected = 0;
+	// Tokens starting a longer dictionary word, e.g. a set expression MeCab split up
+	size_t numCompounds = 0;
+	size_t numKnownTokens = 0;
+};
+
+// In AnalyzedToken::entryIndex and compoundEntryIndex, when there is no entry
+static const uint32_t noAnalyzedEntry = 0xFFFFFFFFu;
+// In AnalyzedToken::deinflectionIndex, when the token was found as MeCab gave it (or not at all)
+static const uint32_t noAnalyzedDeinflection = 0xFFFFFFFFu;
+
+// Everything MeCab and the dictionary said about a token, so it can be written out later without
+// either (see writeDocumentTokens()). Plain data, so it can be saved to disk as is (see
+// AnalysisCacheFile.hpp)
+struct AnalyzedToken
+{
+	// In bytes, in the document. The surface is the text there. 64-bit, since streamed documents
+	// (see analyzeDocumentStream()) can be larger than 4 GiB
+	uint64_t start;
+	uint32_t length;
+	// Of MeCab's feature string, in DocumentTokens::strings
+	uint32_t featureOffset;
+	// The best matching entry, in the dictionary's entry table
+	uint32_t entryIndex;
+	// Into DocumentTokens::deinflections, if the entry was only found by deinflecting the surface
+	uint32_t deinflectionIndex;
+	// The longest dictionary word starting at the token, if it's longer than the token. Otherwise
+	// 0 and noAnalyzedEntry
+	uint32_t compoundLength;
+	uint32_t compoundEntryIndex;
+};
+
+struct AnalyzedDeinflection
+{
+	// The dictionary form the entry was found by, in DocumentTokens::strings
+	uint32_t formOffset;
+	uint32_t formLength;
+	uint32_t numReasons;
+	// DeinflectionReason
+	uint8_t reasons[maxDeinflectionReasons];
+};
+
+// A document's tokens, in order
+struct DocumentTokens
+{
+	std::vector<AnalyzedToken> tokens;
+	std::vector<AnalyzedDeinflection> deinflections;
+	// Null-terminated strings, which tokens and deinflections point at by offset. Each distinct
+	// feature string is only stored once
+	std::string strings;
+	// Where each feature string is in strings, by length and hash. Only used while tokenizing
+	phmap::flat_hash_map<uint64_t, uint32_t> featureOffsets;
+};
+
+void clearDocumentTokens(DocumentTokens& tokens);
+
+// The tokenizing and lookup half of analyzeDocument(). Appends the document's tokens to tokensOut
+bool tokenizeDocument(const MeCab::Tagger& tagger, MeCab::Lattice& lattice,
+                      const DictionaryLookup& dictionary, const char* documentName,
+                      const char* text, size_t textLength, DocumentTokens& tokensOut);
+
+// The writing half of analyzeDocument(): the JSON line for the document, from tokens found in it
+// by tokenizeDocument(), here or on an earlier run with the same dictionary. Whether each token is
+// known is worked out here, so knownWords can change between runs
+void writeDocumentTokens(const DictionaryLookup& dictionary, const KnownWords* knownWords,
+                         const char* documentName, const char* text, size_t textLength,
+                         const DocumentTokens& tokens, rapidjson::StringBuffer& output,
+                         DocumentAnalysisStats& stats);
+
+// Tokenize the document and look up every token in the dictionary, by its dictionary form and
+// reading (see findDictionaryLookupWordEntries()). Appends one line of JSON describing the document
+// to output:
+// {"document": "name", "tokens": [{"surface": "...", "start": 0, "length": 3,
+//                                  "feature": "...", "entry": "..." or null,
+//                                  "deinflection": {"form": "...", "reasons": ["past", ...]},
+//                                  "compound": {"length": 9, "entry": "..."}, "known": true}, ...]}
+// start and length are in bytes. "entry" is the best matching entry line. If the token isn't in
+// the dictionary as MeCab gave it (e.g. MeCab didn't know the word, so has no dictionary form),
+// its surface form is deinflected (see Deinflection.hpp), and "deinflection" says which
+// dictionary form was found and how. "compound" is only written if the longest dictionary word
+// starting at the token is longer than it. "known" is only written if knownWords is given, and is
+// true if the token's dictionary form (or surface, if it has none) is one of them. The text does
+// not need to be null-terminated. MeCab is given one sentence at a time (see findSentenceEnd())
+bool analyzeDocument(const MeCab::Tagger& tagger, MeCab::Lattice& lattice,
+                     const DictionaryLookup& dictionary, const KnownWords* knownWords,
+                     const char* documentName, const char* text, size_t textLength,
+                     rapidjson::StringBuffer& output, DocumentAnalysisStats& stats);
+
+// Same output as analyzeDocument(), but the document is read and written a sentence at a time, so
+// memory use doesn't grow with the size of the document. If anything fails partway through, the
+// line is still terminated, with the tokens analyzed so far
+bool analyzeDocumentStream(const MeCab::Tagger& tagger, MeCab::Lattice& lattice,
+                           const DictionaryLookup& dictionary, const KnownWords* knownWords,
+                           const char* documentName, SentenceReader& reader, std::ostream& output,
+                           DocumentAnalysisStats& stats);
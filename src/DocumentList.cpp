@@ -0,0 +1,74 @@
+#include "DocumentList.hpp"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+bool addDocumentsFromPath(const char* path, std::vector<std::string>& documentsOut)
+{
+	struct stat pathStat;
+	if (stat(path, &pathStat) != 0)
+	{
+		std::cerr << "Error: could not find '" << path << "'\n";
+		return false;
+	}
+
+	if (S_ISREG(pathStat.st_mode))
+	{
+		documentsOut.push_back(path);
+		return true;
+	}
+	if (!S_ISDIR(pathStat.st_mode))
+		return true;
+
+	DIR* directory = opendir(path);
+	if (!directory)
+	{
+		std::cerr << "Error: could not open directory '" << path << "'\n";
+		return false;
+	}
+
+	// Sort so output order doesn't depend on the filesystem
+	std::vector<std::string> children;
+	for (dirent* entry = readdir(directory); entry; entry = readdir(directory))
+	{
+		if (entry->d_name[0] == '.')
+			continue;
+		std::string childPath = path;
+		if (childPath.empty() || childPath.back() != '/')
+			childPath += '/';
+		childPath += entry->d_name;
+		children.push_back(childPath);
+	}
+	closedir(directory);
+	std::sort(children.begin(), children.end());
+
+	bool succeeded = true;
+	for (const std::string& child : children)
+		succeeded &= addDocumentsFromPath(child.c_str(), documentsOut);
+	return succeeded;
+}
+
+bool addDocumentsFromListFile(const char* listFilename, std::vector<std::string>& documentsOut)
+{
+	std::ifstream listFile(listFilename);
+	if (!listFile.is_open())
+	{
+		std::cerr << "Error: could not open file list '" << listFilename << "'\n";
+		return false;
+	}
+
+	bool succeeded = true;
+	std::string line;
+	while (std::getline(listFile, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (line.empty())
+			continue;
+		succeeded &= addDocumentsFromPath(line.c_str(), documentsOut);
+	}
+	return succeeded;
+}
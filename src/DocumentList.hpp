@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Appends path if it is a file, or every file under it (recursively, sorted, skipping hidden files)
+// if it is a directory
+bool addDocumentsFromPath(const char* path, std::vector<std::string>& documentsOut);
+
+// Appends every path listed in listFilename (one per line). Directories are expanded
+bool addDocumentsFromListFile(const char* listFilename, std::vector<std::string>& documentsOut);
@@ -0,0 +1,515 @@
+#include "DueCards.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include "rapidjson/reader.h"
+
+#include "Tracing.hpp"
+
+StringPool::StringPool() : arena(64 * 1024)
+{
+	intern("", 0);
+}
+
+uint32_t StringPool::intern(const char* string, uint32_t length)
+{
+	DictionaryKey key = {string, length};
+	auto findIt = indices.find(key);
+	if (findIt != indices.end())
+		return findIt->second;
+
+	char* copy = arena.allocate(length + 1);
+	std::memcpy(copy, string, length);
+	copy[length] = '\0';
+	key.data = copy;
+	uint32_t index = static_cast<uint32_t>(strings.size());
+	strings.push_back(copy);
+	indices.emplace(key, index);
+	return index;
+}
+
+const char* StringPool::get(uint32_t index) const
+{
+	return strings[index];
+}
+
+void StringPool::clear()
+{
+	indices.clear();
+	strings.clear();
+	arena.clear();
+	intern("", 0);
+}
+
+size_t StringPool::getNumStrings() const
+{
+	return strings.size();
+}
+
+size_t StringPool::bytesAllocated() const
+{
+	return arena.bytesAllocated();
+}
+
+void DueCards::reset(size_t numCards)
+{
+	cardIds.assign(numCards, 0);
+	noteIds.assign(numCards, 0);
+	modifiedTimes.assign(numCards, 0);
+	loadedTimes.assign(numCards, 0);
+	intervals.assign(numCards, 0);
+	fieldOrders.assign(numCards, 0);
+	isLoaded.assign(numCards, 0);
+	modelNames.assign(numCards, 0);
+	quizWords.assign(numCards, 0);
+	strings.clear();
+}
+
+size_t DueCards::add(size_t numCards)
+{
+	size_t firstCard = size();
+	size_t newSize = firstCard + numCards;
+	cardIds.resize(newSize, 0);
+	noteIds.resize(newSize, 0);
+	modifiedTimes.resize(newSize, 0);
+	loadedTimes.resize(newSize, 0);
+	intervals.resize(newSize, 0);
+	fieldOrders.resize(newSize, 0);
+	isLoaded.resize(newSize, 0);
+	modelNames.resize(newSize, 0);
+	quizWords.resize(newSize, 0);
+	return firstCard;
+}
+
+void DueCards::keepOnly(const std::vector<size_t>& keptCards)
+{
+	// Copied out first, since the pool is rebuilt from only the strings still used
+	std::vector<std::string> keptQuizWords(keptCards.size());
+	std::vector<std::string> keptModelNames(keptCards.size());
+	for (size_t i = 0; i < keptCards.size(); ++i)
+	{
+		keptQuizWords[i] = getQuizWord(keptCards[i]);
+		keptModelNames[i] = getModelName(keptCards[i]);
+	}
+
+	// Cards only move towards the front, so they can be moved in place
+	for (size_t i = 0; i < keptCards.size(); ++i)
+	{
+		size_t card = keptCards[i];
+		cardIds[i] = cardIds[card];
+		noteIds[i] = noteIds[card];
+		modifiedTimes[i] = modifiedTimes[card];
+		loadedTimes[i] = loadedTimes[card];
+		intervals[i] = intervals[card];
+		fieldOrders[i] = fieldOrders[card];
+		isLoaded[i] = isLoaded[card];
+	}
+	size_t numCards = keptCards.size();
+	cardIds.resize(numCards);
+	noteIds.resize(numCards);
+	modifiedTimes.resize(numCards);
+	loadedTimes.resize(numCards);
+	intervals.resize(numCards);
+	fieldOrders.resize(numCards);
+	isLoaded.resize(numCards);
+	modelNames.resize(numCards);
+	quizWords.resize(numCards);
+
+	strings.clear();
+	for (size_t i = 0; i < numCards; ++i)
+	{
+		quizWords[i] = strings.intern(keptQuizWords[i].data(),
+		                              static_cast<uint32_t>(keptQuizWords[i].size()));
+		modelNames[i] = strings.intern(keptModelNames[i].data(),
+		                               static_cast<uint32_t>(keptModelNames[i].size()));
+	}
+}
+
+size_t DueCards::size() const
+{
+	return cardIds.size();
+}
+
+const char* DueCards::getQuizWord(size_t card) const
+{
+	return strings.get(quizWords[card]);
+}
+
+const char* DueCards::getModelName(size_t card) const
+{
+	return strings.get(modelNames[card]);
+}
+
+void CardCache::add(const int64_t* cardIds, size_t numCards, size_t& firstCardOut)
+{
+	firstCardOut = cards.add(numCards);
+	for (size_t i = 0; i < numCards; ++i)
+	{
+		cards.cardIds[firstCardOut + i] = cardIds[i];
+		cardIndices[cardIds[i]] = firstCardOut + i;
+	}
+}
+
+bool CardCache::find(int64_t cardId, size_t& cardOut) const
+{
+	auto findIt = cardIndices.find(cardId);
+	if (findIt == cardIndices.end())
+		return false;
+	cardOut = findIt->second;
+	return true;
+}
+
+void CardCache::forget(int64_t cardId)
+{
+	cardIndices.erase(cardId);
+}
+
+void CardCache::compact(const std::vector<int64_t>& keepCardIds)
+{
+	TRACE_ZONE("CardCache::compact");
+	std::vector<size_t> keptCards;
+	keptCards.reserve(keepCardIds.size());
+	size_t card = 0;
+	for (int64_t cardId : keepCardIds)
+	{
+		if (find(cardId, card) && cards.isLoaded[card])
+			keptCards.push_back(card);
+	}
+	std::sort(keptCards.begin(), keptCards.end());
+	keptCards.erase(std::unique(keptCards.begin(), keptCards.end()), keptCards.end());
+
+	cards.keepOnly(keptCards);
+	cardIndices.clear();
+	for (size_t i = 0; i < cards.size(); ++i)
+		cardIndices[cards.cardIds[i]] = i;
+}
+
+const DueCards& CardCache::getCards() const
+{
+	return cards;
+}
+
+DueCards& CardCache::getCards()
+{
+	return cards;
+}
+
+enum class CardKey
+{
+	Other,
+	CardId,
+	Note,
+	ModifiedTime,
+	Interval,
+	FieldOrder,
+	ModelName,
+	Fields
+};
+
+enum class CardField
+{
+	Other,
+	Lemma,
+	EnglishGloss,
+	Front,
+	Back
+};
+
+// Depth of each part of {"result": [{..., "fields": {"Lemma": {"value": ...}}}], "error": null}
+static const int responseDepth = 1;
+static const int resultDepth = 2;
+static const int cardDepth = 3;
+static const int fieldsDepth = 4;
+static const int fieldDepth = 5;
+
+// Only looks at the handful of values it needs; everything else only costs the parser a scan
+struct CardsInfoHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, CardsInfoHandler>
+{
+	DueCards& dueCards;
+	uint32_t firstCard;
+	uint32_t numCards;
+
+	int depth = 0;
+	bool inResult = false;
+	bool inError = false;
+	// Number of elements of the result array seen so far
+	uint32_t numCardsSeen = 0;
+	CardKey cardKey = CardKey::Other;
+	CardField cardField = CardField::Other;
+	bool inFieldValue = false;
+	bool cardHasFields = false;
+	bool hasField[5] = {};
+	// Reused for every card so they only allocate until they have grown big enough
+	std::string fieldValues[5];
+
+	CardsInfoHandler(DueCards& dueCards, uint32_t firstCard, uint32_t numCards)
+	    : dueCards(dueCards), firstCard(firstCard), numCards(numCards)
+	{
+	}
+
+	size_t currentCard() const
+	{
+		return firstCard + numCardsSeen - 1;
+	}
+
+	// Another element in the result array, which may not even be a card (e.g. null)
+	bool startResultElement()
+	{
+		if (numCardsSeen == numCards)
+		{
+			std::cerr << "Error: AnkiConnect returned more cards than were asked for\n";
+			return false;
+		}
+		++numCardsSeen;
+		return true;
+	}
+
+	void startCard()
+	{
+		cardHasFields = false;
+		for (int i = 0; i < 5; ++i)
+		{
+			hasField[i] = false;
+			fieldValues[i].clear();
+		}
+	}
+
+	// Matches the note types the pacer knows how to quiz
+	void finishCard()
+	{
+		if (!cardHasFields)
+			return;
+
+		size_t card = currentCard();
+		const std::string* quizWord = nullptr;
+		bool isReversed = dueCards.fieldOrders[card] == 1;
+		// Only "A Frequency Dictionary of Japanese Words" has this
+		if (hasField[static_cast<int>(CardField::Lemma)])
+			quizWord = &fieldValues[static_cast<int>(isReversed ? CardField::EnglishGloss :
+			                                                      CardField::Lemma)];
+		else if (hasField[static_cast<int>(CardField::Front)])
+			quizWord = &fieldValues[static_cast<int>(isReversed ? CardField::Front :
+			                                                      CardField::Back)];
+		else
+			std::cerr << "Card has unrecognized fields\n";
+
+		if (quizWord)
+			dueCards.quizWords[card] = dueCards.strings.intern(
+			    quizWord->c_str(), static_cast<uint32_t>(quizWord->size()));
+		dueCards.isLoaded[card] = true;
+	}
+
+	bool number(int64_t value)
+	{
+		if (depth == responseDepth && inError)
+			return unknownError();
+		if (depth == resultDepth && inResult)
+			return startResultElement();
+		if (depth != cardDepth || !inResult)
+			return true;
+
+		size_t card = currentCard();
+		switch (cardKey)
+		{
+			case CardKey::CardId:
+				dueCards.cardIds[card] = value;
+				break;
+			case CardKey::Note:
+				dueCards.noteIds[card] = value;
+				break;
+			case CardKey::ModifiedTime:
+				dueCards.modifiedTimes[card] = value;
+				break;
+			case CardKey::Interval:
+				dueCards.intervals[card] = static_cast<int32_t>(value);
+				break;
+			case CardKey::FieldOrder:
+				dueCards.fieldOrders[card] = static_cast<uint8_t>(value);
+				break;
+			default:
+				break;
+		}
+		return true;
+	}
+
+	bool unknownError()
+	{
+		std::cerr << "Error: AnkiConnect: (unknown error)\n";
+		return false;
+	}
+
+	bool Default()
+	{
+		if (depth == responseDepth && inError)
+			return unknownError();
+		if (depth == resultDepth && inResult)
+			return startResultElement();
+		return true;
+	}
+
+	bool Null()
+	{
+		if (depth == responseDepth && inError)
+			return true;
+		return Default();
+	}
+	bool Bool(bool)
+	{
+		return Default();
+	}
+	bool Double(double)
+	{
+		return Default();
+	}
+	bool Int(int value)
+	{
+		return number(value);
+	}
+	bool Uint(unsigned value)
+	{
+		return number(value);
+	}
+	bool Int64(int64_t value)
+	{
+		return number(value);
+	}
+	bool Uint64(uint64_t value)
+	{
+		return number(static_cast<int64_t>(value));
+	}
+
+	bool String(const char* string, rapidjson::SizeType length, bool)
+	{
+		if (depth == responseDepth && inError)
+		{
+			std::cerr << "Error: AnkiConnect: " << string << "\n";
+			return false;
+		}
+		if (!inResult)
+			return true;
+		if (depth == resultDepth)
+			return startResultElement();
+		if (depth == cardDepth && cardKey == CardKey::ModelName)
+			dueCards.modelNames[currentCard()] = dueCards.strings.intern(string, length);
+		else if (depth == fieldDepth && inFieldValue && cardField != CardField::Other)
+			fieldValues[static_cast<int>(cardField)].assign(string, length);
+		return true;
+	}
+
+	bool Key(const char* key, rapidjson::SizeType length, bool)
+	{
+		switch (depth)
+		{
+			case responseDepth:
+				inResult = std::strcmp(key, "result") == 0;
+				inError = std::strcmp(key, "error") == 0;
+				break;
+			case cardDepth:
+				if (std::strcmp(key, "cardId") == 0)
+					cardKey = CardKey::CardId;
+				else if (std::strcmp(key, "note") == 0)
+					cardKey = CardKey::Note;
+				else if (std::strcmp(key, "mod") == 0)
+					cardKey = CardKey::ModifiedTime;
+				else if (std::strcmp(key, "interval") == 0)
+					cardKey = CardKey::Interval;
+				else if (std::strcmp(key, "fieldOrder") == 0)
+					cardKey = CardKey::FieldOrder;
+				else if (std::strcmp(key, "modelName") == 0)
+					cardKey = CardKey::ModelName;
+				else if (std::strcmp(key, "fields") == 0)
+					cardKey = CardKey::Fields;
+				else
+					cardKey = CardKey::Other;
+				break;
+			case fieldsDepth:
+				if (std::strcmp(key, "Lemma") == 0)
+					cardField = CardField::Lemma;
+				else if (std::strcmp(key, "English Gloss") == 0)
+					cardField = CardField::EnglishGloss;
+				else if (std::strcmp(key, "Front") == 0)
+					cardField = CardField::Front;
+				else if (std::strcmp(key, "Back") == 0)
+					cardField = CardField::Back;
+				else
+					cardField = CardField::Other;
+				hasField[static_cast<int>(cardField)] = true;
+				break;
+			case fieldDepth:
+				inFieldValue = std::strcmp(key, "value") == 0;
+				break;
+			default:
+				break;
+		}
+		return true;
+	}
+
+	bool StartObject()
+	{
+		if (inResult && depth == resultDepth)
+		{
+			if (!startResultElement())
+				return false;
+			startCard();
+		}
+		else if (inResult && depth == cardDepth && cardKey == CardKey::Fields)
+			cardHasFields = true;
+		else if (inError && depth == responseDepth)
+			return unknownError();
+		++depth;
+		return true;
+	}
+
+	bool EndObject(rapidjson::SizeType)
+	{
+		--depth;
+		if (inResult && depth == resultDepth)
+			finishCard();
+		return true;
+	}
+
+	bool StartArray()
+	{
+		if (inResult && depth == resultDepth && !startResultElement())
+			return false;
+		if (inError && depth == responseDepth)
+			return unknownError();
+		++depth;
+		return true;
+	}
+
+	bool EndArray(rapidjson::SizeType)
+	{
+		--depth;
+		return true;
+	}
+};
+
+bool parseCardsInfoResponse(char* jsonResponse, uint32_t firstCard, uint32_t numCards,
+                            DueCards& dueCards)
+{
+	TRACE_ZONE("parseCardsInfoResponse");
+	if (!jsonResponse || !jsonResponse[0])
+		return false;
+	if (firstCard + numCards > dueCards.size())
+	{
+		std::cerr << "Error: cards " << firstCard << " to " << firstCard + numCards
+		          << " do not fit in the " << dueCards.size() << " due cards\n";
+		return false;
+	}
+
+	CardsInfoHandler handler(dueCards, firstCard, numCards);
+	rapidjson::Reader reader;
+	rapidjson::InsituStringStream stream(jsonResponse);
+	rapidjson::ParseResult result = reader.Parse<rapidjson::kParseInsituFlag>(stream, handler);
+	if (!result)
+	{
+		// Errors the handler stopped the parse for have already been reported
+		if (result.Code() != rapidjson::kParseErrorTermination)
+			std::cerr << "Error: AnkiConnect cardsInfo response is not valid JSON\n";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "Arena.hpp"
+#include "Dictionary.hpp"
+
+// Stores each distinct string once, so e.g. every card of the same model shares one copy of the
+// model name. Strings are null-terminated and never move, so pointers to them stay valid until
+// clear(). String 0 is always the empty string
+class StringPool
+{
+public:
+	StringPool();
+
+	StringPool(const StringPool&) = delete;
+	StringPool& operator=(const StringPool&) = delete;
+
+	uint32_t intern(const char* string, uint32_t length);
+	const char* get(uint32_t index) const;
+
+	void clear();
+	size_t getNumStrings() const;
+	size_t bytesAllocated() const;
+
+private:
+	Arena arena;
+	std::vector<const char*> strings;
+	phmap::flat_hash_map<DictionaryKey, uint32_t, DictionaryKeyHash, DictionaryKeyEqual> indices;
+};
+
+// Only what the pacer needs from each due card, one array per field. Card i is at index i of every
+// array. Filled in a chunk at a time as cardsInfo responses arrive
+struct DueCards
+{
+	std::vector<int64_t> cardIds;
+	std::vector<int64_t> noteIds;
+	// When the card was last changed (e.g. reviewed), in seconds since the epoch. Editing its note
+	// doesn't change this
+	std::vector<int64_t> modifiedTimes;
+	// When the card's info was asked for, in seconds since the epoch. If its note was modified at
+	// or after this, the card's fields may be out of date
+	std::vector<int64_t> loadedTimes;
+	std::vector<int32_t> intervals;
+	std::vector<uint8_t> fieldOrders;
+	// False until the card's info arrives, and for cards deleted since they were found
+	std::vector<uint8_t> isLoaded;
+	// Indices into strings
+	std::vector<uint32_t> modelNames;
+	std::vector<uint32_t> quizWords;
+
+	StringPool strings;
+
+	// Clears every card and makes room for numCards
+	void reset(size_t numCards);
+	// Makes room for numCards more, without touching the cards already there. Returns the index of
+	// the first new card
+	size_t add(size_t numCards);
+	// Keeps only keptCards (ascending indices), moved to the front in that order. Strings no other
+	// card uses are freed
+	void keepOnly(const std::vector<size_t>& keptCards);
+	size_t size() const;
+	const char* getQuizWord(size_t card) const;
+	const char* getModelName(size_t card) const;
+};
+
+// Cards kept between refreshes, so only cards never seen before need their info fetched. Even a
+// big collection only has a few thousand due at a time, so cards are only evicted by compact(),
+// e.g. once a day. Edits to a cached card's note aren't seen until it is forgotten
+class CardCache
+{
+public:
+	// Cards added are not loaded until their cardsInfo response is parsed into cards
+	void add(const int64_t* cardIds, size_t numCards, size_t& firstCardOut);
+	// Returns false if the card has never been added
+	bool find(int64_t cardId, size_t& cardOut) const;
+	// Next time it is added, it gets a fresh slot, e.g. to retry a load which failed. The old slot
+	// is only freed by compact()
+	void forget(int64_t cardId);
+	// Drops every card except the loaded ones in keepCardIds, and frees forgotten cards' slots.
+	// Card indices change, so no cardsInfo responses may be in flight
+	void compact(const std::vector<int64_t>& keepCardIds);
+
+	const DueCards& getCards() const;
+	DueCards& getCards();
+
+private:
+	DueCards cards;
+	phmap::flat_hash_map<int64_t, size_t> cardIndices;
+};
+
+// Parses a cardsInfo response straight into dueCards, filling cards firstCard onwards. numCards is
+// how many cards were asked for; a response with more is an error. Parses in place, so jsonResponse
+// is overwritten. Unused fields (e.g. the rendered question and answer HTML) are skipped without
+// being copied. Returns false if the response is invalid or holds an error
+bool parseCardsInfoResponse(char* jsonResponse, uint32_t firstCard, uint32_t numCards,
+                            DueCards& dueCards);
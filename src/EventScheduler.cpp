@@ -0,0 +1,266 @@
+#include "EventScheduler.hpp"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+
+EventScheduler::EventScheduler()
+    : epollFd(epoll_create1(EPOLL_CLOEXEC)),
+      timerFd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+      wallClockTimerFd(timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC)),
+      nextEventId(0),
+      stopRequested(false)
+{
+	if (epollFd == -1 || timerFd == -1 || wallClockTimerFd == -1)
+	{
+		std::cerr << "Error: could not create event scheduler timer: " << strerror(errno) << "\n";
+		return;
+	}
+	for (int fileDescriptor : {timerFd, wallClockTimerFd})
+	{
+		epoll_event timerEvent = {};
+		timerEvent.events = EPOLLIN;
+		timerEvent.data.fd = fileDescriptor;
+		if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fileDescriptor, &timerEvent) == -1)
+			std::cerr << "Error: could not watch event scheduler timer: " << strerror(errno)
+			          << "\n";
+	}
+}
+
+EventScheduler::~EventScheduler()
+{
+	if (timerFd != -1)
+		close(timerFd);
+	if (wallClockTimerFd != -1)
+		close(wallClockTimerFd);
+	if (epollFd != -1)
+		close(epollFd);
+}
+
+EventScheduler::EventId EventScheduler::push(ScheduledEvent&& event)
+{
+	event.id = nextEventId++;
+	liveEvents.insert(event.id);
+	if (event.isWallClock)
+		wallClockEvents.push(std::move(event));
+	else
+		events.push(std::move(event));
+	return nextEventId - 1;
+}
+
+EventScheduler::EventId EventScheduler::schedule(Clock::time_point targetTime, const char* name,
+                                                 EventCallback callback)
+{
+	ScheduledEvent event;
+	event.targetTime = targetTime;
+	event.isWallClock = false;
+	event.name = name;
+	event.callback = std::move(callback);
+	return push(std::move(event));
+}
+
+EventScheduler::EventId EventScheduler::schedule(WallClock::time_point targetTime,
+                                                 const char* name, EventCallback callback)
+{
+	ScheduledEvent event;
+	event.wallClockTime = targetTime;
+	event.isWallClock = true;
+	event.name = name;
+	event.callback = std::move(callback);
+	return push(std::move(event));
+}
+
+EventScheduler::EventId EventScheduler::scheduleIn(float seconds, const char* name,
+                                                   EventCallback callback)
+{
+	Clock::time_point targetTime =
+	    Clock::now() +
+	    std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(seconds));
+	return schedule(targetTime, name, std::move(callback));
+}
+
+void EventScheduler::cancel(EventId event)
+{
+	// Events which already ran aren't live, so there's nothing to remember
+	liveEvents.erase(event);
+	dropCancelledEvents();
+}
+
+void EventScheduler::dropCancelledEvents()
+{
+	while (!events.empty() && !liveEvents.count(events.top().id))
+		events.pop();
+	while (!wallClockEvents.empty() && !liveEvents.count(wallClockEvents.top().id))
+		wallClockEvents.pop();
+}
+
+EventScheduler::Clock::duration EventScheduler::getTimeUntil(const ScheduledEvent& event)
+{
+	if (event.isWallClock)
+		return std::chrono::duration_cast<Clock::duration>(event.wallClockTime - WallClock::now());
+	return event.targetTime - Clock::now();
+}
+
+EventScheduler::EventQueue* EventScheduler::getNextEventQueue()
+{
+	if (events.empty())
+		return wallClockEvents.empty() ? nullptr : &wallClockEvents;
+	if (wallClockEvents.empty())
+		return &events;
+	return getTimeUntil(wallClockEvents.top()) < getTimeUntil(events.top()) ? &wallClockEvents :
+	                                                                            &events;
+}
+
+void EventScheduler::setBackgroundWork(std::function<bool()> isBusy,
+                                       std::function<void(int)> waitFunction)
+{
+	isBackgroundWorkBusy = std::move(isBusy);
+	waitForBackgroundWork = std::move(waitFunction);
+}
+
+void EventScheduler::recordDrift(const char* name, Clock::duration drift)
+{
+	float driftMilliseconds = std::chrono::duration<float, std::milli>(drift).count();
+	std::vector<EventDriftStats>::iterator stats = std::find_if(
+	    driftStats.begin(), driftStats.end(),
+	    [name](const EventDriftStats& stats) { return strcmp(stats.name, name) == 0; });
+	if (stats == driftStats.end())
+	{
+		driftStats.push_back(EventDriftStats());
+		stats = driftStats.end() - 1;
+		stats->name = name;
+	}
+	++stats->numEvents;
+	stats->totalDriftMilliseconds += driftMilliseconds;
+	stats->maxDriftMilliseconds = std::max(stats->maxDriftMilliseconds, driftMilliseconds);
+}
+
+void EventScheduler::runDueEvents()
+{
+	while (!stopRequested)
+	{
+		dropCancelledEvents();
+		EventQueue* queue = getNextEventQueue();
+		if (!queue)
+			return;
+		Clock::duration timeUntilEvent = getTimeUntil(queue->top());
+		if (timeUntilEvent > Clock::duration::zero())
+			return;
+
+		// Copied out first; the callback may schedule more events
+		ScheduledEvent event = queue->top();
+		queue->pop();
+		liveEvents.erase(event.id);
+
+		recordDrift(event.name, -timeUntilEvent);
+		event.callback();
+	}
+}
+
+// Relative timers count down from now; wall-clock ones are armed for the absolute time, so the
+// kernel fires them on time whatever happens to the clock in between. An empty queue disarms
+bool EventScheduler::armTimer(int fileDescriptor, const EventQueue& queue)
+{
+	itimerspec timerSpec = {};
+	int flags = 0;
+	if (!queue.empty())
+	{
+		const ScheduledEvent& event = queue.top();
+		std::chrono::nanoseconds time =
+		    event.isWallClock ?
+		        std::chrono::duration_cast<std::chrono::nanoseconds>(
+		            event.wallClockTime.time_since_epoch()) :
+		        std::chrono::duration_cast<std::chrono::nanoseconds>(event.targetTime -
+		                                                             Clock::now());
+		if (event.isWallClock)
+			flags = TFD_TIMER_ABSTIME;
+		// A zero time would disarm the timer instead
+		time = std::max(time, std::chrono::nanoseconds(1));
+		timerSpec.it_value.tv_sec = time.count() / 1000000000;
+		timerSpec.it_value.tv_nsec = time.count() % 1000000000;
+	}
+	if (timerfd_settime(fileDescriptor, flags, &timerSpec, nullptr) == -1)
+	{
+		std::cerr << "Error: could not arm event scheduler timer: " << strerror(errno) << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool EventScheduler::waitForNextEvent()
+{
+	Clock::duration timeToNextEvent = getTimeUntil(getNextEventQueue()->top());
+	if (timeToNextEvent <= Clock::duration::zero())
+		return true;
+
+	if (isBackgroundWorkBusy && isBackgroundWorkBusy())
+	{
+		// Rounded up so the event isn't woken for early, over and over
+		std::chrono::milliseconds timeout =
+		    std::chrono::duration_cast<std::chrono::milliseconds>(timeToNextEvent) +
+		    std::chrono::milliseconds(1);
+		waitForBackgroundWork(static_cast<int>(std::min<int64_t>(timeout.count(), 1000)));
+		return true;
+	}
+
+	if (epollFd == -1 || timerFd == -1 || wallClockTimerFd == -1)
+		return false;
+	if (!armTimer(timerFd, events) || !armTimer(wallClockTimerFd, wallClockEvents))
+		return false;
+
+	epoll_event readyEvents[2];
+	int numReady = epoll_wait(epollFd, readyEvents, 2, -1);
+	if (numReady == -1 && errno != EINTR)
+	{
+		std::cerr << "Error: waiting for events failed: " << strerror(errno) << "\n";
+		return false;
+	}
+	for (int i = 0; i < numReady; ++i)
+	{
+		uint64_t numExpirations = 0;
+		if (read(readyEvents[i].data.fd, &numExpirations, sizeof(numExpirations)) == -1 &&
+		    errno != EAGAIN)
+			return false;
+	}
+	return true;
+}
+
+bool EventScheduler::run()
+{
+	stopRequested = false;
+	while (!stopRequested)
+	{
+		runDueEvents();
+		// Cancelled events have been dropped from the front, so this means none are live
+		dropCancelledEvents();
+		if (stopRequested || (events.empty() && wallClockEvents.empty()))
+			break;
+		if (!waitForNextEvent())
+			return false;
+	}
+	return true;
+}
+
+void EventScheduler::stop()
+{
+	stopRequested = true;
+}
+
+const std::vector<EventDriftStats>& EventScheduler::getDriftStats() const
+{
+	return driftStats;
+}
+
+void printEventDriftStats(const std::vector<EventDriftStats>& driftStats)
+{
+	for (const EventDriftStats& stats : driftStats)
+	{
+		std::cout << stats.name << ": " << stats.numEvents << " events, "
+		          << stats.totalDriftMilliseconds / stats.numEvents << " ms average drift ("
+		          << stats.maxDriftMilliseconds << " ms max)\n";
+	}
+}
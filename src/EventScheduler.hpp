@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include <phmap.h>
+
+// How late events of one kind ran compared to when they were scheduled
+struct EventDriftStats
+{
+	const char* name = nullptr;
+	size_t numEvents = 0;
+	float totalDriftMilliseconds = 0.f;
+	float maxDriftMilliseconds = 0.f;
+};
+
+// Runs callbacks at scheduled times on the calling thread. In between, it sleeps in epoll on a
+// timerfd armed for the earliest event, so nothing polls and a long wait costs nothing. Events are
+// kept in a priority queue; those scheduled for the same time run in the order they were
+// scheduled. Callbacks may schedule and cancel events. Linux only.
+// Events are either relative (Clock, which stops while the machine is suspended) or at a time of
+// day (WallClock). Wall-clock events get their own CLOCK_REALTIME timer armed for the absolute
+// time, so they still run on time after a suspend or a clock change
+class EventScheduler
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+	typedef std::chrono::system_clock WallClock;
+	typedef std::function<void()> EventCallback;
+	typedef uint64_t EventId;
+
+	EventScheduler();
+	~EventScheduler();
+
+	EventScheduler(const EventScheduler&) = delete;
+	EventScheduler& operator=(const EventScheduler&) = delete;
+
+	// name must outlive the scheduler (e.g. a string literal); drift is tracked per name
+	EventId schedule(Clock::time_point targetTime, const char* name, EventCallback callback);
+	EventId schedule(WallClock::time_point targetTime, const char* name, EventCallback callback);
+	EventId scheduleIn(float seconds, const char* name, EventCallback callback);
+	void cancel(EventId event);
+
+	// While isBusy() returns true, waitFunction(timeoutMilliseconds) is called to wait instead of
+	// the timer, e.g. so AnkiConnectPipeline::update() can handle responses as they arrive. It
+	// must return within the timeout
+	void setBackgroundWork(std::function<bool()> isBusy, std::function<void(int)> waitFunction);
+
+	// Runs events until stop() is called or none are left (cancelled ones don't count). Returns
+	// false if waiting failed
+	bool run();
+	void stop();
+
+	const std::vector<EventDriftStats>& getDriftStats() const;
+
+private:
+	struct ScheduledEvent
+	{
+		// Only the one for the event's clock is used
+		Clock::time_point targetTime;
+		WallClock::time_point wallClockTime;
+		bool isWallClock;
+		EventId id;
+		const char* name;
+		EventCallback callback;
+	};
+
+	// Earliest first, then first scheduled. Each queue only holds events of one clock
+	struct LaterEvent
+	{
+		bool operator()(const ScheduledEvent& a, const ScheduledEvent& b) const
+		{
+			if (a.isWallClock && a.wallClockTime != b.wallClockTime)
+				return a.wallClockTime > b.wallClockTime;
+			if (!a.isWallClock && a.targetTime != b.targetTime)
+				return a.targetTime > b.targetTime;
+			return a.id > b.id;
+		}
+	};
+
+	typedef std::priority_queue<ScheduledEvent, std::vector<ScheduledEvent>, LaterEvent> EventQueue;
+
+	EventId push(ScheduledEvent&& event);
+	// On the event's own clock. Negative once it's late
+	static Clock::duration getTimeUntil(const ScheduledEvent& event);
+	// Pops cancelled events off the front of both queues, so the earliest events left will run
+	void dropCancelledEvents();
+	// The queue whose next event is soonest, or nullptr if both are empty
+	EventQueue* getNextEventQueue();
+	void runDueEvents();
+	bool armTimer(int fileDescriptor, const EventQueue& queue);
+	bool waitForNextEvent();
+	void recordDrift(const char* name, Clock::duration drift);
+
+	int epollFd;
+	int timerFd;
+	int wallClockTimerFd;
+	EventQueue events;
+	EventQueue wallClockEvents;
+	// Events which have neither run nor been cancelled. Cancelling only removes the ID from here;
+	// the queue entry is dropped once it reaches the front
+	phmap::flat_hash_set<EventId> liveEvents;
+	EventId nextEventId;
+	bool stopRequested;
+
+	std::function<bool()> isBackgroundWorkBusy;
+	std::function<void(int)> waitForBackgroundWork;
+
+	std::vector<EventDriftStats> driftStats;
+};
+
+void printEventDriftStats(const std::vector<EventDriftStats>& driftStats);
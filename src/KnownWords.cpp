@@ -0,0 +1,141 @@
+#include "KnownWords.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool loadKnownWords(const char* filename, KnownWords& knownWordsOut)
+{
+	knownWordsOut = KnownWords();
+	std::ifstream inputFile;
+	inputFile.open(filename, std::ios::in | std::ios::binary);
+	if (!inputFile.is_open())
+		return false;
+	std::ostringstream contents;
+	contents << inputFile.rdbuf();
+	const std::string fileContents = contents.str();
+
+	const KnownWordsCacheHeader* header =
+	    reinterpret_cast<const KnownWordsCacheHeader*>(fileContents.data());
+	bool isCache = fileContents.size() >= sizeof(KnownWordsCacheHeader) &&
+	               std::memcmp(header->magic, knownWordsCacheMagic, sizeof(header->magic)) == 0;
+	if (!isCache)
+	{
+		// A plain word list is treated as one big note
+		KnownNote wordList;
+		wordList.noteId = 0;
+		wordList.modifiedTime = 0;
+		wordList.words = fileContents;
+		knownWordsOut.notes.push_back(std::move(wordList));
+		rebuildKnownWordSet(knownWordsOut);
+		return true;
+	}
+
+	const size_t notesOffset = sizeof(KnownWordsCacheHeader);
+	const size_t wordsOffset = notesOffset + header->numNotes * sizeof(KnownWordsCacheNote);
+	if (header->version != knownWordsCacheVersion ||
+	    wordsOffset + header->wordsSize > fileContents.size())
+	{
+		std::cerr << "Warning: known words cache '" << filename
+		          << "' is invalid or from an old version. It will be rebuilt on the next sync\n";
+		return false;
+	}
+
+	const KnownWordsCacheNote* cachedNotes =
+	    reinterpret_cast<const KnownWordsCacheNote*>(fileContents.data() + notesOffset);
+	const char* words = fileContents.data() + wordsOffset;
+	knownWordsOut.notes.resize(header->numNotes);
+	for (uint32_t i = 0; i < header->numNotes; ++i)
+	{
+		const KnownWordsCacheNote& cachedNote = cachedNotes[i];
+		if (cachedNote.wordsOffset + cachedNote.wordsLength > header->wordsSize)
+		{
+			std::cerr << "Warning: known words cache '" << filename << "' is corrupt\n";
+			knownWordsOut = KnownWords();
+			return false;
+		}
+		KnownNote& note = knownWordsOut.notes[i];
+		note.noteId = cachedNote.noteId;
+		note.modifiedTime = cachedNote.modifiedTime;
+		note.words.assign(words + cachedNote.wordsOffset, cachedNote.wordsLength);
+	}
+	rebuildKnownWordSet(knownWordsOut);
+	return true;
+}
+
+bool saveKnownWordsCache(const KnownWords& knownWords, const char* filename)
+{
+	KnownWordsCacheHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, knownWordsCacheMagic, sizeof(header.magic));
+	header.version = knownWordsCacheVersion;
+	header.numNotes = static_cast<uint32_t>(knownWords.notes.size());
+
+	std::vector<KnownWordsCacheNote> cachedNotes(knownWords.notes.size());
+	for (size_t i = 0; i < knownWords.notes.size(); ++i)
+	{
+		cachedNotes[i].noteId = knownWords.notes[i].noteId;
+		cachedNotes[i].modifiedTime = knownWords.notes[i].modifiedTime;
+		cachedNotes[i].wordsOffset = header.wordsSize;
+		cachedNotes[i].wordsLength = knownWords.notes[i].words.size();
+		header.wordsSize += knownWords.notes[i].words.size();
+	}
+
+	// Write next to the old cache and swap it in, so a failed write never loses the old one
+	std::string temporaryFilename = std::string(filename) + ".tmp";
+	std::ofstream outputFile;
+	outputFile.open(temporaryFilename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!outputFile.is_open())
+	{
+		std::cerr << "Error: could not open '" << temporaryFilename << "' for writing\n";
+		return false;
+	}
+	outputFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	outputFile.write(reinterpret_cast<const char*>(cachedNotes.data()),
+	                 cachedNotes.size() * sizeof(KnownWordsCacheNote));
+	for (const KnownNote& note : knownWords.notes)
+		outputFile.write(note.words.data(), note.words.size());
+	outputFile.close();
+
+	if (!outputFile || std::rename(temporaryFilename.c_str(), filename) != 0)
+	{
+		std::cerr << "Error: failed while writing '" << filename << "'\n";
+		return false;
+	}
+	return true;
+}
+
+void rebuildKnownWordSet(KnownWords& knownWords)
+{
+	knownWords.words.clear();
+	for (const KnownNote& note : knownWords.notes)
+	{
+		const char* wordsEnd = note.words.data() + note.words.size();
+		for (const char* word = note.words.data(); word < wordsEnd;)
+		{
+			const char* wordEnd =
+			    static_cast<const char*>(std::memchr(word, '\n', wordsEnd - word));
+			if (!wordEnd)
+				wordEnd = wordsEnd;
+			// Word lists may have come from Windows or have trailing spaces
+			const char* trimmedWordEnd = wordEnd;
+			while (trimmedWordEnd > word &&
+			       (trimmedWordEnd[-1] == '\r' || trimmedWordEnd[-1] == ' '))
+				--trimmedWordEnd;
+			if (trimmedWordEnd > word)
+			{
+				DictionaryKey key = {word, static_cast<uint32_t>(trimmedWordEnd - word)};
+				knownWords.words.insert(key);
+			}
+			word = wordEnd + 1;
+		}
+	}
+}
+
+bool isKnownWord(const KnownWords& knownWords, const char* word, size_t wordLength)
+{
+	DictionaryKey key = {word, static_cast<uint32_t>(wordLength)};
+	return knownWords.words.count(key) != 0;
+}
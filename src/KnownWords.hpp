@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <phmap.h>
+
+#include "Dictionary.hpp"
+
+// Words I already know, so text analysis can tell known from unknown words without asking Anki
+// about every token. Built from the notes in Anki (see AnkiKnownWords.hpp) and cached on disk, so
+// only notes which changed since the last sync need to be fetched again.
+//
+// Cache layout (native-endian, like the dictionary index):
+//   KnownWordsCacheHeader
+//   KnownWordsCacheNote[numNotes]  Sorted by noteId
+//   char words[wordsSize]          Each note's words, separated by newlines
+
+// Bump this whenever the layout changes. Old caches are then rebuilt from scratch
+static const uint32_t knownWordsCacheVersion = 1;
+static const char knownWordsCacheMagic[8] = {'J', 'F', 'M', 'K', 'N', 'O', 'W', 'N'};
+
+struct KnownWordsCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t numNotes;
+	uint64_t wordsSize;
+};
+
+struct KnownWordsCacheNote
+{
+	int64_t noteId;
+	// As reported by Anki. Used to tell which notes need to be fetched again
+	int64_t modifiedTime;
+	uint64_t wordsOffset;
+	uint64_t wordsLength;
+};
+
+struct KnownNote
+{
+	int64_t noteId;
+	int64_t modifiedTime;
+	// Separated by newlines
+	std::string words;
+};
+
+// Keys point into KnownWords::notes
+typedef phmap::flat_hash_set<DictionaryKey, DictionaryKeyHash, DictionaryKeyEqual> KnownWordSet;
+
+struct KnownWords
+{
+	KnownWords() = default;
+	// words points into notes' string buffers, so a copy would point into the original. Moving is
+	// fine: the notes vector hands over its buffer without moving the strings in it
+	KnownWords(const KnownWords&) = delete;
+	KnownWords& operator=(const KnownWords&) = delete;
+	KnownWords(KnownWords&&) = default;
+	KnownWords& operator=(KnownWords&&) = default;
+
+	// Sorted by noteId
+	std::vector<KnownNote> notes;
+	// Must be rebuilt with rebuildKnownWordSet() whenever notes change
+	KnownWordSet words;
+};
+
+// Loads either a cache written by saveKnownWordsCache(), or a plain list of words (one per line)
+bool loadKnownWords(const char* filename, KnownWords& knownWordsOut);
+bool saveKnownWordsCache(const KnownWords& knownWords, const char* filename);
+
+void rebuildKnownWordSet(KnownWords& knownWords);
+
+bool isKnownWord(const KnownWords& knownWords, const char* word, size_t wordLength);
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "DictionaryLookup.hpp"
+#include "Tracing.hpp"
+
+static const char* dictionaryFilename = "data/utf8Edict2";
+static const char* dictionaryIndexFilename = "data/utf8Edict2.index";
+
+// Per word found. The rest are only counted
+static const size_t maxEntriesToPrint = 5;
+static const size_t maxEntries = 64;
+
+static void printUsage()
+{
+	std::cerr << "Usage: lookup_words [--all] text...\n"
+	             "Looks up the words in the text the way a popup dictionary does, without MeCab: "
+	             "the longest\nword at the start of the text (after undoing any conjugation), "
+	             "then the longest after that,\nand so on.\n"
+	             "\t--all  Print every entry of each word, rather than the first few\n";
+}
+
+// Prints each word starting at the start of text, then skips past it
+static void lookUpText(const DictionaryLookup& dictionary, const char* text, size_t textLength,
+                       bool printAllEntries)
+{
+	// Only one word is looked up at a time, so these are reused
+	Deinflections deinflections;
+	DictionaryDeinflectedEntry entries[maxEntries];
+	const DictionaryEntryTable& entryTable = getDictionaryLookupEntryTable(dictionary);
+	size_t position = 0;
+	while (position < textLength)
+	{
+		size_t numEntries = 0;
+		size_t length = findDictionaryLookupLongestDeinflection(
+		    dictionary, text + position, textLength - position, deinflections, entries,
+		    maxEntries, numEntries);
+		if (!length)
+		{
+			// Not a word; skip one character
+			++position;
+			while (position < textLength && (text[position] & 0xC0) == 0x80)
+				++position;
+			continue;
+		}
+
+		std::cout.write(text + position, length);
+		std::cout << "\n";
+		size_t numToPrint = printAllEntries ? numEntries : std::min(numEntries, maxEntriesToPrint);
+		for (size_t i = 0; i < numToPrint; ++i)
+		{
+			const DeinflectionCandidate& candidate =
+			    deinflections.candidates[entries[i].candidateIndex];
+			std::cout << "\t";
+			if (candidate.numReasons)
+			{
+				std::cout.write(candidate.text, candidate.length);
+				std::cout << " (";
+				for (uint32_t reason = 0; reason < candidate.numReasons; ++reason)
+					std::cout << (reason ? ", " : "")
+					          << getDeinflectionReasonName(candidate.reasons[reason]);
+				std::cout << ") ";
+			}
+			DictionaryEntryView line = getDictionaryEntryLine(entryTable, entries[i].entryIndex);
+			std::cout.write(line.data, line.length);
+			std::cout << "\n";
+		}
+		if (numToPrint < numEntries)
+			std::cout << "\t(" << numEntries - numToPrint << " more)\n";
+		position += length;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool printAllEntries = false;
+	int firstTextArgument = argc;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--all") == 0)
+			printAllEntries = true;
+		else if (argv[i][0] == '-')
+		{
+			printUsage();
+			return 1;
+		}
+		else
+		{
+			firstTextArgument = i;
+			break;
+		}
+	}
+	if (firstTextArgument == argc)
+	{
+		printUsage();
+		return 1;
+	}
+
+	DictionaryLookup dictionary;
+	if (!openDictionaryLookup(dictionaryFilename, dictionaryIndexFilename, dictionary))
+		return 1;
+
+	for (int i = firstTextArgument; i < argc; ++i)
+		lookUpText(dictionary, argv[i], strlen(argv[i]), printAllEntries);
+
+	closeDictionaryLookup(dictionary);
+	TRACE_SAVE("lookup_words.trace.json");
+	return 0;
+}
@@ -5,15 +5,20 @@
 #include <ctime>
 #include <iostream>
 #include <sstream>
-#include <thread>
+#include <vector>
 
+#include <phmap.h>
 #include "curl/curl.h"
 #include "rapidjson/document.h"
 #include "rapidjson/writer.h"
 
+#include "AnkiConnect.hpp"
+#include "AnkiConnectPipeline.hpp"
+#include "CardCacheFile.hpp"
+#include "DueCards.hpp"
+#include "EventScheduler.hpp"
 #include "Notifications.hpp"
-
-static const char* ankiConnectURL = "http://localhost:8765";
+#include "Tracing.hpp"
 
 // Assumptions made
 // - Anki is running, with the AnkiConnect plugin installed and enabled
@@ -41,82 +46,28 @@ static float reasonableStudyIntervalSeconds = 60.f * 10.f;
 // multiplier accordingly to estimate how many cards I will have to do, including misses.
 static float estimatedActualCardsMultiplier = 1.2f;
 
-//
-// Curl configuration
-//
-static bool curlVerbose = false;
-static bool curlRequestVerbose = false;
-static bool curlResponseStats = false;
-static bool curlResponseVerbose = false;
-
-// I hate auto, so I made this instead
-typedef rapidjson::GenericObject<
-    true, rapidjson::GenericValue<rapidjson::UTF8<char>,
-                                  rapidjson::MemoryPoolAllocator<rapidjson::CrtAllocator>>>
-    RapidJsonObject;
-
-static CURL* curl_handle = nullptr;
-
-// Note that this can be called many times for a single request, if the packets are split
-static size_t CurlReceive(char* ptr, size_t size, size_t nmemb, void* userdata)
-{
-	std::string* stringOut = static_cast<std::string*>(userdata);
-	stringOut->append(ptr);
-	return (size_t)(size * nmemb);
-}
+// In daemon mode, pacing starts again every day at this hour (8AM)
+static int hourStudyTimeStarts = 8;
+// In daemon mode, how often to check which cards are due. Only cards which haven't been seen before
+// are fetched, so this costs little
+static float refreshIntervalSeconds = 60.f * 5.f;
 
-std::string ankiConnectRequest(CURL* curl_handle, const char* jsonRequest)
-{
-	std::string receivedString = "";
-
-	if (curlRequestVerbose)
-		std::cout << "Request: '" << jsonRequest << "'\n";
-
-	curl_easy_setopt(curl_handle, CURLOPT_URL, ankiConnectURL);
-	curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, CurlReceive);
-	curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void*)&receivedString);
-	curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "Japanese-for-me/1.0");
-	if (curlVerbose)
-		curl_easy_setopt(curl_handle, CURLOPT_VERBOSE, 1L);
-	// curl_easy_setopt(curl_handle, CURLOPT_RETURNTRANSFER, true);
-
-	curl_slist* httpHeaders = nullptr;
-	httpHeaders = curl_slist_append(httpHeaders, "Expect:");
-	httpHeaders = curl_slist_append(httpHeaders, "Content-Type: application/json");
-	httpHeaders = curl_slist_append(httpHeaders, "Accept: text/json");
-	httpHeaders = curl_slist_append(httpHeaders, "charset: utf-8");
-	curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, httpHeaders);
-
-	curl_easy_setopt(curl_handle, CURLOPT_POST, 1L);
-	curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, strlen(jsonRequest));
-	curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, jsonRequest);
-
-	CURLcode resultCode = curl_easy_perform(curl_handle);
-	if (resultCode == CURLE_OK)
-	{
-		char* contentType;
-		resultCode = curl_easy_getinfo(curl_handle, CURLINFO_CONTENT_TYPE, &contentType);
-		if (curlResponseStats && resultCode == CURLE_OK && contentType)
-		{
-			std::cout << "Received type " << contentType << "\n";
-			std::cout << receivedString.size() << " characters received\n";
-		}
+// Sync throughout the day so the pace keeps up with cards studied elsewhere (e.g. on the phone).
+// Not too often, because the sync window pops up and is annoying
+static float resyncIntervalSeconds = 60.f * 60.f * 2.f;
 
-		if (curlResponseVerbose)
-			std::cout << receivedString << "\n";
-	}
-	else
-	{
-		std::cerr << "Error: " << curl_easy_strerror(resultCode) << "\n";
-	}
+// Cards are saved here, so the next run can start pacing before Anki has even synced
+static const char* cardCacheFilename = "data/cards.cache";
+// Changes usually come in bursts (e.g. a refresh, then its cards loading), so wait for them to
+// settle rather than saving after each one
+static float cardCacheSaveDelaySeconds = 30.f;
 
-	return receivedString;
-}
+static AnkiConnectClient* ankiConnect = nullptr;
 
 void listDecks()
 {
 	const char* jsonRequest = "{\"action\": \"deckNames\", \"version\": 6}";
-	std::string result = ankiConnectRequest(curl_handle, jsonRequest);
+	const std::string& result = ankiConnect->request(jsonRequest);
 	if (result.empty())
 		return;
 	rapidjson::Document jsonResult;
@@ -127,23 +78,17 @@ void listDecks()
 		std::cout << "[" << i << "] " << resultValue[i].GetString() << "\n";
 }
 
-bool syncAnkiToAnkiWeb()
+// syncedOut is only set once the batch is flushed
+void syncAnkiToAnkiWeb(AnkiConnectBatch& batch, bool& syncedOut)
 {
-	std::cout << "Synchronizing Collection..." << std::flush;
 	const char* jsonRequest = "{\"action\": \"sync\", \"version\": 6}";
-	std::string result = ankiConnectRequest(curl_handle, jsonRequest);
-	std::cout << "done\n";
-
-	if (result.empty())
-	{
-		// Likely a failed connection
-		return false;
-	}
-
-	return true;
+	syncedOut = false;
+	batch.queue(jsonRequest,
+	            [&syncedOut](bool succeeded, const rapidjson::Value&) { syncedOut = succeeded; });
 }
 
-void getDueCards(rapidjson::Document& jsonResult)
+// dueCardIdsOut is set to the array of card IDs once the batch is flushed
+void getDueCards(AnkiConnectBatch& batch, rapidjson::Document& dueCardIdsOut)
 {
 	// Build the request
 	rapidjson::StringBuffer jsonString;
@@ -165,11 +110,11 @@ void getDueCards(rapidjson::Document& jsonResult)
 	}
 	writer.EndObject();
 
-	const char* jsonRequest = jsonString.GetString();
-	std::string result = ankiConnectRequest(curl_handle, jsonRequest);
-	if (result.empty())
-		return;
-	jsonResult.Parse(result.c_str());
+	batch.queue(jsonString.GetString(), jsonString.GetSize(),
+	            [&dueCardIdsOut](bool succeeded, const rapidjson::Value& result) {
+		            if (succeeded)
+			            dueCardIdsOut.CopyFrom(result, dueCardIdsOut.GetAllocator());
+	            });
 
 	// const rapidjson::Value& resultValue = jsonResult["result"];
 	// assert(resultValue.IsArray());
@@ -177,239 +122,767 @@ void getDueCards(rapidjson::Document& jsonResult)
 	// 	std::cout << "[" << i << "] " << resultValue[i].GetInt64() << "\n";
 }
 
-void getCardInfo(rapidjson::Document& jsonResult, const rapidjson::Value& cardsIds)
+void printObjectMembers(const rapidjson::Value& objectValue)
+{
+	static const char* kTypeNames[] = {"Null",  "False",  "True",  "Object",
+	                                   "Array", "String", "Number"};
+	for (rapidjson::Value::ConstMemberIterator itr = objectValue.MemberBegin();
+	     itr != objectValue.MemberEnd(); ++itr)
+	{
+		std::cout << itr->name.GetString() << " is " << kTypeNames[itr->value.GetType()] << "\n";
+	}
+}
+
+void listDueCardsInfo(const DueCards& dueCards)
+{
+	for (size_t i = 0; i < dueCards.size(); ++i)
+	{
+		if (!dueCards.isLoaded[i])
+			continue;
+		std::cout << "[" << i << "] " << dueCards.noteIds[i] << "\n"
+		          << "\tField order: " << static_cast<int>(dueCards.fieldOrders[i]) << "\n"
+		          << "\tModel: " << dueCards.getModelName(i) << "\n"
+		          << "\tInterval: " << dueCards.intervals[i] << "\n"
+		          << "\tQuiz word: " << dueCards.getQuizWord(i) << "\n"
+		          << "\n\n";
+	}
+}
+
+// Due cards are loaded a chunk at a time, so the first ones can be shown while the rest load
+static const size_t dueCardsPerRequest = 50;
+
+static const char* findDueCardsRequest =
+    "{\"action\": \"findCards\", \"version\": 6, \"params\": {\"query\": \"is:due\"}}";
+// Syncs and finds the due cards in one round trip
+static const char* resyncRequest =
+    "{\"action\": \"multi\", \"version\": 6, \"params\": {\"actions\": ["
+    "{\"action\": \"sync\", \"version\": 6}, "
+    "{\"action\": \"findCards\", \"version\": 6, \"params\": {\"query\": \"is:due\"}}]}}";
+
+bool getCardIds(const rapidjson::Value& result, std::vector<int64_t>& cardIdsOut)
+{
+	cardIdsOut.clear();
+	if (!result.IsArray())
+		return false;
+	cardIdsOut.reserve(result.Size());
+	for (rapidjson::SizeType i = 0; i < result.Size(); ++i)
+	{
+		if (result[i].IsInt64())
+			cardIdsOut.push_back(result[i].GetInt64());
+	}
+	return true;
+}
+
+// Fetches cardsInfo for the cards which aren't cached yet. cardsInfo answers in the same order the
+// cards were asked for, so each chunk's cards go straight into their place in the cache
+void queueCardInfo(AnkiConnectPipeline& pipeline, const std::vector<int64_t>& cardIds,
+                   CardCache& cardCache)
+{
+	std::vector<int64_t> newCardIds;
+	size_t cachedCard = 0;
+	for (int64_t cardId : cardIds)
+	{
+		if (!cardCache.find(cardId, cachedCard))
+			newCardIds.push_back(cardId);
+	}
+	if (newCardIds.empty())
+		return;
+
+	size_t firstCard = 0;
+	cardCache.add(newCardIds.data(), newCardIds.size(), firstCard);
+	// Anything which changes after this might not make it into the response
+	int64_t requestTime = static_cast<int64_t>(std::time(nullptr));
+	for (size_t chunkStart = 0; chunkStart < newCardIds.size(); chunkStart += dueCardsPerRequest)
+	{
+		size_t chunkEnd = std::min(chunkStart + dueCardsPerRequest, newCardIds.size());
+		rapidjson::StringBuffer jsonString;
+		rapidjson::Writer<rapidjson::StringBuffer> writer(jsonString);
+		writer.StartObject();
+		writer.Key("action");
+		writer.String("cardsInfo");
+		writer.Key("version");
+		writer.Int(6);
+
+		writer.Key("params");
+		{
+			writer.StartObject();
+			writer.Key("cards");
+			writer.StartArray();
+			for (size_t i = chunkStart; i < chunkEnd; ++i)
+				writer.Int64(newCardIds[i]);
+			writer.EndArray();
+			writer.EndObject();
+		}
+		writer.EndObject();
+
+		std::vector<int64_t> chunkCardIds(newCardIds.begin() + chunkStart,
+		                                  newCardIds.begin() + chunkEnd);
+		uint32_t chunkFirstCard = static_cast<uint32_t>(firstCard + chunkStart);
+		pipeline.queueForResponse(
+		    std::string(jsonString.GetString(), jsonString.GetSize()),
+		    [&cardCache, chunkFirstCard, chunkCardIds, requestTime](bool succeeded,
+		                                                            std::string& response) {
+			    DueCards& cards = cardCache.getCards();
+			    if (succeeded && parseCardsInfoResponse(&response[0], chunkFirstCard,
+			                                            static_cast<uint32_t>(chunkCardIds.size()),
+			                                            cards))
+			    {
+				    std::fill(cards.loadedTimes.begin() + chunkFirstCard,
+				              cards.loadedTimes.begin() + chunkFirstCard + chunkCardIds.size(),
+				              requestTime);
+				    return;
+			    }
+			    // Asked for again on the next refresh
+			    for (int64_t cardId : chunkCardIds)
+				    cardCache.forget(cardId);
+		    });
+	}
+}
+
+// Everything the pacing events share
+struct Pacer
+{
+	EventScheduler scheduler;
+	AnkiConnectPipeline pipeline;
+	NotificationsHandler& notifications;
+	// Keep refreshing the due cards, and start again every day, rather than exiting once study
+	// time is over
+	bool isDaemon = false;
+
+	CardCache cardCache;
+	// As of the last refresh, in the order Anki found them
+	std::vector<int64_t> dueCardIds;
+	// Due card requests can be in flight on different connections at once, and answered in any
+	// order. Each is numbered when queued, and answers older than the due cards already set are
+	// dropped
+	uint64_t lastDueCardsRequest = 0;
+	uint64_t appliedDueCardsRequest = 0;
+	// Since study time started today
+	phmap::flat_hash_set<int64_t> presentedCardIds;
+	// Every card before this in dueCardIds has been presented
+	size_t nextDueCard = 0;
+
+	float timeToNextCard = 0.f;
+	// A time of day, so it's on the wall clock; the steady clock stops while suspended
+	std::chrono::system_clock::time_point studyEndTime;
+	std::chrono::steady_clock::time_point lastCardTime;
+	EventScheduler::EventId nextCardEvent = 0;
+	bool isNextCardScheduled = false;
+
+	// The card cache has changed since it was last saved
+	bool isCardCacheDirty = false;
+	bool isCardCacheSaveScheduled = false;
+
+	// To measure how long it takes to get to the first card
+	std::chrono::steady_clock::time_point startTime;
+	bool isFirstCardPresented = false;
+
+	explicit Pacer(NotificationsHandler& notifications) : notifications(notifications)
+	{
+	}
+};
+
+// Notifications are queued, so a stalled notification daemon can't hold up pacing
+void notify(Pacer& pacer, const std::string& message)
+{
+	pacer.notifications.sendNotification(message.c_str());
+}
+
+// Today at hour:00, or tomorrow if that has passed and nextIfPassed is set
+std::chrono::system_clock::time_point getTimeAtHour(int hour, bool nextIfPassed)
+{
+	std::time_t currentTime;
+	std::time(&currentTime);
+	std::tm timeInfo = *std::localtime(&currentTime);
+	timeInfo.tm_hour = hour;
+	timeInfo.tm_min = 0;
+	timeInfo.tm_sec = 0;
+	// The target may be on the other side of a daylight saving change, so let mktime() work out
+	// whether it's in effect then, rather than using whatever it is now
+	timeInfo.tm_isdst = -1;
+	std::time_t time = std::mktime(&timeInfo);
+	if (nextIfPassed && time <= currentTime)
+	{
+		// mktime() handles the end of the month
+		++timeInfo.tm_mday;
+		timeInfo.tm_hour = hour;
+		timeInfo.tm_isdst = -1;
+		time = std::mktime(&timeInfo);
+	}
+	return std::chrono::system_clock::from_time_t(time);
+}
+
+// Due cards change every day, so a list of them saved on another day is no use
+bool isToday(int64_t time)
+{
+	std::time_t savedTime = static_cast<std::time_t>(time);
+	std::time_t currentTime;
+	std::time(&currentTime);
+	std::tm savedTimeInfo = *std::localtime(&savedTime);
+	std::tm currentTimeInfo = *std::localtime(&currentTime);
+	return savedTimeInfo.tm_year == currentTimeInfo.tm_year &&
+	       savedTimeInfo.tm_yday == currentTimeInfo.tm_yday;
+}
+
+bool isStudyTime(const Pacer& pacer)
+{
+	return std::chrono::system_clock::now() < pacer.studyEndTime;
+}
+
+int countCardsRemaining(const Pacer& pacer)
+{
+	int numCards = 0;
+	for (int64_t cardId : pacer.dueCardIds)
+	{
+		if (!pacer.presentedCardIds.count(cardId))
+			++numCards;
+	}
+	return numCards;
+}
+
+// Spreads the cards still due over the time left. Called again whenever the due cards change
+void updatePace(Pacer& pacer, int numCards)
+{
+	float secondsTimeLeft = std::chrono::duration<float>(pacer.studyEndTime -
+	                                                     std::chrono::system_clock::now())
+	                            .count();
+	float hoursTimeLeft = secondsTimeLeft / (60.f * 60.f);
+	if (numCards <= 0 || secondsTimeLeft <= 0.f)
+		return;
+
+	std::time_t currentTime;
+	std::time(&currentTime);
+	std::tm* currentTimeInfo = std::localtime(&currentTime);
+	std::cout << "Currently "
+	          << (currentTimeInfo->tm_hour > 12 ? currentTimeInfo->tm_hour - 12 :
+	                                              currentTimeInfo->tm_hour)
+	          << ":" << (currentTimeInfo->tm_min < 10 ? "0" : "") << currentTimeInfo->tm_min
+	          << ", " << hoursTimeLeft << " hours left to study " << numCards << " cards\n\n";
+
+	std::cout << "100% accuracy:\n\t";
+	std::cout << (secondsTimeLeft / numCards) << " seconds per card, "
+	          << std::min(numCards / hoursTimeLeft, static_cast<float>(numCards))
+	          << " cards per hour\n\n";
+
+	std::cout << "80% accuracy:\n\t";
+	std::cout << (secondsTimeLeft / (numCards * estimatedActualCardsMultiplier))
+	          << " seconds per card, "
+	          << std::min((numCards * estimatedActualCardsMultiplier) / hoursTimeLeft,
+	                      static_cast<float>(numCards))
+	          << " cards per hour\n";
+
+	// Use the 80% accuracy prediction to pace cards. Keep it positive so things don't get too wacky
+	// if weird math is above
+	pacer.timeToNextCard =
+	    std::max(0.1f, secondsTimeLeft / (numCards * estimatedActualCardsMultiplier));
+}
+
+void presentNextCard(Pacer& pacer);
+
+void cancelNextCard(Pacer& pacer)
+{
+	if (pacer.isNextCardScheduled)
+		pacer.scheduler.cancel(pacer.nextCardEvent);
+	pacer.isNextCardScheduled = false;
+}
+
+void scheduleNextCard(Pacer& pacer, std::chrono::steady_clock::time_point targetTime)
+{
+	cancelNextCard(pacer);
+	if (pacer.nextDueCard >= pacer.dueCardIds.size() || !isStudyTime(pacer))
+		return;
+	pacer.nextCardEvent =
+	    pacer.scheduler.schedule(targetTime, "card", [&pacer]() { presentNextCard(pacer); });
+	pacer.isNextCardScheduled = true;
+}
+
+// Drip feed cards over the maximal time
+void presentNextCard(Pacer& pacer)
+{
+	pacer.isNextCardScheduled = false;
+	while (pacer.nextDueCard < pacer.dueCardIds.size() &&
+	       pacer.presentedCardIds.count(pacer.dueCardIds[pacer.nextDueCard]))
+		++pacer.nextDueCard;
+	// Everything due has been presented. A refresh may find more
+	if (pacer.nextDueCard >= pacer.dueCardIds.size())
+		return;
+
+	int64_t cardId = pacer.dueCardIds[pacer.nextDueCard];
+	const DueCards& cards = pacer.cardCache.getCards();
+	size_t card = 0;
+	bool isLoaded = pacer.cardCache.find(cardId, card) && cards.isLoaded[card];
+	// Still loading. Check back soon rather than presenting it late by a whole card
+	if (!isLoaded && pacer.pipeline.isBusy())
+	{
+		pacer.nextCardEvent = pacer.scheduler.scheduleIn(0.1f, "card (loading)",
+		                                                 [&pacer]() { presentNextCard(pacer); });
+		pacer.isNextCardScheduled = true;
+		return;
+	}
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (!pacer.isFirstCardPresented)
+	{
+		std::cout << "First card after "
+		          << std::chrono::duration<float, std::milli>(now - pacer.startTime).count()
+		          << " ms\n";
+		pacer.isFirstCardPresented = true;
+	}
+	size_t numCardsPresented = pacer.presentedCardIds.size();
+	if (numCardsPresented)
+		std::cout << "\n\n"
+		          << std::chrono::duration<float>(now - pacer.lastCardTime).count()
+		          << " seconds since the last card\n";
+	pacer.lastCardTime = now;
+
+	// Present card
+	std::cout << "[" << numCardsPresented + 1 << "/"
+	          << numCardsPresented + countCardsRemaining(pacer) << "]\n\t"
+	          << (isLoaded ? cards.getQuizWord(card) : "(failed to load card)") << "\n";
+
+	// Trigger a notification to prompt studying
+	// Throttle notifications to not happen too often (this will occur if the learner is running
+	// out of time and has a lot of cards)
+
+	// TODO: Make prompt for saying "Hey, you're in deep shit"
+	// TODO: If study time is almost over and there are stragglers, prompt session
+	// TODO: This is weird to notify per actual card, because we want to notify based on estimated
+	// cards (num cards which would have passed assuming less than 100% accuracy)
+	if (pacer.timeToNextCard * numCardsInStudyBlock > reasonableStudyIntervalSeconds &&
+	    numCardsPresented % numCardsInStudyBlock == 0)
+		notify(pacer, "Time to study!");
+
+	// Wait to present next card
+	pacer.presentedCardIds.insert(cardId);
+	++pacer.nextDueCard;
+	scheduleNextCard(pacer, now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+	                                  std::chrono::duration<float>(pacer.timeToNextCard)));
+}
+
+void saveCardCache(Pacer& pacer)
+{
+	if (pacer.isCardCacheDirty &&
+	    saveCardCacheFile(pacer.cardCache, pacer.dueCardIds, cardCacheFilename))
+		pacer.isCardCacheDirty = false;
+}
+
+// Cards still loading aren't saved, so wait for loading to finish first
+void scheduleCardCacheSave(Pacer& pacer)
+{
+	pacer.isCardCacheDirty = true;
+	if (pacer.isCardCacheSaveScheduled)
+		return;
+	pacer.isCardCacheSaveScheduled = true;
+	pacer.scheduler.scheduleIn(cardCacheSaveDelaySeconds, "save card cache", [&pacer]() {
+		pacer.isCardCacheSaveScheduled = false;
+		if (pacer.pipeline.isBusy())
+			scheduleCardCacheSave(pacer);
+		else
+			saveCardCache(pacer);
+	});
+}
+
+uint64_t beginDueCardsRequest(Pacer& pacer)
+{
+	return ++pacer.lastDueCardsRequest;
+}
+
+// Only cards which haven't been seen before are fetched. If the due cards are the same as last
+// time, nothing else changes. request is from beginDueCardsRequest(), when the due cards were
+// asked for
+void setDueCards(Pacer& pacer, uint64_t request, std::vector<int64_t>&& dueCardIds)
+{
+	if (request < pacer.appliedDueCardsRequest)
+	{
+		std::cout << "\nIgnoring due cards from an older request\n";
+		return;
+	}
+	pacer.appliedDueCardsRequest = request;
+
+	queueCardInfo(pacer.pipeline, dueCardIds, pacer.cardCache);
+	if (dueCardIds == pacer.dueCardIds)
+		return;
+
+	pacer.dueCardIds = std::move(dueCardIds);
+	pacer.nextDueCard = 0;
+	scheduleCardCacheSave(pacer);
+	int numCards = countCardsRemaining(pacer);
+	if (!numCards)
+	{
+		cancelNextCard(pacer);
+		notify(pacer, "No more cards! Good work.");
+		return;
+	}
+
+	updatePace(pacer, numCards);
+	// Keep to the new pace, counting from the last card presented
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point nextCardTime =
+	    pacer.presentedCardIds.empty() ?
+	        now :
+	        std::max(now, pacer.lastCardTime +
+	                          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+	                              std::chrono::duration<float>(pacer.timeToNextCard)));
+	scheduleNextCard(pacer, nextCardTime);
+}
+
+// Cheap enough to do often: findCards only returns card IDs, and cardsInfo is only asked for cards
+// which haven't been seen before
+void refresh(Pacer& pacer)
 {
+	if (!isStudyTime(pacer))
+		return;
+	pacer.scheduler.scheduleIn(refreshIntervalSeconds, "refresh", [&pacer]() { refresh(pacer); });
+
+	uint64_t request = beginDueCardsRequest(pacer);
+	pacer.pipeline.queue(findDueCardsRequest,
+	                     [&pacer, request](bool succeeded, const rapidjson::Value& result) {
+		                     std::vector<int64_t> dueCardIds;
+		                     if (succeeded && getCardIds(result, dueCardIds))
+			                     setDueCards(pacer, request, std::move(dueCardIds));
+	                     });
+}
+
+// Cards loaded from the card cache may have changed since it was saved. Reviewing a card changes
+// its modification time, and editing its note changes the note's, so only cards where either
+// moved on are fetched again
+void refetchChangedCards(Pacer& pacer)
+{
+	const DueCards& cards = pacer.cardCache.getCards();
+	std::vector<int64_t> cachedCardIds;
+	std::vector<int64_t> cachedNoteIds;
+	size_t card = 0;
+	for (int64_t cardId : pacer.dueCardIds)
+	{
+		if (!pacer.cardCache.find(cardId, card) || !cards.isLoaded[card])
+			continue;
+		cachedCardIds.push_back(cardId);
+		cachedNoteIds.push_back(cards.noteIds[card]);
+	}
+	if (cachedCardIds.empty())
+		return;
+
 	rapidjson::StringBuffer jsonString;
 	rapidjson::Writer<rapidjson::StringBuffer> writer(jsonString);
 	writer.StartObject();
 	writer.Key("action");
-	writer.String("cardsInfo");
+	writer.String("multi");
 	writer.Key("version");
 	writer.Int(6);
-
 	writer.Key("params");
+	writer.StartObject();
+	writer.Key("actions");
+	writer.StartArray();
 	{
+		writer.StartObject();
+		writer.Key("action");
+		writer.String("cardsModTime");
+		writer.Key("version");
+		writer.Int(6);
+		writer.Key("params");
 		writer.StartObject();
 		writer.Key("cards");
 		writer.StartArray();
-		for (rapidjson::SizeType i = 0; i < cardsIds.Size(); ++i)
-			writer.Int64(cardsIds[i].GetInt64());
+		for (int64_t cardId : cachedCardIds)
+			writer.Int64(cardId);
+		writer.EndArray();
+		writer.EndObject();
+		writer.EndObject();
+	}
+	{
+		writer.StartObject();
+		writer.Key("action");
+		writer.String("notesModTime");
+		writer.Key("version");
+		writer.Int(6);
+		writer.Key("params");
+		writer.StartObject();
+		writer.Key("notes");
+		writer.StartArray();
+		for (int64_t noteId : cachedNoteIds)
+			writer.Int64(noteId);
 		writer.EndArray();
 		writer.EndObject();
+		writer.EndObject();
 	}
+	writer.EndArray();
+	writer.EndObject();
 	writer.EndObject();
 
-	const char* jsonRequest = jsonString.GetString();
-	// std::cout << jsonRequest << "\n";
-	std::string result = ankiConnectRequest(curl_handle, jsonRequest);
-	if (result.empty())
-		return;
+	pacer.pipeline.queue(
+	    std::string(jsonString.GetString(), jsonString.GetSize()),
+	    [&pacer](bool succeeded, const rapidjson::Value& results) {
+		    if (!succeeded || !results.IsArray() || results.Size() != 2 ||
+		        !results[0].IsObject() || !results[0]["result"].IsArray() ||
+		        !results[1].IsObject() || !results[1]["result"].IsArray())
+		    {
+			    std::cerr << "Warning: could not check whether cached cards have changed\n";
+			    return;
+		    }
+
+		    const DueCards& cards = pacer.cardCache.getCards();
+		    phmap::flat_hash_map<int64_t, int64_t> noteModifiedTimes;
+		    const rapidjson::Value& notesModTime = results[1]["result"];
+		    for (rapidjson::SizeType i = 0; i < notesModTime.Size(); ++i)
+		    {
+			    const rapidjson::Value& modifiedTime = notesModTime[i];
+			    if (modifiedTime.IsObject() && modifiedTime.HasMember("noteId") &&
+			        modifiedTime.HasMember("mod") && modifiedTime["noteId"].IsInt64() &&
+			        modifiedTime["mod"].IsInt64())
+				    noteModifiedTimes[modifiedTime["noteId"].GetInt64()] =
+				        modifiedTime["mod"].GetInt64();
+		    }
+
+		    std::vector<int64_t> changedCardIds;
+		    const rapidjson::Value& cardsModTime = results[0]["result"];
+		    for (rapidjson::SizeType i = 0; i < cardsModTime.Size(); ++i)
+		    {
+			    const rapidjson::Value& modifiedTime = cardsModTime[i];
+			    if (!modifiedTime.IsObject() || !modifiedTime.HasMember("cardId") ||
+			        !modifiedTime.HasMember("mod") || !modifiedTime["cardId"].IsInt64() ||
+			        !modifiedTime["mod"].IsInt64())
+				    continue;
+			    int64_t cardId = modifiedTime["cardId"].GetInt64();
+			    size_t card = 0;
+			    if (!pacer.cardCache.find(cardId, card) || !cards.isLoaded[card])
+				    continue;
+			    phmap::flat_hash_map<int64_t, int64_t>::iterator noteModifiedTime =
+			        noteModifiedTimes.find(cards.noteIds[card]);
+			    if (cards.modifiedTimes[card] != modifiedTime["mod"].GetInt64() ||
+			        (noteModifiedTime != noteModifiedTimes.end() &&
+			         noteModifiedTime->second >= cards.loadedTimes[card]))
+				    changedCardIds.push_back(cardId);
+		    }
+		    if (changedCardIds.empty())
+			    return;
+
+		    std::cout << "\n"
+		              << changedCardIds.size()
+		              << " cached cards have changed. Fetching them again\n";
+		    for (int64_t cardId : changedCardIds)
+			    pacer.cardCache.forget(cardId);
+		    queueCardInfo(pacer.pipeline, pacer.dueCardIds, pacer.cardCache);
+		    scheduleCardCacheSave(pacer);
+	    });
+}
 
-	jsonResult.Parse(result.c_str());
+// Syncs, then re-paces to whatever is due now. Pacing carries on with the cards already due if Anki
+// can't be reached. When pacing started from the card cache, the cached cards are checked for
+// changes once synced
+void syncInBackground(Pacer& pacer, bool isCheckingCachedCards)
+{
+	uint64_t request = beginDueCardsRequest(pacer);
+	pacer.pipeline.queue(resyncRequest, [&pacer, isCheckingCachedCards, request](
+	                                        bool succeeded, const rapidjson::Value& results) {
+		std::vector<int64_t> dueCardIds;
+		if (!succeeded || !results.IsArray() || results.Size() != 2 || !results[1].IsObject() ||
+		    !getCardIds(results[1]["result"], dueCardIds))
+		{
+			notify(pacer, "Failed to sync Collection. Continuing with the cards already due");
+			return;
+		}
+		if (!results[0].IsObject() || !results[0]["error"].IsNull())
+			notify(pacer, "Failed to sync with AnkiWeb. Using the local collection");
+		else if (isCheckingCachedCards)
+			notify(pacer, "Collection synced");
+		std::cout << "\nResynced: " << dueCardIds.size() << " cards due\n";
+		setDueCards(pacer, request, std::move(dueCardIds));
+		if (isCheckingCachedCards)
+			refetchChangedCards(pacer);
+	});
 }
 
-void printObjectMembers(const rapidjson::Value& objectValue)
+void resync(Pacer& pacer)
 {
-	static const char* kTypeNames[] = {"Null",  "False",  "True",  "Object",
-	                                   "Array", "String", "Number"};
-	for (rapidjson::Value::ConstMemberIterator itr = objectValue.MemberBegin();
-	     itr != objectValue.MemberEnd(); ++itr)
-	{
-		std::cout << itr->name.GetString() << " is " << kTypeNames[itr->value.GetType()] << "\n";
-	}
+	if (!isStudyTime(pacer))
+		return;
+	pacer.scheduler.scheduleIn(resyncIntervalSeconds, "resync", [&pacer]() { resync(pacer); });
+	syncInBackground(pacer, false);
 }
 
-std::string getCardQuizWord(const RapidJsonObject& card)
+void endStudyTime(Pacer& pacer);
+void startStudyTime(Pacer& pacer, uint64_t request, std::vector<int64_t>&& dueCardIds);
+
+// Daemon only. Finds the day's due cards, then starts pacing them
+void startStudyDay(Pacer& pacer)
 {
-	std::string quizWord = "";
-	int fieldOrder = card["fieldOrder"].GetInt();
-	assert(card["fields"].IsObject());
-	const rapidjson::Value& fieldsValue = card["fields"];
-	assert(fieldsValue.IsObject());
-	// Only "A Frequency Dictionary of Japanese Words" has this
-	if (fieldsValue.HasMember("Lemma"))
-	{
-		if (fieldOrder == 1)
-		{
-			// English -> Japanese
-			quizWord = fieldsValue["English Gloss"]["value"].GetString();
-		}
-		else
+	uint64_t request = beginDueCardsRequest(pacer);
+	pacer.pipeline.queue(resyncRequest, [&pacer, request](bool succeeded,
+	                                                      const rapidjson::Value& results) {
+		std::vector<int64_t> dueCardIds;
+		if (!succeeded || !results.IsArray() || results.Size() != 2 || !results[1].IsObject() ||
+		    !getCardIds(results[1]["result"], dueCardIds))
 		{
-			// Japanese -> English
-			quizWord = fieldsValue["Lemma"]["value"].GetString();
+			std::cerr << "Error: could not find today's due cards. Trying again later\n";
+			pacer.scheduler.scheduleIn(refreshIntervalSeconds, "study time starts",
+			                           [&pacer]() { startStudyDay(pacer); });
+			return;
 		}
-	}
-	else if (fieldsValue.HasMember("Front"))
-	{
-		if (fieldOrder == 1)
-			quizWord = fieldsValue["Front"]["value"].GetString();
-		else
-			quizWord = fieldsValue["Back"]["value"].GetString();
-	}
+		// Yesterday's cards which aren't due again, and slots left behind by forgotten cards,
+		// would otherwise pile up day after day. Loads in flight fill cards by index, so only
+		// compact once they're done
+		if (!pacer.pipeline.isBusy())
+			pacer.cardCache.compact(dueCardIds);
+		startStudyTime(pacer, request, std::move(dueCardIds));
+	});
+}
+
+void startStudyTime(Pacer& pacer, uint64_t request, std::vector<int64_t>&& dueCardIds)
+{
+	pacer.studyEndTime = getTimeAtHour(hourStudyTimeEnds, false);
+	pacer.presentedCardIds.clear();
+	pacer.dueCardIds.clear();
+
+	std::ostringstream outStr;
+	if (dueCardIds.empty())
+		outStr << "No more cards! Good work.";
 	else
+		outStr << dueCardIds.size() << " remaining";
+	notify(pacer, outStr.str());
+
+	// As a one-shot, there's nothing more to do
+	if (!isStudyTime(pacer) || (dueCardIds.empty() && !pacer.isDaemon))
 	{
-		std::cerr << "Card has unrecognized fields\n";
+		if (pacer.isDaemon)
+			endStudyTime(pacer);
+		return;
 	}
 
-	return quizWord;
+	setDueCards(pacer, request, std::move(dueCardIds));
+	pacer.scheduler.scheduleIn(resyncIntervalSeconds, "resync", [&pacer]() { resync(pacer); });
+	if (pacer.isDaemon)
+		pacer.scheduler.scheduleIn(refreshIntervalSeconds, "refresh",
+		                           [&pacer]() { refresh(pacer); });
+	pacer.scheduler.schedule(pacer.studyEndTime, "study time over",
+	                         [&pacer]() { endStudyTime(pacer); });
 }
 
-void listDueCardsInfo(const rapidjson::Value& dueCardsInfo)
+void endStudyTime(Pacer& pacer)
 {
-	assert(dueCardsInfo.IsArray());
-
-	for (rapidjson::SizeType i = 0; i < dueCardsInfo.Size(); ++i)
+	cancelNextCard(pacer);
+	saveCardCache(pacer);
+	if (!pacer.dueCardIds.empty())
 	{
-		const RapidJsonObject& currentCard = dueCardsInfo[i].GetObject();
-		int fieldOrder = currentCard["fieldOrder"].GetInt();
-
-		// Get quiz word
-		std::string quizWord = getCardQuizWord(currentCard);
+		std::cout << "Study time over. " << countCardsRemaining(pacer) << " cards remaining.\n";
+		printEventDriftStats(pacer.scheduler.getDriftStats());
+		printNotificationStats(pacer.notifications.getStats());
+	}
+	// The daemon never exits, so each day's trace is saved when that day is over
+	TRACE_SAVE("japanese_for_me.trace.json");
 
-		std::cout << "[" << i << "] " << currentCard["note"].GetInt64() << "\n"
-		          << "\tField order: " << fieldOrder << "\n"
-		          << "\tModel: " << currentCard["modelName"].GetString() << "\n"
-		          << "\tInterval: " << currentCard["interval"].GetInt64() << "\n"
-		          << "\tQuiz word: " << quizWord << "\n"
-		          << "\n\n";
+	if (pacer.isDaemon)
+	{
+		// Nothing else happens until tomorrow, so the scheduler sleeps until then
+		pacer.scheduler.schedule(getTimeAtHour(hourStudyTimeStarts, true), "study time starts",
+		                         [&pacer]() { startStudyDay(pacer); });
 	}
+	else
+		pacer.scheduler.stop();
 }
 
-int main()
+void printUsage()
 {
+	std::cerr << "Usage: japanese_for_me [--daemon]\n"
+	             "Paces today's due Anki cards until study time is over.\n"
+	             "\t--daemon    Keep running: refresh the due cards as they are studied, and start "
+	             "again\n"
+	             "\t            every day\n";
+}
+
+int main(int argc, char** argv)
+{
+	bool isDaemon = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--daemon") == 0)
+			isDaemon = true;
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
 	std::cout << "Japanese For Me\nA vocabulary learning app by Macoy Madson.\n\n";
 
-	// std::chrono::steady_clock::time_point programStartTime = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point programStartTime = std::chrono::steady_clock::now();
 
 	curl_global_init(CURL_GLOBAL_ALL);
-	curl_handle = curl_easy_init();
-
-	NotificationsHandler notifications;
+	ankiConnect = new AnkiConnectClient();
+
+	// Queued: shown on their own thread. Any still waiting get a moment to be shown before exiting
+	NotificationsHandler notifications(true);
+
+	Pacer pacer(notifications);
+	pacer.isDaemon = isDaemon;
+	pacer.startTime = programStartTime;
+	// Pacing only needs the number of due cards, so it can start while their info loads. Loading
+	// keeps going between events
+	AnkiConnectPipeline& pipeline = pacer.pipeline;
+	pacer.scheduler.setBackgroundWork(
+	    [&pipeline]() { return pipeline.isBusy(); },
+	    [&pipeline](int timeoutMilliseconds) { pipeline.update(timeoutMilliseconds); });
+
+	// Cards cached on an earlier day are still worth having, but their due card list isn't
+	std::vector<int64_t> cachedDueCardIds;
+	int64_t cardCacheSavedTime = 0;
+	bool isCardCacheLoaded = loadCardCacheFile(cardCacheFilename, pacer.cardCache,
+	                                           cachedDueCardIds, cardCacheSavedTime);
+	if (isCardCacheLoaded && isToday(cardCacheSavedTime) && !cachedDueCardIds.empty())
+	{
+		// Syncing takes seconds, so pace the cards which were due last time in the meantime
+		std::cout << "Starting from " << cachedDueCardIds.size()
+		          << " cached due cards. Synchronizing Collection in the background\n";
+		startStudyTime(pacer, beginDueCardsRequest(pacer), std::move(cachedDueCardIds));
+		syncInBackground(pacer, true);
+		pacer.scheduler.run();
+
+		delete ankiConnect;
+		curl_global_cleanup();
+		return 0;
+	}
 
-	// Make sure we are working with up-to-date data
-	if (syncAnkiToAnkiWeb())
-		notifications.sendNotification("Collection synced");
+	// Make sure we are working with up-to-date data. AnkiConnect runs batched actions in order, so
+	// the due cards are found after syncing, without another round trip
+	bool syncedWithAnkiWeb = false;
+	bool reachedAnki = false;
+	rapidjson::Document dueCardIds;
+	std::cout << "Synchronizing Collection..." << std::flush;
+	{
+		AnkiConnectBatch batch(*ankiConnect);
+		syncAnkiToAnkiWeb(batch, syncedWithAnkiWeb);
+		getDueCards(batch, dueCardIds);
+		reachedAnki = batch.flush();
+	}
+	std::cout << "done\n";
+	// Failing to reach AnkiWeb (e.g. when offline) isn't fatal; failing to reach Anki is
+	if (reachedAnki)
+		notifications.sendNotification(syncedWithAnkiWeb ? "Collection synced" :
+		                                                   "Failed to sync with AnkiWeb. Using the "
+		                                                   "local collection");
 	else
 	{
 		notifications.sendNotification(
 		    "Failed to sync Collection. Please make sure Anki is running, and AnkiConnect is "
 		    "installed.");
+		delete ankiConnect;
+		curl_global_cleanup();
 		return 1;
 	}
 
 	// listDecks();
 
-	rapidjson::Document dueCardIds;
-	getDueCards(dueCardIds);
-	if (dueCardIds.HasMember("result"))
+	std::vector<int64_t> initialDueCardIds;
+	if (getCardIds(dueCardIds, initialDueCardIds))
 	{
-		rapidjson::Document dueCards;
-		getCardInfo(dueCards, dueCardIds["result"]);
-
-		assert(dueCards.HasMember("result"));
-		const rapidjson::Value& dueCardsArray = dueCards["result"];
-		// listDueCardsInfo(dueCardsArray);
-
-		int numCards = static_cast<int>(dueCardsArray.Size());
-		if (numCards)
-		{
-			std::ostringstream outStr;
-			outStr << numCards << " remaining";
-			notifications.sendNotification(outStr.str().c_str());
-
-			// The time math is gonna be a bit loosey goosey here, but that's fine in our case
-			std::time_t currentTime;
-			std::tm* currentTimeInfo;
-			std::time(&currentTime);
-			currentTimeInfo = std::localtime(&currentTime);
-			// -1 from hours to count for minutes eating into the hour
-			float hoursTimeLeft = (((hourStudyTimeEnds - currentTimeInfo->tm_hour - 1) * 60) +
-			                       (60 - currentTimeInfo->tm_min)) /
-			                      60.f;
-			float secondsTimeLeft = (hoursTimeLeft * 60.f * 60.f);
-
-			if (secondsTimeLeft > 0.f)
-			{
-				std::cout << "Currently "
-				          << (currentTimeInfo->tm_hour > 12 ? currentTimeInfo->tm_hour - 12 :
-				                                              currentTimeInfo->tm_hour)
-				          << ":" << (currentTimeInfo->tm_min < 10 ? "0" : "")
-				          << currentTimeInfo->tm_min << ", " << hoursTimeLeft
-				          << " hours left to study " << numCards << " cards\n\n";
-
-				std::cout << "100% accuracy:\n\t";
-				std::cout << (secondsTimeLeft / numCards) << " seconds per card, "
-				          << std::min(numCards / hoursTimeLeft, static_cast<float>(numCards))
-				          << " cards per hour\n\n";
-
-				std::cout << "80% accuracy:\n\t";
-				std::cout << (secondsTimeLeft / (numCards * estimatedActualCardsMultiplier))
-				          << " seconds per card, "
-				          << std::min((numCards * estimatedActualCardsMultiplier) / hoursTimeLeft,
-				                      static_cast<float>(numCards))
-				          << " cards per hour\n";
-
-				// Use the 80% accuracy prediction to pace cards
-				// TODO: Eventually this needs to update after syncing throughout the day
-				// Probably just sync once around lunchtime, because the sync window pops up and is
-				// annoying. It doesn't have to be to-the-card accurate so long as the user is
-				// studying when they are prompted, and getting reasonable accuracy
-				float timeToNextCard =
-				    std::max(0.1f, secondsTimeLeft / (numCards * estimatedActualCardsMultiplier));
-
-				// Drip feed cards over the maximal time
-				for (int i = 0; i < numCards; ++i)
-				{
-					// Present card
-					const RapidJsonObject& currentCard = dueCardsArray[i].GetObject();
-					std::string quizWord = getCardQuizWord(currentCard);
-					std::cout << "[" << i + 1 << "/" << numCards << "]\n\t" << quizWord << "\n";
-
-					// Trigger a notification to prompt studying
-					// Throttle notifications to not happen too often (this will occur if the
-					// learner is running out of time and has a lot of cards)
-
-					// TODO: Make prompt for saying "Hey, you're in deep shit"
-					// TODO: If study time is almost over and there are stragglers, prompt session
-					// TODO: This is weird to notify in this numCards loop, because these are actual
-					// cards, and we want to notify based on estimated cards (num cards which would
-					// have passed assuming less than 100% accuracy)
-					if (timeToNextCard * numCardsInStudyBlock > reasonableStudyIntervalSeconds &&
-					    i % numCardsInStudyBlock == 0)
-						notifications.sendNotification("Time to study!");
-
-					// Wait to present next card
-					// Don't wait if this is the last card
-					if (i < numCards)
-					{
-						std::chrono::steady_clock::time_point startTime =
-						    std::chrono::steady_clock::now();
-						// This won't be super accurate, but give or take a couple seconds even is
-						// fine in our case. Keep it positive so things don't get too wacky if weird
-						// math is above
-						std::this_thread::sleep_for(
-						    std::chrono::duration<float, std::ratio<1, 1>>(timeToNextCard));
-						std::chrono::steady_clock::time_point endTime =
-						    std::chrono::steady_clock::now();
-
-						std::chrono::duration<float> timeSlept =
-						    std::chrono::duration_cast<std::chrono::duration<float>>(endTime -
-						                                                             startTime);
-						std::cout << "\n\n" << timeSlept.count() << " seconds slept\n";
-					}
-				}
-
-				std::cout << "Study time over. " << numCards << " cards remaining.\n";
-			}
-		}
-		else
-		{
-			notifications.sendNotification("No more cards! Good work.");
-		}
+		startStudyTime(pacer, beginDueCardsRequest(pacer), std::move(initialDueCardIds));
+		if (isCardCacheLoaded)
+			refetchChangedCards(pacer);
+		// Until study time is over (forever, as a daemon)
+		pacer.scheduler.run();
 	}
 
-	curl_easy_cleanup(curl_handle);
+	delete ankiConnect;
 	curl_global_cleanup();
 	return 0;
 }
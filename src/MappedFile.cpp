@@ -0,0 +1,50 @@
+#include "MappedFile.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool mapFile(const char* filename, MappedFile& fileOut)
+{
+	int fileDescriptor = open(filename, O_RDONLY);
+	if (fileDescriptor == -1)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size <= 0)
+	{
+		close(fileDescriptor);
+		return false;
+	}
+
+	size_t size = static_cast<size_t>(fileStat.st_size);
+	void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+	// The mapping stays valid after the descriptor is closed
+	close(fileDescriptor);
+	if (data == MAP_FAILED)
+		return false;
+
+	fileOut.data = static_cast<const char*>(data);
+	fileOut.size = size;
+	return true;
+}
+
+void unmapFile(MappedFile& file)
+{
+	if (file.data)
+		munmap(const_cast<char*>(file.data), file.size);
+	file = MappedFile();
+}
+
+bool isFileEmpty(const char* filename)
+{
+	struct stat fileStat;
+	return stat(filename, &fileStat) == 0 && fileStat.st_size == 0;
+}
+
+bool isSectionInFile(const MappedFile& file, uint64_t offset, uint64_t count,
+                     uint64_t elementSize)
+{
+	return offset <= file.size && count <= (file.size - offset) / elementSize;
+}
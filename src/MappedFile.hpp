@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A whole file mapped read-only. Pages are shared with other processes mapping the same file
+struct MappedFile
+{
+	const char* data = nullptr;
+	size_t size = 0;
+};
+
+// Returns false if the file can't be opened or is empty
+bool mapFile(const char* filename, MappedFile& fileOut);
+void unmapFile(MappedFile& file);
+// True if the file exists but is empty, which mapFile() can't tell apart from failing to open it
+bool isFileEmpty(const char* filename);
+// Whether [offset, offset + count * elementSize) is inside the file. Written so a corrupt offset or
+// count can't overflow and pass
+bool isSectionInFile(const MappedFile& file, uint64_t offset, uint64_t count,
+                     uint64_t elementSize);
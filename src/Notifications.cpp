@@ -0,0 +1,163 @@
+#include "Notifications.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include "Tracing.hpp"
+
+// Show at most one notification this often. Any sent in between are merged into the next one
+static const float minNotificationIntervalSeconds = 5.f;
+// Past this, the oldest waiting notifications are dropped. A notification daemon which is stuck
+// shouldn't make the queue grow forever
+static const size_t maxQueuedNotifications = 16;
+// When the handler is destroyed, waiting notifications (e.g. an error right before exiting) get
+// this long to be shown. Whatever is left after that is dropped
+static const float maxShutdownFlushSeconds = 1.5f;
+
+NotificationsHandler::NotificationsHandler(bool isQueued)
+    : isQueued(isQueued), isShuttingDown(false)
+{
+	if (isQueued)
+		dispatcher = std::thread(&NotificationsHandler::dispatcherThread, this);
+	else
+		initializeBackend();
+}
+
+NotificationsHandler::~NotificationsHandler()
+{
+	if (isQueued)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			isShuttingDown = true;
+			notificationsAvailable.notify_one();
+			notificationsTaken.wait_for(lock, std::chrono::duration<float>(maxShutdownFlushSeconds),
+			                            [this]() { return notifications.empty(); });
+			stats.numDropped += notifications.size();
+			notifications.clear();
+		}
+		notificationsAvailable.notify_one();
+		dispatcher.join();
+	}
+	else
+		shutDownBackend();
+}
+
+void NotificationsHandler::sendNotification(const char* text)
+{
+	if (!isQueued)
+	{
+		Clock::time_point sentTime = Clock::now();
+		TRACE_ZONE("showNotification");
+		showNotification(text);
+		std::lock_guard<std::mutex> lock(mutex);
+		recordShown(sentTime);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		// Already going to be shown (e.g. "Time to study!" while the last one is still waiting)
+		for (const QueuedNotification& notification : notifications)
+		{
+			if (notification.text == text)
+			{
+				++stats.numMerged;
+				return;
+			}
+		}
+		if (notifications.size() >= maxQueuedNotifications)
+		{
+			notifications.pop_front();
+			++stats.numDropped;
+		}
+		QueuedNotification notification;
+		notification.text = text;
+		notification.sentTime = Clock::now();
+		notifications.push_back(std::move(notification));
+		TRACE_COUNTER("notifications waiting", notifications.size());
+	}
+	notificationsAvailable.notify_one();
+}
+
+NotificationStats NotificationsHandler::getStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+// Must hold mutex
+void NotificationsHandler::recordShown(Clock::time_point sentTime)
+{
+	float latencyMilliseconds =
+	    std::chrono::duration<float, std::milli>(Clock::now() - sentTime).count();
+	++stats.numShown;
+	stats.totalLatencyMilliseconds += latencyMilliseconds;
+	stats.maxLatencyMilliseconds = std::max(stats.maxLatencyMilliseconds, latencyMilliseconds);
+}
+
+void NotificationsHandler::dispatcherThread()
+{
+	// The backend is only ever touched from this thread
+	initializeBackend();
+
+	const Clock::duration minNotificationInterval =
+	    std::chrono::duration_cast<Clock::duration>(
+	        std::chrono::duration<float>(minNotificationIntervalSeconds));
+	Clock::time_point nextNotificationTime = Clock::now();
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		notificationsAvailable.wait(lock,
+		                            [this]() { return isShuttingDown || !notifications.empty(); });
+		if (notifications.empty())
+			break;
+		// Rate limited. Anything else sent in the meantime joins this notification. Don't hold up
+		// shutting down though
+		if (!isShuttingDown)
+		{
+			notificationsAvailable.wait_until(lock, nextNotificationTime,
+			                                  [this]() { return isShuttingDown; });
+			// Shutting down may have dropped whatever was waiting
+			if (notifications.empty())
+				break;
+		}
+
+		std::string mergedText;
+		for (const QueuedNotification& notification : notifications)
+		{
+			if (!mergedText.empty())
+				mergedText += '\n';
+			mergedText += notification.text;
+		}
+		// Latency is measured from the oldest, which waited the longest
+		Clock::time_point sentTime = notifications.front().sentTime;
+		stats.numMerged += notifications.size() - 1;
+		notifications.clear();
+		notificationsTaken.notify_one();
+		TRACE_COUNTER("notifications waiting", 0);
+
+		lock.unlock();
+		{
+			TRACE_ZONE("showNotification");
+			showNotification(mergedText.c_str());
+		}
+		lock.lock();
+
+		recordShown(sentTime);
+		nextNotificationTime = Clock::now() + minNotificationInterval;
+	}
+	lock.unlock();
+
+	shutDownBackend();
+}
+
+void printNotificationStats(const NotificationStats& stats)
+{
+	if (!stats.numShown && !stats.numDropped)
+		return;
+	std::cout << "notifications: " << stats.numShown << " shown, " << stats.numMerged
+	          << " merged, " << stats.numDropped << " dropped, "
+	          << (stats.numShown ? stats.totalLatencyMilliseconds / stats.numShown : 0.f)
+	          << " ms average latency (" << stats.maxLatencyMilliseconds << " ms max)\n";
+}
@@ -1,10 +1,73 @@
 #pragma once
 
+#include <stddef.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct NotificationStats
+{
+	// Notifications actually shown. Merged ones count once
+	size_t numShown = 0;
+	// Sent while others were waiting, so shown as part of one notification
+	size_t numMerged = 0;
+	// Thrown away because too many were waiting
+	size_t numDropped = 0;
+	// From sendNotification() until shown
+	float totalLatencyMilliseconds = 0.f;
+	float maxLatencyMilliseconds = 0.f;
+};
+
+// Shows desktop notifications. Showing one can block for a long time (e.g. libnotify talks to the
+// notification daemon over D-Bus), so when queued, sendNotification() only queues the text and
+// returns; a dispatcher thread owns the backend and shows them. Bursts are rate limited: everything
+// sent while waiting is merged into a single notification. Notifications still waiting when the
+// handler is destroyed are shown right away, but only given a moment before being dropped, so a
+// stalled notification daemon can't hold up shutting down for long
 class NotificationsHandler
 {
 public:
-	NotificationsHandler();
+	explicit NotificationsHandler(bool isQueued = false);
 	~NotificationsHandler();
 
+	NotificationsHandler(const NotificationsHandler&) = delete;
+	NotificationsHandler& operator=(const NotificationsHandler&) = delete;
+
 	void sendNotification(const char* text);
+
+	NotificationStats getStats();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct QueuedNotification
+	{
+		std::string text;
+		Clock::time_point sentTime;
+	};
+
+	// Implemented by each backend (Notifications_LibNotify.cpp, Notifications_Stub.cpp). When
+	// queued, only called from the dispatcher thread
+	void initializeBackend();
+	void shutDownBackend();
+	void showNotification(const char* text);
+
+	void dispatcherThread();
+	void recordShown(Clock::time_point sentTime);
+
+	bool isQueued;
+	std::thread dispatcher;
+	std::mutex mutex;
+	std::condition_variable notificationsAvailable;
+	// The dispatcher took everything waiting, e.g. so shutting down can stop waiting for it
+	std::condition_variable notificationsTaken;
+	std::deque<QueuedNotification> notifications;
+	bool isShuttingDown;
+
+	NotificationStats stats;
 };
+
+void printNotificationStats(const NotificationStats& stats);
@@ -2,16 +2,17 @@
 
 #include <libnotify/notify.h>
 
-NotificationsHandler::NotificationsHandler()
+void NotificationsHandler::initializeBackend()
 {
 	notify_init("Japanese for Me");
 }
-NotificationsHandler::~NotificationsHandler()
+
+void NotificationsHandler::shutDownBackend()
 {
 	notify_uninit();
 }
 
-void NotificationsHandler::sendNotification(const char* text)
+void NotificationsHandler::showNotification(const char* text)
 {
 	NotifyNotification* notification =
 	    notify_notification_new("Japanese for Me", text, "dialog-information");
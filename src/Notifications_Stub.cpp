@@ -2,11 +2,17 @@
 
 #include <iostream>
 
-NotificationsHandler::NotificationsHandler(){};
-NotificationsHandler::~NotificationsHandler(){};
+void NotificationsHandler::initializeBackend()
+{
+}
+
+void NotificationsHandler::shutDownBackend()
+{
+}
 
-void NotificationsHandler::sendNotification(const char* text)
+void NotificationsHandler::showNotification(const char* text)
 {
-	std::cout << "Notifications not supported. Check ReadMe for build instructions\n";
-	std::cout << text << "\n";
+	// Shown from the dispatcher thread when queued, so keep out of the main thread's stdout
+	std::cerr << "Notifications not supported. Check ReadMe for build instructions\n";
+	std::cerr << text << "\n";
 }
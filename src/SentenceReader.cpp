@@ -0,0 +1,167 @@
+#include "SentenceReader.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+
+#include "DelimiterScanner.hpp"
+
+// Newlines, plus the middle byte of each full-width terminator in UTF-8:
+// 。 = E3 80 82, ！ = EF BC 81, ？ = EF BC 9F
+// The lead bytes start nearly every kana and common kanji, so scanning for them would stop every
+// few bytes. The middle bytes are much rarer; the bytes around them confirm the terminator
+static const DelimiterSet sentenceDelimiters = makeDelimiterSet("\n\x80\xBC");
+
+const char* findSentenceEnd(const char* begin, const char* end)
+{
+	for (const char* current = findNextDelimiter(sentenceDelimiters, begin, end); current < end;
+	     current = findNextDelimiter(sentenceDelimiters, current + 1, end))
+	{
+		if (*current == '\n')
+			return current + 1;
+		// Text starts on a character boundary, so a middle byte can't be first
+		if (current == begin)
+			continue;
+		unsigned char leadByte = static_cast<unsigned char>(current[-1]);
+		unsigned char middleByte = static_cast<unsigned char>(*current);
+		if (!(leadByte == 0xE3 && middleByte == 0x80) && !(leadByte == 0xEF && middleByte == 0xBC))
+			continue;
+		// A terminator cut off by the end of the range can't be told apart from other characters
+		if (end - current < 2)
+			return nullptr;
+		unsigned char lastByte = static_cast<unsigned char>(current[1]);
+		if ((leadByte == 0xE3 && lastByte == 0x82) ||
+		    (leadByte == 0xEF && (lastByte == 0x81 || lastByte == 0x9F)))
+			return current + 2;
+	}
+	return nullptr;
+}
+
+SentenceReader::SentenceReader(size_t bufferSize)
+    : fileDescriptor(-1),
+      ownsFileDescriptor(false),
+      buffer(new char[bufferSize]),
+      bufferSize(bufferSize),
+      readPosition(0),
+      endPosition(0),
+      reachedEndOfFile(false),
+      readFailed(false)
+{
+}
+
+SentenceReader::~SentenceReader()
+{
+	close();
+	delete[] buffer;
+}
+
+bool SentenceReader::open(const char* filename)
+{
+	close();
+	if (strcmp(filename, "-") == 0)
+		fileDescriptor = STDIN_FILENO;
+	else
+	{
+		fileDescriptor = ::open(filename, O_RDONLY);
+		if (fileDescriptor == -1)
+		{
+			std::cerr << "Error: could not open '" << filename << "'\n";
+			return false;
+		}
+		ownsFileDescriptor = true;
+	}
+	return true;
+}
+
+void SentenceReader::close()
+{
+	if (ownsFileDescriptor)
+		::close(fileDescriptor);
+	fileDescriptor = -1;
+	ownsFileDescriptor = false;
+	readPosition = 0;
+	endPosition = 0;
+	reachedEndOfFile = false;
+	readFailed = false;
+}
+
+bool SentenceReader::refill()
+{
+	memmove(buffer, buffer + readPosition, endPosition - readPosition);
+	endPosition -= readPosition;
+	readPosition = 0;
+
+	while (endPosition < bufferSize)
+	{
+		ssize_t numBytesRead =
+		    read(fileDescriptor, buffer + endPosition, bufferSize - endPosition);
+		if (numBytesRead == 0)
+		{
+			reachedEndOfFile = true;
+			break;
+		}
+		if (numBytesRead < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			readFailed = true;
+			return false;
+		}
+		endPosition += static_cast<size_t>(numBytesRead);
+	}
+	return true;
+}
+
+bool SentenceReader::readSentence(const char*& sentenceOut, size_t& sentenceLengthOut)
+{
+	if (fileDescriptor == -1 || readFailed)
+		return false;
+
+	while (true)
+	{
+		const char* unread = buffer + readPosition;
+		const char* unreadEnd = buffer + endPosition;
+		size_t sentenceLength = 0;
+		const char* sentenceEnd = findSentenceEnd(unread, unreadEnd);
+		if (sentenceEnd)
+			sentenceLength = sentenceEnd - unread;
+		// The last sentence doesn't need a terminator
+		else if (reachedEndOfFile)
+			sentenceLength = unreadEnd - unread;
+		// No terminator in a whole buffer. Split it, leaving out the last character if it's cut off
+		else if (readPosition == 0 && endPosition == bufferSize)
+		{
+			sentenceLength = endPosition;
+			for (size_t i = 1; i <= 4 && i < endPosition; ++i)
+			{
+				unsigned char character = static_cast<unsigned char>(buffer[endPosition - i]);
+				// UTF-8 continuation bytes are 10xxxxxx; anything else starts a character
+				if ((character & 0xC0) == 0x80)
+					continue;
+				size_t characterLength =
+				    character < 0x80 ? 1 : character >= 0xF0 ? 4 : character >= 0xE0 ? 3 : 2;
+				if (characterLength > i)
+					sentenceLength = endPosition - i;
+				break;
+			}
+		}
+
+		if (sentenceLength)
+		{
+			sentenceOut = unread;
+			sentenceLengthOut = sentenceLength;
+			readPosition += sentenceLength;
+			return true;
+		}
+
+		if (reachedEndOfFile || !refill())
+			return false;
+	}
+}
+
+bool SentenceReader::hadReadError() const
+{
+	return readFailed;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+
+// Returns the end of the first sentence in [begin, end), i.e. just past its 。, ！, ？ or newline.
+// Returns nullptr if there is no complete sentence in the range
+const char* findSentenceEnd(const char* begin, const char* end);
+
+// Reads a file one sentence at a time through a fixed-size buffer, so memory use stays the same no
+// matter how large the file is. Sentences are split exactly like findSentenceEnd() would split the
+// whole file, except sentences longer than the buffer, which are split at the last UTF-8 character
+// which fits
+class SentenceReader
+{
+public:
+	explicit SentenceReader(size_t bufferSize = 64 * 1024);
+	~SentenceReader();
+
+	SentenceReader(const SentenceReader&) = delete;
+	SentenceReader& operator=(const SentenceReader&) = delete;
+
+	// "-" reads stdin
+	bool open(const char* filename);
+	void close();
+
+	// The sentence is only valid until the next call. Returns false at the end of the file, or if
+	// reading failed (see hadReadError())
+	bool readSentence(const char*& sentenceOut, size_t& sentenceLengthOut);
+
+	bool hadReadError() const;
+
+private:
+	// Moves unread text to the start of the buffer and fills the rest
+	bool refill();
+
+	int fileDescriptor;
+	bool ownsFileDescriptor;
+	char* buffer;
+	size_t bufferSize;
+	// Unread text is [buffer + readPosition, buffer + endPosition)
+	size_t readPosition;
+	size_t endPosition;
+	bool reachedEndOfFile;
+	bool readFailed;
+};
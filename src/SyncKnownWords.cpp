@@ -0,0 +1,77 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "curl/curl.h"
+
+#include "AnkiKnownWords.hpp"
+#include "KnownWords.hpp"
+#include "Tracing.hpp"
+
+static const char* knownWordsCacheFilename = "data/knownWords.cache";
+
+static void printUsage()
+{
+	std::cerr << "Usage: sync_known_words [--query \"Anki search\"] [--cache file] [--url url]\n"
+	             "Updates the cache of words you know from your Anki notes. Only notes which "
+	             "changed since the\nlast sync are fetched.\n"
+	             "\t--query \"Anki search\"  Which notes to include (default: every note, "
+	             "\"deck:*\")\n"
+	             "\t--cache file           Where to keep the words (default "
+	             "data/knownWords.cache)\n"
+	             "\t--url url              Where AnkiConnect is listening (default "
+	             "http://localhost:8765)\n";
+}
+
+int main(int argc, char** argv)
+{
+	const char* query = "deck:*";
+	const char* cacheFilename = knownWordsCacheFilename;
+	const char* ankiConnectURL = defaultAnkiConnectURL;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--query") == 0 && i + 1 < argc)
+			query = argv[++i];
+		else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+			cacheFilename = argv[++i];
+		else if (strcmp(argv[i], "--url") == 0 && i + 1 < argc)
+			ankiConnectURL = argv[++i];
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	// A missing or outdated cache just means every note is fetched
+	KnownWords knownWords;
+	loadKnownWords(cacheFilename, knownWords);
+
+	curl_global_init(CURL_GLOBAL_ALL);
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	KnownWordsSyncStats stats;
+	AnkiConnectStats requestStats;
+	bool succeeded = false;
+	{
+		AnkiConnectClient ankiConnect(ankiConnectURL);
+		succeeded = syncKnownWordsWithAnki(ankiConnect, query, knownWords, stats);
+		requestStats = ankiConnect.getStats();
+	}
+	std::chrono::duration<float, std::milli> syncTime =
+	    std::chrono::steady_clock::now() - startTime;
+	curl_global_cleanup();
+
+	if (!succeeded)
+	{
+		std::cerr << "Error: failed to sync known words. Please make sure Anki is running, and "
+		             "AnkiConnect is installed.\n";
+		return 1;
+	}
+
+	std::cout << stats.numWords << " known words from " << stats.numNotes << " notes ("
+	          << stats.numNotesFetched << " fetched, " << stats.numNotesRemoved << " removed) in "
+	          << syncTime.count() << " ms\n";
+	printAnkiConnectStats(requestStats);
+	TRACE_SAVE("sync_known_words.trace.json");
+	return saveKnownWordsCache(knownWords, cacheFilename) ? 0 : 1;
+}
@@ -1,283 +1,228 @@
+#include <stdlib.h>
+#include <chrono>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <string>
 #include <vector>
 
 #include <mecab.h>
-#include <phmap.h>
 
-#define CHECK(eval)                                                        \
-	if (!eval)                                                             \
-	{                                                                      \
-		const char* e = tagger ? tagger->what() : MeCab::getTaggerError(); \
-		std::cerr << "Exception:" << e << std::endl;                       \
-		delete tagger;                                                     \
-		return -1;                                                         \
-	}
+#include "AnalysisCacheFile.hpp"
+#include "AnalysisPool.hpp"
+#include "DictionaryLookup.hpp"
+#include "DocumentList.hpp"
+#include "KnownWords.hpp"
+#include "SentenceReader.hpp"
+#include "Tracing.hpp"
 
-// Note that frustratingly, phmap::flat_hash_map does not support const char* as key
-typedef phmap::flat_hash_map<std::string, const char*> DictionaryHashMap;
+static const char* dictionaryFilename = "data/utf8Edict2";
+static const char* dictionaryIndexFilename = "data/utf8Edict2.index";
 
-static DictionaryHashMap dictionary;
-static char* rawDictionary = nullptr;
-static size_t rawDictionarySize = 0;
+static void printUsage()
+{
+	std::cerr << "Usage: test_mecab [--output file] [--threads N] [--stream] [--known file] "
+	             "[--cache file]\n                  [--list fileList] [file or directory]... [-]\n"
+	             "Tokenizes each document and looks up every word in the dictionary, writing one "
+	             "line of JSON per document.\n"
+	             "\t--output file    Write results to file instead of stdout\n"
+	             "\t--threads N      Tokenize on N threads (default: one per core)\n"
+	             "\t--stream         Read and analyze one sentence at a time, one document at a "
+	             "time.\n"
+	             "\t                 Memory use stays the same no matter how large the documents "
+	             "are\n"
+	             "\t--known file     Mark whether each token is a word you know. file is a cache "
+	             "from\n\t                 sync_known_words, or a list of words (one per line)\n"
+	             "\t--cache file     Save every document's tokens to file, and only tokenize "
+	             "documents\n\t                 which aren't already in it (e.g. from the last "
+	             "run). Not with --stream\n"
+	             "\t--list fileList  Analyze every file listed in fileList (one per line)\n"
+	             "\t-                Read documents from stdin, separated by null bytes. With "
+	             "--stream,\n"
+	             "\t                 stdin is a single document\n"
+	             "With no documents, data/Test.org is analyzed.\n";
+}
 
-void finishAddWordToDictionary(const char* word, size_t wordLength, const char* entry)
+int main(int argc, char** argv)
 {
-	// TODO do I need to allocate the key?
-	// TODO Memory leak on newKey (iterate over hash map deleting all keys later)
-	// +1 for null terminator
-	char* newKey = new char[wordLength + 1];
-	std::memcpy(newKey, word, wordLength);
-	newKey[wordLength] = '\0';
-	std::string keyStr(newKey);
-	DictionaryHashMap::iterator checkDupeIt = dictionary.find(keyStr);
-	if (checkDupeIt != dictionary.end())
+	const char* outputFilename = nullptr;
+	bool readFromStdin = false;
+	bool streamDocuments = false;
+	const char* knownWordsFilename = nullptr;
+	const char* cacheFilename = nullptr;
+	unsigned int numThreads = 0;
+	std::vector<std::string> documents;
+	for (int i = 1; i < argc; ++i)
 	{
-		// TODO: Handle
-		// std::cout << "Warning: duplicate key '" << keyStr << "' found\n";
+		if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+			outputFilename = argv[++i];
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			numThreads = static_cast<unsigned int>(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--stream") == 0)
+			streamDocuments = true;
+		else if (strcmp(argv[i], "--known") == 0 && i + 1 < argc)
+			knownWordsFilename = argv[++i];
+		else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+			cacheFilename = argv[++i];
+		else if (strcmp(argv[i], "--list") == 0 && i + 1 < argc)
+		{
+			if (!addDocumentsFromListFile(argv[++i], documents))
+				return 1;
+		}
+		else if (strcmp(argv[i], "-") == 0)
+			readFromStdin = true;
+		else if (argv[i][0] == '-')
+		{
+			printUsage();
+			return 1;
+		}
+		else if (!addDocumentsFromPath(argv[i], documents))
+			return 1;
+	}
+	if (documents.empty() && !readFromStdin)
+		documents.push_back("data/Test.org");
+	if (cacheFilename && streamDocuments)
+	{
+		// Streamed documents are never held whole, so can't be hashed before being tokenized
+		std::cerr << "Error: --cache can't be used with --stream\n";
+		return 1;
 	}
 
-	dictionary[keyStr] = entry;
-
-	// TODO Remove
-	// Test whether the dictionary is working
-	DictionaryHashMap::iterator findIt = dictionary.find(newKey);
-	assert(findIt != dictionary.end());
-}
-
-void loadDictionary()
-{
-	// About how many entries there are (lower bound!)
-	dictionary.reserve(190000);
-	std::cout << "Loading dictionary..." << std::flush;
-	std::ifstream inputFile;
-	// std::ios::ate so tellg returns the size
-	inputFile.open("data/utf8Edict2", std::ios::in | std::ios::binary | std::ios::ate);
-	rawDictionarySize = inputFile.tellg();
-	rawDictionary = new char[rawDictionarySize];
-	inputFile.seekg(0, std::ios::beg);
-	inputFile.read(rawDictionary, rawDictionarySize);
-	inputFile.close();
+	std::ofstream outputFile;
+	if (outputFilename)
+	{
+		outputFile.open(outputFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!outputFile.is_open())
+		{
+			std::cerr << "Error: could not open '" << outputFilename << "' for writing\n";
+			return 1;
+		}
+	}
+	std::ostream& output = outputFilename ? outputFile : std::cout;
 
-	enum class EDict2ReadState
+	KnownWords knownWords;
+	if (knownWordsFilename && !loadKnownWords(knownWordsFilename, knownWords))
 	{
-		VersionNumber = 0,
-		JapaneseWord,
-		Reading,
-		EnglishDefinition,
-		EntryId
-	};
+		std::cerr << "Error: could not load known words '" << knownWordsFilename << "'\n";
+		return 1;
+	}
+	const KnownWords* knownWordsIfAny = knownWordsFilename ? &knownWords : nullptr;
 
-	EDict2ReadState readState = EDict2ReadState::VersionNumber;
-	// Multiple ways to say the same "word"
-	std::vector<const char*> wordsThisEntry;
-	char buffer[1024];
-	char* bufferWriteHead = buffer;
-	const char* beginningOfLine = nullptr;
+	DictionaryLookup dictionary;
+	if (!openDictionaryLookup(dictionaryFilename, dictionaryIndexFilename, dictionary))
+		return 1;
 
-#define FINISH_ADD_WORD()                                                             \
-	if (bufferWriteHead != buffer)                                                    \
-	{                                                                                 \
-		finishAddWordToDictionary(buffer, bufferWriteHead - buffer, beginningOfLine); \
-		bufferWriteHead = buffer;                                                     \
+	MeCab::Model* model = MeCab::createModel("");
+	if (!model)
+	{
+		std::cerr << "Exception:" << MeCab::getLastError() << std::endl;
+		closeDictionaryLookup(dictionary);
+		return 1;
 	}
 
-	for (size_t i = 0; i < rawDictionarySize; ++i)
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	DocumentAnalysisStats stats;
+	size_t numFailedDocuments = 0;
+	unsigned int numThreadsUsed = 0;
+	bool isCacheSaved = true;
+	if (streamDocuments)
 	{
-		if (rawDictionary[i] == '\n')
+		MeCab::Tagger* tagger = model->createTagger();
+		MeCab::Lattice* lattice = model->createLattice();
+		if (!tagger || !lattice)
 		{
-			// If this is hit, an entry has a format this state machine doesn't understand
-			assert(readState == EDict2ReadState::VersionNumber ||
-			       readState == EDict2ReadState::EntryId);
-			// Reset for the start of next word (words are separated by line)
-			beginningOfLine = nullptr;
-			readState = EDict2ReadState::JapaneseWord;
-			continue;
+			std::cerr << "Error: could not create MeCab tagger: " << MeCab::getLastError() << "\n";
+			delete lattice;
+			delete tagger;
+			delete model;
+			closeDictionaryLookup(dictionary);
+			return 1;
 		}
-
-		switch (readState)
+		SentenceReader reader;
+		numThreadsUsed = 1;
+		if (readFromStdin)
+			documents.push_back("-");
+		for (const std::string& documentName : documents)
 		{
-			case EDict2ReadState::VersionNumber:
-				// Ignore the whole first line, because it is a different format to report version
-				// info
-				break;
-			case EDict2ReadState::JapaneseWord:
-				if (!beginningOfLine)
-					beginningOfLine = &rawDictionary[i];
-
-				if (rawDictionary[i] == '/')
-				{
-					FINISH_ADD_WORD();
-					readState = EDict2ReadState::EnglishDefinition;
-				}
-				else if (rawDictionary[i] == '[')
-				{
-					FINISH_ADD_WORD();
-					readState = EDict2ReadState::Reading;
-				}
-				else if (rawDictionary[i] == ';')
-				{
-					// Separate writing of the same word
-					FINISH_ADD_WORD();
-				}
-				else if (rawDictionary[i] == ' ')
-				{
-					// Ignore all spaces
-				}
-				else
-				{
-					*bufferWriteHead = rawDictionary[i];
-					++bufferWriteHead;
-				}
-				break;
-			case EDict2ReadState::Reading:
-				if (rawDictionary[i] == ']')
-				{
-					FINISH_ADD_WORD();
-					readState = EDict2ReadState::JapaneseWord;
-				}
-				else if (rawDictionary[i] == ';')
-				{
-					// Separate reading
-					FINISH_ADD_WORD();
-				}
-				else if (rawDictionary[i] == ' ')
-				{
-					// Ignore all spaces
-				}
-				else
-				{
-					*bufferWriteHead = rawDictionary[i];
-					++bufferWriteHead;
-				}
-				break;
-			case EDict2ReadState::EnglishDefinition:
-				// Gross. Absorb '/' unless it's clearly the entry ID slash
-				if (rawDictionary[i] == '/' && rawDictionary[i + 1] == 'E' &&
-				    rawDictionary[i + 2] == 'n' && rawDictionary[i + 3] == 't' &&
-				    rawDictionary[i + 4] == 'L')
-					readState = EDict2ReadState::EntryId;
-				break;
-			case EDict2ReadState::EntryId:
-				break;
-			default:
-				break;
+			if (!reader.open(documentName.c_str()) ||
+			    !analyzeDocumentStream(*tagger, *lattice, dictionary, knownWordsIfAny,
+			                           documentName == "-" ? "stdin" : documentName.c_str(),
+			                           reader, output, stats))
+				++numFailedDocuments;
+			reader.close();
 		}
+		output.flush();
+		delete lattice;
+		delete tagger;
 	}
-
-#undef FINISH_ADD_WORD
-
-	std::cout << "done.\n" << std::flush;	
-}
-
-// bool getDictionaryResults(const char* query, char* outBuffer, size_t outBufferSize)
-// {
-// 	char* result = strstr(rawDictionary, query);
-// 	if (result)
-// 	{
-// 		// TODO Range check raw Dictionary pointer
-// 		for (size_t i = 0; i < outBufferSize; i++)
-// 		{
-// 			outBuffer[i] = result[i];
-// 			if (result[i] == '\n')
-// 				break;
-// 		}
-// 		return true;
-// 	}
-// 	return false;
-// }
-
-bool getDictionaryResults(const char* query, char* outBuffer, size_t outBufferSize)
-{
-	std::cout << "Find '" << query << "'\n";
-	DictionaryHashMap::iterator findIt = dictionary.find(query);
-	if (findIt == dictionary.end())
-		return false;
-
-	// TODO Range check raw Dictionary pointer
-	for (size_t i = 0; i < outBufferSize; i++)
+	else
 	{
-		outBuffer[i] = findIt->second[i];
-		if (findIt->second[i] == '\n')
-			break;
-	}
-	return true;
-}
-
-void freeDictionary()
-{
-	delete[] rawDictionary;
-}
-
-// Sample of MeCab::Tagger class.
-int main(int argc, char** argv)
-{
-	loadDictionary();
-	std::ifstream inputFile;
-	// std::ios::ate so tellg returns the size
-	inputFile.open("data/Test.org", std::ios::in | std::ios::binary | std::ios::ate);
-	size_t size = inputFile.tellg();
-	char* memblock = new char[size];
-	inputFile.seekg(0, std::ios::beg);
-	inputFile.read(memblock, size);
-	inputFile.close();
-
-	char* input = memblock;
-	// char input[1024] =
-	// "\u592a\u90ce\u306f\u6b21\u90ce\u304c\u6301\u3063\u3066\u3044\u308b\u672c\u3092\u82b1\u5b50"
-	// "\u306b\u6e21\u3057\u305f\u3002";
+		// A missing or outdated cache is fine: every document is analyzed and saved to a new one
+		AnalysisCache cache;
+		AnalysisCacheFileWriter newCache;
+		bool isCacheOpen = false;
+		bool isNewCacheOpen = false;
+		if (cacheFilename)
+		{
+			uint64_t dictionaryVersion = getDictionaryLookupVersion(dictionary);
+			uint64_t modelVersion = getMeCabModelVersion(*model);
+			isCacheOpen = openAnalysisCache(cacheFilename, dictionaryVersion, modelVersion, cache);
+			isNewCacheOpen =
+			    beginAnalysisCacheFile(cacheFilename, dictionaryVersion, modelVersion, newCache);
+		}
 
-	MeCab::Tagger* tagger = MeCab::createTagger("");
-	CHECK(tagger);
+		AnalysisPool analysisPool(*model, dictionary, output, numThreads, knownWordsIfAny,
+		                          isCacheOpen ? &cache : nullptr,
+		                          isNewCacheOpen ? &newCache : nullptr);
+		numThreadsUsed = analysisPool.getNumThreads();
+		for (const std::string& documentName : documents)
+			analysisPool.submitFile(documentName);
 
-	// Gets Node object.
-	const MeCab::Node* node = tagger->parseToNode(input);
-	CHECK(node);
-	for (; node; node = node->next)
-	{
-		if (node->stat == MECAB_BOS_NODE)
-			std::cout << "BOS"
-			          << "\n";
-		else if (node->stat == MECAB_EOS_NODE)
-			std::cout << "EOS"
-			          << "\n";
-		else
+		if (readFromStdin)
 		{
-			char feature[256] = {0};
-			std::memcpy(feature, node->surface,
-			            node->length > sizeof(feature) ? sizeof(feature) : node->length);
-			feature[node->length] = '\0';
-			// for (int i = 0; i < node->length; ++i)
-			// feature[i] = *(node->surface + i);
-
-			// char dictionaryResult[512] = {0};
-			// if (getDictionaryResults(feature, dictionaryResult, sizeof(dictionaryResult)))
-				// std::cout << feature << " " << dictionaryResult << "\n";
-			// else
-				std::cout << feature << "_\n";
+			std::string documentText;
+			for (int documentIndex = 0; std::getline(std::cin, documentText, '\0');
+			     ++documentIndex)
+			{
+				analysisPool.submitText("stdin:" + std::to_string(documentIndex),
+				                        std::move(documentText));
+				documentText.clear();
+			}
 		}
 
-		// std::cout << node->id << ' ';
-		// if (node->stat == MECAB_BOS_NODE)
-		// 	std::cout << "BOS";
-		// else if (node->stat == MECAB_EOS_NODE)
-		// 	std::cout << "EOS";
-		// else
-		// 	std::cout.write(node->surface, node->length);
+		analysisPool.finish();
+		stats = analysisPool.getStats();
+		numFailedDocuments = analysisPool.getNumFailedDocuments();
 
-		std::cout << ' ' << node->feature << ' ' << (int)(node->surface - input) << ' '
-		          << (int)(node->surface - input + node->length) << ' ' << node->rcAttr << ' '
-		          << node->lcAttr << ' ' << node->posid << ' ' << (int)node->char_type << ' '
-		          << (int)node->stat << ' ' << (int)node->isbest << ' ' << node->alpha << ' '
-		          << node->beta << ' ' << node->prob << ' ' << node->cost << std::endl;
+		if (isNewCacheOpen)
+			isCacheSaved = endAnalysisCacheFile(newCache);
+		closeAnalysisCache(cache);
 	}
 
-	delete tagger;
-
-	delete[] memblock;
-
-	freeDictionary();
-
-	return 0;
+	std::chrono::duration<float> analysisTime = std::chrono::steady_clock::now() - startTime;
+	float seconds = analysisTime.count() > 0.f ? analysisTime.count() : 1e-6f;
+	std::cerr << "Analyzed " << stats.numDocuments << " documents on " << numThreadsUsed
+	          << " threads (" << stats.numBytes << " bytes, " << stats.numTokens << " tokens, "
+	          << stats.numDictionaryHits << " found in dictionary (" << stats.numDeinflected
+	          << " by deinflecting), " << stats.numCompounds << " starting compounds) in "
+	          << seconds << " seconds\n"
+	          << "\t" << stats.numDocuments / seconds << " documents/second, "
+	          << (stats.numBytes / (1024.f * 1024.f)) / seconds << " MB/second, "
+	          << stats.numTokens / seconds << " tokens/second\n";
+	if (cacheFilename)
+		std::cerr << "\t" << stats.numCachedDocuments
+		          << " documents were unchanged since they were cached, and "
+		          << stats.numDocuments - stats.numCachedDocuments << " were tokenized\n";
+	if (knownWordsIfAny)
+		std::cerr << "\t" << stats.numKnownTokens << " tokens ("
+		          << (stats.numTokens ? 100.f * stats.numKnownTokens / stats.numTokens : 0.f)
+		          << "%) are words you know\n";
+	if (numFailedDocuments)
+		std::cerr << numFailedDocuments << " documents failed\n";
+
+	delete model;
+	closeDictionaryLookup(dictionary);
+
+	TRACE_SAVE("test_mecab.trace.json");
+	return numFailedDocuments || !isCacheSaved ? 1 : 0;
 }
@@ -0,0 +1,76 @@
+#include "TokenFeatures.hpp"
+
+#include <string.h>
+
+bool getFeatureField(const char* feature, TokenFeature field, const char*& fieldOut,
+                     size_t& fieldLengthOut)
+{
+	if (!feature)
+		return false;
+
+	const char* fieldStart = feature;
+	for (int fieldIndex = 0; fieldIndex < static_cast<int>(field); ++fieldIndex)
+	{
+		fieldStart = strchr(fieldStart, ',');
+		if (!fieldStart)
+			return false;
+		++fieldStart;
+	}
+
+	const char* fieldEnd = strchr(fieldStart, ',');
+	size_t fieldLength =
+	    fieldEnd ? static_cast<size_t>(fieldEnd - fieldStart) : strlen(fieldStart);
+	if (!fieldLength || (fieldLength == 1 && *fieldStart == '*'))
+		return false;
+
+	fieldOut = fieldStart;
+	fieldLengthOut = fieldLength;
+	return true;
+}
+
+bool getTokenFeature(const MeCab::Node& node, TokenFeature feature, const char*& fieldOut,
+                     size_t& fieldLengthOut)
+{
+	return getFeatureField(node.feature, feature, fieldOut, fieldLengthOut);
+}
+
+void getFeatureLemma(const char* feature, const char* surface, size_t surfaceLength,
+                     const char*& lemmaOut, size_t& lemmaLengthOut)
+{
+	if (getFeatureField(feature, TokenFeature::BaseForm, lemmaOut, lemmaLengthOut))
+		return;
+	lemmaOut = surface;
+	lemmaLengthOut = surfaceLength;
+}
+
+void getTokenLemma(const MeCab::Node& node, const char*& lemmaOut, size_t& lemmaLengthOut)
+{
+	getFeatureLemma(node.feature, node.surface, node.length, lemmaOut, lemmaLengthOut);
+}
+
+bool isSymbolToken(const MeCab::Node& node)
+{
+	const char* partOfSpeech = nullptr;
+	size_t partOfSpeechLength = 0;
+	return getTokenFeature(node, TokenFeature::PartOfSpeech, partOfSpeech, partOfSpeechLength) &&
+	       partOfSpeechLength == strlen("記号") &&
+	       memcmp(partOfSpeech, "記号", partOfSpeechLength) == 0;
+}
+
+DictionaryWord getTokenDictionaryWord(const MeCab::Node& node)
+{
+	DictionaryWord word;
+	if (!getTokenFeature(node, TokenFeature::BaseForm, word.baseForm, word.baseFormLength))
+	{
+		word.baseForm = nullptr;
+		word.baseFormLength = 0;
+	}
+	if (!getTokenFeature(node, TokenFeature::Reading, word.reading, word.readingLength))
+	{
+		word.reading = nullptr;
+		word.readingLength = 0;
+	}
+	word.surface = node.surface;
+	word.surfaceLength = node.length;
+	return word;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <mecab.h>
+
+#include "DictionaryLookup.hpp"
+
+// Fields of MeCab's comma-separated feature string, as laid out by IPADIC:
+// 品詞,品詞細分類1,品詞細分類2,品詞細分類3,活用型,活用形,原形,読み,発音
+enum class TokenFeature
+{
+	PartOfSpeech = 0,
+	PartOfSpeechSubclass1,
+	PartOfSpeechSubclass2,
+	PartOfSpeechSubclass3,
+	ConjugationType,
+	ConjugationForm,
+	BaseForm,
+	Reading,
+	Pronunciation
+};
+
+// Returns false if the feature string doesn't have that many fields, or the field is "*" (unknown).
+// The field points into node.feature and is not null-terminated
+bool getTokenFeature(const MeCab::Node& node, TokenFeature feature, const char*& fieldOut,
+                     size_t& fieldLengthOut);
+
+// The dictionary form of the token (e.g. 食べる for 食べ), falling back to the surface form for
+// words MeCab doesn't know. Points into the node; not null-terminated
+void getTokenLemma(const MeCab::Node& node, const char*& lemmaOut, size_t& lemmaLengthOut);
+
+// The same, for a feature string kept after its node is gone (e.g. in DocumentTokens)
+bool getFeatureField(const char* feature, TokenFeature field, const char*& fieldOut,
+                     size_t& fieldLengthOut);
+void getFeatureLemma(const char* feature, const char* surface, size_t surfaceLength,
+                     const char*& lemmaOut, size_t& lemmaLengthOut);
+
+// Symbols, punctuation and whitespace (記号), which aren't vocabulary
+bool isSymbolToken(const MeCab::Node& node);
+
+// The base form, reading and surface form of the token, for findDictionaryLookupWordEntries().
+// Points into the node
+DictionaryWord getTokenDictionaryWord(const MeCab::Node& node);
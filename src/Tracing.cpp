@@ -0,0 +1,131 @@
+#include "Tracing.hpp"
+
+#if defined(JFM_TRACE_ENABLE) && !defined(TRACY_ENABLE)
+
+#include <stdio.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct TraceEvent
+{
+	const char* name;
+	// Microseconds since the first event
+	int64_t timestamp;
+	// Zones only
+	int64_t duration;
+	// Counters only
+	int64_t value;
+	bool isCounter;
+};
+
+// Each thread records into its own buffer, so threads never wait on each other. The lock is only
+// ever contended while saving
+struct ThreadTraceBuffer
+{
+	std::mutex mutex;
+	std::vector<TraceEvent> events;
+	unsigned int threadId;
+};
+
+static std::mutex threadBuffersMutex;
+// Kept after their threads exit, so their events are still saved
+static std::vector<std::unique_ptr<ThreadTraceBuffer>> threadBuffers;
+static const std::chrono::steady_clock::time_point traceStartTime =
+    std::chrono::steady_clock::now();
+
+static ThreadTraceBuffer& getThreadBuffer()
+{
+	static thread_local ThreadTraceBuffer* threadBuffer = nullptr;
+	if (!threadBuffer)
+	{
+		std::lock_guard<std::mutex> lock(threadBuffersMutex);
+		threadBuffers.push_back(std::unique_ptr<ThreadTraceBuffer>(new ThreadTraceBuffer()));
+		threadBuffer = threadBuffers.back().get();
+		threadBuffer->threadId = static_cast<unsigned int>(threadBuffers.size());
+	}
+	return *threadBuffer;
+}
+
+static int64_t toTraceTime(std::chrono::steady_clock::duration duration)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+void recordTraceZone(const char* name, std::chrono::steady_clock::time_point startTime,
+                     std::chrono::steady_clock::time_point endTime)
+{
+	TraceEvent event;
+	event.name = name;
+	event.timestamp = toTraceTime(startTime - traceStartTime);
+	event.duration = toTraceTime(endTime - startTime);
+	event.value = 0;
+	event.isCounter = false;
+	ThreadTraceBuffer& buffer = getThreadBuffer();
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+	buffer.events.push_back(event);
+}
+
+void recordTraceCounter(const char* name, int64_t value)
+{
+	TraceEvent event;
+	event.name = name;
+	event.timestamp = toTraceTime(std::chrono::steady_clock::now() - traceStartTime);
+	event.duration = 0;
+	event.value = value;
+	event.isCounter = true;
+	ThreadTraceBuffer& buffer = getThreadBuffer();
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+	buffer.events.push_back(event);
+}
+
+// Chrome's Trace Event Format, "X" (complete) events for zones and "C" events for counters. Names
+// are string literals, so they aren't escaped
+bool saveTrace(const char* filename)
+{
+	FILE* outputFile = fopen(filename, "w");
+	if (!outputFile)
+	{
+		std::cerr << "Error: could not open '" << filename << "' for writing\n";
+		return false;
+	}
+
+	fputs("{\"traceEvents\": [\n", outputFile);
+	bool isFirstEvent = true;
+	std::lock_guard<std::mutex> buffersLock(threadBuffersMutex);
+	for (std::unique_ptr<ThreadTraceBuffer>& buffer : threadBuffers)
+	{
+		std::lock_guard<std::mutex> lock(buffer->mutex);
+		for (const TraceEvent& event : buffer->events)
+		{
+			if (!isFirstEvent)
+				fputs(",\n", outputFile);
+			isFirstEvent = false;
+			if (event.isCounter)
+				fprintf(outputFile,
+				        "{\"name\": \"%s\", \"ph\": \"C\", \"ts\": %lld, \"pid\": 1, \"tid\": %u, "
+				        "\"args\": {\"value\": %lld}}",
+				        event.name, static_cast<long long>(event.timestamp), buffer->threadId,
+				        static_cast<long long>(event.value));
+			else
+				fprintf(outputFile,
+				        "{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %lld, \"dur\": %lld, "
+				        "\"pid\": 1, \"tid\": %u}",
+				        event.name, static_cast<long long>(event.timestamp),
+				        static_cast<long long>(event.duration), buffer->threadId);
+		}
+		buffer->events.clear();
+	}
+	fputs("\n]}\n", outputFile);
+
+	bool succeeded = !ferror(outputFile);
+	if (fclose(outputFile) != 0 || !succeeded)
+	{
+		std::cerr << "Error: failed while writing '" << filename << "'\n";
+		return false;
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+
+// Scoped zones and counters for profiling. Compiled out entirely unless one of these is defined:
+//   JFM_TRACE_ENABLE  Zones and counters are recorded in memory and saveTrace() writes them as a
+//                     Chrome trace (open in chrome://tracing or https://ui.perfetto.dev)
+//   TRACY_ENABLE      Zones and counters go to Tracy (Dependencies/tracy) instead
+// Build with jam -sTRACE_BUILD=true or -sTRACY_BUILD=true respectively (see Jamrules).
+//
+// TRACE_ZONE("name") times from where it is declared until the end of the scope. name must be a
+// string literal (or otherwise outlive the trace). TRACE_COUNTER("name", value) records a value,
+// which shows up as a graph over time.
+
+#if defined(TRACY_ENABLE)
+
+#include "Tracy.hpp"
+
+#define TRACE_ZONE(name) ZoneScopedN(name)
+#define TRACE_COUNTER(name, value) TracyPlot(name, static_cast<int64_t>(value))
+// Tracy streams everything to its profiler as it happens
+#define TRACE_SAVE(filename)
+
+#elif defined(JFM_TRACE_ENABLE)
+
+#include <stdint.h>
+#include <chrono>
+
+#define TRACE_CONCATENATE_(a, b) a##b
+#define TRACE_CONCATENATE(a, b) TRACE_CONCATENATE_(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCATENATE(traceZone, __LINE__)(name)
+#define TRACE_COUNTER(name, value) recordTraceCounter(name, static_cast<int64_t>(value))
+#define TRACE_SAVE(filename) saveTrace(filename)
+
+void recordTraceZone(const char* name, std::chrono::steady_clock::time_point startTime,
+                     std::chrono::steady_clock::time_point endTime);
+void recordTraceCounter(const char* name, int64_t value);
+
+// Writes every zone and counter recorded so far, on every thread, then forgets them. Returns false
+// if the file couldn't be written
+bool saveTrace(const char* filename);
+
+class TraceZone
+{
+public:
+	explicit TraceZone(const char* name) : name(name), startTime(std::chrono::steady_clock::now())
+	{
+	}
+	~TraceZone()
+	{
+		recordTraceZone(name, startTime, std::chrono::steady_clock::now());
+	}
+
+	TraceZone(const TraceZone&) = delete;
+	TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+	const char* name;
+	std::chrono::steady_clock::time_point startTime;
+};
+
+#else
+
+#define TRACE_ZONE(name)
+#define TRACE_COUNTER(name, value)
+#define TRACE_SAVE(filename)
+
+#endif
@@ -0,0 +1,242 @@
+#include "VocabularyAnalysis.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+#include "MappedFile.hpp"
+#include "SentenceReader.hpp"
+#include "TokenFeatures.hpp"
+#include "Tracing.hpp"
+
+// Counts while tokenizing. Each thread has its own, so counting never waits on a lock
+struct ThreadLemmaCount
+{
+	uint64_t numOccurrences = 0;
+	uint32_t numDocuments = 0;
+	// The document this lemma was last seen in, and where it is in that document's lemmas
+	uint32_t lastDocument = UINT32_MAX;
+	uint32_t documentLemmaIndex = 0;
+	// Which submap of the merged LemmaCountMap this lemma goes in
+	uint32_t submapIndex = 0;
+};
+
+typedef phmap::flat_hash_map<DictionaryKey, ThreadLemmaCount, DictionaryKeyHash,
+                             DictionaryKeyEqual>
+    ThreadLemmaCountMap;
+
+static bool countDocumentVocabulary(const MeCab::Tagger& tagger, MeCab::Lattice& lattice,
+                                    const LemmaCountMap& mergedLemmas, const char* text,
+                                    size_t textLength, uint32_t documentIndex,
+                                    ThreadLemmaCountMap& lemmaCounts, Arena& lemmaArena,
+                                    DocumentVocabulary& documentOut)
+{
+	TRACE_ZONE("countDocumentVocabulary");
+	const char* textEnd = text + textLength;
+	for (const char* sentence = text; sentence < textEnd;)
+	{
+		const char* sentenceEnd = findSentenceEnd(sentence, textEnd);
+		if (!sentenceEnd)
+			sentenceEnd = textEnd;
+		lattice.set_sentence(sentence, sentenceEnd - sentence);
+		bool isParsed = false;
+		{
+			TRACE_ZONE("MeCab parse");
+			isParsed = tagger.parse(&lattice);
+		}
+		if (!isParsed)
+		{
+			std::cerr << "Error: failed to tokenize '" << documentOut.name << "': "
+			          << lattice.what() << "\n";
+			return false;
+		}
+		sentence = sentenceEnd;
+
+		for (const MeCab::Node* node = lattice.bos_node(); node; node = node->next)
+		{
+			if (node->stat == MECAB_BOS_NODE || node->stat == MECAB_EOS_NODE ||
+			    isSymbolToken(*node))
+				continue;
+
+			const char* lemma = nullptr;
+			size_t lemmaLength = 0;
+			getTokenLemma(*node, lemma, lemmaLength);
+			DictionaryKey lemmaKey = {lemma, static_cast<uint32_t>(lemmaLength)};
+			ThreadLemmaCountMap::iterator lemmaCount = lemmaCounts.find(lemmaKey);
+			if (lemmaCount == lemmaCounts.end())
+			{
+				// Only new lemmas are copied; the token's own text goes away with the lattice
+				lemmaKey.data = lemmaArena.copy(lemma, lemmaLength);
+				lemmaCount = lemmaCounts.emplace(lemmaKey, ThreadLemmaCount()).first;
+				lemmaCount->second.submapIndex =
+				    static_cast<uint32_t>(mergedLemmas.subidx(mergedLemmas.hash(lemmaKey)));
+			}
+
+			ThreadLemmaCount& count = lemmaCount->second;
+			++count.numOccurrences;
+			if (count.lastDocument != documentIndex)
+			{
+				count.lastDocument = documentIndex;
+				count.documentLemmaIndex = static_cast<uint32_t>(documentOut.lemmas.size());
+				++count.numDocuments;
+				documentOut.lemmas.push_back({lemmaCount->first, 0});
+			}
+			++documentOut.lemmas[count.documentLemmaIndex].numOccurrences;
+			++documentOut.numTokens;
+		}
+	}
+	return true;
+}
+
+static void countVocabularyThread(const MeCab::Model& model, const LemmaCountMap& mergedLemmas,
+                                  const std::vector<std::string>& documentNames,
+                                  std::atomic<size_t>& nextDocument,
+                                  ThreadLemmaCountMap& lemmaCountsOut, Arena& lemmaArena,
+                                  std::vector<DocumentVocabulary>& documentsOut)
+{
+	MeCab::Tagger* tagger = model.createTagger();
+	MeCab::Lattice* lattice = model.createLattice();
+	for (size_t documentIndex = nextDocument++; documentIndex < documentNames.size();
+	     documentIndex = nextDocument++)
+	{
+		DocumentVocabulary& document = documentsOut[documentIndex];
+		document.name = documentNames[documentIndex];
+		MappedFile file;
+		if (!mapFile(document.name.c_str(), file))
+		{
+			// Empty files can't be mapped, but are valid documents with no tokens
+			if (isFileEmpty(document.name.c_str()))
+				document.succeeded = true;
+			else
+				std::cerr << "Error: could not open '" << document.name << "'\n";
+			continue;
+		}
+		document.succeeded =
+		    tagger && lattice &&
+		    countDocumentVocabulary(*tagger, *lattice, mergedLemmas, file.data, file.size,
+		                            static_cast<uint32_t>(documentIndex), lemmaCountsOut,
+		                            lemmaArena, document);
+		unmapFile(file);
+	}
+	delete lattice;
+	delete tagger;
+}
+
+// Each merging thread owns the submaps where submapIndex % numThreads == threadIndex, so no locks
+// are needed
+static void mergeLemmaCounts(LemmaCountMap& lemmas,
+                             const std::vector<ThreadLemmaCountMap>& threadLemmaCounts,
+                             unsigned int threadIndex, unsigned int numThreads)
+{
+	for (const ThreadLemmaCountMap& lemmaCounts : threadLemmaCounts)
+	{
+		for (const ThreadLemmaCountMap::value_type& threadCount : lemmaCounts)
+		{
+			if (threadCount.second.submapIndex % numThreads != threadIndex)
+				continue;
+			LemmaCount& count = lemmas[threadCount.first];
+			count.numOccurrences += threadCount.second.numOccurrences;
+			count.numDocuments += threadCount.second.numDocuments;
+		}
+	}
+}
+
+static bool isMoreFrequent(const LemmaCountMap::value_type* a, const LemmaCountMap::value_type* b)
+{
+	if (a->second.numOccurrences != b->second.numOccurrences)
+		return a->second.numOccurrences > b->second.numOccurrences;
+	int order =
+	    std::memcmp(a->first.data, b->first.data, std::min(a->first.length, b->first.length));
+	return order ? order < 0 : a->first.length < b->first.length;
+}
+
+bool countVocabulary(const MeCab::Model& model, const std::vector<std::string>& documentNames,
+                     unsigned int numThreads, Vocabulary& vocabularyOut)
+{
+	if (!numThreads)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	numThreads = std::min(numThreads,
+	                      std::max(1u, static_cast<unsigned int>(documentNames.size())));
+
+	vocabularyOut.documents.resize(documentNames.size());
+	std::vector<ThreadLemmaCountMap> threadLemmaCounts(numThreads);
+	for (unsigned int i = 0; i < numThreads; ++i)
+		vocabularyOut.lemmaArenas.push_back(std::unique_ptr<Arena>(new Arena()));
+
+	// Documents are handed out one at a time, so a few huge ones don't leave threads idle
+	std::atomic<size_t> nextDocument(0);
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < numThreads; ++i)
+		threads.push_back(std::thread(countVocabularyThread, std::cref(model),
+		                              std::cref(vocabularyOut.lemmas), std::cref(documentNames),
+		                              std::ref(nextDocument), std::ref(threadLemmaCounts[i]),
+		                              std::ref(*vocabularyOut.lemmaArenas[i]),
+		                              std::ref(vocabularyOut.documents)));
+	countVocabularyThread(model, vocabularyOut.lemmas, documentNames, nextDocument,
+	                      threadLemmaCounts[0], *vocabularyOut.lemmaArenas[0],
+	                      vocabularyOut.documents);
+	for (std::thread& thread : threads)
+		thread.join();
+	threads.clear();
+
+	for (unsigned int i = 1; i < numThreads; ++i)
+		threads.push_back(std::thread(mergeLemmaCounts, std::ref(vocabularyOut.lemmas),
+		                              std::cref(threadLemmaCounts), i, numThreads));
+	mergeLemmaCounts(vocabularyOut.lemmas, threadLemmaCounts, 0, numThreads);
+	for (std::thread& thread : threads)
+		thread.join();
+
+	for (const DocumentVocabulary& document : vocabularyOut.documents)
+	{
+		vocabularyOut.numTokens += document.numTokens;
+		if (!document.succeeded)
+			++vocabularyOut.numFailedDocuments;
+	}
+
+	vocabularyOut.lemmasByRank.reserve(vocabularyOut.lemmas.size());
+	for (LemmaCountMap::value_type& lemma : vocabularyOut.lemmas)
+		vocabularyOut.lemmasByRank.push_back(&lemma);
+	std::sort(vocabularyOut.lemmasByRank.begin(), vocabularyOut.lemmasByRank.end(),
+	          isMoreFrequent);
+	for (size_t i = 0; i < vocabularyOut.lemmasByRank.size(); ++i)
+		vocabularyOut.lemmasByRank[i]->second.rank = static_cast<uint32_t>(i + 1);
+
+	return vocabularyOut.numFailedDocuments == 0;
+}
+
+float getCorpusCoverage(const Vocabulary& vocabulary, size_t numLemmas)
+{
+	if (!vocabulary.numTokens)
+		return 0.f;
+	uint64_t numTokensCovered = 0;
+	numLemmas = std::min(numLemmas, vocabulary.lemmasByRank.size());
+	for (size_t i = 0; i < numLemmas; ++i)
+		numTokensCovered += vocabulary.lemmasByRank[i]->second.numOccurrences;
+	return static_cast<float>(numTokensCovered) / vocabulary.numTokens;
+}
+
+uint32_t getRankNeededForCoverage(const Vocabulary& vocabulary,
+                                  const DocumentVocabulary& document, float coverage)
+{
+	std::vector<std::pair<uint32_t, uint32_t>> ranksAndOccurrences;
+	ranksAndOccurrences.reserve(document.lemmas.size());
+	for (const DocumentLemma& lemma : document.lemmas)
+		ranksAndOccurrences.push_back(std::make_pair(
+		    vocabulary.lemmas.find(lemma.lemma)->second.rank, lemma.numOccurrences));
+	std::sort(ranksAndOccurrences.begin(), ranksAndOccurrences.end());
+
+	const uint64_t numTokensNeeded = static_cast<uint64_t>(coverage * document.numTokens + 0.5f);
+	uint64_t numTokensCovered = 0;
+	for (const std::pair<uint32_t, uint32_t>& rankAndOccurrences : ranksAndOccurrences)
+	{
+		if (numTokensCovered >= numTokensNeeded)
+			break;
+		numTokensCovered += rankAndOccurrences.second;
+		if (numTokensCovered >= numTokensNeeded)
+			return rankAndOccurrences.first;
+	}
+	return 0;
+}
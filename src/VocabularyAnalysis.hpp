@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <mecab.h>
+#include <phmap.h>
+
+#include "Arena.hpp"
+#include "Dictionary.hpp"
+
+struct LemmaCount
+{
+	uint64_t numOccurrences = 0;
+	uint32_t numDocuments = 0;
+	// 1 is the most frequent lemma in the corpus
+	uint32_t rank = 0;
+};
+
+// Keys point into Vocabulary::lemmaArenas
+typedef phmap::parallel_flat_hash_map<DictionaryKey, LemmaCount, DictionaryKeyHash,
+                                      DictionaryKeyEqual>
+    LemmaCountMap;
+
+struct DocumentLemma
+{
+	DictionaryKey lemma;
+	uint32_t numOccurrences;
+};
+
+struct DocumentVocabulary
+{
+	std::string name;
+	bool succeeded = false;
+	uint64_t numTokens = 0;
+	// In order of first appearance
+	std::vector<DocumentLemma> lemmas;
+};
+
+// Lemma frequencies across a corpus. Symbols and punctuation aren't counted as tokens
+struct Vocabulary
+{
+	LemmaCountMap lemmas;
+	// Most frequent first. Ties are broken by byte order so the ranking is deterministic
+	std::vector<LemmaCountMap::value_type*> lemmasByRank;
+	// In the order they were given
+	std::vector<DocumentVocabulary> documents;
+	uint64_t numTokens = 0;
+	size_t numFailedDocuments = 0;
+	// One per counting thread
+	std::vector<std::unique_ptr<Arena>> lemmaArenas;
+};
+
+// Tokenizes every document on numThreads threads (0 = one per core), each counting into its own
+// map, then merges the counts. Documents are tokenized a sentence at a time, like analyzeDocument()
+bool countVocabulary(const MeCab::Model& model, const std::vector<std::string>& documentNames,
+                     unsigned int numThreads, Vocabulary& vocabularyOut);
+
+// The fraction of all tokens in the corpus which are one of the numLemmas most frequent lemmas
+float getCorpusCoverage(const Vocabulary& vocabulary, size_t numLemmas);
+
+// How far down the corpus frequency list a reader needs to know to recognize coverage (0-1) of the
+// document's tokens. A rough measure of how difficult the document is compared to the rest
+uint32_t getRankNeededForCoverage(const Vocabulary& vocabulary,
+                                  const DocumentVocabulary& document, float coverage);
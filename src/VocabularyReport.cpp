@@ -0,0 +1,243 @@
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <mecab.h>
+#include <phmap.h>
+
+#include "DictionaryLookup.hpp"
+#include "DocumentList.hpp"
+#include "KnownWords.hpp"
+#include "Tracing.hpp"
+#include "VocabularyAnalysis.hpp"
+
+static const char* dictionaryFilename = "data/utf8Edict2";
+static const char* dictionaryIndexFilename = "data/utf8Edict2.index";
+
+static const char* knownWordsCacheFilename = "data/knownWords.cache";
+
+static void printUsage()
+{
+	std::cerr << "Usage: vocabulary_report [--threads N] [--top N] [--known file] "
+	             "[--list fileList] [file or directory]...\n"
+	             "Counts how often each word (by dictionary form) appears across the documents, "
+	             "then reports\nhow much of the text the most frequent words cover, the most "
+	             "frequent words you don't know,\nand how difficult each document is.\n"
+	             "\t--threads N      Tokenize on N threads (default: one per core)\n"
+	             "\t--top N          How many unknown words to list (default 50)\n"
+	             "\t--known file     Words you already know, one per line, or a cache from "
+	             "sync_known_words\n\t                 (default: data/knownWords.cache, if "
+	             "present)\n"
+	             "\t--list fileList  Analyze every file listed in fileList (one per line)\n";
+}
+
+static void printCoverage(const Vocabulary& vocabulary, const KnownWordSet* knownWords)
+{
+	std::cout << "Coverage of the text by the most frequent words:\n";
+	const size_t numLemmasSteps[] = {100, 250, 500, 1000, 2000, 5000, 10000, 20000, 50000};
+	for (size_t numLemmas : numLemmasSteps)
+	{
+		if (numLemmas >= vocabulary.lemmasByRank.size())
+			break;
+		std::cout << "\t" << std::setw(6) << numLemmas << " words: " << std::fixed
+		          << std::setprecision(1) << getCorpusCoverage(vocabulary, numLemmas) * 100.f
+		          << "%\n";
+	}
+	std::cout << "\t" << std::setw(6) << vocabulary.lemmasByRank.size() << " words: 100.0%\n";
+
+	if (!knownWords)
+		return;
+	size_t numKnownLemmas = 0;
+	uint64_t numKnownTokens = 0;
+	for (const LemmaCountMap::value_type* lemma : vocabulary.lemmasByRank)
+	{
+		if (knownWords->count(lemma->first))
+		{
+			++numKnownLemmas;
+			numKnownTokens += lemma->second.numOccurrences;
+		}
+	}
+	std::cout << "You know " << numKnownLemmas << " of " << vocabulary.lemmasByRank.size()
+	          << " words, covering " << std::fixed << std::setprecision(1)
+	          << (vocabulary.numTokens ? 100.f * numKnownTokens / vocabulary.numTokens : 0.f)
+	          << "% of the text\n";
+}
+
+static void printTopUnknownWords(const Vocabulary& vocabulary, const DictionaryLookup& dictionary,
+                                 const KnownWordSet* knownWords, size_t numWordsToList)
+{
+	std::cout << "\nMost frequent " << (knownWords ? "unknown " : "") << "words:\n"
+	          << "\t  rank  count  documents  word\n";
+	size_t numListed = 0;
+	for (const LemmaCountMap::value_type* lemma : vocabulary.lemmasByRank)
+	{
+		if (numListed >= numWordsToList)
+			break;
+		if (knownWords && knownWords->count(lemma->first))
+			continue;
+		++numListed;
+
+		std::cout << "\t" << std::setw(6) << lemma->second.rank << " " << std::setw(6)
+		          << lemma->second.numOccurrences << " " << std::setw(10)
+		          << lemma->second.numDocuments << "  ";
+		std::cout.write(lemma->first.data, lemma->first.length);
+		// Lemmas are dictionary forms, so prefer entries written that way over ones read that way
+		DictionaryWord word;
+		word.baseForm = lemma->first.data;
+		word.baseFormLength = lemma->first.length;
+		word.reading = nullptr;
+		word.readingLength = 0;
+		word.surface = lemma->first.data;
+		word.surfaceLength = lemma->first.length;
+		DictionaryEntryView entry;
+		if (findDictionaryLookupWordEntries(dictionary, word, &entry, 1))
+		{
+			std::cout << "\n\t\t\t\t   ";
+			std::cout.write(entry.data, entry.length);
+		}
+		else
+			std::cout << " (not in dictionary)";
+		std::cout << "\n";
+	}
+}
+
+struct DocumentDifficulty
+{
+	const DocumentVocabulary* document;
+	float knownCoverage;
+	uint32_t rankNeeded;
+};
+
+static bool isEasier(const DocumentDifficulty& a, const DocumentDifficulty& b)
+{
+	if (a.knownCoverage != b.knownCoverage)
+		return a.knownCoverage > b.knownCoverage;
+	return a.rankNeeded < b.rankNeeded;
+}
+
+static void printDocumentDifficulty(const Vocabulary& vocabulary, const KnownWordSet* knownWords)
+{
+	const float coverageNeeded = 0.95f;
+	std::vector<DocumentDifficulty> difficulties;
+	for (const DocumentVocabulary& document : vocabulary.documents)
+	{
+		if (!document.succeeded || !document.numTokens)
+			continue;
+		DocumentDifficulty difficulty;
+		difficulty.document = &document;
+		difficulty.rankNeeded = getRankNeededForCoverage(vocabulary, document, coverageNeeded);
+		difficulty.knownCoverage = 0.f;
+		if (knownWords)
+		{
+			uint64_t numKnownTokens = 0;
+			for (const DocumentLemma& lemma : document.lemmas)
+			{
+				if (knownWords->count(lemma.lemma))
+					numKnownTokens += lemma.numOccurrences;
+			}
+			difficulty.knownCoverage = static_cast<float>(numKnownTokens) / document.numTokens;
+		}
+		difficulties.push_back(difficulty);
+	}
+	std::stable_sort(difficulties.begin(), difficulties.end(), isEasier);
+
+	// "Words needed" is how many of the corpus' most frequent words cover 95% of the document
+	std::cout << "\nDocuments, easiest first:\n\t" << (knownWords ? " known  " : "")
+	          << "words needed  tokens  document\n";
+	for (const DocumentDifficulty& difficulty : difficulties)
+	{
+		std::cout << "\t";
+		if (knownWords)
+			std::cout << std::setw(5) << std::fixed << std::setprecision(1)
+			          << difficulty.knownCoverage * 100.f << "%  ";
+		std::cout << std::setw(12) << difficulty.rankNeeded << "  " << std::setw(6)
+		          << difficulty.document->numTokens << "  " << difficulty.document->name << "\n";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int numThreads = 0;
+	size_t numWordsToList = 50;
+	const char* knownWordsFilename = nullptr;
+	std::vector<std::string> documents;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			numThreads = static_cast<unsigned int>(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc)
+			numWordsToList = static_cast<size_t>(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--known") == 0 && i + 1 < argc)
+			knownWordsFilename = argv[++i];
+		else if (strcmp(argv[i], "--list") == 0 && i + 1 < argc)
+		{
+			if (!addDocumentsFromListFile(argv[++i], documents))
+				return 1;
+		}
+		else if (argv[i][0] == '-')
+		{
+			printUsage();
+			return 1;
+		}
+		else if (!addDocumentsFromPath(argv[i], documents))
+			return 1;
+	}
+	if (documents.empty())
+	{
+		printUsage();
+		return 1;
+	}
+
+	// Without --known, fall back to the words synced from Anki, if they have been
+	KnownWords knownWords;
+	bool haveKnownWords = false;
+	if (knownWordsFilename)
+	{
+		haveKnownWords = loadKnownWords(knownWordsFilename, knownWords);
+		if (!haveKnownWords)
+		{
+			std::cerr << "Error: could not load known words '" << knownWordsFilename << "'\n";
+			return 1;
+		}
+	}
+	else
+		haveKnownWords = loadKnownWords(knownWordsCacheFilename, knownWords);
+
+	DictionaryLookup dictionary;
+	if (!openDictionaryLookup(dictionaryFilename, dictionaryIndexFilename, dictionary))
+		return 1;
+
+	MeCab::Model* model = MeCab::createModel("");
+	if (!model)
+	{
+		std::cerr << "Exception:" << MeCab::getLastError() << std::endl;
+		closeDictionaryLookup(dictionary);
+		return 1;
+	}
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	Vocabulary vocabulary;
+	countVocabulary(*model, documents, numThreads, vocabulary);
+	std::chrono::duration<float> countTime = std::chrono::steady_clock::now() - startTime;
+	float seconds = countTime.count() > 0.f ? countTime.count() : 1e-6f;
+	std::cerr << "Counted " << vocabulary.numTokens << " tokens (" << vocabulary.lemmas.size()
+	          << " different words) in " << vocabulary.documents.size() << " documents in "
+	          << seconds << " seconds (" << vocabulary.numTokens / seconds << " tokens/second)\n";
+	if (vocabulary.numFailedDocuments)
+		std::cerr << vocabulary.numFailedDocuments << " documents failed\n";
+
+	const KnownWordSet* knownWordsIfAny = haveKnownWords ? &knownWords.words : nullptr;
+	printCoverage(vocabulary, knownWordsIfAny);
+	printTopUnknownWords(vocabulary, dictionary, knownWordsIfAny, numWordsToList);
+	printDocumentDifficulty(vocabulary, knownWordsIfAny);
+
+	delete model;
+	closeDictionaryLookup(dictionary);
+	TRACE_SAVE("vocabulary_report.trace.json");
+	return vocabulary.numFailedDocuments ? 1 : 0;
+}